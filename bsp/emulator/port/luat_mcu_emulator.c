@@ -0,0 +1,7 @@
+#include "luat_base.h"
+#include "luat_mcu.h"
+#include "windows.h"
+
+uint64_t luat_mcu_tick64_ms(void) {
+    return GetTickCount64();
+}
@@ -11,19 +11,32 @@
 
 #define LUAT_RET int
 #define LUAT_RT_RET_TYPE	void
-#define LUAT_RT_CB_PARAM void *param
+#define LUAT_RT_CB_PARAM void *data, void *param
 #define LUAT_RTOS_API_NOTOK 1
 // Linux 下默认64bit得了, 32bit的编译器太难找
 #define LUAT_CONF_VM_64bit
 
 #define LUAT_USE_FS_VFS 1
 #define LUAT_USE_VFS_INLINE_LIB 1
+// x86/arm64 均支持非对齐访问, luadb中的字节码可直接原地引用
+#define LUAT_UNDUMP_ROM_UNALIGNED 1
+// 虚拟机小对象走分级分配器, 减少碎片
+#define LUAT_USE_MEMORY_SLAB 1
 
 #define LUAT_USE_CRYPTO 1
 #define LUAT_COMPILER_NOWEAK
 
 #define LUAT_USE_SM 1
 
+// fskv使用内存模拟的片上flash, 见port/luat_sfd_onchip_linux.c
+#define LUAT_USE_FSKV 1
+// 日志结构的存储方式, 注释掉则每个key一个lfs文件
+#define LUAT_USE_FSKV_LOG 1
+
+// socket库, 走posix网络适配器, 见components/network/posix
+#define LUAT_USE_NETWORK 1
+#define LUAT_USE_TLS 1
+
 //#define LUAT_USE_LVGL 1
 #define LUAT_USE_LVGL_SDL2 1
 #define LUAT_USE_LCD_SDL2 1
@@ -2,7 +2,19 @@
 #include "luat_msgbus.h"
 #include "luat_fs.h"
 #include "luat_timer.h"
+#include "luat_malloc.h"
 #include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#define LUAT_LOG_TAG "main"
+#include "luat_log.h"
+
+#ifdef LUAT_USE_NETWORK
+#include "luat_network_adapter.h"
+extern network_adapter_info network_posix;
+void posix_network_set_ready(uint8_t ready);
+#endif
 
 #ifdef LUAT_USE_LVGL
 #include "lvgl.h"
@@ -38,10 +50,20 @@ static const luaL_Reg loadedlibs[] = {
   {"zbuff", luaopen_zbuff},            // 
   {"crypto", luaopen_crypto},
 //   {"fatfs", luaopen_fatfs},
-//   {"sfd",   luaopen_sfd},
-//   {"lfs2",   luaopen_lfs2},
+  {"sfd",   luaopen_sfd},
+  {"lfs2",   luaopen_lfs2},
 //   {"gpio",   luaopen_gpio},
   {"rsa", luaopen_rsa},
+  {"mcu", luaopen_mcu},
+#ifdef LUAT_USE_NETWORK
+  {"socket", luaopen_socket_adapter},
+#endif
+#ifdef LUAT_USE_FSKV
+  {"fskv", luaopen_fskv},
+#endif
+#ifdef LUAT_USE_PROFILER
+  {"profiler", luaopen_profiler},
+#endif
 #ifdef __XMAKE_BUILD__
   {"protobuf", luaopen_protobuf},
   {"iotauth", luaopen_iotauth},
@@ -58,6 +80,11 @@ void luat_openlibs(lua_State *L) {
     // 初始化队列服务
     luat_msgbus_init();
     //print_list_mem("done>luat_msgbus_init");
+#ifdef LUAT_USE_NETWORK
+    // 本机网络走posix适配器, 最后注册的就是默认网卡, 启动即就绪
+    network_register_adapter(NW_ADAPTER_INDEX_ETH0, &network_posix, NULL);
+    posix_network_set_ready(1);
+#endif
     // 加载系统库
     const luaL_Reg *lib;
     /* "require" functions from 'loadedlibs' and set results to global table */
@@ -79,6 +106,31 @@ extern const struct luat_vfs_filesystem vfs_fs_posix;
 extern const struct luat_vfs_filesystem vfs_fs_luadb;
 
 extern const char* luat_luadb_mock;
+extern size_t luat_luadb_act_size;
+
+// 可通过环境变量 LUATOS_LUADB 指定一个luadb镜像文件, 代替内置的mock镜像挂载到/luadb/
+static char* luadb_image_load(void) {
+	const char* path = getenv("LUATOS_LUADB");
+	if (path == NULL)
+		return NULL;
+	FILE* f = fopen(path, "rb");
+	if (f == NULL) {
+		LLOGW("luadb image %s not found", path);
+		return NULL;
+	}
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	char* ptr = size > 0 ? luat_heap_malloc(size) : NULL;
+	if (ptr && fread(ptr, 1, size, f) != (size_t)size) {
+		luat_heap_free(ptr);
+		ptr = NULL;
+	}
+	fclose(f);
+	if (ptr)
+		luat_luadb_act_size = size;
+	return ptr;
+}
 
 int luat_fs_init(void) {
 	#ifdef LUAT_USE_FS_VFS
@@ -96,13 +148,21 @@ int luat_fs_init(void) {
 	};
 	luat_fs_mount(&conf);
 	#ifdef LUAT_USE_VFS_INLINE_LIB
+	char* image = luadb_image_load();
 	luat_fs_conf_t conf2 = {
-		.busname = (char*)luat_luadb_mock,
+		.busname = image ? image : (char*)luat_luadb_mock,
 		.type = "luadb",
 		.filesystem = "luadb",
 		.mount_point = "/luadb/",
 	};
+	struct timespec t1, t2;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
 	luat_fs_mount(&conf2);
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+	if (image) {
+		LLOGI("luadb mount %s in %ldus", getenv("LUATOS_LUADB"),
+			(long)((t2.tv_sec - t1.tv_sec) * 1000000 + (t2.tv_nsec - t1.tv_nsec) / 1000));
+	}
 	#endif
 	#endif
 
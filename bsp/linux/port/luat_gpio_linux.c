@@ -65,4 +65,8 @@ void luat_gpio_close(int pin) {
         return;
     }
     win32gpios[pin].open = 0;
-}
\ No newline at end of file
+}
+
+// 模拟环境下没有真实引脚, 脉冲输出不做任何事
+void luat_gpio_pulse(int pin, uint8_t *level, uint16_t len, uint16_t delay_ns) {
+}
@@ -22,6 +22,10 @@ void luat_nprint(char *s, size_t l) {
     printf("%.*s", (int)l, s);
 }
 
+void luat_log_write(char *s, size_t l) {
+    luat_nprint(s, l);
+}
+
 void luat_log_set_level(int level) {
     luat_log_level_cur = level;
 }
@@ -32,6 +32,10 @@ void* luat_heap_calloc(size_t count, size_t _size) {
     }
     return ptr;
 }
+
+void* luat_heap_zalloc(size_t _size) {
+    return calloc(1, _size);
+}
 //------------------------------------------------
 
 //------------------------------------------------
@@ -1,7 +1,47 @@
 #include "luat_base.h"
 #include "luat_mcu.h"
 // #include "task.h"
+#include <time.h>
 
+// tick单位为ms, 与mcu.hz()一致
 long luat_mcu_ticks(void) {
-    return clock()*1000;
+    return (long)luat_mcu_tick64_ms();
+}
+
+uint32_t luat_mcu_hz(void) {
+    return 1000;
+}
+
+uint64_t luat_mcu_tick64_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// 单位为us, mcu.tick64()使用
+uint64_t luat_mcu_tick64(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int luat_mcu_us_period(void) {
+    return 1;
+}
+
+int luat_mcu_set_clk(size_t mhz) {
+    return 0;
+}
+
+int luat_mcu_get_clk(void) {
+    return 0;
+}
+
+const char* luat_mcu_unique_id(size_t* t) {
+    static const char id[] = "linux";
+    *t = sizeof(id) - 1;
+    return id;
+}
+
+void luat_mcu_set_clk_source(uint8_t source_main, uint8_t source_32k, uint32_t delay) {
 }
@@ -1,64 +1,155 @@
-
+#define _POSIX_C_SOURCE 200809L
 #include "luat_msgbus.h"
 #include "luat_malloc.h"
 
 #define LUAT_LOG_TAG "msgbus"
 #include "luat_log.h"
 
-typedef struct sysp_msgbus {
-    uint32_t vaild;
+#include <pthread.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <time.h>
+
+// 消息队列的槽位数量, 必须是2的幂, 可在luat_conf_bsp.h中覆盖
+#ifndef LUAT_MSGBUS_SIZE
+#define LUAT_MSGBUS_SIZE (4096)
+#endif
+
+#if (LUAT_MSGBUS_SIZE & (LUAT_MSGBUS_SIZE - 1)) != 0
+#error "LUAT_MSGBUS_SIZE must be power of 2"
+#endif
+
+#define MSGBUS_MASK (LUAT_MSGBUS_SIZE - 1)
+
+// 有界多生产者单消费者环形队列(Vyukov算法)
+// 每个槽位带一个序号, 生产者通过CAS抢占写位置, 写完后发布序号
+// 消费者只有lua线程一个, 读位置无需CAS
+typedef struct msgbus_slot {
+    atomic_size_t seq;
     rtos_msg_t msg;
-    void* next;
-}sysp_msgbus_t;
+}msgbus_slot_t;
 
-#define MSGBUS_SIZE (128)
+static msgbus_slot_t slots[LUAT_MSGBUS_SIZE];
+static atomic_size_t w_pos;
+static atomic_size_t r_pos;
+static atomic_int inited;
 
-static int msgbus_w_pos = 0;
-static int msgbus_r_pos = 0;
-static sysp_msgbus_t *msg_head;
+// 仅在队列为空且消费者需要阻塞时才使用
+static pthread_mutex_t wait_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wait_cond;
+static atomic_int waiting;
 
 void luat_msgbus_init(void) {
-    msg_head = luat_heap_malloc(sizeof(sysp_msgbus_t));
-    msg_head->vaild = 0;
+    if (atomic_load(&inited))
+        return;
+    for (size_t i = 0; i < LUAT_MSGBUS_SIZE; i++)
+    {
+        atomic_store_explicit(&slots[i].seq, i, memory_order_relaxed);
+    }
+    atomic_store(&w_pos, 0);
+    atomic_store(&r_pos, 0);
+    // 用单调时钟做超时, 避免系统时间被调整时等待异常
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&wait_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    atomic_store(&inited, 1);
 }
+
 uint32_t luat_msgbus_put(rtos_msg_t* msg, size_t timeout) {
-    sysp_msgbus_t *tmp = luat_heap_malloc(sizeof(sysp_msgbus_t));
-    if (tmp == NULL) {
-        LLOGD("out of memory when malloc msgbus mss");
+    (void)timeout;
+    if (!atomic_load_explicit(&inited, memory_order_acquire))
         return 1;
-    }
-    tmp->vaild = 0;
-
-    //LLOGD("luat_msgbus_put GoGo\n");
-
-    sysp_msgbus_t* t = msg_head;
+    msgbus_slot_t *slot;
+    size_t pos = atomic_load_explicit(&w_pos, memory_order_relaxed);
     while (1) {
-        if (t->vaild == 0) {
-            //LLOGD("luat_msgbus_put t->vaild\n");
-            memcpy(&t->msg, msg, sizeof(rtos_msg_t));
-            t->vaild = 1;
-            t->next = tmp;
-            return 0;
+        slot = &slots[pos & MSGBUS_MASK];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&w_pos, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0) {
+            LLOGW("msgbus is full, drop msg");
+            return 1;
         }
         else {
-            t = t->next;
+            pos = atomic_load_explicit(&w_pos, memory_order_relaxed);
         }
     }
+    slot->msg = *msg;
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+
+    // 与消费者的 waiting=1 -> 复查队列 构成Dekker式同步, 避免丢失唤醒
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&waiting, memory_order_relaxed)) {
+        pthread_mutex_lock(&wait_lock);
+        pthread_cond_signal(&wait_cond);
+        pthread_mutex_unlock(&wait_lock);
+    }
     return 0;
 }
 
+static int msgbus_try_get(rtos_msg_t* msg) {
+    size_t pos = atomic_load_explicit(&r_pos, memory_order_relaxed);
+    msgbus_slot_t *slot = &slots[pos & MSGBUS_MASK];
+    size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    if (seq != pos + 1)
+        return 1;
+    *msg = slot->msg;
+    atomic_store_explicit(&slot->seq, pos + LUAT_MSGBUS_SIZE, memory_order_release);
+    atomic_store_explicit(&r_pos, pos + 1, memory_order_relaxed);
+    return 0;
+}
+
+// timeout单位为毫秒, (size_t)-1 代表永久等待, 0 代表不等待
 uint32_t luat_msgbus_get(rtos_msg_t* msg, size_t timeout) {
-    //LLOGD("CALL luat_msgbus_get\n");
-    sysp_msgbus_t* t = msg_head;
-    if (t->vaild) {
-        memcpy(msg, &t->msg, sizeof(rtos_msg_t));
-        msg_head = t->next;
-        luat_heap_free(t);
+    if (!atomic_load_explicit(&inited, memory_order_acquire))
+        return 1;
+    if (msgbus_try_get(msg) == 0)
         return 0;
+    if (timeout == 0)
+        return 1;
+
+    struct timespec deadline = {0};
+    int forever = (timeout == (size_t)-1);
+    if (!forever) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += timeout / 1000;
+        deadline.tv_nsec += (timeout % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec ++;
+            deadline.tv_nsec -= 1000000000;
+        }
     }
-    return 1;
+
+    uint32_t ret = 1;
+    pthread_mutex_lock(&wait_lock);
+    while (1) {
+        atomic_store_explicit(&waiting, 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (msgbus_try_get(msg) == 0) {
+            ret = 0;
+            break;
+        }
+        int rc = forever ? pthread_cond_wait(&wait_cond, &wait_lock)
+                         : pthread_cond_timedwait(&wait_cond, &wait_lock, &deadline);
+        if (rc == ETIMEDOUT) {
+            ret = msgbus_try_get(msg);
+            break;
+        }
+    }
+    atomic_store_explicit(&waiting, 0, memory_order_relaxed);
+    pthread_mutex_unlock(&wait_lock);
+    return ret;
 }
 
 uint32_t luat_msgbus_freesize(void) {
-    return 1;
+    size_t used = atomic_load_explicit(&w_pos, memory_order_relaxed) - atomic_load_explicit(&r_pos, memory_order_relaxed);
+    if (used >= LUAT_MSGBUS_SIZE)
+        return 0;
+    return LUAT_MSGBUS_SIZE - used;
 }
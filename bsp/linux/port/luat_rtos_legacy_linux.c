@@ -0,0 +1,152 @@
+// 旧版rtos接口(luat_rtos_legacy.h)的Linux实现, 主要给网络适配器用
+
+#include "luat_base.h"
+#include "luat_malloc.h"
+#include "luat_timer.h"
+#include "luat_msgbus.h"
+#include "luat_rtos_legacy.h"
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <errno.h>
+
+#define LUAT_LOG_TAG "rtos"
+#include "luat_log.h"
+
+//------------------------------------------------
+// 任务和消息
+// Linux下没有luat任务, 网络适配器只使用回调模式, task_handle总是NULL
+
+LUAT_RET luat_send_event_to_task(void *task_handle, uint32_t id, uint32_t param1, uint32_t param2, uint32_t param3) {
+    if (task_handle == NULL)
+        return -1;
+    LLOGE("task event not supported");
+    return -1;
+}
+
+LUAT_RET luat_wait_event_from_task(void *task_handle, uint32_t wait_event_id, luat_event_t *out_event, void *call_back, uint32_t ms) {
+    LLOGE("task event not supported");
+    return -1;
+}
+
+void *luat_get_current_task(void) {
+    return NULL;
+}
+
+//------------------------------------------------
+// 互斥锁, 用信号量实现, 允许在其他线程unlock
+
+void *luat_mutex_create(void) {
+    sem_t *sem = luat_heap_malloc(sizeof(sem_t));
+    if (sem == NULL)
+        return NULL;
+    if (sem_init(sem, 0, 1)) {
+        luat_heap_free(sem);
+        return NULL;
+    }
+    return sem;
+}
+
+LUAT_RET luat_mutex_lock(void *mutex) {
+    while (sem_wait((sem_t *)mutex)) {
+        if (errno != EINTR)
+            return -1;
+    }
+    return 0;
+}
+
+LUAT_RET luat_mutex_unlock(void *mutex) {
+    return sem_post((sem_t *)mutex);
+}
+
+void luat_mutex_release(void *mutex) {
+    sem_destroy((sem_t *)mutex);
+    luat_heap_free(mutex);
+}
+
+//------------------------------------------------
+// 定时器, 挂在luat_timer的时间轮上, 回调在lua线程中执行
+
+// 与rtos.timer_start使用的id错开
+#define LEGACY_TIMER_ID_MIN (0x40000000)
+#define LEGACY_TIMER_ID_MAX (0x7FFFFFFF)
+
+typedef void (*legacy_timer_cb_t)(void *data, void *param);
+
+typedef struct legacy_timer {
+    luat_timer_t timer; // 必须放在第一个, 由luat_timer_get找回
+    legacy_timer_cb_t cb;
+    void *param;
+}legacy_timer_t;
+
+static pthread_mutex_t legacy_timer_lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t legacy_timer_id = LEGACY_TIMER_ID_MIN;
+
+static int legacy_timer_handler(lua_State *L, void* ptr) {
+    rtos_msg_t* msg = (rtos_msg_t*)lua_topointer(L, -1);
+    // 定时器可能已经停止或释放, 按id重新查一次
+    legacy_timer_t *t = (legacy_timer_t *)luat_timer_get((uint32_t)msg->arg1);
+    if (t == NULL)
+        return 0;
+    if (!t->timer.repeat)
+        luat_timer_stop(&t->timer);
+    if (t->cb)
+        t->cb(NULL, t->param);
+    return 0;
+}
+
+void *luat_create_rtos_timer(void *cb, void *param, void *task_handle) {
+    legacy_timer_t *t = luat_heap_zalloc(sizeof(legacy_timer_t));
+    if (t == NULL)
+        return NULL;
+    t->cb = (legacy_timer_cb_t)cb;
+    t->param = param;
+    t->timer.func = legacy_timer_handler;
+    pthread_mutex_lock(&legacy_timer_lock);
+    t->timer.id = legacy_timer_id;
+    legacy_timer_id = (legacy_timer_id >= LEGACY_TIMER_ID_MAX) ? LEGACY_TIMER_ID_MIN : legacy_timer_id + 1;
+    pthread_mutex_unlock(&legacy_timer_lock);
+    return t;
+}
+
+int luat_start_rtos_timer(void *timer, uint32_t ms, uint8_t is_repeat) {
+    legacy_timer_t *t = (legacy_timer_t *)timer;
+    luat_timer_stop(&t->timer);
+    t->timer.timeout = ms;
+    t->timer.repeat = is_repeat ? -1 : 0;
+    return luat_timer_start(&t->timer) ? -1 : 0;
+}
+
+void luat_stop_rtos_timer(void *timer) {
+    luat_timer_stop(&((legacy_timer_t *)timer)->timer);
+}
+
+void luat_release_rtos_timer(void *timer) {
+    if (timer == NULL)
+        return;
+    luat_stop_rtos_timer(timer);
+    luat_heap_free(timer);
+}
+
+//------------------------------------------------
+// 全局锁, 代替关闭任务调度
+
+static pthread_mutex_t legacy_global_lock;
+static pthread_once_t legacy_global_once = PTHREAD_ONCE_INIT;
+
+static void legacy_global_init(void) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&legacy_global_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+void luat_task_suspend_all(void) {
+    pthread_once(&legacy_global_once, legacy_global_init);
+    pthread_mutex_lock(&legacy_global_lock);
+}
+
+void luat_task_resume_all(void) {
+    pthread_mutex_unlock(&legacy_global_lock);
+}
@@ -0,0 +1,88 @@
+#include "luat_base.h"
+#include "luat_sfd.h"
+#include "luat_malloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define LUAT_LOG_TAG "onchip"
+#include "luat_log.h"
+
+// 用内存模拟片上flash, 行为与NOR flash一致: 擦除后全是0xFF, 写入只能把1改成0
+// 可通过环境变量 LUATOS_ONCHIP_FLASH 指定一个文件, 内容会保存下来, 用于测试掉电后的恢复
+static uint8_t* flash;
+static FILE* flash_file;
+static size_t flash_size;
+
+static void flash_sync(size_t offset, size_t len) {
+    if (flash_file == NULL)
+        return;
+    fseek(flash_file, offset, SEEK_SET);
+    fwrite(flash + offset, 1, len, flash_file);
+    fflush(flash_file);
+}
+
+int sfd_onchip_init (void* userdata) {
+    sfd_onchip_t* onchip = (sfd_onchip_t*)userdata;
+    flash_size = LFS_BLOCK_DEVICE_TOTOAL_SIZE;
+    if (flash == NULL) {
+        flash = luat_heap_malloc(flash_size);
+        if (flash == NULL)
+            return -1;
+        memset(flash, 0xFF, flash_size);
+        const char* path = getenv("LUATOS_ONCHIP_FLASH");
+        if (path) {
+            flash_file = fopen(path, "r+b");
+            if (flash_file) {
+                if (fread(flash, 1, flash_size, flash_file) != flash_size)
+                    LLOGW("flash image %s is short", path);
+            }
+            else {
+                flash_file = fopen(path, "w+b");
+                flash_sync(0, flash_size);
+            }
+        }
+    }
+    memcpy(onchip->name, "onchip", 7);
+    onchip->addr = 0;
+    onchip->block_size = LFS_BLOCK_DEVICE_ERASE_SIZE;
+    onchip->block_count = flash_size / LFS_BLOCK_DEVICE_ERASE_SIZE;
+    return 0;
+}
+
+int sfd_onchip_status (void* userdata) {
+    return flash == NULL ? -1 : 0;
+}
+
+int sfd_onchip_read (void* userdata, char* buff, size_t offset, size_t len) {
+    if (offset + len > flash_size)
+        return -1;
+    memcpy(buff, flash + offset, len);
+    return len;
+}
+
+int sfd_onchip_write (void* userdata, const char* buff, size_t offset, size_t len) {
+    if (offset + len > flash_size)
+        return -1;
+    for (size_t i = 0; i < len; i++) {
+        if ((flash[offset + i] & buff[i]) != (uint8_t)buff[i]) {
+            LLOGE("write to dirty area at 0x%X", offset + i);
+            return -1;
+        }
+        flash[offset + i] &= buff[i];
+    }
+    flash_sync(offset, len);
+    return len;
+}
+
+int sfd_onchip_erase (void* userdata, size_t offset, size_t len) {
+    if (offset % LFS_BLOCK_DEVICE_ERASE_SIZE || offset + len > flash_size)
+        return -1;
+    memset(flash + offset, 0xFF, len);
+    flash_sync(offset, len);
+    return 0;
+}
+
+int sfd_onchip_ioctl (void* userdata, size_t cmd, void* buff) {
+    return 0;
+}
@@ -1,4 +1,4 @@
-#define _POSIX_C_SOURCE 199309L
+#define _POSIX_C_SOURCE 200809L
 #include "luat_base.h"
 #include "luat_malloc.h"
 #include "luat_timer.h"
@@ -10,124 +10,328 @@
 #include "luat_log.h"
 
 #include <time.h>
-#include <math.h>
 #include <unistd.h>
+#include <string.h>
+
+// 最大定时器数量, 可在luat_conf_bsp.h中覆盖
+#ifndef LUAT_TIMER_MAX
+#define LUAT_TIMER_MAX (64*1024)
+#endif
+
+// id -> 定时器 的哈希桶数量, 必须是2的幂
+#ifndef LUAT_TIMER_HASH_SIZE
+#define LUAT_TIMER_HASH_SIZE (1024)
+#endif
+
+// 分层时间轮: 4层, 每层256个槽, 第0层精度1ms, 第n层精度 256^n ms
+#define WHEEL_LEVELS     (4)
+#define WHEEL_SLOT_BITS  (8)
+#define WHEEL_SLOTS      (1 << WHEEL_SLOT_BITS)
+#define WHEEL_MASK       (WHEEL_SLOTS - 1)
+#define WHEEL_MAX_DELTA  (0xFFFFFFFFUL)
 
-#define TIMER_COUNT 128
 typedef struct sysp_timer {
     luat_timer_t* timer;
-    uint32_t starttime;
-    uint32_t nexttime;
+    uint64_t expires;
+    struct sysp_timer* prev;   // 时间轮槽位链表
+    struct sysp_timer* next;
+    struct sysp_timer* hnext;  // id哈希链表
+    uint8_t level;
+    uint8_t slot;
+    uint8_t in_wheel;
 } sysp_timer_t;
-static sysp_timer_t timers[TIMER_COUNT] = {0};
+
+typedef struct timer_wheel_level {
+    sysp_timer_t* slots[WHEEL_SLOTS];
+    uint64_t bitmap[WHEEL_SLOTS / 64];
+} timer_wheel_level_t;
+
+static timer_wheel_level_t wheel[WHEEL_LEVELS];
+static sysp_timer_t* id_hash[LUAT_TIMER_HASH_SIZE];
+static uint64_t wheel_clk;      // 时间轮当前处理到的时刻(ms)
+static uint64_t wake_at;        // 定时器线程当前计划醒来的时刻, 0代表无限期休眠
+static size_t timer_count;
+
+static pthread_mutex_t mp = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cv;
+static pthread_once_t timer_once = PTHREAD_ONCE_INIT;
+
+// 单调时钟, 单位ms, 不受系统时间调整影响
+static uint64_t timer_now_ms(void) {
+    struct timespec _t = {0};
+    clock_gettime(CLOCK_MONOTONIC, &_t);
+    return (uint64_t)_t.tv_sec * 1000 + _t.tv_nsec / 1000000;
+}
 
 // 获取当前时间
 uint32_t get_timestamp(void) {
-    struct timespec _t = {0};
-    clock_gettime(CLOCK_REALTIME, &_t);
-    uint32_t timenow = _t.tv_sec*1000 + lround(_t.tv_nsec/1e6);
-    //printf("time now > %u\n", timenow);
-    return timenow;
+    return (uint32_t)timer_now_ms();
 }
 
-void luat_timer_check(void) {
-    //LLOGD("timer callback");
-    uint32_t timenow = get_timestamp();
+static void timer_init_once(void) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&cv, &attr);
+    pthread_condattr_destroy(&attr);
+    wheel_clk = timer_now_ms();
+}
+
+//------------------------------------------------
+// 时间轮操作, 调用者需持有mp
+
+static void wheel_link(sysp_timer_t* t, uint8_t level, uint8_t slot) {
+    timer_wheel_level_t* lv = &wheel[level];
+    t->level = level;
+    t->slot = slot;
+    t->prev = NULL;
+    t->next = lv->slots[slot];
+    if (t->next)
+        t->next->prev = t;
+    lv->slots[slot] = t;
+    lv->bitmap[slot >> 6] |= (1ULL << (slot & 63));
+    t->in_wheel = 1;
+}
+
+static void wheel_unlink(sysp_timer_t* t) {
+    if (!t->in_wheel)
+        return;
+    timer_wheel_level_t* lv = &wheel[t->level];
+    if (t->prev)
+        t->prev->next = t->next;
+    else
+        lv->slots[t->slot] = t->next;
+    if (t->next)
+        t->next->prev = t->prev;
+    if (lv->slots[t->slot] == NULL)
+        lv->bitmap[t->slot >> 6] &= ~(1ULL << (t->slot & 63));
+    t->prev = t->next = NULL;
+    t->in_wheel = 0;
+}
+
+static void wheel_add(sysp_timer_t* t) {
+    uint64_t expires = t->expires;
+    if (expires < wheel_clk)
+        expires = wheel_clk;
+    uint64_t delta = expires - wheel_clk;
+    if (delta > WHEEL_MAX_DELTA) {
+        delta = WHEEL_MAX_DELTA;
+        expires = wheel_clk + delta;
+    }
+    uint8_t level = 0;
+    while (level < WHEEL_LEVELS - 1 && delta >= (1ULL << (WHEEL_SLOT_BITS * (level + 1))))
+        level ++;
+    wheel_link(t, level, (expires >> (WHEEL_SLOT_BITS * level)) & WHEEL_MASK);
+}
+
+// 把上一层某个槽位的定时器重新分配到下层, 返回该槽位索引
+static int wheel_cascade(uint8_t level) {
+    int index = (wheel_clk >> (WHEEL_SLOT_BITS * level)) & WHEEL_MASK;
+    timer_wheel_level_t* lv = &wheel[level];
+    sysp_timer_t* t = lv->slots[index];
+    lv->slots[index] = NULL;
+    lv->bitmap[index >> 6] &= ~(1ULL << (index & 63));
+    while (t) {
+        sysp_timer_t* next = t->next;
+        t->in_wheel = 0;
+        wheel_add(t);
+        t = next;
+    }
+    return index;
+}
+
+// 从start开始(含)循环查找下一个非空槽位, 返回距离, 没有则返回-1
+static int wheel_next_slot(uint8_t level, int start) {
+    const uint64_t* bm = wheel[level].bitmap;
+    for (int i = 0; i < WHEEL_SLOTS; ) {
+        int pos = (start + i) & WHEEL_MASK;
+        uint64_t word = bm[pos >> 6] >> (pos & 63);
+        if (word) {
+            return i + __builtin_ctzll(word);
+        }
+        i += 64 - (pos & 63);
+    }
+    return -1;
+}
+
+// 计算下一次需要处理时间轮的时刻(到期或者上层下放), 没有定时器则返回0
+static uint64_t wheel_next_expiry(void) {
+    uint64_t next = 0;
+    if (timer_count == 0)
+        return 0;
+    int dist = wheel_next_slot(0, wheel_clk & WHEEL_MASK);
+    if (dist >= 0)
+        next = wheel_clk + dist;
+    for (uint8_t level = 1; level < WHEEL_LEVELS; level++) {
+        uint8_t shift = WHEEL_SLOT_BITS * level;
+        dist = wheel_next_slot(level, ((wheel_clk >> shift) + 1) & WHEEL_MASK);
+        if (dist < 0)
+            continue;
+        uint64_t t = ((wheel_clk >> shift) + dist + 1) << shift;
+        if (next == 0 || t < next)
+            next = t;
+    }
+    return next;
+}
+
+static void timer_fire(sysp_timer_t* t) {
+    luat_timer_t *timer = t->timer;
     rtos_msg_t msg;
-    for (size_t i = 0; i < TIMER_COUNT; i++)
-    {
-        if (timers[i].timer == NULL) continue;
-        //LLOGD("%d %d\n", timers[i].nexttime, timenow);
-        if (timers[i].nexttime < timenow) {
-            luat_timer_t *timer = timers[i].timer;
-            msg.handler = timer->func;
-            msg.ptr = NULL;
-            msg.arg1 = timer->id;
-            msg.arg2 = 0;
-            luat_msgbus_put(&msg, 0);
-            if (timer->repeat) {
-                timers[i].nexttime += timer->timeout;
-            }
-            else {
-                timers[i].nexttime = 0;
+    msg.handler = timer->func;
+    msg.ptr = NULL;
+    msg.arg1 = timer->id;
+    msg.arg2 = 0;
+    luat_msgbus_put(&msg, 0);
+    if (timer->repeat) {
+        t->expires += timer->timeout;
+        // 当前槽位已经摘下, 落后的定时器放到下一个tick
+        if (t->expires <= wheel_clk)
+            t->expires = wheel_clk + 1;
+        wheel_add(t);
+    }
+}
+
+// 推进时间轮并投递到期消息, 调用者需持有mp
+void luat_timer_check(void) {
+    uint64_t now = timer_now_ms();
+    while (wheel_clk <= now) {
+        int index = wheel_clk & WHEEL_MASK;
+        if (index == 0) {
+            for (uint8_t level = 1; level < WHEEL_LEVELS; level++) {
+                if (wheel_cascade(level) != 0)
+                    break;
             }
         }
+        sysp_timer_t* t = wheel[0].slots[index];
+        wheel[0].slots[index] = NULL;
+        wheel[0].bitmap[index >> 6] &= ~(1ULL << (index & 63));
+        while (t) {
+            sysp_timer_t* next = t->next;
+            t->in_wheel = 0;
+            t->prev = t->next = NULL;
+            timer_fire(t);
+            t = next;
+        }
+        // 跳过本轮中的空槽位, 最多到下一次下放的边界
+        uint64_t jump = wheel_clk + (WHEEL_SLOTS - index);
+        int dist = wheel_next_slot(0, index + 1);
+        if (dist >= 0 && index + 1 + dist < WHEEL_SLOTS)
+            jump = wheel_clk + 1 + dist;
+        wheel_clk = jump < now + 1 ? jump : now + 1;
     }
-    //LLOGD("end of luat_timer_check\n");
 }
 
-static int nextTimerSlot() {
-    for (size_t i = 0; i < TIMER_COUNT; i++)
-    {
-        if (timers[i].timer == NULL) {
-            return i;
+//------------------------------------------------
+// id 哈希表, 调用者需持有mp
+
+static inline size_t id_hash_index(size_t id) {
+    return (id ^ (id >> 10)) & (LUAT_TIMER_HASH_SIZE - 1);
+}
+
+static void id_hash_remove(sysp_timer_t* t) {
+    sysp_timer_t** pp = &id_hash[id_hash_index(t->timer->id)];
+    while (*pp) {
+        if (*pp == t) {
+            *pp = t->hnext;
+            break;
         }
+        pp = &(*pp)->hnext;
     }
-    return -1;
+    t->hnext = NULL;
 }
 
+//------------------------------------------------
+
 int luat_timer_start(luat_timer_t* timer) {
-    // int os_timer;
-    int timerIndex;
-    //LLOGD(">>luat_timer_start timeout=%ld", timer->timeout);
-    timerIndex = nextTimerSlot();
-    //LLOGD("timer id=%ld", timerIndex);
-    if (timerIndex < 0) {
-        return 1; // too many timer!!
+    pthread_once(&timer_once, timer_init_once);
+    pthread_mutex_lock(&mp);
+    if (timer_count >= LUAT_TIMER_MAX) {
+        pthread_mutex_unlock(&mp);
+        LLOGE("too many timers, max %d", LUAT_TIMER_MAX);
+        return 1;
+    }
+    sysp_timer_t* t = luat_heap_malloc(sizeof(sysp_timer_t));
+    if (t == NULL) {
+        pthread_mutex_unlock(&mp);
+        LLOGE("out of memory when malloc timer");
+        return 1;
     }
-    // os_timer = timerIndex;
-    //LLOGD("timer id=%ld, osTimerNew=%p", timerIndex, os_timer);
-    timers[timerIndex].timer = timer;
-    timers[timerIndex].starttime = get_timestamp();
-    timers[timerIndex].nexttime = timers[timerIndex].starttime + timer->timeout;
-    
-    //timer->os_timer = os_timer;
+    memset(t, 0, sizeof(sysp_timer_t));
+    t->timer = timer;
+    timer->os_timer = t;
+    // 空闲期间时间轮不推进, 直接对齐到当前时间
+    if (timer_count == 0)
+        wheel_clk = timer_now_ms();
+    t->expires = timer_now_ms() + timer->timeout;
+    wheel_add(t);
+    size_t idx = id_hash_index(timer->id);
+    t->hnext = id_hash[idx];
+    id_hash[idx] = t;
+    timer_count ++;
+    if (wake_at == 0 || t->expires < wake_at)
+        pthread_cond_signal(&cv);
+    pthread_mutex_unlock(&mp);
     return 0;
 }
 
 int luat_timer_stop(luat_timer_t* timer) {
     if (!timer)
         return 1;
-    for (size_t i = 0; i < TIMER_COUNT; i++)
-    {
-        if (timers[i].timer == timer) {
-            timers[i].timer = NULL;
-            break;
-        }
+    pthread_mutex_lock(&mp);
+    sysp_timer_t* t = (sysp_timer_t*)timer->os_timer;
+    if (t == NULL || t->timer != timer) {
+        pthread_mutex_unlock(&mp);
+        return 0;
     }
+    wheel_unlink(t);
+    id_hash_remove(t);
+    timer->os_timer = NULL;
+    timer_count --;
+    pthread_mutex_unlock(&mp);
+    luat_heap_free(t);
     return 0;
 };
 
 luat_timer_t* luat_timer_get(size_t timer_id) {
-    for (size_t i = 0; i < TIMER_COUNT; i++)
-    {
-        if (timers[i].timer && timers[i].timer->id == timer_id) {
-            return timers[i].timer;
+    luat_timer_t* timer = NULL;
+    pthread_mutex_lock(&mp);
+    sysp_timer_t* t = id_hash[id_hash_index(timer_id)];
+    while (t) {
+        if (t->timer->id == timer_id) {
+            timer = t->timer;
+            break;
         }
+        t = t->hnext;
     }
-    return NULL;
+    pthread_mutex_unlock(&mp);
+    return timer;
 }
 
 
 int luat_timer_mdelay(size_t ms) {
-    if (ms > 0)
-        usleep(ms*1000);
+    if (ms > 0) {
+        struct timespec ts = {.tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000};
+        nanosleep(&ts, NULL);
+    }
     return 0;
 }
 
-
-static pthread_mutex_t mp;
-static pthread_cond_t cv;
-
 void *timer_thread_start(void *args) {
     // printf("timer thread started\r\n");
     struct timespec to = {0};
+    pthread_once(&timer_once, timer_init_once);
     pthread_mutex_lock(&mp);
-    to.tv_sec = 0;
-    to.tv_nsec = 100;
     while (1) {
-        pthread_cond_timedwait(&cv, &mp, &to);
         luat_timer_check();
+        wake_at = wheel_next_expiry();
+        if (wake_at == 0) {
+            pthread_cond_wait(&cv, &mp);
+        }
+        else {
+            to.tv_sec = wake_at / 1000;
+            to.tv_nsec = (wake_at % 1000) * 1000000;
+            pthread_cond_timedwait(&cv, &mp, &to);
+        }
     }
     return NULL;
 }
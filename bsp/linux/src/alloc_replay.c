@@ -0,0 +1,153 @@
+/*
+ * 回放 LUATOS_ALLOC_TRACE 记录下来的虚拟机内存操作, 对比不同分配器的表现
+ *
+ * 用法:
+ *   LUATOS_ALLOC_TRACE=alloc.trace ./luatos xxx.lua
+ *   ./alloc_replay alloc.trace heap [堆大小KB]
+ *   ./alloc_replay alloc.trace slab [堆大小KB]
+ *
+ * 输出耗时, 失败次数, 峰值占用, 以及bget空闲内存的碎片率(1 - 最大空闲块/总空闲)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "bget.h"
+#include "luat_malloc.h"
+#include "luat_slab.h"
+
+typedef void* (*alloc_fn)(void *ud, void *ptr, size_t osize, size_t nsize);
+
+// 记录中的指针 -> 回放时的指针, 开放寻址
+#define MAP_BITS (20)
+#define MAP_SIZE (1 << MAP_BITS)
+static uint64_t *map_keys;
+static void **map_vals;
+
+static size_t map_slot(uint64_t key) {
+    size_t idx = (size_t)((key * 0x9E3779B97F4A7C15ULL) >> (64 - MAP_BITS));
+    while (map_keys[idx] && map_keys[idx] != key)
+        idx = (idx + 1) & (MAP_SIZE - 1);
+    return idx;
+}
+
+static void* map_get(uint64_t key) {
+    size_t idx = map_slot(key);
+    return map_keys[idx] ? map_vals[idx] : NULL;
+}
+
+static void map_put(uint64_t key, void* val) {
+    size_t idx = map_slot(key);
+    map_keys[idx] = key;
+    map_vals[idx] = val;
+}
+
+static void map_del(uint64_t key) {
+    size_t idx = map_slot(key);
+    if (map_keys[idx] == 0)
+        return;
+    map_keys[idx] = 0;
+    // 把后面同一探测链上的元素重新放置
+    idx = (idx + 1) & (MAP_SIZE - 1);
+    while (map_keys[idx]) {
+        uint64_t k = map_keys[idx];
+        void* v = map_vals[idx];
+        map_keys[idx] = 0;
+        map_put(k, v);
+        idx = (idx + 1) & (MAP_SIZE - 1);
+    }
+}
+
+static uint64_t parse_ptr(const char* s) {
+    if (s[0] == '(') // glibc 把NULL打印成(nil)
+        return 0;
+    return strtoull(s, NULL, 16);
+}
+
+static double frag_ratio(void) {
+    long curalloc, totfree, maxfree;
+    unsigned long nget, nrel;
+    bstats(&curalloc, &totfree, &maxfree, &nget, &nrel);
+    if (totfree <= 0)
+        return 0;
+    return 1.0 - (double)maxfree / totfree;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        printf("usage: %s <trace> heap|slab [heap_kb]\n", argv[0]);
+        return 1;
+    }
+    alloc_fn fn = strcmp(argv[2], "slab") == 0 ? luat_slab_alloc : luat_heap_alloc;
+    size_t heap_size = (argc > 3 ? atoi(argv[3]) : 256) * 1024;
+    bpool(malloc(heap_size), heap_size);
+    map_keys = calloc(MAP_SIZE, sizeof(uint64_t));
+    map_vals = calloc(MAP_SIZE, sizeof(void*));
+
+    FILE* f = fopen(argv[1], "r");
+    if (f == NULL) {
+        printf("can't open %s\n", argv[1]);
+        return 1;
+    }
+    char sp[32], sd[32];
+    size_t osize, nsize;
+    size_t ops = 0, fails = 0, skipped = 0;
+    double worst_frag = 0;
+    double cost = 0;
+    struct timespec t1, t2;
+    while (fscanf(f, "%31s %zu %zu %31s", sp, &osize, &nsize, sd) == 4) {
+        uint64_t p = parse_ptr(sp);
+        uint64_t d = parse_ptr(sd);
+        void* rp = NULL;
+        if (p) {
+            rp = map_get(p);
+            if (rp == NULL) {
+                skipped ++;
+                continue;
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        void* rd = fn(NULL, rp, osize, nsize);
+        clock_gettime(CLOCK_MONOTONIC, &t2);
+        cost += (t2.tv_sec - t1.tv_sec) * 1e9 + (t2.tv_nsec - t1.tv_nsec);
+        ops ++;
+        if (nsize && rd == NULL) {
+            fails ++;
+            continue;
+        }
+        if (p)
+            map_del(p);
+        if (nsize && d)
+            map_put(d, rd);
+        if ((ops & 0xFFF) == 0) {
+            double fr = frag_ratio();
+            if (fr > worst_frag)
+                worst_frag = fr;
+        }
+    }
+    fclose(f);
+
+    long curalloc, totfree, maxfree;
+    unsigned long nget, nrel;
+    bstats(&curalloc, &totfree, &maxfree, &nget, &nrel);
+    printf("allocator   : %s, heap %zuKB\n", argv[2], heap_size / 1024);
+    printf("ops         : %zu, failed %zu, skipped %zu\n", ops, fails, skipped);
+    printf("time        : %.1fns/op\n", ops ? cost / ops : 0);
+    printf("heap peak   : %ld bytes\n", (long)bstatsmaxget());
+    printf("heap final  : used %ld, free %ld, largest free %ld\n", curalloc, totfree, maxfree);
+    printf("frag final  : %.1f%%, worst %.1f%%\n", frag_ratio() * 100, worst_frag * 100);
+    if (fn == luat_slab_alloc) {
+        luat_slab_stat_t st;
+        luat_slab_stat(&st);
+        printf("slab pages  : %zu bytes, used %zu, peak %zu\n", st.page_bytes, st.used_bytes, st.max_page_bytes);
+        for (size_t i = 0; i < LUAT_SLAB_CLASS_COUNT; i++) {
+            luat_slab_class_stat_t* c = &st.classes[i];
+            printf("  class %3d : pages %3d objs %6u hit %8u miss %6u waste %zu\n",
+                c->size, c->pages, c->objs, c->hit, c->miss, (size_t)c->objs * c->size - c->requested);
+        }
+    }
+    return 0;
+}
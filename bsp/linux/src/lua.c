@@ -601,9 +601,35 @@ static int pmain (lua_State *L) {
 
 void* luat_heap_alloc(void *ud, void *ptr, size_t osize, size_t nsize);
 
+#ifdef LUAT_USE_PROFILER
+#include "luat_profiler.h"
+#define LUAVM_ALLOC luat_profiler_alloc
+#elif defined(LUAT_USE_MEMORY_SLAB)
+#include "luat_slab.h"
+#define LUAVM_ALLOC luat_slab_alloc
+#else
+#define LUAVM_ALLOC luat_heap_alloc
+#endif
+
+/*
+** 设置环境变量 LUATOS_ALLOC_TRACE 后, 把虚拟机的每次内存操作记录到该文件,
+** 每行: 原指针 osize nsize 新指针, 用于 alloc_replay 回放对比不同的分配器
+*/
+static FILE *alloc_trace;
+
+static void *trace_alloc (void *ud, void *ptr, size_t osize, size_t nsize) {
+  void *dst = LUAVM_ALLOC(ud, ptr, osize, nsize);
+  fprintf(alloc_trace, "%p %zu %zu %p\n", ptr, osize, nsize, dst);
+  return dst;
+}
+
 int lua_main (int argc, char **argv) {
   int status, result;
-  lua_State *L = lua_newstate(luat_heap_alloc, NULL);;  /* create state */
+  lua_Alloc allocf = LUAVM_ALLOC;
+  const char *trace = getenv("LUATOS_ALLOC_TRACE");
+  if (trace && (alloc_trace = fopen(trace, "w")) != NULL)
+    allocf = trace_alloc;
+  lua_State *L = lua_newstate(allocf, NULL);  /* create state */
   if (L == NULL) {
     l_message(argv[0], "cannot create state: not enough memory");
     return EXIT_FAILURE;
@@ -5,3 +5,7 @@
 long luat_mcu_ticks(void) {
     return GetTickCount();
 }
+
+uint64_t luat_mcu_tick64_ms(void) {
+    return GetTickCount64();
+}
@@ -23,6 +23,7 @@
 #include "luat_malloc.h"
 #include "luat_base.h"
 #include "luat_log.h"
+#include "crc.h"
 
 #define COMMON_LOG_BUF_SIZE 255
 static char common_log_buf[COMMON_LOG_BUF_SIZE];
@@ -576,59 +577,11 @@ uint8_t SumCheck(uint8_t *Data, uint32_t Len)
 
 uint8_t CRC8Cal(void *Data, uint16_t Len, uint8_t CRC8Last, uint8_t CRCRoot, uint8_t IsReverse)
 {
-	uint16_t i;
-	uint8_t CRC8 = CRC8Last;
-	uint8_t wTemp = CRCRoot;
-	uint8_t *Src = (uint8_t *)Data;
-	if (IsReverse)
-	{
-		CRCRoot = 0;
-		for (i = 0; i < 8; i++)
-		{
-			if (wTemp & (1 << (7 - i)))
-			{
-				CRCRoot |= 1 << i;
-			}
-		}
-		while (Len--)
-		{
-
-			CRC8 ^= *Src++;
-			for (i = 0; i < 8; i++)
-			{
-				if ((CRC8 & 0x01))
-				{
-					CRC8 >>= 1;
-					CRC8 ^= CRCRoot;
-				}
-				else
-				{
-					CRC8 >>= 1;
-				}
-			}
-		}
-	}
-	else
-	{
-		while (Len--)
-		{
-
-			CRC8 ^= *Src++;
-			for (i = 8; i > 0; --i)
-			{
-				if ((CRC8 & 0x80))
-				{
-					CRC8 <<= 1;
-					CRC8 ^= CRCRoot;
-				}
-				else
-				{
-					CRC8 <<= 1;
-				}
-			}
-		}
-	}
-	return CRC8;
+	luat_crc_ctx_t ctx;
+	luat_crc_init(&ctx, 8, CRCRoot, 0, 0, IsReverse, IsReverse);
+	ctx.crc = CRC8Last;
+	luat_crc_update(&ctx, Data, Len);
+	return ctx.crc;
 }
 
 /************************************************************************/
@@ -636,66 +589,11 @@ uint8_t CRC8Cal(void *Data, uint16_t Len, uint8_t CRC8Last, uint8_t CRCRoot, uin
 /************************************************************************/
 uint16_t CRC16Cal(void *Data, uint16_t Len, uint16_t CRC16Last, uint16_t CRCRoot, uint8_t IsReverse)
 {
-	uint16_t i;
-	uint16_t CRC16 = CRC16Last;
-	uint16_t wTemp = CRCRoot;
-	uint8_t *Src = (uint8_t *)Data;
-	if (IsReverse)
-	{
-		CRCRoot = 0;
-		for (i = 0; i < 16; i++)
-		{
-			if (wTemp & (1 << (15 - i)))
-			{
-				CRCRoot |= 1 << i;
-			}
-		}
-		while (Len--)
-		{
-			for (i = 0; i < 8; i++)
-			{
-				if ((CRC16 & 0x0001) != 0)
-				{
-					CRC16 >>= 1;
-					CRC16 ^= CRCRoot;
-				}
-				else
-				{
-					CRC16 >>= 1;
-				}
-				if ((*Src&(1 << i)) != 0)
-				{
-					CRC16 ^= CRCRoot;
-				}
-			}
-			Src++;
-		}
-	}
-	else
-	{
-		while (Len--)
-		{
-			for (i = 8; i > 0; i--)
-			{
-				if ((CRC16 & 0x8000) != 0)
-				{
-					CRC16 <<= 1;
-					CRC16 ^= CRCRoot;
-				}
-				else
-				{
-					CRC16 <<= 1;
-				}
-				if ((*Src&(1 << (i - 1))) != 0)
-				{
-					CRC16 ^= CRCRoot;
-				}
-			}
-			Src++;
-		}
-	}
-
-	return CRC16;
+	luat_crc_ctx_t ctx;
+	luat_crc_init(&ctx, 16, CRCRoot, 0, 0, IsReverse, IsReverse);
+	ctx.crc = CRC16Last;
+	luat_crc_update(&ctx, Data, Len);
+	return ctx.crc;
 }
 
 uint32_t AsciiToU32(uint8_t *Src, uint32_t Len)
@@ -785,6 +683,10 @@ void CRC32_CreateTable(uint32_t *Tab, uint32_t Gen)
 uint32_t CRC32_Cal(uint32_t *CRC32_Table, uint8_t *Buf, uint32_t Size, uint32_t CRC32Last)
 {
 	uint32_t i;
+	if (CRC32_Table[1] == 0x77073096) // 由CRC32_GEN生成的表, 交给公共的CRC引擎
+	{
+		return luat_crc32_update(CRC32Last, Buf, Size);
+	}
 	for (i = 0; i < Size; i++)
 	{
 		CRC32Last = CRC32_Table[(CRC32Last ^ Buf[i]) & 0xff] ^ (CRC32Last >> 8);
@@ -193,58 +193,89 @@ int luat_crypto_md(const char* md, const char* str, size_t str_size, void* out_p
     return 0;
 }
 
-int luat_crypto_md_file(const char* md, void* out_ptr, const char* key, size_t key_len, const char* path) {
-    const mbedtls_md_info_t * info = mbedtls_md_info_from_string(md);
+int luat_crypto_md_init(luat_crypto_md_ctx_t* md, const char* name, const char* key, size_t key_len) {
+    const mbedtls_md_info_t * info = mbedtls_md_info_from_string(name);
+    md->ctx = NULL;
+    md->hmac = key_len > 0 ? 1 : 0;
     if (info == NULL) {
+        return -1;
+    }
+    mbedtls_md_context_t* ctx = luat_heap_malloc(sizeof(mbedtls_md_context_t));
+    if (ctx == NULL) {
+        LLOGE("out of memory when md init");
+        return -2;
+    }
+    mbedtls_md_init(ctx);
+    if (mbedtls_md_setup(ctx, info, md->hmac) != 0) {
+        mbedtls_md_free(ctx);
+        luat_heap_free(ctx);
+        return -2;
+    }
+    if (md->hmac) {
+        mbedtls_md_hmac_starts(ctx, (const unsigned char*)key, key_len);
+    }
+    else {
+        mbedtls_md_starts(ctx);
+    }
+    md->ctx = ctx;
+    md->size = mbedtls_md_get_size(info);
+    return md->size;
+}
+
+int luat_crypto_md_update(luat_crypto_md_ctx_t* md, const void* data, size_t len) {
+    if (md->ctx == NULL)
+        return -1;
+    if (md->hmac)
+        return mbedtls_md_hmac_update(md->ctx, data, len);
+    return mbedtls_md_update(md->ctx, data, len);
+}
+
+int luat_crypto_md_finish(luat_crypto_md_ctx_t* md, void* out_ptr) {
+    if (md->ctx == NULL)
+        return -1;
+    mbedtls_md_context_t* ctx = md->ctx;
+    int ret = md->hmac ? mbedtls_md_hmac_finish(ctx, out_ptr) : mbedtls_md_finish(ctx, out_ptr);
+    if (ret == 0) {
+        ret = md->size;
+    }
+    else {
+        LLOGI("md finish ret %d", ret);
+    }
+    luat_crypto_md_free(md);
+    return ret;
+}
+
+void luat_crypto_md_free(luat_crypto_md_ctx_t* md) {
+    if (md->ctx) {
+        mbedtls_md_free(md->ctx);
+        luat_heap_free(md->ctx);
+        md->ctx = NULL;
+    }
+}
+
+int luat_crypto_md_file(const char* md, void* out_ptr, const char* key, size_t key_len, const char* path) {
+    luat_crypto_md_ctx_t ctx;
+    if (luat_crypto_md_init(&ctx, md, key, key_len) < 0) {
         LLOGI("no such message digest %s", md);
         return -1;
     }
     FILE* fd = luat_fs_fopen(path, "rb");
     if (fd == NULL) {
         LLOGI("no such file %s", path);
+        luat_crypto_md_free(&ctx);
         return -1;
     }
-    mbedtls_md_context_t ctx;
-
-    mbedtls_md_init(&ctx);
-    mbedtls_md_setup(&ctx, info, key_len > 0 ? 1 : 0);
 
     uint8_t buff[512];
     int len = 0;
-
-    if (key_len > 0) {
-        mbedtls_md_hmac_starts(&ctx, (const unsigned char*)key, key_len);
-    }
-    else {
-        mbedtls_md_starts(&ctx);
-    }
-
     while (1) {
         len = luat_fs_fread(buff, 1, 512, fd);
         if (len < 1)
             break;
-        if (key_len > 0) {
-            mbedtls_md_hmac_update(&ctx, buff, len);
-        }
-        else {
-            mbedtls_md_update(&ctx, buff, len);
-        }
+        luat_crypto_md_update(&ctx, buff, len);
     }
     luat_fs_fclose(fd);
-
-    int ret = 0;
-    if (key_len > 0) {
-        ret = mbedtls_md_hmac_finish(&ctx, out_ptr);
-    }
-    else {
-        ret = mbedtls_md_finish(&ctx, out_ptr);
-    }
-    mbedtls_md_free(&ctx);
-    if (ret == 0) {
-        return mbedtls_md_get_size(info);
-    }
-    LLOGI("md finish ret %d", ret);
-    return ret;
+    return luat_crypto_md_finish(&ctx, out_ptr);
 }
 
 int luat_crypto_md5_simple(const char* str, size_t str_size, void* out_ptr) {
@@ -13,6 +13,7 @@
 #include "luat_malloc.h"
 
 #include "flashdb.h"
+#include "luat_kv_value.h"
 
 #ifndef LUAT_LOG_TAG
 #define LUAT_LOG_TAG "fdb"
@@ -22,6 +23,8 @@
 static struct fdb_kvdb* kvdb;
 static uint32_t kvdb_inited = 0;
 
+static void fdb_batch_recover(void);
+
 /**
 初始化kv数据库
 @api fdb.kvdb_init(name, partition)
@@ -55,6 +58,7 @@ static int l_fdb_kvdb_init(lua_State *L) {
         }
         else {
             kvdb_inited = 1;
+            fdb_batch_recover();
         }
         lua_pushboolean(L, ret == 0 ? 1 : 0);
     }
@@ -78,6 +82,68 @@ static int l_fdb_kvdb_deinit(lua_State *L) {
     return 1;
 }
 
+// 批量写入时先把全部数据作为一个kv写入, flashdb保证单个kv的完整性.
+// 然后逐个key写入, 最后删掉这个kv. 启动时如果它还在, 说明上次逐个写入时掉电了, 重新写一遍
+#define FDB_BATCH_KEY "__kv_batch"
+
+typedef struct fdb_batch_item {
+    uint8_t key_len;
+    uint8_t reserved;
+    uint16_t len;
+} fdb_batch_item_t;
+
+static int fdb_batch_apply(const uint8_t* data, size_t size) {
+    char key[FDB_KV_NAME_MAX + 1];
+    fdb_batch_item_t item;
+    struct fdb_blob blob = {0};
+    for (size_t off = 0; off + sizeof(item) <= size; ) {
+        memcpy(&item, data + off, sizeof(item));
+        off += sizeof(item);
+        if (item.key_len > FDB_KV_NAME_MAX || off + item.key_len + item.len > size)
+            return -1;
+        memcpy(key, data + off, item.key_len);
+        key[item.key_len] = 0;
+        off += item.key_len;
+        blob.buf = (void*)(data + off);
+        blob.size = item.len;
+        if (fdb_kv_set_blob(kvdb, key, &blob) != FDB_NO_ERR)
+            return -2;
+        off += item.len;
+    }
+    return 0;
+}
+
+static void fdb_batch_recover(void) {
+    struct fdb_kv kv = {0};
+    struct fdb_blob blob = {0};
+    if (fdb_kv_get_obj(kvdb, FDB_BATCH_KEY, &kv) == NULL)
+        return;
+    LLOGI("replay unfinished batch");
+    uint8_t* data = luat_heap_malloc(kv.value_len);
+    if (data == NULL) {
+        LLOGE("out of memory when malloc batch %d", kv.value_len);
+        return;
+    }
+    blob.buf = data;
+    blob.size = kv.value_len;
+    if (fdb_kv_get_blob(kvdb, FDB_BATCH_KEY, &blob) == kv.value_len && fdb_batch_apply(data, kv.value_len) == 0)
+        fdb_kv_del(kvdb, FDB_BATCH_KEY);
+    luat_heap_free(data);
+}
+
+// 与已有的值相同就不需要再写一次
+static int fdb_same_value(const char* key, const char* data, size_t len) {
+    struct fdb_blob blob = {0};
+    char* buff = luat_heap_malloc(len);
+    if (buff == NULL)
+        return 0;
+    blob.buf = buff;
+    blob.size = len;
+    int same = fdb_kv_get_blob(kvdb, key, &blob) == len && blob.saved.len == len && memcmp(buff, data, len) == 0;
+    luat_heap_free(buff);
+    return same;
+}
+
 /**
 设置一对kv数据
 @api fdb.kv_set(key, value)
@@ -97,94 +163,13 @@ static int l_fdb_kv_set(lua_State *L) {
     }
     size_t len;
     struct fdb_blob blob = {0};
-    luaL_Buffer buff;
-    luaL_buffinit(L, &buff);
     const char* key = luaL_checkstring(L, 1);
-    //luaL_addchar(&buff, 0xA5);
-    int type = lua_type(L, 2);
-    switch (type)
-    {
-    case LUA_TBOOLEAN:
-        luaL_addchar(&buff, LUA_TBOOLEAN);
-        bool val = lua_toboolean(L, 2);
-        luaL_addlstring(&buff, (const char*)&val, sizeof(val));
-        break;
-    case LUA_TNUMBER:
-        if (lua_isinteger(L, 2)) {
-            luaL_addchar(&buff, LUA_TINTEGER); // 自定义类型
-            lua_Integer val = luaL_checkinteger(L, 2);
-            luaL_addlstring(&buff, (const char*)&val, sizeof(val));
-        }
-        else {
-            luaL_addchar(&buff, LUA_TNUMBER);
-            lua_getglobal(L, "pack");
-            if (lua_isnil(L, -1)) {
-                LLOGW("float number need pack lib");
-                lua_pushboolean(L, 0);
-                return 1;
-            }
-            lua_getfield(L, -1, "pack");
-            lua_pushstring(L, ">f");
-            lua_pushvalue(L, 2);
-            lua_call(L, 2, 1);
-            if (lua_isstring(L, -1)) {
-                const char* val = luaL_checklstring(L, -1, &len);
-                luaL_addlstring(&buff, val, len);
-            }
-            else {
-                LLOGW("kdb store number fail!!");
-                lua_pushboolean(L, 0);
-                return 1;
-            }
-        }
-        break;
-    case LUA_TSTRING:
-    {
-        luaL_addchar(&buff, LUA_TSTRING);
-        const char* val = luaL_checklstring(L, 2, &len);
-        luaL_addlstring(&buff, val, len);
-        break;
-    }
-    case LUA_TTABLE:
-    {
-        lua_settop(L, 2);
-        lua_getglobal(L, "json");
-        if (lua_isnil(L, -1)) {
-            LLOGW("miss json lib, not support table value");
-            lua_pushboolean(L, 0);
-            return 1;
-        }
-        lua_getfield(L, -1, "encode");
-        if (lua_isfunction(L, -1)) {
-            lua_pushvalue(L, 2);
-            lua_call(L, 1, 1);
-            if (lua_isstring(L, -1)) {
-                luaL_addchar(&buff, LUA_TTABLE);
-                const char* val = luaL_checklstring(L, -1, &len);
-                luaL_addlstring(&buff, val, len);
-            }
-            else {
-                LLOGW("json.encode(val) report error");
-                lua_pushboolean(L, 0);
-                return 1;
-            }
-        }
-        else {
-            LLOGW("miss json.encode, not support table value");
-            lua_pushboolean(L, 0);
-            return 1;
-        }
-        break;
-    }
-    default:
-    {
-        LLOGW("function/userdata/nil/thread isn't allow");
+    if (!luat_kv_pack_value(L, 2, 0)) {
         lua_pushboolean(L, 0);
         return 1;
     }
-    }
-    blob.buf = buff.b;
-    blob.size = buff.n;
+    blob.buf = (void*)lua_tolstring(L, -1, &len);
+    blob.size = len;
     fdb_err_t ret = fdb_kv_set_blob(kvdb, key, &blob);
     lua_pushboolean(L, ret == FDB_NO_ERR ? 1 : 0);
     lua_pushinteger(L, ret);
@@ -285,6 +270,98 @@ static int l_fdb_kv_del(lua_State *L) {
     return 1;
 }
 
+/**
+批量写入一组kv数据, 要么全部生效, 要么全部不生效
+@api fdb.kv_batch(tbl)
+@table 需要写入的键值对, key必须是字符串, value与fdb.kv_set相同
+@return boolean 成功返回true,否则返回false
+@return int 实际写入的条数, 值没有变化的会跳过
+@usage
+-- 多个配置项一起保存, 中途掉电不会只保存了一半
+if fdb.kvdb_init("env", "onchip_fdb") then
+    log.info("fdb", fdb.kv_batch({ssid="luatos", passwd="12345678", retry=3}))
+end
+ */
+static int l_fdb_kv_batch(lua_State *L) {
+    if (kvdb_inited == 0) {
+        LLOGE("call fdb.kvdb_init first!!!");
+        return 0;
+    }
+    luaL_checktype(L, 1, LUA_TTABLE);
+    lua_settop(L, 1);
+    lua_newtable(L); // 2, 值有变化的key -> 编码后的值
+    size_t count = 0;
+    size_t total = 0;
+    lua_pushnil(L);
+    while (lua_next(L, 1)) {
+        size_t key_len, len;
+        if (lua_type(L, -2) != LUA_TSTRING || !luat_kv_pack_value(L, -1, 0)) {
+            lua_pushboolean(L, 0);
+            return 1;
+        }
+        const char* key = lua_tolstring(L, -3, &key_len);
+        const char* data = lua_tolstring(L, -1, &len);
+        if (key_len == 0 || key_len > FDB_KV_NAME_MAX || len > 0xFFFF) {
+            LLOGW("bad key %s or value too big %d", key, len);
+            lua_pushboolean(L, 0);
+            return 1;
+        }
+        if (fdb_same_value(key, data, len)) {
+            lua_pop(L, 2);
+            continue;
+        }
+        lua_setfield(L, 2, key);
+        lua_pop(L, 1);
+        count++;
+        total += sizeof(fdb_batch_item_t) + key_len + len;
+    }
+    if (count == 0) {
+        lua_pushboolean(L, 1);
+        lua_pushinteger(L, 0);
+        return 2;
+    }
+    uint8_t* data = luat_heap_malloc(total);
+    if (data == NULL) {
+        LLOGE("out of memory when malloc batch %d", total);
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+    size_t off = 0;
+    lua_pushnil(L);
+    while (lua_next(L, 2)) {
+        size_t key_len, len;
+        const char* key = lua_tolstring(L, -2, &key_len);
+        const char* value = lua_tolstring(L, -1, &len);
+        fdb_batch_item_t item = {.key_len = key_len, .reserved = 0, .len = len};
+        memcpy(data + off, &item, sizeof(item));
+        off += sizeof(item);
+        memcpy(data + off, key, key_len);
+        off += key_len;
+        memcpy(data + off, value, len);
+        off += len;
+        lua_pop(L, 1);
+    }
+    fdb_err_t ret = FDB_NO_ERR;
+    struct fdb_blob blob = {.buf = data, .size = total};
+    if (count > 1) {
+        // 只有一个key时本身就是完整的, 不需要先写一份
+        ret = fdb_kv_set_blob(kvdb, FDB_BATCH_KEY, &blob);
+    }
+    if (ret == FDB_NO_ERR) {
+        if (fdb_batch_apply(data, total))
+            ret = FDB_WRITE_ERR;
+        else if (count > 1)
+            ret = fdb_kv_del(kvdb, FDB_BATCH_KEY);
+    }
+    else {
+        LLOGW("save batch failed %d, size %d", ret, total);
+    }
+    luat_heap_free(data);
+    lua_pushboolean(L, ret == FDB_NO_ERR ? 1 : 0);
+    lua_pushinteger(L, count);
+    return 2;
+}
+
 /**
 清空整个kv数据库
 @api fdb.kv_clr()
@@ -410,6 +487,7 @@ static const rotable_Reg_t reg_fdb[] =
     { "kv_iter",            ROREG_FUNC(l_fdb_kv_iter)},
     { "kv_next",            ROREG_FUNC(l_fdb_kv_next)},
     { "kv_stat",            ROREG_FUNC(l_fdb_kv_stat)},
+    { "kv_batch",           ROREG_FUNC(l_fdb_kv_batch)},
     { NULL,                 ROREG_INT(0)}
 };
 
@@ -3,15 +3,95 @@
 #include "luat_malloc.h"
 #include "luat_msgbus.h"
 #include "luat_sfd.h"
+#include "crc.h"
 
 #define LUAT_LOG_TAG "fskv"
 #include "luat_log.h"
 
 #include "lfs.h"
 
+#ifndef LUAT_USE_FSKV_LOG
+
 // TODO 应该对接vfs, 而非直接对接lfs
+extern sfd_drv_t* sfd_onchip;
 extern luat_sfd_lfs_t* sfd_lfs;
 
+// 批量写入时先把全部数据写进这个日志文件, 再逐个key写入, 最后删掉日志文件.
+// lfs在close时才提交文件内容, 日志文件只有完整和不存在两种状态.
+// 启动时如果日志文件还在, 说明上次逐个写入的过程中掉电了, 重新写一遍
+#define FSKV_JOURNAL ".fskv_batch"
+#define FSKV_JOURNAL_MAGIC (0x4A564B46) // "FKVJ"
+
+typedef struct fskv_journal_item {
+    uint8_t key_len;
+    uint8_t del;
+    uint16_t reserved;
+    uint32_t len;
+} fskv_journal_item_t;
+
+static int fskv_journal_apply(void) {
+    lfs_file_t fd = {0};
+    if (lfs_file_open(&sfd_lfs->lfs, &fd, FSKV_JOURNAL, LFS_O_RDONLY) != LFS_ERR_OK)
+        return 0;
+    int size = lfs_file_size(&sfd_lfs->lfs, &fd);
+    uint8_t* buff = size > 12 ? luat_heap_malloc(size) : NULL;
+    int ret = -1;
+    if (buff && lfs_file_read(&sfd_lfs->lfs, &fd, buff, size) == size) {
+        uint32_t crc;
+        memcpy(&crc, buff + size - 4, 4);
+        if (*(uint32_t*)buff == FSKV_JOURNAL_MAGIC && crc == ~luat_crc32_update(0xFFFFFFFF, buff, size - 4))
+            ret = 0;
+    }
+    lfs_file_close(&sfd_lfs->lfs, &fd);
+    if (ret == 0) {
+        char key[LUAT_FSKV_KEY_MAX + 1];
+        fskv_journal_item_t item;
+        for (int off = 4; off + sizeof(item) <= size - 4; ) {
+            memcpy(&item, buff + off, sizeof(item));
+            off += sizeof(item);
+            memcpy(key, buff + off, item.key_len);
+            key[item.key_len] = 0;
+            off += item.key_len;
+            if (item.del)
+                luat_fskv_del(key);
+            else if (luat_fskv_set(key, buff + off, item.len) != item.len)
+                ret = -2;
+            off += item.len;
+        }
+    }
+    if (buff)
+        luat_heap_free(buff);
+    // 写到一半的日志文件说明批量写入还没开始, 直接丢弃
+    if (ret != -2)
+        lfs_remove(&sfd_lfs->lfs, FSKV_JOURNAL);
+    return ret;
+}
+
+int luat_fskv_init(void) {
+    struct lfs_info info;
+    if (sfd_lfs == NULL) {
+        if (sfd_onchip == NULL) {
+            luat_sfd_onchip_init();
+        }
+        if (sfd_onchip == NULL) {
+            LLOGE("sfd-onchip init failed");
+            return -1;
+        }
+        if (sfd_lfs == NULL) {
+            luat_sfd_lfs_init(sfd_onchip);
+        }
+        if (sfd_lfs == NULL) {
+            LLOGE("sfd-onchip lfs int failed");
+            return -2;
+        }
+        if (lfs_stat(&sfd_lfs->lfs, FSKV_JOURNAL, &info) == LFS_ERR_OK) {
+            LLOGI("replay unfinished batch");
+            fskv_journal_apply();
+        }
+    }
+    return 0;
+}
+
 int luat_fskv_del(const char* key) {
     lfs_remove(&sfd_lfs->lfs, key);
     return 0;
@@ -123,3 +203,94 @@ int luat_fskv_next(char* buff, size_t offset) {
     lfs_dir_close(&sfd_lfs->lfs, &dir);
     return 0;
 }
+
+static int fskv_journal_write(lfs_file_t* fd, const void* data, size_t len, uint32_t* crc) {
+    *crc = luat_crc32_update(*crc, data, len);
+    return lfs_file_write(&sfd_lfs->lfs, fd, data, len) == (lfs_ssize_t)len ? 0 : -1;
+}
+
+// 与已有的值相同就不需要再写一次
+static int fskv_same_value(const char* key, const void* data, size_t len) {
+    char tmp[256];
+    int size = luat_fskv_size(key, tmp);
+    if (data == NULL)
+        return size <= 0;
+    if (size != len)
+        return 0;
+    if (size > 1 && size < 256)
+        return memcmp(tmp, data, len) == 0;
+    char* buff = luat_heap_malloc(len);
+    int same = buff && luat_fskv_get(key, buff, len) == len && memcmp(buff, data, len) == 0;
+    if (buff)
+        luat_heap_free(buff);
+    return same;
+}
+
+// items[i]之后还有同名的key时返回1
+static int fskv_batch_dup(const luat_fskv_batch_item_t* items, size_t count, size_t i) {
+    for (size_t j = i + 1; j < count; j++) {
+        if (strcmp(items[i].key, items[j].key) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+// 被后面同名key覆盖的, 以及值没有变化的都不需要写, 要先去重再和旧值比较
+static int fskv_batch_skip(const luat_fskv_batch_item_t* items, size_t count, size_t i) {
+    return fskv_batch_dup(items, count, i) || fskv_same_value(items[i].key, items[i].data, items[i].len);
+}
+
+int luat_fskv_batch(const luat_fskv_batch_item_t* items, size_t count) {
+    size_t n = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (!fskv_batch_skip(items, count, i))
+            n++;
+    }
+    if (n == 0)
+        return 0;
+    lfs_file_t fd = {0};
+    if (lfs_file_open(&sfd_lfs->lfs, &fd, FSKV_JOURNAL, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC) != LFS_ERR_OK)
+        return -1;
+    uint32_t crc = 0xFFFFFFFF;
+    uint32_t magic = FSKV_JOURNAL_MAGIC;
+    int ret = fskv_journal_write(&fd, &magic, 4, &crc);
+    for (size_t i = 0; i < count && ret == 0; i++) {
+        size_t key_len = strlen(items[i].key);
+        if (fskv_batch_skip(items, count, i))
+            continue;
+        if (key_len == 0 || key_len > LUAT_FSKV_KEY_MAX || items[i].len > LUAT_FSKV_MAX_SIZE) {
+            ret = -1;
+            break;
+        }
+        fskv_journal_item_t item = {.key_len = key_len, .del = items[i].data == NULL, .len = items[i].data ? items[i].len : 0};
+        ret = fskv_journal_write(&fd, &item, sizeof(item), &crc);
+        if (ret == 0)
+            ret = fskv_journal_write(&fd, items[i].key, key_len, &crc);
+        if (ret == 0 && item.len)
+            ret = fskv_journal_write(&fd, items[i].data, item.len, &crc);
+    }
+    crc = ~crc;
+    if (ret == 0 && lfs_file_write(&sfd_lfs->lfs, &fd, &crc, 4) != 4)
+        ret = -1;
+    if (lfs_file_close(&sfd_lfs->lfs, &fd) != LFS_ERR_OK)
+        ret = -1;
+    if (ret) {
+        lfs_remove(&sfd_lfs->lfs, FSKV_JOURNAL);
+        return -2;
+    }
+    // 日志已经落盘, 后面即使掉电也会在下次启动时补上
+    if (fskv_journal_apply())
+        return -3;
+    return n;
+}
+
+// 每个key一个文件, 由lfs自己管理空间, 不需要额外回收
+int luat_fskv_gc_needed(void) {
+    return 0;
+}
+
+int luat_fskv_gc(void) {
+    return -1;
+}
+
+#endif
@@ -24,7 +24,25 @@
 
 #include "lfs.h"
 
-
+#ifdef LUAT_USE_FSKV_LOG
+// 日志结构的存储方式, 按页追加写入, 页大小需要是擦除大小的整数倍
+#ifndef LUAT_FSKV_PAGE_SIZE
+#define LUAT_FSKV_PAGE_SIZE (8192)
+#endif
+// 写入时的对齐要求, 需要是2的幂
+#ifndef LUAT_FSKV_WRITE_ALIGN
+#define LUAT_FSKV_WRITE_ALIGN (4)
+#endif
+// 给回收保留的空页数量, 正常写入不会用到这些页
+#ifndef LUAT_FSKV_GC_RESERVE
+#define LUAT_FSKV_GC_RESERVE (1)
+#endif
+// value的最大长度, 一条记录不跨页
+#define LUAT_FSKV_MAX_SIZE (LUAT_FSKV_PAGE_SIZE - 128)
+#else
+#define LUAT_FSKV_MAX_SIZE (4096)
+#endif
+#define LUAT_FSKV_KEY_MAX (63)
 
 /**
  * @defgroup luatos_fskv 持久化数据存储接口
@@ -47,10 +65,10 @@ int luat_fskv_del(const char* key);
 
 /**
  * @brief 写入指定key的数据
- * @param key[IN] 待写入的key值,不能为NULL,必须是\0结尾,最大长度64字节
+ * @param key[IN] 待写入的key值,不能为NULL,必须是\0结尾,最大长度63字节
  * @param data[IN] 待写入的数据, 不需要\0结尾
- * @param len[IN] 待写入的数据长度, 不含\0,当前支持最大长度255字节
- * @return int == 0 正常 != 0失败
+ * @param len[IN] 待写入的数据长度, 不含\0,最大长度LUAT_FSKV_MAX_SIZE
+ * @return int 成功返回len, <0失败
  */
 int luat_fskv_set(const char* key, void* data, size_t len);
 
@@ -75,6 +93,32 @@ int luat_fskv_stat(size_t *using_sz, size_t *max_sz, size_t *kv_count);
 
 int luat_fskv_next(char* buff, size_t offset);
 
+typedef struct luat_fskv_batch_item {
+    const char* key;
+    const void* data;   // NULL表示删除这个key
+    size_t len;
+} luat_fskv_batch_item_t;
+
+/**
+ * @brief 批量写入/删除, 要么全部生效, 要么全部不生效(掉电时)
+ * @param items[IN] 待写入的数据, 同一个key出现多次时以最后一个为准
+ * @param count[IN] items的数量
+ * @return int >= 0 实际写入的条数(值没有变化的会跳过), <0失败
+ */
+int luat_fskv_batch(const luat_fskv_batch_item_t* items, size_t count);
+
+/**
+ * @brief 是否需要回收空间, 日志结构的存储方式空页不足时返回1
+ * @return int 1 需要, 0 不需要
+ */
+int luat_fskv_gc_needed(void);
+
+/**
+ * @brief 回收一页空间, 把有效数据搬走后擦除最旧的一页
+ * @return int == 0 正常 != 0失败或者没有可回收的空间
+ */
+int luat_fskv_gc(void);
+
 /**
  * @}
  */
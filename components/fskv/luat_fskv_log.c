@@ -0,0 +1,691 @@
+#include "luat_base.h"
+#include "luat_fskv.h"
+#include "luat_malloc.h"
+#include "luat_sfd.h"
+#include "crc.h"
+#include <stddef.h>
+
+#define LUAT_LOG_TAG "fskv"
+#include "luat_log.h"
+
+#ifdef LUAT_USE_FSKV_LOG
+
+/*
+日志结构的kv存储, 直接使用sfd_onchip的空间, 不经过lfs
+
+1. 空间按页划分, 每页开头是页头(带序号), 后面是依次追加的记录
+2. set/del都是追加一条新记录, 旧记录就成了垃圾, 不需要擦除和改写元数据
+3. 启动时按页序号从旧到新扫描全部记录, 在内存里建立 key -> 记录地址 的hash索引
+4. 空页不足时回收最旧的一页, 把里面仍然有效的记录搬到最新页, 然后擦除.
+   总是回收最旧的页, 所以其中的删除记录可以直接丢弃, 更旧的数据已经不存在了
+5. 每条记录带crc, 写到一半掉电的记录会被忽略, 旧值仍然有效
+6. 批量写入是一条BATCH记录, 它的value就是若干条普通的SET/DEL记录, crc覆盖全部内容,
+   一次写入flash. 扫描时整条BATCH校验通过才会逐条应用, 否则一条都不生效
+*/
+
+#ifndef LUAT_FSKV_AREA_SIZE
+#define LUAT_FSKV_AREA_SIZE LFS_BLOCK_DEVICE_TOTOAL_SIZE
+#endif
+
+#define FSKV_PAGE_MAGIC     (0x564B5346) // "FSKV"
+#define FSKV_REC_MAGIC      (0xA5)
+#define FSKV_REC_SET        (1)
+#define FSKV_REC_DEL        (2)
+#define FSKV_REC_BATCH      (3)
+
+#define FSKV_PAGE_COUNT     (LUAT_FSKV_AREA_SIZE / LUAT_FSKV_PAGE_SIZE)
+#define FSKV_ALIGN(x)       (((x) + LUAT_FSKV_WRITE_ALIGN - 1) & ~(LUAT_FSKV_WRITE_ALIGN - 1))
+#define FSKV_PAGE_BASE(p)   ((uint32_t)(p) * LUAT_FSKV_PAGE_SIZE)
+
+typedef struct fskv_page_hdr {
+    uint32_t magic;
+    uint32_t seq;       // 页序号, 越大越新
+    uint32_t reserved;
+    uint32_t crc;
+} fskv_page_hdr_t;
+
+typedef struct fskv_rec_hdr {
+    uint8_t magic;
+    uint8_t type;
+    uint8_t key_len;
+    uint8_t reserved;
+    uint32_t value_len;
+    uint32_t crc;       // 前8字节 + key + value
+} fskv_rec_hdr_t;
+
+typedef struct fskv_slot {
+    uint32_t hash;
+    uint32_t addr;      // 记录在整个区域内的偏移, 0为空槽(页头占用了0)
+    uint32_t size;      // 记录占用的空间, 含对齐
+} fskv_slot_t;
+
+typedef struct fskv_page {
+    uint32_t seq;       // 0为空页
+    uint32_t used;      // 有效数据的末尾, 含页头
+    uint32_t live;      // 有效记录占用的字节数
+    uint8_t sealed;     // 有损坏的记录, 不能再追加
+} fskv_page_t;
+
+static struct {
+    sfd_drv_t* drv;
+    fskv_slot_t* slots;
+    uint32_t cap;       // 槽数, 2的幂
+    uint32_t count;
+    uint32_t seq;
+    int active;         // 当前追加写入的页, -1表示还没有
+    fskv_page_t pages[FSKV_PAGE_COUNT];
+} kv;
+
+extern sfd_drv_t* sfd_onchip;
+
+static uint32_t fskv_hash(const char* key, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (uint8_t)key[i]) * 16777619u;
+    }
+    return h;
+}
+
+static int fskv_read(uint32_t addr, void* buff, size_t len) {
+    return luat_sfd_read(kv.drv, buff, addr, len) < 0 ? -1 : 0;
+}
+
+static int fskv_write(uint32_t addr, const void* buff, size_t len) {
+    return luat_sfd_write(kv.drv, buff, addr, len) < 0 ? -1 : 0;
+}
+
+static int fskv_erase_page(int page) {
+    for (uint32_t off = 0; off < LUAT_FSKV_PAGE_SIZE; off += LFS_BLOCK_DEVICE_ERASE_SIZE) {
+        if (luat_sfd_erase(kv.drv, FSKV_PAGE_BASE(page) + off, LFS_BLOCK_DEVICE_ERASE_SIZE) < 0)
+            return -1;
+    }
+    memset(&kv.pages[page], 0, sizeof(fskv_page_t));
+    return 0;
+}
+
+static uint32_t fskv_rec_size(size_t key_len, size_t value_len) {
+    return FSKV_ALIGN(sizeof(fskv_rec_hdr_t) + key_len + value_len);
+}
+
+static uint32_t fskv_page_crc(const fskv_page_hdr_t* hdr) {
+    return ~luat_crc32_update(0xFFFFFFFF, hdr, offsetof(fskv_page_hdr_t, crc));
+}
+
+// BATCH记录只跳过头部, 后面紧跟着的就是其中的各条记录
+static uint32_t fskv_rec_step(const fskv_rec_hdr_t* hdr) {
+    if (hdr->type == FSKV_REC_BATCH)
+        return sizeof(fskv_rec_hdr_t);
+    return fskv_rec_size(hdr->key_len, hdr->value_len);
+}
+
+// 校验flash上的一条记录, key和value分段读出来算crc
+static int fskv_rec_check(uint32_t addr, const fskv_rec_hdr_t* hdr) {
+    char tmp[64];
+    uint32_t crc = luat_crc32_update(0xFFFFFFFF, hdr, offsetof(fskv_rec_hdr_t, crc));
+    uint32_t len = hdr->key_len + hdr->value_len;
+    addr += sizeof(fskv_rec_hdr_t);
+    while (len) {
+        uint32_t n = len > sizeof(tmp) ? sizeof(tmp) : len;
+        if (fskv_read(addr, tmp, n))
+            return -1;
+        crc = luat_crc32_update(crc, tmp, n);
+        addr += n;
+        len -= n;
+    }
+    return (~crc == hdr->crc) ? 0 : -1;
+}
+
+//-----------------------------------------------------------------
+// hash索引, 开放寻址, 线性探测
+
+static int fskv_key_equal(uint32_t addr, const char* key, size_t key_len) {
+    struct {
+        fskv_rec_hdr_t hdr;
+        char key[LUAT_FSKV_KEY_MAX];
+    } rec;
+    if (fskv_read(addr, &rec, sizeof(fskv_rec_hdr_t) + key_len))
+        return 0;
+    return rec.hdr.key_len == key_len && memcmp(rec.key, key, key_len) == 0;
+}
+
+static fskv_slot_t* fskv_find(const char* key, size_t key_len, uint32_t hash) {
+    if (kv.cap == 0)
+        return NULL;
+    uint32_t mask = kv.cap - 1;
+    for (uint32_t i = hash & mask; kv.slots[i].addr; i = (i + 1) & mask) {
+        if (kv.slots[i].hash == hash && fskv_key_equal(kv.slots[i].addr, key, key_len))
+            return &kv.slots[i];
+    }
+    return NULL;
+}
+
+static void fskv_place(fskv_slot_t* slots, uint32_t cap, const fskv_slot_t* s) {
+    uint32_t i = s->hash & (cap - 1);
+    while (slots[i].addr)
+        i = (i + 1) & (cap - 1);
+    slots[i] = *s;
+}
+
+static int fskv_insert(uint32_t hash, uint32_t addr, uint32_t size) {
+    // 装载率超过3/4就扩容
+    if ((kv.count + 1) * 4 > kv.cap * 3) {
+        uint32_t cap = kv.cap ? kv.cap * 2 : 32;
+        fskv_slot_t* slots = luat_heap_malloc(cap * sizeof(fskv_slot_t));
+        if (slots == NULL) {
+            LLOGE("out of memory when grow index to %d", cap);
+            return -1;
+        }
+        memset(slots, 0, cap * sizeof(fskv_slot_t));
+        for (uint32_t i = 0; i < kv.cap; i++) {
+            if (kv.slots[i].addr)
+                fskv_place(slots, cap, &kv.slots[i]);
+        }
+        if (kv.slots)
+            luat_heap_free(kv.slots);
+        kv.slots = slots;
+        kv.cap = cap;
+    }
+    fskv_slot_t s = {.hash = hash, .addr = addr, .size = size};
+    fskv_place(kv.slots, kv.cap, &s);
+    kv.count++;
+    return 0;
+}
+
+// 删除后把后面同一探测链上的槽往前挪, 不需要墓碑标记
+static void fskv_remove(fskv_slot_t* s) {
+    uint32_t mask = kv.cap - 1;
+    uint32_t i = s - kv.slots;
+    uint32_t j = i;
+    while (1) {
+        j = (j + 1) & mask;
+        if (kv.slots[j].addr == 0)
+            break;
+        uint32_t k = kv.slots[j].hash & mask;
+        if ((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j))) {
+            kv.slots[i] = kv.slots[j];
+            i = j;
+        }
+    }
+    kv.slots[i].addr = 0;
+    kv.count--;
+}
+
+//-----------------------------------------------------------------
+// 页管理
+
+static int fskv_free_pages(void) {
+    int n = 0;
+    for (int i = 0; i < FSKV_PAGE_COUNT; i++) {
+        if (kv.pages[i].seq == 0)
+            n++;
+    }
+    return n;
+}
+
+static int fskv_oldest_page(void) {
+    int p = -1;
+    for (int i = 0; i < FSKV_PAGE_COUNT; i++) {
+        if (kv.pages[i].seq && i != kv.active && (p < 0 || kv.pages[i].seq < kv.pages[p].seq))
+            p = i;
+    }
+    return p;
+}
+
+static int fskv_page_open(void) {
+    // 从当前页的下一页开始找空页, 各页轮流使用
+    int start = kv.active < 0 ? 0 : kv.active + 1;
+    for (int i = 0; i < FSKV_PAGE_COUNT; i++) {
+        int p = (start + i) % FSKV_PAGE_COUNT;
+        if (kv.pages[p].seq)
+            continue;
+        if (fskv_erase_page(p))
+            return -1;
+        fskv_page_hdr_t hdr = {.magic = FSKV_PAGE_MAGIC, .seq = kv.seq + 1, .reserved = 0xFFFFFFFF};
+        hdr.crc = fskv_page_crc(&hdr);
+        if (fskv_write(FSKV_PAGE_BASE(p), &hdr, sizeof(hdr)))
+            return -1;
+        kv.seq++;
+        kv.pages[p].seq = kv.seq;
+        kv.pages[p].used = sizeof(hdr);
+        kv.active = p;
+        return 0;
+    }
+    return -1;
+}
+
+static int fskv_gc_one(void);
+
+// 确保当前页能放下size字节, 正常写入时留出给回收用的空页
+static int fskv_reserve(uint32_t size, int for_gc) {
+    int gc_round = 0;
+    while (kv.active < 0 || kv.pages[kv.active].sealed || kv.pages[kv.active].used + size > LUAT_FSKV_PAGE_SIZE) {
+        if (for_gc || fskv_free_pages() > LUAT_FSKV_GC_RESERVE) {
+            if (fskv_page_open())
+                return -1;
+        }
+        else if (gc_round++ >= FSKV_PAGE_COUNT || fskv_gc_one()) {
+            LLOGW("no space left");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// 追加一条已经组装好的记录, 返回记录地址, 0为失败
+static uint32_t fskv_append(const void* rec, uint32_t size, int for_gc) {
+    if (fskv_reserve(size, for_gc))
+        return 0;
+    fskv_page_t* page = &kv.pages[kv.active];
+    uint32_t addr = FSKV_PAGE_BASE(kv.active) + page->used;
+    if (fskv_write(addr, rec, size)) {
+        // 写失败的位置状态未知, 这一页不再使用
+        page->sealed = 1;
+        return 0;
+    }
+    page->used += size;
+    return addr;
+}
+
+// 回收最旧的一页
+static int fskv_gc_one(void) {
+    int victim = fskv_oldest_page();
+    if (victim < 0)
+        return -1;
+    fskv_page_t* page = &kv.pages[victim];
+    uint32_t base = FSKV_PAGE_BASE(victim);
+    uint32_t off = sizeof(fskv_page_hdr_t);
+    fskv_rec_hdr_t hdr;
+    char key[LUAT_FSKV_KEY_MAX];
+    while (page->live && off + sizeof(hdr) <= page->used) {
+        if (fskv_read(base + off, &hdr, sizeof(hdr)) || fskv_read(base + off + sizeof(hdr), key, hdr.key_len))
+            return -1;
+        uint32_t size = fskv_rec_size(hdr.key_len, hdr.value_len);
+        if (hdr.type == FSKV_REC_BATCH) {
+            // 里面的记录已经生效, 按普通记录逐条搬走
+            off += fskv_rec_step(&hdr);
+            continue;
+        }
+        fskv_slot_t* s = hdr.type == FSKV_REC_SET ? fskv_find(key, hdr.key_len, fskv_hash(key, hdr.key_len)) : NULL;
+        if (s && s->addr == base + off) {
+            uint8_t* rec = luat_heap_malloc(size);
+            if (rec == NULL)
+                return -1;
+            uint32_t addr = 0;
+            if (fskv_read(base + off, rec, size) == 0)
+                addr = fskv_append(rec, size, 1);
+            luat_heap_free(rec);
+            if (addr == 0)
+                return -1;
+            s->addr = addr;
+            page->live -= size;
+            kv.pages[addr / LUAT_FSKV_PAGE_SIZE].live += size;
+        }
+        off += size;
+    }
+    return fskv_erase_page(victim);
+}
+
+//-----------------------------------------------------------------
+// 启动时扫描
+
+static void fskv_apply(const fskv_rec_hdr_t* hdr, const char* key, uint32_t addr, uint32_t size) {
+    uint32_t hash = fskv_hash(key, hdr->key_len);
+    fskv_slot_t* s = fskv_find(key, hdr->key_len, hash);
+    if (s) {
+        kv.pages[s->addr / LUAT_FSKV_PAGE_SIZE].live -= s->size;
+    }
+    if (hdr->type == FSKV_REC_DEL) {
+        if (s)
+            fskv_remove(s);
+        return;
+    }
+    if (s) {
+        s->addr = addr;
+        s->size = size;
+    }
+    else if (fskv_insert(hash, addr, size)) {
+        return;
+    }
+    kv.pages[addr / LUAT_FSKV_PAGE_SIZE].live += size;
+}
+
+static void fskv_scan_page(int p) {
+    fskv_page_t* page = &kv.pages[p];
+    uint32_t base = FSKV_PAGE_BASE(p);
+    uint32_t off = sizeof(fskv_page_hdr_t);
+    fskv_rec_hdr_t hdr;
+    char key[LUAT_FSKV_KEY_MAX];
+    static const fskv_rec_hdr_t empty = {0xFF, 0xFF, 0xFF, 0xFF, 0xFFFFFFFF, 0xFFFFFFFF};
+    while (off + sizeof(hdr) <= LUAT_FSKV_PAGE_SIZE) {
+        if (fskv_read(base + off, &hdr, sizeof(hdr)))
+            break;
+        if (memcmp(&hdr, &empty, sizeof(hdr)) == 0)
+            break; // 后面都是空的
+        uint32_t size = fskv_rec_size(hdr.key_len, hdr.value_len);
+        int bad = hdr.magic != FSKV_REC_MAGIC || off + size > LUAT_FSKV_PAGE_SIZE;
+        if (!bad && hdr.type == FSKV_REC_BATCH) {
+            // 整批校验, 里面的记录在下一轮循环里逐条应用
+            bad = hdr.key_len != 0 || fskv_rec_check(base + off, &hdr);
+        }
+        else if (!bad) {
+            bad = (hdr.type != FSKV_REC_SET && hdr.type != FSKV_REC_DEL)
+                || hdr.key_len == 0 || hdr.key_len > LUAT_FSKV_KEY_MAX || hdr.value_len > LUAT_FSKV_MAX_SIZE
+                || fskv_rec_check(base + off, &hdr) || fskv_read(base + off + sizeof(hdr), key, hdr.key_len);
+        }
+        if (bad) {
+            // 多半是写到一半掉电了, 这一页后面的内容不再使用
+            LLOGW("page %d bad record at %d, sealed", p, off);
+            page->sealed = 1;
+            break;
+        }
+        if (hdr.type != FSKV_REC_BATCH)
+            fskv_apply(&hdr, key, base + off, size);
+        off += fskv_rec_step(&hdr);
+    }
+    page->used = off;
+}
+
+int luat_fskv_init(void) {
+    if (kv.drv)
+        return 0;
+    if (sfd_onchip == NULL)
+        luat_sfd_onchip_init();
+    if (sfd_onchip == NULL) {
+        LLOGE("sfd-onchip init failed");
+        return -1;
+    }
+    kv.drv = sfd_onchip;
+    kv.active = -1;
+    int order[FSKV_PAGE_COUNT];
+    int n = 0;
+    fskv_page_hdr_t hdr;
+    for (int i = 0; i < FSKV_PAGE_COUNT; i++) {
+        memset(&kv.pages[i], 0, sizeof(fskv_page_t));
+        if (fskv_read(FSKV_PAGE_BASE(i), &hdr, sizeof(hdr)) || hdr.magic != FSKV_PAGE_MAGIC
+            || hdr.seq == 0 || hdr.crc != fskv_page_crc(&hdr))
+            continue; // 空页, 或者是别的数据, 用之前会先擦除
+        kv.pages[i].seq = hdr.seq;
+        // 按序号插入排序, 页数很少
+        int j = n++;
+        while (j > 0 && kv.pages[order[j - 1]].seq > hdr.seq) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+    for (int i = 0; i < n; i++) {
+        fskv_scan_page(order[i]);
+    }
+    if (n) {
+        kv.active = order[n - 1];
+        kv.seq = kv.pages[kv.active].seq;
+    }
+    LLOGD("init ok, %d pages in use, %d keys", n, kv.count);
+    return 0;
+}
+
+//-----------------------------------------------------------------
+// 对外接口
+
+// 已有的值是否与data相同, 相同就不需要再写一次
+static int fskv_same_value(const fskv_slot_t* s, size_t key_len, const void* data, size_t len) {
+    char tmp[64];
+    fskv_rec_hdr_t hdr;
+    if (fskv_read(s->addr, &hdr, sizeof(hdr)) || hdr.value_len != len)
+        return 0;
+    uint32_t addr = s->addr + sizeof(hdr) + key_len;
+    for (size_t off = 0; off < len; off += sizeof(tmp)) {
+        size_t n = (len - off) > sizeof(tmp) ? sizeof(tmp) : (len - off);
+        if (fskv_read(addr + off, tmp, n) || memcmp(tmp, (const char*)data + off, n))
+            return 0;
+    }
+    return 1;
+}
+
+// data可以已经就在rec里了(BATCH记录), 此时不需要复制
+static void fskv_fill(uint8_t* rec, uint8_t type, const char* key, size_t key_len, const void* data, size_t len, uint32_t size) {
+    fskv_rec_hdr_t* hdr = (fskv_rec_hdr_t*)rec;
+    uint8_t* value = rec + sizeof(fskv_rec_hdr_t) + key_len;
+    hdr->magic = FSKV_REC_MAGIC;
+    hdr->type = type;
+    hdr->key_len = key_len;
+    hdr->reserved = 0xFF;
+    hdr->value_len = len;
+    if (key_len)
+        memcpy(rec + sizeof(fskv_rec_hdr_t), key, key_len);
+    if (len && data != value)
+        memcpy(value, data, len);
+    // 对齐填充的部分保持擦除后的状态
+    memset(value + len, 0xFF, size - sizeof(fskv_rec_hdr_t) - key_len - len);
+    uint32_t crc = luat_crc32_update(0xFFFFFFFF, rec, offsetof(fskv_rec_hdr_t, crc));
+    hdr->crc = ~luat_crc32_update(crc, rec + sizeof(fskv_rec_hdr_t), key_len + len);
+}
+
+static uint8_t* fskv_build(uint8_t type, const char* key, size_t key_len, const void* data, size_t len, uint32_t size) {
+    uint8_t* rec = luat_heap_malloc(size);
+    if (rec == NULL) {
+        LLOGE("out of memory when malloc record %d", size);
+        return NULL;
+    }
+    fskv_fill(rec, type, key, key_len, data, len, size);
+    return rec;
+}
+
+int luat_fskv_set(const char* key, void* data, size_t len) {
+    size_t key_len = strlen(key);
+    if (kv.drv == NULL || key_len == 0 || key_len > LUAT_FSKV_KEY_MAX || len > LUAT_FSKV_MAX_SIZE)
+        return -1;
+    uint32_t hash = fskv_hash(key, key_len);
+    fskv_slot_t* s = fskv_find(key, key_len, hash);
+    if (s && fskv_same_value(s, key_len, data, len))
+        return len;
+    uint32_t size = fskv_rec_size(key_len, len);
+    uint8_t* rec = fskv_build(FSKV_REC_SET, key, key_len, data, len, size);
+    if (rec == NULL)
+        return -1;
+    uint32_t addr = fskv_append(rec, size, 0);
+    luat_heap_free(rec);
+    if (addr == 0)
+        return -2;
+    kv.pages[addr / LUAT_FSKV_PAGE_SIZE].live += size;
+    // 追加时可能发生了回收, 旧记录的位置会变, 重新查一次
+    s = fskv_find(key, key_len, hash);
+    if (s) {
+        kv.pages[s->addr / LUAT_FSKV_PAGE_SIZE].live -= s->size;
+        s->addr = addr;
+        s->size = size;
+    }
+    else if (fskv_insert(hash, addr, size)) {
+        return -3;
+    }
+    return len;
+}
+
+int luat_fskv_del(const char* key) {
+    size_t key_len = strlen(key);
+    if (kv.drv == NULL || key_len == 0 || key_len > LUAT_FSKV_KEY_MAX)
+        return -1;
+    uint32_t hash = fskv_hash(key, key_len);
+    if (fskv_find(key, key_len, hash) == NULL)
+        return 0;
+    uint32_t size = fskv_rec_size(key_len, 0);
+    uint8_t* rec = fskv_build(FSKV_REC_DEL, key, key_len, NULL, 0, size);
+    if (rec == NULL)
+        return -1;
+    uint32_t addr = fskv_append(rec, size, 0);
+    luat_heap_free(rec);
+    if (addr == 0)
+        return -2;
+    fskv_slot_t* s = fskv_find(key, key_len, hash);
+    if (s) {
+        kv.pages[s->addr / LUAT_FSKV_PAGE_SIZE].live -= s->size;
+        fskv_remove(s);
+    }
+    return 0;
+}
+
+// 后面还有同一个key时返回1, 批量写入只保留最后一次
+static int fskv_batch_dup(const luat_fskv_batch_item_t* items, size_t count, size_t i) {
+    for (size_t j = i + 1; j < count; j++) {
+        if (strcmp(items[i].key, items[j].key) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+int luat_fskv_batch(const luat_fskv_batch_item_t* items, size_t count) {
+    if (kv.drv == NULL)
+        return -1;
+    // 先算出每条记录的长度, 被后面同名key覆盖的, 值没变的和删除不存在的key记为0, 跳过
+    uint32_t* sizes = luat_heap_malloc(count * sizeof(uint32_t) + 1);
+    if (sizes == NULL)
+        return -1;
+    uint32_t total = sizeof(fskv_rec_hdr_t);
+    size_t n = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t key_len = strlen(items[i].key);
+        sizes[i] = 0;
+        if (key_len == 0 || key_len > LUAT_FSKV_KEY_MAX || items[i].len > LUAT_FSKV_MAX_SIZE) {
+            luat_heap_free(sizes);
+            return -1;
+        }
+        // 先去重再和旧值比较, 否则{k=新值, k=旧值}会因为最后一条没变化而留下新值
+        if (fskv_batch_dup(items, count, i))
+            continue;
+        fskv_slot_t* s = fskv_find(items[i].key, key_len, fskv_hash(items[i].key, key_len));
+        if (items[i].data ? (s && fskv_same_value(s, key_len, items[i].data, items[i].len)) : (s == NULL))
+            continue;
+        sizes[i] = fskv_rec_size(key_len, items[i].data ? items[i].len : 0);
+        total += sizes[i];
+        n++;
+    }
+    if (n == 0 || total > LUAT_FSKV_PAGE_SIZE - sizeof(fskv_page_hdr_t)) {
+        luat_heap_free(sizes);
+        if (n == 0)
+            return 0;
+        LLOGE("batch too big %d, max %d", total, LUAT_FSKV_PAGE_SIZE - sizeof(fskv_page_hdr_t));
+        return -4;
+    }
+    uint8_t* buff = luat_heap_malloc(total);
+    if (buff == NULL) {
+        LLOGE("out of memory when malloc batch %d", total);
+        luat_heap_free(sizes);
+        return -1;
+    }
+    uint32_t off = sizeof(fskv_rec_hdr_t);
+    for (size_t i = 0; i < count; i++) {
+        if (sizes[i] == 0)
+            continue;
+        size_t len = items[i].data ? items[i].len : 0;
+        fskv_fill(buff + off, items[i].data ? FSKV_REC_SET : FSKV_REC_DEL, items[i].key, strlen(items[i].key), items[i].data, len, sizes[i]);
+        off += sizes[i];
+    }
+    luat_heap_free(sizes);
+    // 外层的BATCH记录, crc覆盖里面全部的记录
+    fskv_fill(buff, FSKV_REC_BATCH, NULL, 0, buff + sizeof(fskv_rec_hdr_t), total - sizeof(fskv_rec_hdr_t), total);
+    uint32_t addr = fskv_append(buff, total, 0);
+    if (addr) {
+        // 与启动扫描一样逐条更新索引
+        for (off = sizeof(fskv_rec_hdr_t); off < total; ) {
+            fskv_rec_hdr_t* hdr = (fskv_rec_hdr_t*)(buff + off);
+            uint32_t size = fskv_rec_size(hdr->key_len, hdr->value_len);
+            fskv_apply(hdr, (const char*)(hdr + 1), addr + off, size);
+            off += size;
+        }
+    }
+    luat_heap_free(buff);
+    return addr ? (int)n : -2;
+}
+
+int luat_fskv_get(const char* key, void* data, size_t len) {
+    size_t key_len = strlen(key);
+    if (kv.drv == NULL || key_len == 0 || key_len > LUAT_FSKV_KEY_MAX)
+        return 0;
+    fskv_slot_t* s = fskv_find(key, key_len, fskv_hash(key, key_len));
+    fskv_rec_hdr_t hdr;
+    if (s == NULL || fskv_read(s->addr, &hdr, sizeof(hdr)))
+        return 0;
+    if (len > hdr.value_len)
+        len = hdr.value_len;
+    if (fskv_read(s->addr + sizeof(hdr) + key_len, data, len))
+        return 0;
+    return len;
+}
+
+int luat_fskv_size(const char* key, char buff[4]) {
+    size_t key_len = strlen(key);
+    if (kv.drv == NULL || key_len == 0 || key_len > LUAT_FSKV_KEY_MAX)
+        return 0;
+    fskv_slot_t* s = fskv_find(key, key_len, fskv_hash(key, key_len));
+    fskv_rec_hdr_t hdr;
+    if (s == NULL || fskv_read(s->addr, &hdr, sizeof(hdr)))
+        return 0;
+    // 与lfs方式一致, 小数据顺便读出来
+    if (hdr.value_len > 1 && hdr.value_len < 256) {
+        if (fskv_read(s->addr + sizeof(hdr) + key_len, buff, hdr.value_len))
+            return -2;
+    }
+    return hdr.value_len;
+}
+
+int luat_fskv_clear(void) {
+    if (kv.drv == NULL)
+        return -1;
+    for (int i = 0; i < FSKV_PAGE_COUNT; i++) {
+        if (fskv_erase_page(i)) {
+            LLOGE("fskv clear page %d failed", i);
+            return -1;
+        }
+    }
+    if (kv.slots)
+        luat_heap_free(kv.slots);
+    kv.slots = NULL;
+    kv.cap = 0;
+    kv.count = 0;
+    kv.seq = 0;
+    kv.active = -1;
+    return 0;
+}
+
+int luat_fskv_stat(size_t *using_sz, size_t *max_sz, size_t *kv_count) {
+    size_t live = 0;
+    for (int i = 0; i < FSKV_PAGE_COUNT; i++) {
+        live += kv.pages[i].live;
+    }
+    *using_sz = live;
+    *max_sz = (FSKV_PAGE_COUNT - LUAT_FSKV_GC_RESERVE) * (LUAT_FSKV_PAGE_SIZE - sizeof(fskv_page_hdr_t));
+    *kv_count = kv.count;
+    return 0;
+}
+
+int luat_fskv_next(char* buff, size_t offset) {
+    fskv_rec_hdr_t hdr;
+    for (uint32_t i = 0; i < kv.cap; i++) {
+        if (kv.slots[i].addr == 0)
+            continue;
+        if (offset--)
+            continue;
+        if (fskv_read(kv.slots[i].addr, &hdr, sizeof(hdr))
+            || fskv_read(kv.slots[i].addr + sizeof(hdr), buff, hdr.key_len))
+            return -2;
+        buff[hdr.key_len] = 0;
+        return 0;
+    }
+    return -1;
+}
+
+int luat_fskv_gc_needed(void) {
+    if (kv.drv == NULL || fskv_free_pages() > LUAT_FSKV_GC_RESERVE + 1)
+        return 0;
+    // 最旧的一页里有垃圾才值得回收
+    int p = fskv_oldest_page();
+    return p >= 0 && kv.pages[p].live + sizeof(fskv_page_hdr_t) < kv.pages[p].used;
+}
+
+int luat_fskv_gc(void) {
+    if (kv.drv == NULL)
+        return -1;
+    return fskv_gc_one();
+}
+
+#endif
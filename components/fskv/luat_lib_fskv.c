@@ -18,7 +18,7 @@ log.info("fskv", "wendal", fskv.get("wendal"))
 fskv与fdb的实现机制导致的差异
 
                     fskv          fdb
-1. value长度        4096           255
+1. value长度        4096(日志模式约8K) 255
 2. key长度          63             64
 3. 空间利用率(对比)  较低            较高
 4. 读取速度         恒定           脏数据影响速度,非恒定
@@ -31,6 +31,7 @@ fskv与fdb的实现机制导致的差异
 #include "luat_malloc.h"
 
 #include "luat_fskv.h"
+#include "luat_kv_value.h"
 #include "luat_sfd.h"
 
 #ifndef LUAT_LOG_TAG
@@ -38,10 +39,27 @@ fskv与fdb的实现机制导致的差异
 #include "luat_log.h"
 #endif
 
-#define LUAT_FSKV_MAX_SIZE (4096)
-
 extern sfd_drv_t* sfd_onchip;
-extern luat_sfd_lfs_t* sfd_lfs;
+
+static uint8_t fskv_inited;
+static uint8_t fskv_gc_pending;
+
+// 回收放到消息队列里做, 不占用set/del本身的时间
+static int l_fskv_gc_handler(lua_State *L, void* ptr) {
+    (void)ptr;
+    fskv_gc_pending = 0;
+    if (luat_fskv_gc_needed()) {
+        luat_fskv_gc();
+    }
+    return 0;
+}
+
+static void fskv_gc_check(void) {
+    if (!fskv_gc_pending && luat_fskv_gc_needed()) {
+        rtos_msg_t msg = {.handler = l_fskv_gc_handler};
+        fskv_gc_pending = luat_msgbus_put(&msg, 0) == 0;
+    }
+}
 
 // static char fskv_read_buff[LUAT_FSKV_MAX_SIZE];
 
@@ -59,21 +77,11 @@ end
 -- 写一个main.lua, 执行 fskv.kvdb_init 后 执行 fskv.clear() 即可全清fdb数据.
  */
 static int l_fskvdb_init(lua_State *L) {
-    if (sfd_lfs == NULL) {
-        if (sfd_onchip == NULL) {
-            luat_sfd_onchip_init();
-        }
-        if (sfd_onchip == NULL) {
-            LLOGE("sfd-onchip init failed");
-            return 0;
-        }
-        if (sfd_lfs == NULL) {
-            luat_sfd_lfs_init(sfd_onchip);
-        }
-        if (sfd_lfs == NULL) {
-            LLOGE("sfd-onchip lfs int failed");
+    if (!fskv_inited) {
+        if (luat_fskv_init()) {
             return 0;
         }
+        fskv_inited = 1;
     }
     lua_pushboolean(L, 1);
     return 1;
@@ -83,7 +91,7 @@ static int l_fskvdb_init(lua_State *L) {
 设置一对kv数据
 @api fskv.set(key, value)
 @string key的名称,必填,不能空字符串
-@string 用户数据,必填,不能nil, 支持字符串/数值/table/布尔值, 数据长度最大4095字节
+@string 用户数据,必填,不能nil, 支持字符串/数值/table/布尔值, 数据长度最大4095字节, 启用LUAT_USE_FSKV_LOG时约8K
 @return boolean 成功返回true,否则返回false
 @usage
 -- 设置数据, 字符串,数值,table,布尔值,均可
@@ -94,104 +102,20 @@ log.info("fdb", fskv.set("timer", 1))
 log.info("fdb", fskv.set("bigd", {name="wendal",age=123}))
  */
 static int l_fskv_set(lua_State *L) {
-    if (sfd_lfs == 0) {
+    if (!fskv_inited) {
         LLOGE("call fskv.init() first!!!");
         return 0;
     }
     size_t len;
-    luaL_Buffer buff;
-    luaL_buffinit(L, &buff);
     const char* key = luaL_checkstring(L, 1);
-    //luaL_addchar(&buff, 0xA5);
-    int type = lua_type(L, 2);
-    switch (type)
-    {
-    case LUA_TBOOLEAN:
-        luaL_addchar(&buff, LUA_TBOOLEAN);
-        bool val = lua_toboolean(L, 2);
-        luaL_addlstring(&buff, (const char*)&val, sizeof(val));
-        break;
-    case LUA_TNUMBER:
-        if (lua_isinteger(L, 2)) {
-            luaL_addchar(&buff, LUA_TINTEGER); // 自定义类型
-            lua_Integer val = luaL_checkinteger(L, 2);
-            luaL_addlstring(&buff, (const char*)&val, sizeof(val));
-        }
-        else {
-            luaL_addchar(&buff, LUA_TNUMBER);
-            lua_getglobal(L, "pack");
-            if (lua_isnil(L, -1)) {
-                LLOGW("float number need pack lib");
-                lua_pushboolean(L, 0);
-                return 1;
-            }
-            lua_getfield(L, -1, "pack");
-            lua_pushstring(L, ">f");
-            lua_pushvalue(L, 2);
-            lua_call(L, 2, 1);
-            if (lua_isstring(L, -1)) {
-                const char* val = luaL_checklstring(L, -1, &len);
-                luaL_addlstring(&buff, val, len);
-            }
-            else {
-                LLOGW("kdb store number fail!!");
-                lua_pushboolean(L, 0);
-                return 1;
-            }
-        }
-        break;
-    case LUA_TSTRING:
-    {
-        luaL_addchar(&buff, LUA_TSTRING);
-        const char* val = luaL_checklstring(L, 2, &len);
-        luaL_addlstring(&buff, val, len);
-        break;
-    }
-    case LUA_TTABLE:
-    {
-        lua_settop(L, 2);
-        lua_getglobal(L, "json");
-        if (lua_isnil(L, -1)) {
-            LLOGW("miss json lib, not support table value");
-            lua_pushboolean(L, 0);
-            return 1;
-        }
-        lua_getfield(L, -1, "encode");
-        if (lua_isfunction(L, -1)) {
-            lua_pushvalue(L, 2);
-            lua_call(L, 1, 1);
-            if (lua_isstring(L, -1)) {
-                luaL_addchar(&buff, LUA_TTABLE);
-                const char* val = luaL_checklstring(L, -1, &len);
-                luaL_addlstring(&buff, val, len);
-            }
-            else {
-                LLOGW("json.encode(val) report error");
-                lua_pushboolean(L, 0);
-                return 1;
-            }
-        }
-        else {
-            LLOGW("miss json.encode, not support table value");
-            lua_pushboolean(L, 0);
-            return 1;
-        }
-        break;
-    }
-    default:
-    {
-        LLOGW("function/userdata/nil/thread isn't allow");
-        lua_pushboolean(L, 0);
-        return 1;
-    }
-    }
-    if (buff.n > LUAT_FSKV_MAX_SIZE) {
-        LLOGE("value too big %d max %d", buff.n, LUAT_FSKV_MAX_SIZE);
+    if (!luat_kv_pack_value(L, 2, LUAT_FSKV_MAX_SIZE)) {
         lua_pushboolean(L, 0);
         return 1;
     }
-    int ret = luat_fskv_set(key, buff.b, buff.n);
-    lua_pushboolean(L, ret == buff.n ? 1 : 0);
+    const char* data = lua_tolstring(L, -1, &len);
+    int ret = luat_fskv_set(key, (void*)data, len);
+    fskv_gc_check();
+    lua_pushboolean(L, ret == len ? 1 : 0);
     // lua_pushinteger(L, ret);
     return 1;
 }
@@ -208,7 +132,7 @@ if fskv.init() then
 end
  */
 static int l_fskv_get(lua_State *L) {
-    if (sfd_lfs == NULL) {
+    if (!fskv_inited) {
         LLOGE("call fskv.init() first!!!");
         return 0;
     }
@@ -291,7 +215,7 @@ static int l_fskv_get(lua_State *L) {
 log.info("fdb", fskv.del("wendal"))
  */
 static int l_fskv_del(lua_State *L) {
-    if (sfd_lfs == NULL) {
+    if (!fskv_inited) {
         LLOGE("call fskv.init() first!!!");
         return 0;
     }
@@ -301,10 +225,180 @@ static int l_fskv_del(lua_State *L) {
         return 1;
     }
     int ret = luat_fskv_del(key);
+    fskv_gc_check();
     lua_pushboolean(L, ret == 0 ? 1 : 0);
     return 1;
 }
 
+#define LUAT_FSKV_TX_TYPE "FSKV_TX*"
+
+typedef struct fskv_tx {
+    uint8_t closed;
+} fskv_tx_t;
+
+// 暂存的数据放在tx的uservalue里, key -> 编码后的值, false表示删除
+static int fskv_tx_stage(lua_State *L) {
+    fskv_tx_t* tx = (fskv_tx_t*)luaL_checkudata(L, 1, LUAT_FSKV_TX_TYPE);
+    if (tx->closed) {
+        LLOGE("batch already committed");
+        return 0;
+    }
+    lua_getuservalue(L, 1);
+    return 1;
+}
+
+/*
+在批量写入中设置一对kv数据, 只是暂存在内存里
+@api tx:set(key, value)
+@string key的名称,必填,不能空字符串
+@any 用户数据, 与fskv.set相同
+@return boolean 成功返回true,否则返回false
+*/
+static int l_fskv_tx_set(lua_State *L) {
+    const char* key = luaL_checkstring(L, 2);
+    lua_settop(L, 3);
+    if (!fskv_tx_stage(L) || !luat_kv_pack_value(L, 3, LUAT_FSKV_MAX_SIZE)) {
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+    lua_setfield(L, 4, key);
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+/*
+在批量写入中删除一个key
+@api tx:del(key)
+@string key的名称,必填,不能空字符串
+@return boolean 成功返回true,否则返回false
+*/
+static int l_fskv_tx_del(lua_State *L) {
+    const char* key = luaL_checkstring(L, 2);
+    lua_settop(L, 2);
+    if (!fskv_tx_stage(L)) {
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+    lua_pushboolean(L, 0);
+    lua_setfield(L, 3, key);
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// 把暂存表里的数据一次性写入
+static int fskv_batch_commit(lua_State *L, int stage) {
+    size_t count = 0;
+    lua_pushnil(L);
+    while (lua_next(L, stage)) {
+        count++;
+        lua_pop(L, 1);
+    }
+    if (count == 0) {
+        return 0;
+    }
+    luat_fskv_batch_item_t* items = luat_heap_malloc(count * sizeof(luat_fskv_batch_item_t));
+    if (items == NULL) {
+        LLOGE("out of memory when malloc batch items %d", count);
+        return -1;
+    }
+    size_t i = 0;
+    lua_pushnil(L);
+    // key和value都被暂存表引用着, 提交完之前指针一直有效
+    while (lua_next(L, stage)) {
+        items[i].key = lua_tostring(L, -2);
+        if (lua_isstring(L, -1)) {
+            items[i].data = lua_tolstring(L, -1, &items[i].len);
+        }
+        else {
+            items[i].data = NULL;
+            items[i].len = 0;
+        }
+        i++;
+        lua_pop(L, 1);
+    }
+    int ret = luat_fskv_batch(items, count);
+    luat_heap_free(items);
+    fskv_gc_check();
+    return ret;
+}
+
+/**
+批量写入, 要么全部生效, 要么全部不生效
+@api fskv.batch(func)
+@function/table 传入函数时以tx为参数调用, 在里面调用tx:set(key, value)/tx:del(key);
+ 传入table时把其中全部的键值对写入
+@return boolean 成功返回true,否则返回false
+@return any 成功时返回实际写入的条数, 失败时返回错误信息
+@usage
+-- 多个配置项一起保存, 只写一次flash, 中途掉电不会只保存了一半
+-- 日志结构的存储方式(LUAT_USE_FSKV_LOG)下, 一批数据的总大小不能超过一页(约8K)
+fskv.batch(function(tx)
+    tx:set("ssid", "luatos")
+    tx:set("passwd", "12345678")
+    tx:set("retry", 3)
+    tx:del("tmp")
+    -- return false 则放弃本次写入
+end)
+-- 也可以直接传入table, fdb风格的写法是 fdb.kv_batch(tbl)
+fskv.batch({ssid="luatos", passwd="12345678", retry=3})
+-- 注意: 回调函数里不能调用sys.wait等会挂起的函数
+ */
+static int l_fskv_batch(lua_State *L) {
+    if (!fskv_inited) {
+        LLOGE("call fskv.init() first!!!");
+        return 0;
+    }
+    int type = lua_type(L, 1);
+    if (type != LUA_TFUNCTION && type != LUA_TTABLE) {
+        return luaL_argerror(L, 1, "function or table expected");
+    }
+    lua_settop(L, 1);
+    lua_newtable(L); // 2, 暂存表
+    if (type == LUA_TTABLE) {
+        lua_pushnil(L);
+        while (lua_next(L, 1)) {
+            if (lua_type(L, -2) != LUA_TSTRING || !luat_kv_pack_value(L, -1, LUAT_FSKV_MAX_SIZE)) {
+                lua_pushboolean(L, 0);
+                lua_pushliteral(L, "bad key or value");
+                return 2;
+            }
+            lua_setfield(L, 2, lua_tostring(L, -3));
+            lua_pop(L, 1);
+        }
+    }
+    else {
+        fskv_tx_t* tx = (fskv_tx_t*)lua_newuserdata(L, sizeof(fskv_tx_t)); // 3
+        tx->closed = 0;
+        luaL_setmetatable(L, LUAT_FSKV_TX_TYPE);
+        lua_pushvalue(L, 2);
+        lua_setuservalue(L, 3);
+        lua_pushvalue(L, 1);
+        lua_pushvalue(L, 3);
+        int ret = lua_pcall(L, 1, 1, 0);
+        tx->closed = 1;
+        if (ret != LUA_OK) {
+            LLOGW("batch aborted %s", lua_tostring(L, -1));
+            lua_pushboolean(L, 0);
+            lua_insert(L, -2);
+            return 2;
+        }
+        if (lua_isboolean(L, -1) && !lua_toboolean(L, -1)) {
+            lua_pushboolean(L, 0);
+            lua_pushliteral(L, "cancelled");
+            return 2;
+        }
+    }
+    int ret = fskv_batch_commit(L, 2);
+    if (ret < 0) {
+        lua_pushboolean(L, 0);
+        lua_pushfstring(L, "commit failed %d", ret);
+        return 2;
+    }
+    lua_pushboolean(L, 1);
+    lua_pushinteger(L, ret);
+    return 2;
+}
+
 /**
 清空整个kv数据库
 @api fskv.clear()
@@ -314,7 +408,7 @@ static int l_fskv_del(lua_State *L) {
 fskv.clear()
  */
 static int l_fskv_clr(lua_State *L) {
-    if (sfd_lfs == NULL) {
+    if (!fskv_inited) {
         LLOGE("call fskv.init() first!!!");
         return 0;
     }
@@ -342,7 +436,7 @@ if iter then
 end
  */
 static int l_fskv_iter(lua_State *L) {
-    if (sfd_lfs == 0) {
+    if (!fskv_inited) {
         LLOGE("call fskv.init first!!!");
         return 0;
     }
@@ -396,7 +490,7 @@ static int l_fskv_stat(lua_State *L) {
     size_t using_sz = 0;
     size_t max_sz = 0;
     size_t kv_count = 0;
-    if (sfd_lfs == 0) {
+    if (!fskv_inited) {
         LLOGE("call fskv.init() first!!!");
         return 0;
     }
@@ -407,6 +501,28 @@ static int l_fskv_stat(lua_State *L) {
     return 3;
 }
 
+/*
+获取flash的写入统计, 用于评估写放大和flash寿命
+@api fskv.flash_stat()
+@return int 累计写入次数
+@return int 累计写入字节数
+@return int 累计擦除次数
+@usage
+local pc, pb, ec = fskv.flash_stat()
+fskv.set("counter", 1)
+local pc2, pb2, ec2 = fskv.flash_stat()
+log.info("fskv", "本次写入", pb2 - pb, "字节", "擦除", ec2 - ec, "次")
+*/
+static int l_fskv_flash_stat(lua_State *L) {
+    if (sfd_onchip == NULL) {
+        return 0;
+    }
+    lua_pushinteger(L, sfd_onchip->prog_count);
+    lua_pushinteger(L, sfd_onchip->prog_bytes);
+    lua_pushinteger(L, sfd_onchip->erase_count);
+    return 3;
+}
+
 #include "rotable2.h"
 static const rotable_Reg_t reg_fskv[] =
 {
@@ -420,6 +536,8 @@ static const rotable_Reg_t reg_fskv[] =
     { "status",             ROREG_FUNC(l_fskv_stat)},
     { "iter",               ROREG_FUNC(l_fskv_iter)},
     { "next",               ROREG_FUNC(l_fskv_next)},
+    { "flash_stat",         ROREG_FUNC(l_fskv_flash_stat)},
+    { "batch",              ROREG_FUNC(l_fskv_batch)},
 
     // -- 提供与fdb兼容的API
     { "kvdb_init" ,         ROREG_FUNC(l_fskvdb_init)},
@@ -430,10 +548,22 @@ static const rotable_Reg_t reg_fskv[] =
     { "kv_stat",            ROREG_FUNC(l_fskv_stat)},
     { "kv_iter",            ROREG_FUNC(l_fskv_iter)},
     { "kv_next",            ROREG_FUNC(l_fskv_next)},
+    { "kv_batch",           ROREG_FUNC(l_fskv_batch)},
+    { NULL,                 ROREG_INT(0)}
+};
+
+static const rotable_Reg_t reg_fskv_tx[] =
+{
+    { "set",                ROREG_FUNC(l_fskv_tx_set)},
+    { "del",                ROREG_FUNC(l_fskv_tx_del)},
     { NULL,                 ROREG_INT(0)}
 };
 
 LUAMOD_API int luaopen_fskv( lua_State *L ) {
+    luaL_newmetatable(L, LUAT_FSKV_TX_TYPE);
+    rotable2_newidx(L, reg_fskv_tx);
+    lua_setfield(L, -2, "__index");
+    lua_pop(L, 1);
     luat_newlib2(L, reg_fskv);
     lua_pushvalue(L, -1);
     lua_setglobal(L, "fdb");
@@ -4,6 +4,7 @@
 #include "luat_spi.h"
 #include "luat_malloc.h"
 #include "luat_timer.h"
+#include "luat_msgbus.h"
 
 #define LUAT_LOG_TAG "lcd"
 #include "luat_log.h"
@@ -181,90 +182,402 @@ int luat_lcd_set_color(luat_color_t back, luat_color_t fore){
     return 0;
 }
 
+static uint32_t rect_area(const luat_lcd_rect_t* r) {
+    return (uint32_t)(r->x2 - r->x1 + 1) * (r->y2 - r->y1 + 1);
+}
+
+static void rect_union(luat_lcd_rect_t* out, const luat_lcd_rect_t* a, const luat_lcd_rect_t* b) {
+    out->x1 = a->x1 < b->x1 ? a->x1 : b->x1;
+    out->y1 = a->y1 < b->y1 ? a->y1 : b->y1;
+    out->x2 = a->x2 > b->x2 ? a->x2 : b->x2;
+    out->y2 = a->y2 > b->y2 ? a->y2 : b->y2;
+}
+
+// 合并两个区域后需要额外发送的像素数
+static uint32_t rect_merge_cost(const luat_lcd_rect_t* a, const luat_lcd_rect_t* b) {
+    luat_lcd_rect_t u;
+    uint32_t overlap = 0;
+    rect_union(&u, a, b);
+    int ix1 = a->x1 > b->x1 ? a->x1 : b->x1;
+    int iy1 = a->y1 > b->y1 ? a->y1 : b->y1;
+    int ix2 = a->x2 < b->x2 ? a->x2 : b->x2;
+    int iy2 = a->y2 < b->y2 ? a->y2 : b->y2;
+    if (ix1 <= ix2 && iy1 <= iy2)
+        overlap = (uint32_t)(ix2 - ix1 + 1) * (iy2 - iy1 + 1);
+    return rect_area(&u) - (rect_area(a) + rect_area(b) - overlap);
+}
+
+void luat_lcd_mark_dirty(luat_lcd_conf_t* conf, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2) {
+    luat_lcd_rect_t r = {x1, y1, x2, y2};
+    // 行范围继续维护, 自定义刷新实现可能只用到它
+    if (y1 < conf->flush_y_min)
+        conf->flush_y_min = y1;
+    if (y2 > conf->flush_y_max)
+        conf->flush_y_max = y2;
+    while (1) {
+        int best = -1;
+        uint32_t best_cost = 0;
+        for (size_t i = 0; i < conf->dirty_count; i++) {
+            uint32_t cost = rect_merge_cost(&conf->dirty[i], &r);
+            if (best < 0 || cost < best_cost) {
+                best = i;
+                best_cost = cost;
+            }
+        }
+        if (best >= 0 && (best_cost <= LUAT_LCD_DIRTY_MERGE_PIXELS || conf->dirty_count >= LUAT_LCD_DIRTY_RECTS)) {
+            // 取出被合并的区域, 合并结果可能又与其他区域相邻, 继续尝试
+            rect_union(&r, &conf->dirty[best], &r);
+            conf->dirty[best] = conf->dirty[--conf->dirty_count];
+            continue;
+        }
+        conf->dirty[conf->dirty_count++] = r;
+        return;
+    }
+}
+
+void luat_lcd_clear_dirty(luat_lcd_conf_t* conf) {
+    conf->dirty_count = 0;
+    conf->flush_y_max = 0;
+    conf->flush_y_min = conf->h;
+}
+
+static int lcd_flush_done_handler(lua_State *L, void* ptr) {
+    rtos_msg_t* msg = (rtos_msg_t*)lua_topointer(L, -1);
+    lua_getglobal(L, "sys_pub");
+    if (lua_isfunction(L, -1)) {
+        lua_pushliteral(L, "LCD_FLUSH_DONE");
+        lua_pushboolean(L, msg->arg1 == 0);
+        lua_pushinteger(L, msg->arg2);
+        lua_call(L, 3, 0);
+    }
+    return 0;
+}
+
+// 完成通知总是经过msgbus, 即使是同步完成的, 保证lua侧先执行到sys.waitUntil
+static void lcd_flush_done(luat_lcd_conf_t* conf, int result, uint32_t bytes) {
+    rtos_msg_t msg = {0};
+    msg.handler = lcd_flush_done_handler;
+    msg.ptr = conf;
+    msg.arg1 = result;
+    msg.arg2 = bytes;
+    luat_msgbus_put(&msg, 0);
+}
+
 #ifndef LUAT_USE_LCD_CUSTOM_DRAW
+static void lcd_send_pixels(luat_lcd_conf_t* conf, const luat_color_t* data, size_t size) {
+    if (conf->port == LUAT_LCD_SPI_DEVICE){
+        luat_spi_device_send((luat_spi_device_t*)(conf->lcd_spi_device), (const char*)data, size);
+    }else{
+        luat_spi_send(conf->port, (const char*)data, size);
+    }
+}
+
 int luat_lcd_flush(luat_lcd_conf_t* conf) {
     if (conf->buff == NULL) {
         return 0;
     }
-    //LLOGD("luat_lcd_flush range %d %d", conf->flush_y_min, conf->flush_y_max);
-    if (conf->flush_y_max < conf->flush_y_min) {
+    if (conf->dirty_count == 0) {
         // 没有需要刷新的内容,直接跳过
-        //LLOGD("luat_lcd_flush no need");
         return 0;
     }
-    uint32_t size = conf->w * (conf->flush_y_max - conf->flush_y_min + 1) * 2;
-    luat_lcd_set_address(conf, 0, conf->flush_y_min, conf->w - 1, conf->flush_y_max);
-    const char* tmp = (const char*)(conf->buff + conf->flush_y_min * conf->w);
-	if (conf->port == LUAT_LCD_SPI_DEVICE){
-		luat_spi_device_send((luat_spi_device_t*)(conf->lcd_spi_device), tmp, size);
-	}else{
-		luat_spi_send(conf->port, tmp, size);
-	}
-
+    if (conf->tx_busy) {
+        // 异步发送还在占用总线, 脏区域保留, 等这一帧发完再刷
+        conf->tx_pending = 1;
+        return -1;
+    }
+    uint32_t bytes = 0;
+    for (size_t i = 0; i < conf->dirty_count; i++) {
+        luat_lcd_rect_t* r = &conf->dirty[i];
+        size_t rw = r->x2 - r->x1 + 1;
+        size_t rh = r->y2 - r->y1 + 1;
+        const luat_color_t* tmp = conf->buff + r->x1 + r->y1 * conf->w;
+        luat_lcd_set_address(conf, r->x1, r->y1, r->x2, r->y2);
+        if (rw == conf->w) {
+            // 整行宽度, 内存连续, 一次发完
+            lcd_send_pixels(conf, tmp, rw * rh * sizeof(luat_color_t));
+        }
+        else {
+            for (size_t y = 0; y < rh; y++) {
+                lcd_send_pixels(conf, tmp, rw * sizeof(luat_color_t));
+                tmp += conf->w;
+            }
+        }
+        bytes += rw * rh * sizeof(luat_color_t);
+    }
+    conf->flush_stat.flushes++;
+    conf->flush_stat.windows += conf->dirty_count;
+    conf->flush_stat.bytes += bytes;
+    conf->flush_stat.last_bytes = bytes;
     // 重置为不需要刷新的状态
-    conf->flush_y_max = 0;
-    conf->flush_y_min = conf->h;
-    
+    luat_lcd_clear_dirty(conf);
     return 0;
 }
 
 int luat_lcd_draw(luat_lcd_conf_t* conf, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, luat_color_t* color) {
     // 直接刷屏模式
     if (conf->buff == NULL) {
-        uint32_t size = (x2 - x1 + 1) * (y2 - y1 + 1) * 2;
+        uint32_t size = (x2 - x1 + 1) * (y2 - y1 + 1) * sizeof(luat_color_t);
         luat_lcd_set_address(conf, x1, y1, x2, y2);
-	    if (conf->port == LUAT_LCD_SPI_DEVICE){
-		    luat_spi_device_send((luat_spi_device_t*)(conf->lcd_spi_device), (const char*)color, size);
-	    }else{
-		    luat_spi_send(conf->port, (const char*)color, size);
-	    }
+        lcd_send_pixels(conf, color, size);
         return 0;
     }
     // buff模式
-    if (x1 > conf->w || y1 > conf->h) {
+    if (x1 >= conf->w || y1 >= conf->h) {
         LLOGE("out of lcd range");
         return -1;
     }
-    uint16_t x_end = x2 > conf->w?conf->w:x2;
-    uint16_t y_end = y2 > conf->h?conf->h:y2;
+    uint16_t x_end = x2 >= conf->w ? conf->w - 1 : x2;
+    uint16_t y_end = y2 >= conf->h ? conf->h - 1 : y2;
     luat_color_t* dst = (conf->buff + x1 + conf->w * y1);
     luat_color_t* src = (color);
     size_t lsize = (x_end - x1 + 1);
     for (size_t i = y1; i <= y_end; i++) {
         memcpy(dst, src, lsize * sizeof(luat_color_t));
         dst += conf->w;  // 移动到下一行
-        src += lsize;    // 移动数据
-        if (x2 > conf->w){
-            src+=x2 - conf->w;
-        }
+        src += x2 - x1 + 1; // 源数据按原始宽度排列
     }
     // 存储需要刷新的区域
-    if (y1 < conf->flush_y_min)
-        conf->flush_y_min = y1;
-    if (y_end > conf->flush_y_max)
-        conf->flush_y_max = y_end;
+    luat_lcd_mark_dirty(conf, x1, y1, x_end, y_end);
+    return 0;
+}
+
+static void lcd_async_run(luat_lcd_conf_t* conf);
+
+static void lcd_async_finish(luat_lcd_conf_t* conf, int result) {
+    conf->tx_busy = 0;
+    lcd_flush_done(conf, result, conf->tx_offset * sizeof(luat_color_t));
+    // 发送期间又有新的绘制且开启了自动刷新, 或者有被推迟的同步刷新, 接着发下一帧
+    uint8_t pending = conf->tx_pending;
+    conf->tx_pending = 0;
+    if ((conf->auto_flush || pending) && conf->dirty_count)
+        luat_lcd_flush_async(conf);
+}
+
+static int lcd_async_next_handler(lua_State *L, void* ptr) {
+    rtos_msg_t* msg = (rtos_msg_t*)lua_topointer(L, -1);
+    luat_lcd_conf_t* conf = (luat_lcd_conf_t*)msg->ptr;
+    if (conf->port == LUAT_LCD_SPI_DEVICE) {
+        luat_gpio_set(conf->lcd_spi_device->spi_config.cs, Luat_GPIO_HIGH);
+    }
+    if (msg->arg1) {
+        LLOGW("lcd async flush fail %d", msg->arg1);
+        lcd_async_finish(conf, msg->arg1);
+        return 0;
+    }
+    lcd_async_run(conf);
+    return 0;
+}
+
+// SPI传输完成回调, 可能处于中断上下文, 只投递消息, 下一个窗口的命令在lua线程中发送
+static int32_t lcd_async_cb(void *pdata, void *param) {
+    rtos_msg_t msg = {0};
+    msg.handler = lcd_async_next_handler;
+    msg.ptr = param;
+    msg.arg1 = (uint32_t)(uintptr_t)pdata >> 16;
+    luat_msgbus_put(&msg, 0);
+    return 0;
+}
+
+static int lcd_send_pixels_no_block(luat_lcd_conf_t* conf, const luat_color_t* data, size_t size) {
+    int ret;
+    if (conf->port == LUAT_LCD_SPI_DEVICE) {
+        luat_spi_device_t* dev = conf->lcd_spi_device;
+        luat_spi_device_config(dev);
+        luat_gpio_set(dev->spi_config.cs, Luat_GPIO_LOW);
+        ret = luat_spi_no_block_transfer(dev->bus_id, (uint8_t*)data, NULL, size, lcd_async_cb, conf);
+        if (ret)
+            luat_gpio_set(dev->spi_config.cs, Luat_GPIO_HIGH);
+    }
+    else {
+        ret = luat_spi_no_block_transfer(conf->port, (uint8_t*)data, NULL, size, lcd_async_cb, conf);
+    }
+    return ret;
+}
+
+static void lcd_async_run(luat_lcd_conf_t* conf) {
+    while (conf->tx_index < conf->tx_count) {
+        luat_lcd_rect_t* r = &conf->tx_rects[conf->tx_index];
+        size_t pixels = (size_t)(r->x2 - r->x1 + 1) * (r->y2 - r->y1 + 1);
+        const luat_color_t* data = conf->buff_tx + conf->tx_offset;
+        conf->tx_index++;
+        conf->tx_offset += pixels;
+        luat_lcd_set_address(conf, r->x1, r->y1, r->x2, r->y2);
+        if (lcd_send_pixels_no_block(conf, data, pixels * sizeof(luat_color_t)) == 0)
+            return; // 传输完成后由回调继续
+        // 平台不支持非阻塞传输, 退回同步发送
+        lcd_send_pixels(conf, data, pixels * sizeof(luat_color_t));
+    }
+    lcd_async_finish(conf, 0);
+}
+
+int luat_lcd_flush_async(luat_lcd_conf_t* conf) {
+    if (conf->buff == NULL || conf->buff_tx == NULL) {
+        return -1;
+    }
+    if (conf->tx_busy) {
+        return -1;
+    }
+    size_t total = 0;
+    for (size_t i = 0; i < conf->dirty_count; i++)
+        total += rect_area(&conf->dirty[i]);
+    if (total > conf->w * conf->h) {
+        // 合并后的区域有重叠, 打包后放不下, 改为发送外接矩形
+        for (size_t i = 1; i < conf->dirty_count; i++)
+            rect_union(&conf->dirty[0], &conf->dirty[0], &conf->dirty[i]);
+        conf->dirty_count = 1;
+        total = rect_area(&conf->dirty[0]);
+    }
+    // 各区域按行连续打包到发送缓冲区, 每个窗口只需一次传输
+    luat_color_t* dst = conf->buff_tx;
+    for (size_t i = 0; i < conf->dirty_count; i++) {
+        luat_lcd_rect_t* r = &conf->dirty[i];
+        size_t rw = r->x2 - r->x1 + 1;
+        const luat_color_t* src = conf->buff + r->x1 + r->y1 * conf->w;
+        if (rw == conf->w) {
+            memcpy(dst, src, rect_area(r) * sizeof(luat_color_t));
+            dst += rect_area(r);
+            continue;
+        }
+        for (size_t y = r->y1; y <= r->y2; y++) {
+            memcpy(dst, src, rw * sizeof(luat_color_t));
+            dst += rw;
+            src += conf->w;
+        }
+    }
+    memcpy(conf->tx_rects, conf->dirty, conf->dirty_count * sizeof(luat_lcd_rect_t));
+    conf->tx_count = conf->dirty_count;
+    conf->tx_index = 0;
+    conf->tx_offset = 0;
+    conf->tx_busy = 1;
+    conf->flush_stat.flushes++;
+    conf->flush_stat.windows += conf->tx_count;
+    conf->flush_stat.bytes += total * sizeof(luat_color_t);
+    conf->flush_stat.last_bytes = total * sizeof(luat_color_t);
+    luat_lcd_clear_dirty(conf);
+    lcd_async_run(conf);
+    return 0;
+}
+#else
+// 自定义绘制的平台(如SDL2)自行实现luat_lcd_flush, 这里同步刷新后同样发布完成消息
+int luat_lcd_flush_async(luat_lcd_conf_t* conf) {
+    luat_lcd_flush(conf);
+    lcd_flush_done(conf, 0, 0);
     return 0;
 }
 #endif
 
+// 直接刷屏模式下填充用的颜色缓冲区, 循环发送, 避免每次填充都申请内存
+static luat_color_t fill_burst[LUAT_LCD_FILL_BURST];
+static luat_color_t fill_burst_color;
+static uint8_t fill_burst_ready;
+
+// 用8字节宽度的写入填充n个像素, c为已经swap过的颜色
+static void lcd_fill_pixels(luat_color_t* dst, size_t n, luat_color_t c) {
+    uint64_t pattern = 0;
+    for (size_t i = 0; i < sizeof(uint64_t) / sizeof(luat_color_t); i++)
+        memcpy((uint8_t*)&pattern + i * sizeof(luat_color_t), &c, sizeof(luat_color_t));
+    // 先逐个像素写到8字节对齐
+    while (n && ((uintptr_t)dst & (sizeof(uint64_t) - 1))) {
+        *dst++ = c;
+        n--;
+    }
+    size_t words = n * sizeof(luat_color_t) / sizeof(uint64_t);
+    for (size_t i = 0; i < words; i++)
+        memcpy((uint8_t*)dst + i * sizeof(uint64_t), &pattern, sizeof(uint64_t));
+    dst += words * sizeof(uint64_t) / sizeof(luat_color_t);
+    n -= words * sizeof(uint64_t) / sizeof(luat_color_t);
+    while (n--)
+        *dst++ = c;
+}
+
+static luat_color_t* lcd_fill_burst(luat_color_t c) {
+    if (!fill_burst_ready || fill_burst_color != c) {
+        lcd_fill_pixels(fill_burst, LUAT_LCD_FILL_BURST, c);
+        fill_burst_color = c;
+        fill_burst_ready = 1;
+    }
+    return fill_burst;
+}
+
 int luat_lcd_draw_point(luat_lcd_conf_t* conf, uint16_t x, uint16_t y, luat_color_t color) {
     // 注意, 这里需要把颜色swap了
     luat_color_t tmp = color_swap(color);
+#ifndef LUAT_USE_LCD_CUSTOM_DRAW
+    if (conf->buff) {
+        if (x >= conf->w || y >= conf->h)
+            return -1;
+        conf->buff[x + y * conf->w] = tmp;
+        luat_lcd_mark_dirty(conf, x, y, x, y);
+        return 0;
+    }
+#endif
     return luat_lcd_draw(conf, x, y, x, y, &tmp);
 }
 
 int luat_lcd_clear(luat_lcd_conf_t* conf, luat_color_t color){
-    luat_lcd_draw_fill(conf, 0, 0, conf->w, conf->h, color);
+    luat_lcd_draw_fill(conf, 0, 0, conf->w - 1, conf->h - 1, color);
     return 0;
 }
 
-int luat_lcd_draw_fill(luat_lcd_conf_t* conf,uint16_t x1,uint16_t y1,uint16_t x2,uint16_t y2, luat_color_t color) {          
-	uint16_t i;
-	for(i=y1;i<y2;i++)
-	{
-		luat_lcd_draw_line(conf, x1, i, x2, i, color);
-	}
-    return 0;			  	    
+// 填充矩形区域, 含x2列和y2行, 超出屏幕的部分被裁掉
+int luat_lcd_draw_fill(luat_lcd_conf_t* conf,uint16_t x1,uint16_t y1,uint16_t x2,uint16_t y2, luat_color_t color) {
+    uint16_t t;
+    if (x1 > x2) {t = x1; x1 = x2; x2 = t;}
+    if (y1 > y2) {t = y1; y1 = y2; y2 = t;}
+    if (x1 >= conf->w || y1 >= conf->h)
+        return 0;
+    if (x2 >= conf->w)
+        x2 = conf->w - 1;
+    if (y2 >= conf->h)
+        y2 = conf->h - 1;
+    luat_color_t c = color_swap(color);
+    size_t rw = x2 - x1 + 1;
+#ifndef LUAT_USE_LCD_CUSTOM_DRAW
+    size_t rh = y2 - y1 + 1;
+    if (conf->buff) {
+        luat_color_t* dst = conf->buff + x1 + y1 * conf->w;
+        if (rw == conf->w) {
+            // 整行宽度, 内存连续
+            lcd_fill_pixels(dst, rw * rh, c);
+        }
+        else {
+            // 只填第一行, 其余行复制第一行
+            lcd_fill_pixels(dst, rw, c);
+            for (size_t i = 1; i < rh; i++)
+                memcpy(dst + i * conf->w, dst, rw * sizeof(luat_color_t));
+        }
+        luat_lcd_mark_dirty(conf, x1, y1, x2, y2);
+        return 0;
+    }
+    // 直接刷屏, 只设置一次窗口, 然后循环发送颜色缓冲区
+    luat_color_t* burst = lcd_fill_burst(c);
+    size_t total = rw * rh;
+    luat_lcd_set_address(conf, x1, y1, x2, y2);
+    while (total) {
+        size_t n = total > LUAT_LCD_FILL_BURST ? LUAT_LCD_FILL_BURST : total;
+        lcd_send_pixels(conf, burst, n * sizeof(luat_color_t));
+        total -= n;
+    }
+#else
+    // 自定义绘制的平台只有luat_lcd_draw可用, 按颜色缓冲区的大小分块提交
+    luat_color_t* burst = lcd_fill_burst(c);
+    if (rw <= LUAT_LCD_FILL_BURST) {
+        size_t rows = LUAT_LCD_FILL_BURST / rw;
+        for (size_t y = y1; y <= y2; y += rows) {
+            size_t end = y + rows - 1 > y2 ? y2 : y + rows - 1;
+            luat_lcd_draw(conf, x1, y, x2, end, burst);
+        }
+    }
+    else {
+        for (size_t y = y1; y <= y2; y++) {
+            for (size_t x = x1; x <= x2; x += LUAT_LCD_FILL_BURST) {
+                size_t end = x + LUAT_LCD_FILL_BURST - 1 > x2 ? x2 : x + LUAT_LCD_FILL_BURST - 1;
+                luat_lcd_draw(conf, x, y, end, y, burst);
+            }
+        }
+    }
+#endif
+    return 0;
 }
 
 int luat_lcd_draw_vline(luat_lcd_conf_t* conf, uint16_t x, uint16_t y,uint16_t h, luat_color_t color) {
@@ -279,24 +592,11 @@ int luat_lcd_draw_hline(luat_lcd_conf_t* conf, uint16_t x, uint16_t y,uint16_t w
 
 int luat_lcd_draw_line(luat_lcd_conf_t* conf,uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2,luat_color_t color) {
     uint16_t t;
-    uint32_t i = 0;
     int xerr = 0, yerr = 0, delta_x, delta_y, distance;
     int incx, incy, row, col;
     if (x1 == x2 || y1 == y2) // 直线
     {
-        size_t dots = (x2 - x1 + 1) * (y2 - y1 + 1);//点数量
-        luat_color_t* line_buf = (luat_color_t*) luat_heap_malloc(dots * sizeof(luat_color_t));
-        // 颜色swap
-        luat_color_t tmp = color_swap(color);
-        if (line_buf) {
-            for (i = 0; i < dots; i++)
-            {
-                line_buf[i] = tmp;
-            }
-            luat_lcd_draw(conf, x1, y1, x2, y2, line_buf);
-            luat_heap_free(line_buf);
-            return 0;
-        }
+        return luat_lcd_draw_fill(conf, x1, y1, x2, y2, color);
     }
 
     delta_x = x2 - x1;
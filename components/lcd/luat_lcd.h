@@ -41,8 +41,37 @@
 
 #define LUAT_LCD_SPI_DEVICE 255
 
+// buff模式下最多记录的脏区域数, 超出时合并代价最小的两个区域
+#ifndef LUAT_LCD_DIRTY_RECTS
+#define LUAT_LCD_DIRTY_RECTS (8)
+#endif
+
+// 合并两个区域时允许多发送的像素数, 小于它就合并以节省设置窗口的开销
+#ifndef LUAT_LCD_DIRTY_MERGE_PIXELS
+#define LUAT_LCD_DIRTY_MERGE_PIXELS (256)
+#endif
+
+// 直接刷屏模式下填充使用的静态颜色缓冲区, 单位为像素
+#ifndef LUAT_LCD_FILL_BURST
+#define LUAT_LCD_FILL_BURST (256)
+#endif
+
 struct luat_lcd_opts;
 
+typedef struct luat_lcd_rect {
+    uint16_t x1;
+    uint16_t y1;
+    uint16_t x2;
+    uint16_t y2;
+} luat_lcd_rect_t;
+
+typedef struct luat_lcd_flush_stat {
+    uint32_t flushes;    // 刷新次数
+    uint32_t windows;    // 发送的窗口数
+    uint64_t bytes;      // 累计发送的像素数据字节数
+    uint32_t last_bytes; // 最近一次刷新发送的字节数
+} luat_lcd_flush_stat_t;
+
 typedef struct luat_lcd_conf {
     uint8_t port;
     uint8_t pin_dc;
@@ -69,6 +98,18 @@ typedef struct luat_lcd_conf {
     uint16_t flush_y_min;
     uint16_t flush_y_max;
     uint8_t is_init_done;
+    uint8_t dirty_count;
+    luat_lcd_rect_t dirty[LUAT_LCD_DIRTY_RECTS];
+    luat_lcd_flush_stat_t flush_stat;
+    // 双缓冲异步刷新, 发送缓冲区与buff等大, 传输期间可以继续在buff上绘图
+    luat_color_t* buff_tx;
+    int buff_tx_ref;
+    uint8_t tx_busy;
+    uint8_t tx_pending;     // 发送期间收到的同步刷新请求, 当前帧发完后接着发送
+    uint8_t tx_count;
+    uint8_t tx_index;
+    uint32_t tx_offset;
+    luat_lcd_rect_t tx_rects[LUAT_LCD_DIRTY_RECTS];
 } luat_lcd_conf_t;
 
 typedef struct luat_lcd_opts {
@@ -94,7 +135,15 @@ int luat_lcd_set_address(luat_lcd_conf_t* conf,uint16_t x1, uint16_t y1, uint16_
 int luat_lcd_set_color(luat_color_t back, luat_color_t fore);
 luat_color_t color_swap(luat_color_t color);
 int luat_lcd_draw(luat_lcd_conf_t* conf, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, luat_color_t* color);
+// 双缓冲模式下若上一帧仍在异步发送, 不会抢占总线, 返回-1并在发送完成后自动补刷
 int luat_lcd_flush(luat_lcd_conf_t* conf);
+// buff模式下记录需要刷新的区域, 坐标需已在屏幕范围内
+void luat_lcd_mark_dirty(luat_lcd_conf_t* conf, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2);
+// 丢弃所有待刷新区域
+void luat_lcd_clear_dirty(luat_lcd_conf_t* conf);
+// 双缓冲模式下的异步刷新, 脏区域复制到buff_tx后立即返回, 全部发送完成后发布消息 LCD_FLUSH_DONE
+// 返回0表示已启动, -1表示上一帧仍在发送, 此时脏区域保留到下一次刷新
+int luat_lcd_flush_async(luat_lcd_conf_t* conf);
 int luat_lcd_draw_no_block(luat_lcd_conf_t* conf, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, luat_color_t* color, uint8_t last_flush);
 int luat_lcd_clear(luat_lcd_conf_t* conf,luat_color_t color);
 int luat_lcd_draw_fill(luat_lcd_conf_t* conf,uint16_t x1,uint16_t y1,uint16_t x2,uint16_t y2,luat_color_t color);
@@ -69,6 +69,11 @@ static void lcd_auto_flush(luat_lcd_conf_t *conf) {
   if (conf == NULL || conf->buff == NULL || conf->auto_flush == 0)
     return;
 #endif
+  if (conf && conf->buff_tx) {
+    // 双缓冲模式, 上一帧还在发送时本次的区域会在发送完成后接着刷新
+    luat_lcd_flush_async(conf);
+    return;
+  }
   luat_lcd_flush(conf);
 }
 
@@ -481,7 +486,7 @@ lcd颜色填充
 @int 右下边缘的Y位置.
 @int 绘画颜色 可选参数,默认背景色
 @usage
--- lcd颜色填充
+-- lcd颜色填充, 包含右下边缘所在的行和列
 lcd.fill(20,30,220,30,0x0000)
 */
 static int l_lcd_draw_fill(lua_State* L) {
@@ -634,13 +639,13 @@ static int l_lcd_drawQrcode(lua_State *L)
         int scale = size / qr_size ;
         if (!scale)scale = 1;
         int margin = (size - qr_size * scale) / 2;
-        luat_lcd_draw_fill(default_conf,x,y,x+size,y+size,BACK_COLOR);
+        luat_lcd_draw_fill(default_conf,x,y,x+size-1,y+size-1,BACK_COLOR);
         x+=margin;
         y+=margin;
         for (int j = 0; j < qr_size; j++) {
             for (int i = 0; i < qr_size; i++) {
                 if (qrcodegen_getModule(qrcode, i, j))
-                    luat_lcd_draw_fill(default_conf,x+i*scale,y+j*scale,x+(i+1)*scale,y+(j+1)*scale,FORE_COLOR);
+                    luat_lcd_draw_fill(default_conf,x+i*scale,y+j*scale,x+(i+1)*scale-1,y+(j+1)*scale-1,FORE_COLOR);
             }
         }
     }else{
@@ -1330,10 +1335,14 @@ static int l_lcd_showimage(lua_State *L){
 /*
 主动刷新数据到界面, 仅设置buff且禁用自动属性后使用
 @api lcd.flush()
-@return bool 成功返回true, 否则返回nil/false
+@return bool 成功返回true, 否则返回nil/false. 双缓冲模式下上一帧仍在发送时返回false
 @usgae
 -- 本API与 lcd.setupBuff lcd.autoFlush 配合使用
 lcd.flush()
+-- 双缓冲模式下立即返回, 可以继续绘制下一帧, 发送完成后发布 LCD_FLUSH_DONE
+if lcd.flush() then
+    sys.waitUntil("LCD_FLUSH_DONE", 100)
+end
 */
 static int l_lcd_flush(lua_State* L) {
   luat_lcd_conf_t * conf = NULL;
@@ -1355,20 +1364,27 @@ static int l_lcd_flush(lua_State* L) {
     //LLOGI("lcd auto flush is enable, no need for flush");
     return 0;
   }
+  if (conf->buff_tx) {
+    lua_pushboolean(L, luat_lcd_flush_async(conf) == 0);
+    return 1;
+  }
   luat_lcd_flush(conf);
   lua_pushboolean(L, 1);
-  return 0;
+  return 1;
 }
 
 /*
 设置显示缓冲区, 所需内存大小为 2×宽×高 字节. 请衡量内存需求与业务所需的刷新频次.
-@api lcd.setupBuff(conf, onheap)
+@api lcd.setupBuff(conf, onheap, double)
 @userdata conf指针, 不需要传
 @bool true使用heap内存, false使用vm内存, 默认使用vm内存, 不需要主动传
+@bool 是否启用双缓冲, 默认false. 启用后内存翻倍, lcd.flush()以非阻塞方式发送, 完成后发布 LCD_FLUSH_DONE. 自定义绘制的平台(如SDL2)忽略此参数
 @return bool 是否成功
 @usage
 -- 初始化lcd的buff缓冲区, 可理解为FrameBuffer区域.
 lcd.setupBuff()
+-- 双缓冲, 发送上一帧的同时绘制下一帧
+lcd.setupBuff(nil, true, true)
 */
 static int l_lcd_setup_buff(lua_State* L) {
   luat_lcd_conf_t * conf = NULL;
@@ -1399,15 +1415,58 @@ static int l_lcd_setup_buff(lua_State* L) {
     LLOGE("lcd buff malloc fail, out of memory?");
     return 0;
   }
+#ifndef LUAT_USE_LCD_CUSTOM_DRAW
+  // 自定义绘制的平台自行刷新, 用不到发送缓冲区
+  if (lua_toboolean(L, 3)) {
+    if (lua_isboolean(L, 2) && lua_toboolean(L, 2)) {
+      conf->buff_tx = luat_heap_malloc(sizeof(luat_color_t) * conf->w * conf->h);
+    }
+    else {
+      conf->buff_tx = lua_newuserdata(L, sizeof(luat_color_t) * conf->w * conf->h);
+      if (conf->buff_tx) {
+        conf->buff_tx_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+      }
+    }
+    if (conf->buff_tx == NULL) {
+      LLOGW("lcd tx buff malloc fail, double buffer disabled");
+    }
+  }
+#endif
   // 先设置为不需要的区间
-  conf->flush_y_min = conf->h;
-  conf->flush_y_max = 0;
+  luat_lcd_clear_dirty(conf);
   // luat_lcd_clear 会将区域扩展到整个屏幕
   luat_lcd_clear(default_conf, BACK_COLOR);
   lua_pushboolean(L, 1);
   return 1;
 }
 
+/*
+获取buff模式下的刷新统计, 用于评估局部刷新节省的传输量
+@api lcd.flushStat(reset)
+@bool 读取后是否清零统计, 默认false
+@return int 刷新次数
+@return int 累计发送的像素数据字节数
+@return int 最近一次刷新发送的字节数
+@return int 累计设置的窗口数
+@usage
+local flushes, total, last, windows = lcd.flushStat()
+log.info("lcd", "平均每次刷新", total // flushes, "字节")
+*/
+static int l_lcd_flush_stat(lua_State* L) {
+  luat_lcd_conf_t * conf = default_conf;
+  if (conf == NULL) {
+    return 0;
+  }
+  lua_pushinteger(L, conf->flush_stat.flushes);
+  lua_pushinteger(L, conf->flush_stat.bytes);
+  lua_pushinteger(L, conf->flush_stat.last_bytes);
+  lua_pushinteger(L, conf->flush_stat.windows);
+  if (lua_toboolean(L, 1)) {
+    memset(&conf->flush_stat, 0, sizeof(luat_lcd_flush_stat_t));
+  }
+  return 4;
+}
+
 /*
 设置自动刷新, 需配合lcd.setupBuff使用
 @api lcd.autoFlush(enable)
@@ -1625,6 +1684,7 @@ static const rotable_Reg_t reg_lcd[] =
     { "drawQrcode", ROREG_FUNC(l_lcd_drawQrcode)},
     { "drawStr",    ROREG_FUNC(l_lcd_draw_str)},
     { "flush",      ROREG_FUNC(l_lcd_flush)},
+    { "flushStat",  ROREG_FUNC(l_lcd_flush_stat)},
     { "setupBuff",  ROREG_FUNC(l_lcd_setup_buff)},
     { "autoFlush",  ROREG_FUNC(l_lcd_auto_flush)},
     { "setFont",    ROREG_FUNC(l_lcd_set_font)},
@@ -7,25 +7,123 @@
 #include "luat_malloc.h"
 
 #include "lfs.h"
+#include "lfs_sfd.h"
 
 #define LUAT_LOG_TAG "lfs2"
 #include "luat_log.h"
 
-int lfs_sfd_read(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, void *buffer, lfs_size_t size) {
-    sfd_drv_t *drv = (sfd_drv_t *)c->context;
-    int ret = drv->opts->read(drv, buffer, block*4096+off, size);
+lfs_sfd_ctx_t* lfs_sfd_ctx_create(sfd_drv_t* drv, size_t line_size, size_t line_count) {
+    lfs_sfd_ctx_t* ctx = luat_heap_malloc(sizeof(lfs_sfd_ctx_t));
+    if (ctx == NULL)
+        return NULL;
+    memset(ctx, 0, sizeof(lfs_sfd_ctx_t));
+    ctx->drv = drv;
+    if (line_count > 0 && line_size > 0) {
+        ctx->lines = luat_heap_malloc(sizeof(lfs_sfd_line_t) * line_count);
+        ctx->data = luat_heap_malloc(line_size * line_count);
+        if (ctx->lines == NULL || ctx->data == NULL) {
+            // 内存不够就不要缓存了, 不影响功能
+            LLOGW("no memory for lfs cache %d x %d", line_size, line_count);
+            if (ctx->lines)
+                luat_heap_free(ctx->lines);
+            if (ctx->data)
+                luat_heap_free(ctx->data);
+            ctx->lines = NULL;
+            ctx->data = NULL;
+        }
+        else {
+            memset(ctx->lines, 0, sizeof(lfs_sfd_line_t) * line_count);
+            ctx->line_size = line_size;
+            ctx->line_count = line_count;
+        }
+    }
+    return ctx;
+}
+
+void lfs_sfd_ctx_free(lfs_sfd_ctx_t* ctx) {
+    if (ctx == NULL)
+        return;
+    if (ctx->lines)
+        luat_heap_free(ctx->lines);
+    if (ctx->data)
+        luat_heap_free(ctx->data);
+    luat_heap_free(ctx);
+}
+
+static int sfd_read(sfd_drv_t *drv, void *buffer, size_t addr, size_t size) {
+    int ret = drv->opts->read(drv, buffer, addr, size);
     if (ret >= 0 && size >= ret) return LFS_ERR_OK;
     return LFS_ERR_IO;
 }
 
+// 命中返回对应的行, 否则淘汰最久没用的那一行并从flash读入
+static uint8_t* line_get(lfs_sfd_ctx_t* ctx, uint32_t addr) {
+    lfs_sfd_line_t* victim = &ctx->lines[0];
+    for (size_t i = 0; i < ctx->line_count; i++) {
+        lfs_sfd_line_t* line = &ctx->lines[i];
+        if (line->valid && line->addr == addr) {
+            line->lru = ++ctx->tick;
+            ctx->hit++;
+            return ctx->data + i * ctx->line_size;
+        }
+        if (!line->valid || (victim->valid && line->lru < victim->lru))
+            victim = line;
+    }
+    size_t index = victim - ctx->lines;
+    uint8_t* data = ctx->data + index * ctx->line_size;
+    victim->valid = 0;
+    if (sfd_read(ctx->drv, data, addr, ctx->line_size))
+        return NULL;
+    victim->addr = addr;
+    victim->lru = ++ctx->tick;
+    victim->valid = 1;
+    ctx->miss++;
+    return data;
+}
+
+int lfs_sfd_read(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, void *buffer, lfs_size_t size) {
+    lfs_sfd_ctx_t *ctx = (lfs_sfd_ctx_t *)c->context;
+    uint32_t addr = block * c->block_size + off;
+    // 超过一行的大块读取直接读, 不污染缓存
+    if (ctx->line_count == 0 || size > ctx->line_size)
+        return sfd_read(ctx->drv, buffer, addr, size);
+    uint8_t* dst = buffer;
+    while (size > 0) {
+        uint32_t base = addr - (addr % ctx->line_size);
+        uint32_t n = ctx->line_size - (addr - base);
+        if (n > size)
+            n = size;
+        uint8_t* data = line_get(ctx, base);
+        if (data == NULL)
+            return LFS_ERR_IO;
+        memcpy(dst, data + (addr - base), n);
+        dst += n;
+        addr += n;
+        size -= n;
+    }
+    return LFS_ERR_OK;
+}
+
     // Program a region in a block. The block must have previously
     // been erased. Negative error codes are propogated to the user.
     // May return LFS_ERR_CORRUPT if the block should be considered bad.
 int lfs_sfd_prog(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, const void *buffer, lfs_size_t size) {
-    sfd_drv_t *drv = (sfd_drv_t *)c->context;
-    int ret =  drv->opts->write(drv, buffer, block*4096+off, size);
-    if (ret >= 0 && size >= ret) return LFS_ERR_OK;
-    return LFS_ERR_IO;
+    lfs_sfd_ctx_t *ctx = (lfs_sfd_ctx_t *)c->context;
+    sfd_drv_t *drv = ctx->drv;
+    uint32_t addr = block * c->block_size + off;
+    int ret =  drv->opts->write(drv, buffer, addr, size);
+    if (ret < 0 || size < ret)
+        return LFS_ERR_IO;
+    // 写穿, 同步更新缓存里重叠的部分. lfs只会写已擦除的区域, 所以结果就是写入的数据
+    for (size_t i = 0; i < ctx->line_count; i++) {
+        lfs_sfd_line_t* line = &ctx->lines[i];
+        if (!line->valid || line->addr >= addr + size || line->addr + ctx->line_size <= addr)
+            continue;
+        uint32_t start = line->addr > addr ? line->addr : addr;
+        uint32_t end = line->addr + ctx->line_size < addr + size ? line->addr + ctx->line_size : addr + size;
+        memcpy(ctx->data + i * ctx->line_size + (start - line->addr), (const uint8_t*)buffer + (start - addr), end - start);
+    }
+    return LFS_ERR_OK;
 }
 
     // Erase a block. A block must be erased before being programmed.
@@ -33,8 +131,14 @@ int lfs_sfd_prog(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, c
     // are propogated to the user.
     // May return LFS_ERR_CORRUPT if the block should be considered bad.
 int lfs_sfd_erase(const struct lfs_config *c, lfs_block_t block) {
-    sfd_drv_t *drv = (sfd_drv_t *)c->context;
-    int ret = drv->opts->erase(drv, block*4096, 4096);
+    lfs_sfd_ctx_t *ctx = (lfs_sfd_ctx_t *)c->context;
+    sfd_drv_t *drv = ctx->drv;
+    uint32_t addr = block * c->block_size;
+    for (size_t i = 0; i < ctx->line_count; i++) {
+        if (ctx->lines[i].addr >= addr && ctx->lines[i].addr < addr + c->block_size)
+            ctx->lines[i].valid = 0;
+    }
+    int ret = drv->opts->erase(drv, addr, c->block_size);
     if (ret == 0) return LFS_ERR_OK;
     return LFS_ERR_IO;
 }
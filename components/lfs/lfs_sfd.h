@@ -0,0 +1,40 @@
+#ifndef LFS_SFD_H
+#define LFS_SFD_H
+
+#include "luat_sfd.h"
+#include "lfs.h"
+
+// 多个文件共享的LRU读缓存, 每行大小等于lfs的read_size
+// lfs每个打开的文件有自己的cache, 但元数据和文件块链表的指针这类小读取会被反复执行, 放在这里可以省掉SPI传输
+typedef struct lfs_sfd_line {
+    uint32_t addr;      // 行起始地址, 按行大小对齐
+    uint32_t lru;       // 最近一次使用的序号, 越小越久没用
+    uint8_t valid;
+}lfs_sfd_line_t;
+
+// LRU读缓存最多的行数
+#ifndef LFS_SFD_LRU_MAX
+#define LFS_SFD_LRU_MAX 64
+#endif
+
+typedef struct lfs_sfd_ctx {
+    sfd_drv_t* drv;
+    uint32_t line_size;
+    uint32_t line_count;
+    uint32_t tick;
+    uint32_t hit;
+    uint32_t miss;
+    lfs_sfd_line_t* lines;
+    uint8_t* data;
+}lfs_sfd_ctx_t;
+
+lfs_sfd_ctx_t* lfs_sfd_ctx_create(sfd_drv_t* drv, size_t line_size, size_t line_count);
+void lfs_sfd_ctx_free(lfs_sfd_ctx_t* ctx);
+
+// context必须是lfs_sfd_ctx_create返回的数据
+int lfs_sfd_read(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, void *buffer, lfs_size_t size);
+int lfs_sfd_prog(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, const void *buffer, lfs_size_t size);
+int lfs_sfd_erase(const struct lfs_config *c, lfs_block_t block);
+int lfs_sfd_sync(const struct lfs_config *c);
+
+#endif
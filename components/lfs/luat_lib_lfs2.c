@@ -16,10 +16,7 @@
 extern const struct luat_vfs_filesystem vfs_fs_lfs2;
 #endif
 
-int lfs_sfd_read(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, void *buffer, lfs_size_t size);
-int lfs_sfd_prog(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, const void *buffer, lfs_size_t size);
-int lfs_sfd_erase(const struct lfs_config *c, lfs_block_t block);
-int lfs_sfd_sync(const struct lfs_config *c);
+#include "lfs_sfd.h"
 
 typedef struct lfs2_mount {
     char path[16];
@@ -31,22 +28,99 @@ typedef struct lfs2_mount {
 
 static lfs2_mount_t mounted[2] = {0};
 
+static void lfs2_mount_free(lua_State *L, lfs2_mount_t* m) {
+    struct lfs_config* cfg = m->cfg;
+    if (cfg) {
+        if (cfg->lookahead_buffer)
+            luat_heap_free(cfg->lookahead_buffer);
+        if (cfg->prog_buffer)
+            luat_heap_free(cfg->prog_buffer);
+        if (cfg->read_buffer)
+            luat_heap_free(cfg->read_buffer);
+        lfs_sfd_ctx_free(cfg->context);
+        luat_heap_free(cfg);
+    }
+    if (m->fs)
+        luat_heap_free(m->fs);
+    luaL_unref(L, LUA_REGISTRYINDEX, m->luaref);
+    m->fs = NULL;
+    m->cfg = NULL;
+    m->userdata = NULL;
+}
+
 /**
 挂载lifftefs,当前支持spi flash 和 memory 两种
-@api lfs2.mount(path, drv, formatOnFail)
+@api lfs2.mount(path, drv, formatOnFail, opts)
 @string 挂载路径
 @userdata 挂载所需要的额外数据, 当前仅支持sfd
 @bool 挂载失败时是否尝试格式化,默认为false
+@table 可选的几何及缓存参数, 见usage. 格式化与挂载时必须使用相同的block
+@return bool 成功返回true
 @usage
 local drv = sfd.init(0, 18)
 if drv then
   local fs = lfs2.mount("/sfd", drv, true)
 end
+-- 大文件顺序读写为主时, 加大cache可以减少SPI传输次数, 加大block可以用上64K块擦除
+-- block 擦除块大小, 4096的2的幂倍数, 默认4096
+-- read/prog 最小读/写单位, 默认256
+-- cache 每个打开的文件各自的缓存大小, 默认256, 需要是read/prog的倍数, 且能整除block
+-- lookahead 分配块时的位图大小(字节), 默认16, 需要是8的倍数, 每字节对应8个块
+-- lru 所有文件共享的读缓存行数, 每行read字节, 默认8, 最多64, 0为关闭. 缓存的主要是元数据和文件块链表指针这类小读取
+lfs2.mount("/sfd", drv, true, {block=4096, cache=1024, lookahead=64, lru=8})
 */
 static int l_lfs2_mount(lua_State *L) {
     const char* path = luaL_checkstring(L, 1);
     sfd_drv_t *drv = lua_touserdata(L, 2);
     bool formatOnFail = lua_isboolean(L, 3) ? lua_toboolean(L, 3) : false;
+    if (drv == NULL) {
+        LLOGE("need sfd drv");
+        return 0;
+    }
+    if (strlen(path) >= sizeof(mounted[0].path)) {
+        LLOGE("path too long %s", path);
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+    // 先按有符号数读取, 负数转成size_t会变成很大的值
+    lua_Integer block_size = 4096;
+    lua_Integer read_size = 256;
+    lua_Integer prog_size = 256;
+    lua_Integer cache_size = 256;
+    lua_Integer lookahead_size = 16;
+    lua_Integer lru = 8;
+    if (lua_istable(L, 4)) {
+      lua_getfield(L, 4, "block");
+      block_size = luaL_optinteger(L, -1, block_size);
+      lua_getfield(L, 4, "read");
+      read_size = luaL_optinteger(L, -1, read_size);
+      lua_getfield(L, 4, "prog");
+      prog_size = luaL_optinteger(L, -1, prog_size);
+      lua_getfield(L, 4, "cache");
+      cache_size = luaL_optinteger(L, -1, cache_size);
+      lua_getfield(L, 4, "lookahead");
+      lookahead_size = luaL_optinteger(L, -1, lookahead_size);
+      lua_getfield(L, 4, "lru");
+      lru = luaL_optinteger(L, -1, lru);
+      lua_pop(L, 6);
+    }
+    // 参数不合法时lfs内部会断言失败, 这里先检查, 取模之前必须确认都大于0
+    if (block_size < 4096 || (block_size & (block_size - 1)) || read_size <= 0 || prog_size <= 0
+        || cache_size <= 0 || lookahead_size <= 0 || lru < 0 || lru > LFS_SFD_LRU_MAX
+        || cache_size % read_size || cache_size % prog_size || block_size % cache_size
+        || lookahead_size % 8) {
+        LLOGE("bad geometry block %d read %d prog %d cache %d lookahead %d lru %d",
+              (int)block_size, (int)read_size, (int)prog_size, (int)cache_size, (int)lookahead_size, (int)lru);
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+    // sector_count是按256字节的页计算的, lfs至少需要2个块存放超级块
+    size_t block_count = drv->sector_count * 256 / block_size;
+    if (block_count < 2) {
+        LLOGE("flash too small for block %d", (int)block_size);
+        lua_pushboolean(L, 0);
+        return 1;
+    }
     for (size_t i = 0; i < 2; i++)
     {
         if (mounted[i].userdata == NULL) {
@@ -68,39 +142,35 @@ static int l_lfs2_mount(lua_State *L) {
             cfg->erase = lfs_sfd_erase;
             cfg->sync  = lfs_sfd_sync;
 
-            cfg->read_size = 256;
-            cfg->prog_size = 256;
-            cfg->block_size = 4096;
-            cfg->block_count = drv->sector_count / 16;
+            cfg->read_size = read_size;
+            cfg->prog_size = prog_size;
+            cfg->block_size = block_size;
+            cfg->block_count = block_count;
             cfg->block_cycles = 200;
-            cfg->cache_size = 256;
-            cfg->lookahead_size = 16;
+            cfg->cache_size = cache_size;
+            cfg->lookahead_size = lookahead_size;
 
-            cfg->read_buffer = luat_heap_malloc(256);
-            cfg->prog_buffer = luat_heap_malloc(256);
-            cfg->lookahead_buffer = luat_heap_malloc(256);
+            cfg->read_buffer = luat_heap_malloc(cache_size);
+            cfg->prog_buffer = luat_heap_malloc(cache_size);
+            cfg->lookahead_buffer = luat_heap_malloc(lookahead_size);
             cfg->name_max = 63;
             cfg->file_max = 0;
             cfg->attr_max = 0;
 
-            cfg->context = drv;
+            cfg->context = lfs_sfd_ctx_create(drv, read_size, lru);
 
-            int ret = lfs_mount(mounted[i].fs, cfg);
-            LLOGW("lfs_mount ret %d", ret);
-            if (ret < 0 && formatOnFail) {
-              if (lfs_format(mounted[i].fs, cfg) == 0) {
-                ret = lfs_mount(mounted[i].fs, cfg);
+            int ret = LFS_ERR_NOMEM;
+            if (cfg->context && cfg->read_buffer && cfg->prog_buffer && cfg->lookahead_buffer) {
+              ret = lfs_mount(mounted[i].fs, cfg);
+              LLOGW("lfs_mount ret %d", ret);
+              if (ret < 0 && formatOnFail) {
+                if (lfs_format(mounted[i].fs, cfg) == 0) {
+                  ret = lfs_mount(mounted[i].fs, cfg);
+                }
               }
             }
             if (ret < 0) {
-                luat_heap_free(cfg->lookahead_buffer);
-                luat_heap_free(cfg->prog_buffer);
-                luat_heap_free(cfg->read_buffer);
-                luat_heap_free(cfg);
-                luat_heap_free(mounted[i].fs);
-                mounted[i].fs = NULL;
-                mounted[i].cfg = NULL;
-                mounted[i].userdata = NULL;
+                lfs2_mount_free(L, &mounted[i]);
             }
             else {
               #ifdef LUAT_USE_FS_VFS
@@ -124,6 +194,67 @@ static int l_lfs2_mount(lua_State *L) {
     return 0;
 }
 
+/**
+取消挂载
+@api lfs2.unmount(path)
+@string 挂载路径, 与lfs2.mount时一致
+@return bool 成功返回true, 挂载路径下还有未关闭的文件时返回false且不卸载
+@usage
+lfs2.unmount("/sfd")
+*/
+static int l_lfs2_unmount(lua_State *L) {
+  const char* path = luaL_checkstring(L, 1);
+  for (size_t i = 0; i < 2; i++) {
+    if (mounted[i].userdata == NULL)
+      continue;
+    if (!strcmp(mounted[i].path, path)) {
+      #ifdef LUAT_USE_FS_VFS
+      luat_fs_conf_t conf2 = {
+        .busname = (char*)mounted[i].fs,
+        .type = "lfs2",
+        .filesystem = "lfs2",
+        .mount_point = mounted[i].path,
+      };
+      if (luat_fs_umount(&conf2) == -3) {
+        // 还有文件没关闭, 保持挂载
+        lua_pushboolean(L, 0);
+        return 1;
+      }
+      #endif
+      int ret = lfs_unmount(mounted[i].fs);
+      lfs2_mount_free(L, &mounted[i]);
+      lua_pushboolean(L, ret == 0 ? 1 : 0);
+      return 1;
+    }
+  }
+  LLOGW("not path match, ignore unmount");
+  return 0;
+}
+
+/**
+共享读缓存的命中统计
+@api lfs2.cache_stat(path)
+@string 挂载路径
+@return int 命中次数
+@return int 未命中次数
+@usage
+log.info("lfs2", "cache", lfs2.cache_stat("/sfd"))
+*/
+static int l_lfs2_cache_stat(lua_State *L) {
+  const char* path = luaL_checkstring(L, 1);
+  for (size_t i = 0; i < 2; i++) {
+    if (mounted[i].userdata == NULL)
+      continue;
+    if (!strcmp(mounted[i].path, path)) {
+      lfs_sfd_ctx_t* ctx = mounted[i].cfg->context;
+      lua_pushinteger(L, ctx->hit);
+      lua_pushinteger(L, ctx->miss);
+      return 2;
+    }
+  }
+  return 0;
+}
+
 /**
 格式化为lifftefs
 @api lfs2.mount(path)
@@ -158,7 +289,8 @@ static int l_lfs2_mkfs(lua_State *L) {
 static const rotable_Reg_t reg_lfs2[] =
 { 
   { "mount",	ROREG_FUNC(l_lfs2_mount)}, //初始化,挂载
-//   { "unmount",	ROREG_FUNC(l_lfs2_unmount)}, // 取消挂载
+  { "unmount",	ROREG_FUNC(l_lfs2_unmount)}, // 取消挂载
+  { "cache_stat",	ROREG_FUNC(l_lfs2_cache_stat)},
   { "mkfs",		ROREG_FUNC(l_lfs2_mkfs)}, // 格式化!!!
   { NULL,		  ROREG_INT(0)}
 };
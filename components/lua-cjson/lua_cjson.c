@@ -59,10 +59,20 @@
 
 #define LUAT_LOG_TAG "json"
 #include "luat_log.h"
+#include "luat_zbuff.h"
+
+/* 编码/解码用的缓冲区在调用之间保留, 超过这个大小时用完即释放, 避免长期占用内存 */
+#ifndef LUAT_JSON_KEEP_BUFFER
+#define LUAT_JSON_KEEP_BUFFER (4096)
+#endif
+
+static strbuf_t encode_buf;
+static strbuf_t decode_buf;
 
 //#include <lrodefs.h>
 //#include <auxmods.h>
 
+// 用户指定的浮点数格式, 为空字符串时输出最短可往返形式
 static char float_fmt[12];
 
 #ifdef WIN32
@@ -596,12 +606,12 @@ static void json_append_number(lua_State *l,
     strbuf_ensure_empty_length(json, FPCONV_G_FMT_BUFSIZE);
     if (json->is_err)
         return;
+    // 整数和默认模式的浮点数与tostring共用luat_dtoa, 浮点数输出能还原原值的最短形式
     if (lua_isinteger(l, lindex)) {
-        #ifdef LUAT_CONF_VM_64bit
-        len = snprintf_(strbuf_empty_ptr(json), FPCONV_G_FMT_BUFSIZE, "%lld", lua_tointeger(l, lindex));
-        #else
-        len = snprintf_(strbuf_empty_ptr(json), FPCONV_G_FMT_BUFSIZE, "%ld", lua_tointeger(l, lindex));
-        #endif
+        len = lua_integer2str(strbuf_empty_ptr(json), FPCONV_G_FMT_BUFSIZE, lua_tointeger(l, lindex));
+    }
+    else if (float_fmt[0] == 0) {
+        len = lua_number2str(strbuf_empty_ptr(json), FPCONV_G_FMT_BUFSIZE, lua_tonumber(l, lindex));
     }
     else {
         len = snprintf_(strbuf_empty_ptr(json), FPCONV_G_FMT_BUFSIZE, float_fmt, lua_tonumber(l, lindex));
@@ -703,38 +713,69 @@ static void json_append_data(lua_State *l,
     }
 }
 
+/* 保留的缓冲区过大时释放 */
+static void json_release_buf(strbuf_t *buf)
+{
+    if (strbuf_allocated(buf) && buf->size > LUAT_JSON_KEEP_BUFFER)
+        strbuf_free(buf);
+}
+
 static int json_encode(lua_State *l)
 {
     //json_config_t *cfg = json_fetch_config(l);
-    strbuf_t local_encode_buf;
-    strbuf_t *encode_buf;
+    luat_zbuff_t *zbuff = NULL;
+    strbuf_t zbuff_buf;
     char *json;
     int len;
     int ret;
 
-    luaL_argcheck(l, lua_gettop(l) == 1, 1, "expected 1 argument");
+    luaL_argcheck(l, lua_gettop(l) <= 2, 1, "expected 1 argument");
+    if (lua_gettop(l) == 2) {
+        zbuff = (luat_zbuff_t *)luaL_checkudata(l, 2, LUAT_ZBUFF_TYPE);
+        luat_zbuff_check_linear(l, zbuff, 2);
+        lua_settop(l, 1);
+    }
 
+    if (zbuff) {
+        /* 直接追加到zbuff已有数据之后, 空间不足时扩大zbuff */
+        size_t start = zbuff->used;
+        strbuf_attach_zbuff(&zbuff_buf, zbuff);
+        json_append_data(l, 0, &zbuff_buf);
+        if (zbuff_buf.is_err) {
+            LLOGE("json encode failed by memory less");
+            lua_pushnil(l);
+        }
+        else {
+            zbuff->used = strbuf_length(&zbuff_buf);
+            lua_pushinteger(l, zbuff->used - start);
+        }
+        strbuf_free(&zbuff_buf);
+        return 1;
+    }
 
-    encode_buf = &local_encode_buf;
-    ret = strbuf_init(encode_buf, 0);
-    if (ret) {
-        LLOGE("json encode out of memory!!!");
-        return 0;
+    if (!strbuf_allocated(&encode_buf)) {
+        ret = strbuf_init(&encode_buf, 0);
+        if (ret) {
+            LLOGE("json encode out of memory!!!");
+            return 0;
+        }
     }
+    strbuf_reset(&encode_buf);
+    encode_buf.is_err = 0;
 
-    json_append_data(l, 0, encode_buf);
+    json_append_data(l, 0, &encode_buf);
 
     // check if err
-    if (local_encode_buf.is_err) {
+    if (encode_buf.is_err) {
         LLOGE("json encode failed by memory less");
         lua_pushnil(l);
     }
     else {
-        json = strbuf_string(encode_buf, &len);
+        json = strbuf_string(&encode_buf, &len);
         lua_pushlstring(l, json, len);
     }
 
-    strbuf_free(encode_buf);
+    json_release_buf(&encode_buf);
 
     return 1;
 }
@@ -1297,10 +1338,19 @@ static int json_decode(lua_State *l)
     json_token_t token;
     size_t json_len;
 
-    luaL_argcheck(l, lua_gettop(l) == 1, 1, "expected 1 argument");
+    luaL_argcheck(l, lua_gettop(l) >= 1, 1, "expected 1 argument");
 
     //json.cfg = json_fetch_config(l);
-    json.data = luaL_checklstring(l, 1, &json_len);
+    if (lua_isuserdata(l, 1)) {
+        /* 范围由调用者检查过, 并且末尾已临时写入了'\0' */
+        luat_zbuff_t *zbuff = (luat_zbuff_t *)luaL_checkudata(l, 1, LUAT_ZBUFF_TYPE);
+        luat_zbuff_check_linear(l, zbuff, 1);
+        json.data = (const char *)zbuff->addr + luaL_checkinteger(l, 2);
+        json_len = luaL_checkinteger(l, 3);
+    }
+    else {
+        json.data = luaL_checklstring(l, 1, &json_len);
+    }
     json.current_depth = 0;
     json.ptr = json.data;
 
@@ -1315,11 +1365,19 @@ static int json_decode(lua_State *l)
     /* Ensure the temporary buffer can hold the entire string.
      * This means we no longer need to do length checks since the decoded
      * string must be smaller than the entire json string */
-    json.tmp = strbuf_new(json_len);
-    if (json.tmp == NULL) {
+    if (!strbuf_allocated(&decode_buf) && strbuf_init(&decode_buf, json_len)) {
+        LLOGE("json decode out of memory!");
+        return 0;
+    }
+    strbuf_reset(&decode_buf);
+    decode_buf.is_err = 0;
+    strbuf_ensure_empty_length(&decode_buf, json_len);
+    if (decode_buf.is_err) {
+        strbuf_free(&decode_buf);
         LLOGE("json decode out of memory!");
         return 0;
     }
+    json.tmp = &decode_buf;
 
     json_next_token(&json, &token);
     json_process_value(l, &json, &token);
@@ -1331,7 +1389,7 @@ static int json_decode(lua_State *l)
     if (token.type != T_END)
         json_throw_parse_error(l, &json, "the end", &token);
 
-    strbuf_free(json.tmp);
+    json_release_buf(json.tmp);
 
     return 1;
 }
@@ -1388,14 +1446,19 @@ static int json_protect_conversion(lua_State *l)
 
 /*
 将对象序列化为json字符串
-@api json.encode(obj,t)
+@api json.encode(obj,t,buff)
 @obj 需要序列化的对象
-@string 浮点数精度和模式,这项不存在的时候,为默认值"7g",数字只支持"0~14",模式只支持"f/g"
-@return string 序列化后的json字符串, 失败的话返回nil
+@string 浮点数精度和模式,数字只支持"0~14",模式只支持"f/g". 这项不存在的时候,浮点数输出能精确还原原值的最短形式,与tostring一致
+@zbuff 可选, 直接追加写入到该zbuff的used之后, 空间不足时自动扩大, 不再生成字符串. 也可以作为第2个参数传入
+@return string 序列化后的json字符串, 失败的话返回nil. 传入zbuff时返回写入的字节数
 @return string 序列化失败的报错信息
 @usage
-json.encode(obj)-->浮点数用%.7g的方式转换为字符串
+json.encode(obj)-->浮点数输出最短形式, 例如 0.1 得到 0.1, 1/3 得到 0.3333333333333333(64位固件)
 json.encode(obj,"12f")-->浮点数用%.12f的方式转换为字符串
+-- 直接写入zbuff, 适合频繁上报的大报文, 省去中间字符串
+local buff = zbuff.create(1024)
+local len = json.encode(obj, buff)
+mqttc:publish(topic, buff)
 */
 static int l_json_encode_safe(lua_State *L) {
     // int top = lua_gettop(L);
@@ -1404,7 +1467,7 @@ static int l_json_encode_safe(lua_State *L) {
         lua_pushliteral(L, "obj is nil");
         return 1;
     }
-    memcpy(float_fmt, "%.7g", strlen("%.7g") + 1);
+    float_fmt[0] = 0;
     size_t len = 0;
 	int prec = 0;
     char buff[6] = {0};
@@ -1416,14 +1479,23 @@ static int l_json_encode_safe(lua_State *L) {
                 memcpy(float_fmt, mode, len + 1);
             }
             else {
+                float_fmt[0] = '%';
+                float_fmt[1] = '.';
                 memcpy(float_fmt + 2, mode, len + 1);
             }
         }
     }
     //LLOGD("float_fmt [%s]", float_fmt);
+    int zbuff_index = 0;
+    if (luaL_testudata(L, 2, LUAT_ZBUFF_TYPE))
+        zbuff_index = 2;
+    else if (luaL_testudata(L, 3, LUAT_ZBUFF_TYPE))
+        zbuff_index = 3;
     lua_pushcfunction(L, json_encode);
     lua_pushvalue(L, 1);
-    int status = lua_pcall(L, 1, 1, 0);
+    if (zbuff_index)
+        lua_pushvalue(L, zbuff_index);
+    int status = lua_pcall(L, zbuff_index ? 2 : 1, 1, 0);
     if (status != LUA_OK) {
         const char* err = lua_tostring(L, -1);
         lua_pushnil(L);
@@ -1435,19 +1507,56 @@ static int l_json_encode_safe(lua_State *L) {
 
 /*
 将字符串反序列化为对象
-@api json.decode(str)
-@string 需要反序列化的json字符串
+@api json.decode(str, offset, len)
+@string 需要反序列化的json字符串, 也可以是zbuff
+@int 数据为zbuff时的起始位置, 默认0
+@int 数据为zbuff时的长度, 默认到zbuff的used为止
 @return obj 反序列化后的对象(通常是table), 失败的话返回nil
 @return result 成功返回1,否则返回0
 @return err 反序列化失败的报错信息
 @usage
 json.decode("[1,2,3,4,5,6]")
+-- 直接解析zbuff中的数据, 不需要先转成字符串
+local obj = json.decode(buff)
+local obj = json.decode(buff, 4, 100)
 */
 static int l_json_decode_safe(lua_State *L) {
     int top = lua_gettop(L);
-    lua_pushcfunction(L, json_decode);
-    lua_insert(L, 1);
-    int status = lua_pcall(L, top, 1, 0);
+    int status;
+    luat_zbuff_t *zbuff = (luat_zbuff_t *)luaL_testudata(L, 1, LUAT_ZBUFF_TYPE);
+    if (zbuff) {
+        luat_zbuff_check_linear(L, zbuff, 1);
+        size_t offset = luaL_optinteger(L, 2, 0);
+        size_t len = luaL_optinteger(L, 3, zbuff->used > offset ? zbuff->used - offset : 0);
+        if (offset > zbuff->used || len > zbuff->used - offset) {
+            lua_pushnil(L);
+            lua_pushboolean(L, 0);
+            lua_pushliteral(L, "out of zbuff range");
+            return 3;
+        }
+        /* 解析器依赖结尾的'\0', 临时写入, 解析完成后恢复原来的字节 */
+        if (offset + len >= zbuff->len && __zbuff_resize(zbuff, offset + len + 1)) {
+            lua_pushnil(L);
+            lua_pushboolean(L, 0);
+            lua_pushliteral(L, "out of memory");
+            return 3;
+        }
+        uint8_t *end = zbuff->addr + offset + len;
+        uint8_t saved = *end;
+        *end = 0;
+        lua_settop(L, 1);
+        lua_pushcfunction(L, json_decode);
+        lua_insert(L, 1);
+        lua_pushinteger(L, offset);
+        lua_pushinteger(L, len);
+        status = lua_pcall(L, 3, 1, 0);
+        *end = saved;
+    }
+    else {
+        lua_pushcfunction(L, json_decode);
+        lua_insert(L, 1);
+        status = lua_pcall(L, top, 1, 0);
+    }
     if (status != LUA_OK) {
         const char *msg = lua_tostring(L, -1);
         lua_pushnil(L);
@@ -1529,7 +1638,7 @@ static int lua_cjson_new(lua_State *l)
 
 int luaopen_cjson(lua_State *l)
 {
-    memcpy(float_fmt, "%.7g", strlen("%.7g") + 1);
+    float_fmt[0] = 0;
     lua_cjson_new(l);
 
 // #ifdef ENABLE_CJSON_GLOBAL
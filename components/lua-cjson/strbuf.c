@@ -30,6 +30,7 @@
 
 #include "luat_base.h"
 #include "luat_malloc.h"
+#include "luat_zbuff.h"
 
 #define LUAT_LOG_TAG "cjson"
 #include "luat_log.h"
@@ -57,6 +58,7 @@ int strbuf_init(strbuf_t *s, int len)
     s->increment = STRBUF_DEFAULT_INCREMENT;
     s->dynamic = 0;
     s->is_err = 0;
+    s->zbuff = NULL;
     // s->reallocs = 0;
     // s->debug = 0;
 
@@ -95,6 +97,13 @@ void strbuf_free(strbuf_t *s)
 {
     // debug_stats(s);
 
+    if (s->zbuff) {
+        /* 内存属于zbuff, 扩容时已经同步过了 */
+        s->buf = NULL;
+        s->zbuff = NULL;
+        return;
+    }
+
     if (s->buf) {
         L_FREE (s->buf);
         s->buf = NULL;
@@ -145,9 +154,25 @@ void strbuf_resize(strbuf_t *s, int len)
     else {
         s->size = newsize;
         s->buf = ptr;
+        if (s->zbuff) {
+            ((luat_zbuff_t *)s->zbuff)->addr = ptr;
+            ((luat_zbuff_t *)s->zbuff)->len = newsize;
+        }
     }
 }
 
+void strbuf_attach_zbuff(strbuf_t *s, void *zbuff)
+{
+    luat_zbuff_t *buff = (luat_zbuff_t *)zbuff;
+    s->buf = (char *)buff->addr;
+    s->size = buff->len;
+    s->length = buff->used;
+    s->increment = STRBUF_DEFAULT_INCREMENT;
+    s->dynamic = 0;
+    s->is_err = 0;
+    s->zbuff = zbuff;
+}
+
 void strbuf_append_string(strbuf_t *s, const char *str)
 {
     int space, i;
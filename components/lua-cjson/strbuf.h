@@ -40,6 +40,7 @@ typedef struct {
     int increment;
     int dynamic;
     int is_err;
+    void *zbuff;    /* 非NULL时借用该zbuff的内存, 扩容时同步更新zbuff, 释放时不释放内存 */
     // int reallocs;
     // int debug;
 } strbuf_t;
@@ -56,6 +57,9 @@ extern strbuf_t *strbuf_new(int len);
 extern int strbuf_init(strbuf_t *s, int len);
 extern void strbuf_set_increment(strbuf_t *s, int increment);
 
+/* 在zbuff已有数据之后追加, 完成后zbuff->used需由调用者更新为strbuf_length */
+extern void strbuf_attach_zbuff(strbuf_t *s, void *zbuff);
+
 /* Release */
 extern void strbuf_free(strbuf_t *s);
 extern char *strbuf_free_to_string(strbuf_t *s, int *len);
@@ -85,6 +85,7 @@ LUAT_WEAK void luat_lv_disp_flush(lv_disp_drv_t * disp_drv, const lv_area_t * ar
     //-----
     if (lcd_conf != NULL) {
         luat_lcd_draw(lcd_conf, area->x1, area->y1, area->x2, area->y2, color_p);
+        // 双缓冲的异步刷新还在发送时, luat_lcd_flush不会抢占总线, 等那一帧发完自动补刷
         if (disp_drv->buffer->flushing_last)
             luat_lcd_flush(lcd_conf);
     }
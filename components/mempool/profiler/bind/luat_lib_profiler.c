@@ -1,33 +1,78 @@
+/*
+@module  profiler
+@summary lua虚拟机内存分析
+@version 1.0
+@date    2023.06.01
+@tag LUAT_USE_PROFILER
+@usage
+-- 需要固件启用 LUAT_USE_PROFILER
+profiler.start()
+-- 运行一段业务代码后
+profiler.print(10)
+local data = profiler.dump()
+*/
 #include "luat_base.h"
 #include "luat_malloc.h"
-#include "luat_malloc.h"
 #include "luat_timer.h"
 #include "luat_profiler.h"
 
+/*
+开始内存分析, 清空之前的统计
+@api profiler.start()
+@return nil 无返回值
+*/
 static int l_profiler_start(lua_State *L) {
-    (void)L;
-    luat_profiler_start();
+    luat_profiler_start(L);
     return 0;
 }
 
+/*
+停止内存分析, 统计数据保留, 可继续print/dump
+@api profiler.stop()
+@return nil 无返回值
+*/
 static int l_profiler_stop(lua_State *L) {
     (void)L;
     luat_profiler_stop();
     return 0;
 }
 
+/*
+打印统计信息, 以及当前占用内存最多的分配位置
+@api profiler.print(top_n)
+@int 打印多少个分配位置, 默认10
+@return nil 无返回值
+*/
 static int l_profiler_print(lua_State *L) {
-    (void)L;
-    luat_profiler_print();
+    luat_profiler_print(luaL_optinteger(L, 1, 10));
     return 0;
 }
 
+/*
+导出二进制格式的统计数据, 可保存到文件或上传到服务器分析, 格式见luat_profiler.c
+@api profiler.dump()
+@return string 二进制数据
+*/
+static int l_profiler_dump(lua_State *L) {
+    luaL_Buffer b;
+    size_t len;
+    luaL_buffinit(L, &b);
+    // 申请缓冲区本身也可能被采样出新的分配位置, 长度不够就重来
+    do {
+        len = luat_profiler_dump(NULL, 0);
+        len = luat_profiler_dump((uint8_t*)luaL_prepbuffsize(&b, len), len);
+    } while (len == 0);
+    luaL_pushresultsize(&b, len);
+    return 1;
+}
+
 #include "rotable2.h"
 static const rotable_Reg_t reg_profiler[] =
 {
     { "start" ,        ROREG_FUNC(l_profiler_start)},
     { "stop" ,         ROREG_FUNC(l_profiler_stop)},
     { "print",         ROREG_FUNC(l_profiler_print)},
+    { "dump",          ROREG_FUNC(l_profiler_dump)},
 	{ NULL,            ROREG_INT(0)}
 };
 
@@ -2,6 +2,45 @@
 #define LUAT_PROFILER_H
 
 #include "stdint.h"
+#include "stddef.h"
+#include "lua.h"
+
+/**
+ * lua虚拟机内存分析器
+ *
+ * 启用 LUAT_USE_PROFILER 后, 虚拟机的每块内存前面多一个8字节的头部, 记录大小和归属.
+ * 总占用/峰值是精确统计的; 归属按字节采样, 平均每 LUAT_PROFILER_SAMPLE_BYTES 字节
+ * 抽取一次分配, 记录当时正在执行的lua源码位置(source:line)以及正在调用的C函数名.
+ */
+
+// 采样间隔, 单位字节
+#ifndef LUAT_PROFILER_SAMPLE_BYTES
+#define LUAT_PROFILER_SAMPLE_BYTES (1024)
+#endif
+
+// 最多记录的分配位置数, 超出的统计到最后一项 "(other)"
+#ifndef LUAT_PROFILER_SITES
+#define LUAT_PROFILER_SITES (64)
+#endif
+
+#define LUAT_PROFILER_SRC_LEN  (32)
+#define LUAT_PROFILER_CTAG_LEN (16)
+
+// dump()导出的二进制格式, 全部为小端
+#define LUAT_PROFILER_DUMP_MAGIC   "LPRF"
+#define LUAT_PROFILER_DUMP_VERSION (1)
+
+typedef struct luat_profiler_site
+{
+    char source[LUAT_PROFILER_SRC_LEN];  // lua源文件, 过长时保留结尾部分
+    char ctag[LUAT_PROFILER_CTAG_LEN];   // 分配发生在C函数里时, 该函数的名字
+    int32_t line;
+    uint32_t samples;    // 采样次数
+    uint32_t live;       // 估算的当前占用字节数
+    uint32_t total;      // 估算的累计分配字节数
+    const void* key_src; // 以下仅用于查找, 不导出
+    const void* key_ctag;
+}luat_profiler_site_t;
 
 typedef struct luat_profiler_ctx
 {
@@ -15,13 +54,23 @@ typedef struct luat_profiler_ctx
     uint32_t lua_heap_end_used;
     uint32_t sys_heap_begin_used;
     uint32_t sys_heap_end_used;
+    size_t live_bytes;      // 当前虚拟机内存占用(不含头部), 精确值
+    size_t peak_bytes;      // 启动分析后的峰值
+    int32_t sample_countdown;
+    uint32_t site_count;
+    luat_profiler_site_t sites[LUAT_PROFILER_SITES];
 }luat_profiler_ctx_t;
 
 void* luat_profiler_alloc(void *ud, void *ptr, size_t osize, size_t nsize);
 
-int luat_profiler_start(void);
+// L 为任意一个协程, 用于找到主线程
+int luat_profiler_start(lua_State *L);
 int luat_profiler_stop(void);
 
-void luat_profiler_print(void);
+// 打印总体统计及占用最多的top_n个分配位置
+void luat_profiler_print(size_t top_n);
+
+// 导出二进制数据, buff为NULL时返回所需的长度
+size_t luat_profiler_dump(uint8_t* buff, size_t len);
 
 #endif
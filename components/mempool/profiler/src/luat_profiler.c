@@ -1,79 +1,275 @@
 #include "luat_base.h"
 #include "luat_malloc.h"
 #include "luat_profiler.h"
+#ifdef LUAT_USE_MEMORY_SLAB
+#include "luat_slab.h"
+#endif
 
 #define LUAT_LOG_TAG "profiler"
 #include "luat_log.h"
 
+#ifdef LUAT_USE_MEMORY_SLAB
+#define PROFILER_BACKEND luat_slab_alloc
+#else
+#define PROFILER_BACKEND luat_heap_alloc
+#endif
+
+// 每块内存前的头部, 保持8字节以免破坏对齐
+typedef struct profiler_hdr {
+    uint32_t size;    // 用户请求的大小
+    uint16_t site;    // 被采样时为 分配位置序号+1, 否则为0
+    uint16_t session; // 采样时所在的分析会话, 重新start后旧的采样不再计入
+} profiler_hdr_t;
+
+#define HDR_SIZE (sizeof(profiler_hdr_t))
+
+#ifdef LUAT_USE_PROFILER
+extern lua_State *luat_running_thread; // ldo.c, 当前正在resume的协程
+#else
+static lua_State *luat_running_thread; // 未启用时ldo.c不跟踪协程, 只能归属到主线程
+#endif
+
 static luat_profiler_ctx_t ctx;
+static lua_State *main_thread;
+static uint16_t session;
+static uint32_t sample_seed = 0x2545F491;
 
-void* luat_profiler_alloc(void *ud, void *ptr, size_t osize, size_t nsize) {
-    // TODO 加调试信息的head, 这样才能记录实际malloc和realloc的大小
-    void* dst = NULL;
-    if (ctx.tag == 0) { // 停用状态, 原样返回
-        return luat_heap_alloc(ud, ptr, osize, nsize);
-    }
-    LLOGD("ud %p ptr %p oszie %08X nsize %08X", ud, ptr, osize, nsize);
-    if (ptr == NULL && nsize == 0) {
-        LLOGD("free NULL");
-        return NULL;
+// 采样到的分配代表的字节数, 大块必定被采样, 按实际大小计
+static inline uint32_t sample_weight(size_t size) {
+    return size >= LUAT_PROFILER_SAMPLE_BYTES ? size : LUAT_PROFILER_SAMPLE_BYTES;
+}
+
+// 下一次采样前还需分配的字节数, 在间隔附近随机化, 避免和固定的分配序列同步
+static int32_t next_countdown(void) {
+    sample_seed = sample_seed * 1103515245 + 12345;
+    return LUAT_PROFILER_SAMPLE_BYTES / 2 + (sample_seed >> 8) % LUAT_PROFILER_SAMPLE_BYTES;
+}
+
+static void copy_tail(char* dst, const char* src, size_t len) {
+    size_t slen = strlen(src);
+    if (slen >= len)
+        src += slen - len + 1;
+    strncpy(dst, src, len - 1);
+    dst[len - 1] = 0;
+}
+
+// 找出当前正在执行的lua代码位置, 必须在真正申请/释放内存之前调用,
+// 因为realloc可能移动的正是该协程的栈
+static uint16_t site_capture(void) {
+    lua_State *L = luat_running_thread ? luat_running_thread : main_thread;
+    lua_Debug ar;
+    const char* ctag = NULL;
+    const char* src = "[C]";
+    const char* short_src = "[C]";
+    int line = -1;
+    if (L) {
+        for (int level = 0; level < 4 && lua_getstack(L, level, &ar); level++) {
+            if (!lua_getinfo(L, level == 0 ? "Sln" : "Sl", &ar))
+                break;
+            if (*ar.what != 'C') {
+                src = ar.source;
+                short_src = ar.short_src;
+                line = ar.currentline;
+                break;
+            }
+            if (level == 0)
+                ctag = ar.name;
+        }
     }
-    // 如果指针不为NULL, 目标大小为0, 那就是free
-    else if (ptr != NULL && nsize == 0) {
-        LLOGD("call free %p", ptr);
-        ctx.counter_free ++;
-        dst = luat_heap_alloc(ud, ptr, osize, nsize);
-        LLOGD("done free %p", ptr);
-        return dst;
+    for (size_t i = 0; i < ctx.site_count; i++) {
+        luat_profiler_site_t* site = &ctx.sites[i];
+        if (site->key_src == src && site->key_ctag == ctag && site->line == line)
+            return i + 1;
     }
-    // 如果指针为NULL, 目标大小不为0, 那就是malloc
-    else if (ptr == NULL && nsize > 0) {
-        ctx.counter_malloc ++;
-        LLOGD("call malloc %08X type %08X", nsize, osize);
-        dst = luat_heap_alloc(ud, ptr, osize, nsize);
-        LLOGD("call malloc %08X type %08X %p", nsize, osize, dst);
-        return dst;
+    if (ctx.site_count >= LUAT_PROFILER_SITES) // 最后一项统计其余所有位置
+        return LUAT_PROFILER_SITES;
+    luat_profiler_site_t* site = &ctx.sites[ctx.site_count++];
+    site->key_src = src;
+    site->key_ctag = ctag;
+    site->line = line;
+    if (ctx.site_count == LUAT_PROFILER_SITES) {
+        strcpy(site->source, "(other)");
+        site->line = -1;
+        site->key_src = NULL;
     }
-    // 最后剩下realloc
     else {
-        ctx.counter_realloc ++;
-        LLOGD("call realloc %08X osize %08X", nsize, osize);
-        dst = luat_heap_alloc(ud, ptr, osize, nsize);
-        LLOGD("call realloc %08X osize %08X %p", nsize, osize, dst);
-        return dst;
+        copy_tail(site->source, short_src, LUAT_PROFILER_SRC_LEN);
+        if (ctag)
+            copy_tail(site->ctag, ctag, LUAT_PROFILER_CTAG_LEN);
     }
+    return ctx.site_count;
 }
 
-int luat_profiler_start(void) {
+static void site_release(profiler_hdr_t* hdr) {
+    if (hdr->site == 0 || hdr->session != session)
+        return;
+    luat_profiler_site_t* site = &ctx.sites[hdr->site - 1];
+    uint32_t weight = sample_weight(hdr->size);
+    site->live = site->live > weight ? site->live - weight : 0;
+}
+
+void* luat_profiler_alloc(void *ud, void *ptr, size_t osize, size_t nsize) {
+    profiler_hdr_t* hdr = NULL;
+    profiler_hdr_t old = {0};
+    uint16_t site = 0;
+    if (ptr) {
+        hdr = (profiler_hdr_t*)((char*)ptr - HDR_SIZE);
+        old = *hdr;
+        osize = old.size;
+    }
+    if (ctx.tag) {
+        if (nsize == 0)
+            ctx.counter_free += ptr ? 1 : 0;
+        else if (ptr)
+            ctx.counter_realloc ++;
+        else
+            ctx.counter_malloc ++;
+        // 大块必定采样且不影响计数, 否则紧随大块之后的小分配几乎不会被采样到
+        if (nsize >= LUAT_PROFILER_SAMPLE_BYTES) {
+            site = site_capture();
+        }
+        else if (nsize > 0) {
+            ctx.sample_countdown -= nsize;
+            if (ctx.sample_countdown <= 0) {
+                site = site_capture();
+                ctx.sample_countdown += next_countdown();
+            }
+        }
+    }
+
+    if (nsize == 0) {
+        if (ptr) {
+            site_release(&old);
+            ctx.live_bytes -= osize;
+            PROFILER_BACKEND(ud, hdr, osize + HDR_SIZE, 0);
+        }
+        return NULL;
+    }
+    hdr = PROFILER_BACKEND(ud, hdr, ptr ? osize + HDR_SIZE : 0, nsize + HDR_SIZE);
+    if (hdr == NULL)
+        return NULL; // 原内存块保持不变
+    if (ptr)
+        site_release(&old);
+    ctx.live_bytes += nsize;
+    ctx.live_bytes -= ptr ? osize : 0;
+    if (ctx.live_bytes > ctx.peak_bytes)
+        ctx.peak_bytes = ctx.live_bytes;
+    hdr->size = nsize;
+    hdr->site = site;
+    hdr->session = session;
+    if (site) {
+        luat_profiler_site_t* s = &ctx.sites[site - 1];
+        uint32_t weight = sample_weight(nsize);
+        s->samples ++;
+        s->live += weight;
+        s->total += weight;
+    }
+    return (char*)hdr + HDR_SIZE;
+}
+
+int luat_profiler_start(lua_State *L) {
     size_t total; size_t used; size_t max_used;
-    LLOGD("start profiler");
+    size_t live = ctx.live_bytes;
     memset(&ctx, 0, sizeof(luat_profiler_ctx_t));
+    ctx.live_bytes = live;
+    ctx.peak_bytes = live;
+    ctx.sample_countdown = next_countdown();
+    session ++;
+    lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+    main_thread = lua_tothread(L, -1);
+    lua_pop(L, 1);
+    luat_meminfo_luavm(&total, &used, &max_used);
+    ctx.lua_heap_begin_used = used;
+    luat_meminfo_sys(&total, &used, &max_used);
+    ctx.sys_heap_begin_used = used;
     ctx.tag = 1;
-    luat_meminfo_luavm(&total, &ctx.lua_heap_begin_used, &max_used);
-    LLOGD("%s luavm %ld %ld %ld", "profiler start", total, ctx.lua_heap_begin_used, max_used);
-    luat_meminfo_sys(&total, &ctx.sys_heap_begin_used, &max_used);
-    LLOGD("%s sys   %ld %ld %ld", "profiler start", total, ctx.sys_heap_begin_used, max_used);
+    LLOGD("start profiler, lua used %u", ctx.lua_heap_begin_used);
     return 0;
 }
 
 int luat_profiler_stop(void) {
     size_t total; size_t used; size_t max_used;
-    LLOGD("stop profiler");
     ctx.tag = 0;
-    luat_meminfo_luavm(&total, &ctx.lua_heap_end_used, &max_used);
-    LLOGD("%s luavm %ld %ld %ld", "profiler stop", total, ctx.lua_heap_end_used, max_used);
-    luat_meminfo_sys(&total, &ctx.sys_heap_end_used, &max_used);
-    LLOGD("%s sys   %ld %ld %ld", "profiler stop", total, ctx.sys_heap_end_used, max_used);
+    luat_meminfo_luavm(&total, &used, &max_used);
+    ctx.lua_heap_end_used = used;
+    luat_meminfo_sys(&total, &used, &max_used);
+    ctx.sys_heap_end_used = used;
+    LLOGD("stop profiler, lua used %u", ctx.lua_heap_end_used);
     return 0;
 }
 
-void luat_profiler_print(void) {
-    size_t total; size_t used; size_t max_used;
-    LLOGD("============================================");
-    // 输出调用次数
-    LLOGD("counter malloc %08X free %08X realloc %08X", ctx.counter_malloc, ctx.counter_free, ctx.counter_realloc);
-    // 输出前后内存大小
-    LLOGD("heap used at start: lua %08X sys %08X", ctx.lua_heap_begin_used, ctx.sys_heap_begin_used);
-    LLOGD("heap used at stop : lua %08X sys %08X", ctx.lua_heap_end_used, ctx.sys_heap_end_used);
-    LLOGD("============================================");
+void luat_profiler_print(size_t top_n) {
+    uint16_t order[LUAT_PROFILER_SITES];
+    size_t count = ctx.site_count;
+    for (size_t i = 0; i < count; i++)
+        order[i] = i;
+    // 按当前占用从大到小排序, 位置数很少, 插入排序即可
+    for (size_t i = 1; i < count; i++) {
+        uint16_t cur = order[i];
+        size_t j = i;
+        while (j > 0 && ctx.sites[order[j - 1]].live < ctx.sites[cur].live) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = cur;
+    }
+    LLOGI("============================================");
+    LLOGI("counter malloc %u free %u realloc %u", ctx.counter_malloc, ctx.counter_free, ctx.counter_realloc);
+    LLOGI("lua vm live %u peak %u, sample every %d bytes", (uint32_t)ctx.live_bytes, (uint32_t)ctx.peak_bytes, LUAT_PROFILER_SAMPLE_BYTES);
+    if (ctx.tag == 0)
+        LLOGI("heap used at start: lua %u sys %u, stop: lua %u sys %u", ctx.lua_heap_begin_used, ctx.sys_heap_begin_used, ctx.lua_heap_end_used, ctx.sys_heap_end_used);
+    for (size_t i = 0; i < count && i < top_n; i++) {
+        luat_profiler_site_t* site = &ctx.sites[order[i]];
+        LLOGI("%2d live %7u total %8u samples %5u %s:%d %s", (int)i + 1, site->live, site->total, site->samples,
+            site->source, site->line, site->ctag);
+    }
+    LLOGI("============================================");
+}
+
+static uint8_t* put_u16(uint8_t* p, uint16_t v) {
+    p[0] = v; p[1] = v >> 8;
+    return p + 2;
+}
+
+static uint8_t* put_u32(uint8_t* p, uint32_t v) {
+    p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+    return p + 4;
+}
+
+/*
+dump格式, 全部小端:
+  "LPRF" u16版本 u16位置数 u32采样间隔 u32当前占用 u32峰值 u32 malloc次数 u32 free次数 u32 realloc次数
+  每个位置: char source[32] char ctag[16] i32行号 u32采样次数 u32当前占用 u32累计分配
+*/
+#define DUMP_HEAD_SIZE (4 + 2 + 2 + 4 * 6)
+#define DUMP_SITE_SIZE (LUAT_PROFILER_SRC_LEN + LUAT_PROFILER_CTAG_LEN + 4 * 4)
+
+size_t luat_profiler_dump(uint8_t* buff, size_t len) {
+    size_t need = DUMP_HEAD_SIZE + ctx.site_count * DUMP_SITE_SIZE;
+    if (buff == NULL)
+        return need;
+    if (len < need)
+        return 0;
+    uint8_t* p = buff;
+    memcpy(p, LUAT_PROFILER_DUMP_MAGIC, 4);
+    p = put_u16(p + 4, LUAT_PROFILER_DUMP_VERSION);
+    p = put_u16(p, ctx.site_count);
+    p = put_u32(p, LUAT_PROFILER_SAMPLE_BYTES);
+    p = put_u32(p, ctx.live_bytes);
+    p = put_u32(p, ctx.peak_bytes);
+    p = put_u32(p, ctx.counter_malloc);
+    p = put_u32(p, ctx.counter_free);
+    p = put_u32(p, ctx.counter_realloc);
+    for (size_t i = 0; i < ctx.site_count; i++) {
+        luat_profiler_site_t* site = &ctx.sites[i];
+        memcpy(p, site->source, LUAT_PROFILER_SRC_LEN);
+        p += LUAT_PROFILER_SRC_LEN;
+        memcpy(p, site->ctag, LUAT_PROFILER_CTAG_LEN);
+        p += LUAT_PROFILER_CTAG_LEN;
+        p = put_u32(p, (uint32_t)site->line);
+        p = put_u32(p, site->samples);
+        p = put_u32(p, site->live);
+        p = put_u32(p, site->total);
+    }
+    return need;
 }
@@ -0,0 +1,57 @@
+#ifndef LUAT_SLAB_H
+#define LUAT_SLAB_H
+
+#include "stdint.h"
+#include "stddef.h"
+
+/**
+ * Lua虚拟机小对象分级分配器
+ *
+ * 放在 luat_heap_alloc 前面, 对不超过 LUAT_SLAB_MAX_SIZE 的分配按8字节分级,
+ * 从固定大小的页中切分, 减少字符串/闭包/表节点等小对象频繁申请释放带来的碎片.
+ * 页本身从 luat_heap_alloc 申请, 空页会归还, 不额外预留内存.
+ * 依赖lua分配器协议中 osize 为原始大小这一约定, 只能作为lua_newstate的分配函数使用.
+ *
+ * 在luat_conf_bsp.h中定义 LUAT_USE_MEMORY_SLAB 启用
+ */
+
+// 分级上限, 必须是8的倍数
+#ifndef LUAT_SLAB_MAX_SIZE
+#define LUAT_SLAB_MAX_SIZE (64)
+#endif
+
+// 页大小
+#ifndef LUAT_SLAB_PAGE_SIZE
+#define LUAT_SLAB_PAGE_SIZE (1024)
+#endif
+
+// 最大页数, 超出后小对象直接走 luat_heap_alloc
+#ifndef LUAT_SLAB_MAX_PAGES
+#define LUAT_SLAB_MAX_PAGES (512)
+#endif
+
+#define LUAT_SLAB_CLASS_COUNT (LUAT_SLAB_MAX_SIZE / 8)
+
+typedef struct luat_slab_class_stat
+{
+    uint16_t size;      // 该级的槽位大小
+    uint16_t pages;     // 当前占用的页数
+    uint32_t objs;      // 当前使用中的对象数
+    uint32_t hit;       // 由slab满足的分配次数
+    uint32_t miss;      // 无法分配页, 回落到luat_heap_alloc的次数
+    size_t   requested; // 使用中对象实际请求的字节数, 与 objs*size 之差为内部碎片
+}luat_slab_class_stat_t;
+
+typedef struct luat_slab_stat
+{
+    size_t page_bytes;      // 所有页的总字节数
+    size_t used_bytes;      // 使用中槽位的字节数
+    size_t max_page_bytes;  // 历史最大页字节数
+    luat_slab_class_stat_t classes[LUAT_SLAB_CLASS_COUNT];
+}luat_slab_stat_t;
+
+void* luat_slab_alloc(void *ud, void *ptr, size_t osize, size_t nsize);
+
+void luat_slab_stat(luat_slab_stat_t* stat);
+
+#endif
@@ -0,0 +1,212 @@
+#include "luat_base.h"
+#include "luat_malloc.h"
+#include "luat_slab.h"
+
+#if (LUAT_SLAB_MAX_SIZE % 8) != 0 || LUAT_SLAB_MAX_SIZE > 255 * 8
+#error "LUAT_SLAB_MAX_SIZE must be multiple of 8"
+#endif
+
+// 页头部, 后面紧跟着槽位
+typedef struct slab_page {
+    struct slab_page* prev;  // 所属分级的可用页链表
+    struct slab_page* next;
+    void* free;              // 已释放的槽位链表
+    uint16_t used;           // 使用中的槽位数
+    uint16_t bump;           // 从未分配过的槽位的起始序号, 新页不必预先串链表
+    uint8_t cls;
+    uint8_t full;            // 已满的页不在可用页链表中
+} slab_page_t;
+
+#define SLAB_HDR_SIZE ((sizeof(slab_page_t) + 7) & ~((size_t)7))
+#define SLAB_CLASS(size) (((size) - 1) >> 3)
+#define SLAB_SLOT_SIZE(cls) (((cls) + 1) << 3)
+#define SLAB_CAP(cls) ((LUAT_SLAB_PAGE_SIZE - SLAB_HDR_SIZE) / SLAB_SLOT_SIZE(cls))
+
+typedef struct slab_class {
+    slab_page_t* partial;    // 有空闲槽位的页
+    uint16_t npartial;
+} slab_class_t;
+
+static slab_class_t classes[LUAT_SLAB_CLASS_COUNT];
+static luat_slab_stat_t stat;
+
+// 按地址排序的页表, 释放时二分查找指针所属的页
+static slab_page_t* pages[LUAT_SLAB_MAX_PAGES];
+static size_t page_count;
+
+static size_t page_search(const void* ptr) {
+    size_t lo = 0, hi = page_count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) >> 1;
+        if ((const char*)pages[mid] <= (const char*)ptr)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo; // 第一个起始地址大于ptr的页
+}
+
+static slab_page_t* page_find(const void* ptr) {
+    size_t idx = page_search(ptr);
+    if (idx == 0)
+        return NULL;
+    slab_page_t* page = pages[idx - 1];
+    if ((const char*)ptr < (const char*)page + LUAT_SLAB_PAGE_SIZE)
+        return page;
+    return NULL;
+}
+
+static void partial_link(slab_class_t* c, slab_page_t* page) {
+    page->prev = NULL;
+    page->next = c->partial;
+    if (c->partial)
+        c->partial->prev = page;
+    c->partial = page;
+    c->npartial ++;
+}
+
+static void partial_unlink(slab_class_t* c, slab_page_t* page) {
+    if (page->prev)
+        page->prev->next = page->next;
+    else
+        c->partial = page->next;
+    if (page->next)
+        page->next->prev = page->prev;
+    page->prev = page->next = NULL;
+    c->npartial --;
+}
+
+static slab_page_t* page_new(void* ud, uint8_t cls) {
+    if (page_count >= LUAT_SLAB_MAX_PAGES)
+        return NULL;
+    slab_page_t* page = luat_heap_alloc(ud, NULL, 0, LUAT_SLAB_PAGE_SIZE);
+    if (page == NULL)
+        return NULL;
+    memset(page, 0, SLAB_HDR_SIZE);
+    page->cls = cls;
+    size_t idx = page_search(page);
+    memmove(&pages[idx + 1], &pages[idx], (page_count - idx) * sizeof(slab_page_t*));
+    pages[idx] = page;
+    page_count ++;
+    partial_link(&classes[cls], page);
+    stat.classes[cls].pages ++;
+    stat.page_bytes += LUAT_SLAB_PAGE_SIZE;
+    if (stat.page_bytes > stat.max_page_bytes)
+        stat.max_page_bytes = stat.page_bytes;
+    return page;
+}
+
+static void page_release(void* ud, slab_page_t* page) {
+    size_t idx = page_search(page) - 1;
+    memmove(&pages[idx], &pages[idx + 1], (page_count - idx - 1) * sizeof(slab_page_t*));
+    page_count --;
+    partial_unlink(&classes[page->cls], page);
+    stat.classes[page->cls].pages --;
+    stat.page_bytes -= LUAT_SLAB_PAGE_SIZE;
+    luat_heap_alloc(ud, page, LUAT_SLAB_PAGE_SIZE, 0);
+}
+
+static void* slab_malloc(void* ud, size_t size) {
+    uint8_t cls = SLAB_CLASS(size);
+    slab_class_t* c = &classes[cls];
+    slab_page_t* page = c->partial;
+    if (page == NULL) {
+        page = page_new(ud, cls);
+        if (page == NULL) {
+            stat.classes[cls].miss ++;
+            return NULL;
+        }
+    }
+    void* ptr = page->free;
+    if (ptr) {
+        page->free = *(void**)ptr;
+    }
+    else {
+        ptr = (char*)page + SLAB_HDR_SIZE + page->bump * SLAB_SLOT_SIZE(cls);
+        page->bump ++;
+    }
+    page->used ++;
+    if (page->free == NULL && page->bump == SLAB_CAP(cls)) {
+        partial_unlink(c, page);
+        page->full = 1;
+    }
+    stat.classes[cls].hit ++;
+    stat.classes[cls].objs ++;
+    stat.classes[cls].requested += size;
+    stat.used_bytes += SLAB_SLOT_SIZE(cls);
+    return ptr;
+}
+
+static void slab_free(void* ud, slab_page_t* page, void* ptr, size_t size) {
+    uint8_t cls = page->cls;
+    slab_class_t* c = &classes[cls];
+    *(void**)ptr = page->free;
+    page->free = ptr;
+    page->used --;
+    stat.classes[cls].objs --;
+    stat.classes[cls].requested -= size;
+    stat.used_bytes -= SLAB_SLOT_SIZE(cls);
+    if (page->full) {
+        page->full = 0;
+        partial_link(c, page);
+    }
+    // 每个分级保留一个空页, 避免在边界上反复申请释放
+    if (page->used == 0 && c->npartial > 1)
+        page_release(ud, page);
+}
+
+// 与lua_Alloc语义一致: ptr为NULL时osize是对象类型而非大小
+void* luat_slab_alloc(void *ud, void *ptr, size_t osize, size_t nsize) {
+    slab_page_t* page = NULL;
+    void* dst = NULL;
+    if (ptr == NULL)
+        osize = 0;
+    else
+        page = page_find(ptr);
+
+    if (nsize == 0) {
+        if (page)
+            slab_free(ud, page, ptr, osize);
+        else if (ptr)
+            luat_heap_alloc(ud, ptr, osize, 0);
+        return NULL;
+    }
+
+    if (page) {
+        // 同一分级内缩放, 原地返回
+        if (nsize <= LUAT_SLAB_MAX_SIZE && SLAB_CLASS(nsize) == page->cls) {
+            stat.classes[page->cls].requested += nsize;
+            stat.classes[page->cls].requested -= osize;
+            return ptr;
+        }
+    }
+    else if (ptr && nsize > LUAT_SLAB_MAX_SIZE) {
+        return luat_heap_alloc(ud, ptr, osize, nsize);
+    }
+
+    if (nsize <= LUAT_SLAB_MAX_SIZE)
+        dst = slab_malloc(ud, nsize);
+    if (dst == NULL) {
+        if (ptr && page == NULL) // 原本就在堆上, 直接realloc
+            return luat_heap_alloc(ud, ptr, osize, nsize);
+        dst = luat_heap_alloc(ud, NULL, 0, nsize);
+        if (dst == NULL)
+            return NULL;
+    }
+    if (ptr) {
+        memcpy(dst, ptr, osize < nsize ? osize : nsize);
+        if (page)
+            slab_free(ud, page, ptr, osize);
+        else
+            luat_heap_alloc(ud, ptr, osize, 0);
+    }
+    return dst;
+}
+
+void luat_slab_stat(luat_slab_stat_t* st) {
+    memcpy(st, &stat, sizeof(luat_slab_stat_t));
+    for (size_t i = 0; i < LUAT_SLAB_CLASS_COUNT; i++)
+    {
+        st->classes[i].size = SLAB_SLOT_SIZE(i);
+    }
+}
@@ -16,6 +16,9 @@
 #include "luat_log.h"
 //static const char NW_TYPE[] = "NWA*";
 #define LUAT_NW_CTRL_TYPE "NWCTRL*"
+#ifndef LUAT_SOCKET_TX_IOV_MAX
+#define LUAT_SOCKET_TX_IOV_MAX 16
+#endif
 typedef struct
 {
 	network_ctrl_t *netc;
@@ -88,6 +91,145 @@ static int l_socket_local_ip(lua_State *L)
 	return 0;
 }
 
+// 取出一段要发送的数据, string或者zbuff, zbuff默认取已使用的部分
+static const uint8_t *l_socket_tx_data(lua_State *L, int idx, size_t *len)
+{
+	if (lua_type(L, idx) == LUA_TSTRING)
+	{
+		return (const uint8_t *)lua_tolstring(L, idx, len);
+	}
+	luat_zbuff_t *buff = (luat_zbuff_t *)luaL_testudata(L, idx, LUAT_ZBUFF_TYPE);
+	if (buff == NULL)
+	{
+		return NULL;
+	}
+	if (buff->is_ring)
+	{
+		// 环形模式的数据可能不连续, 不能直接发送
+		luaL_error(L, "socket.tx: ring zbuff not supported, call setRing(false) first");
+	}
+	*len = buff->used;
+	return buff->addr;
+}
+
+// socket.tx的数据参数, 可以是string/zbuff, 也可以是由它们组成的table,
+// table里的元素还可以是{data, offset, len}, 只发送其中一部分, 数据不需要先拼接起来
+// 返回段数, *total为总长度
+static uint32_t l_socket_tx_iov(lua_State *L, int arg, luat_network_iovec_t *iov, size_t *total)
+{
+	size_t len = 0;
+	*total = 0;
+	if (!lua_istable(L, arg))
+	{
+		iov[0].data = l_socket_tx_data(L, arg, &len);
+		luaL_argcheck(L, iov[0].data != NULL, arg, "string/zbuff/table expected");
+		iov[0].len = len;
+		*total = len;
+		return 1;
+	}
+	size_t cnt = lua_rawlen(L, arg);
+	luaL_argcheck(L, cnt <= LUAT_SOCKET_TX_IOV_MAX, arg, "too many segments");
+	for (size_t i = 0; i < cnt; i++)
+	{
+		lua_rawgeti(L, arg, i + 1);
+		int idx = lua_gettop(L);
+		const uint8_t *data;
+		if (lua_istable(L, idx))
+		{
+			lua_rawgeti(L, idx, 1);
+			data = l_socket_tx_data(L, -1, &len);
+			lua_pop(L, 1);
+			lua_rawgeti(L, idx, 2);
+			lua_rawgeti(L, idx, 3);
+			size_t offset = luaL_optinteger(L, -2, 0);
+			if (data == NULL || offset > len)
+			{
+				return luaL_error(L, "socket.tx segment %d invalid", (int)(i + 1));
+			}
+			size_t seg_len = luaL_optinteger(L, -1, len - offset);
+			if (seg_len > len - offset)
+			{
+				return luaL_error(L, "socket.tx segment %d out of range", (int)(i + 1));
+			}
+			lua_pop(L, 2);
+			data += offset;
+			len = seg_len;
+		}
+		else
+		{
+			data = l_socket_tx_data(L, idx, &len);
+			if (data == NULL)
+			{
+				return luaL_error(L, "socket.tx segment %d invalid", (int)(i + 1));
+			}
+		}
+		// 数据的引用仍然保存在table里, 这里可以直接出栈
+		lua_pop(L, 1);
+		iov[i].data = data;
+		iov[i].len = len;
+		*total += len;
+	}
+	return cnt;
+}
+
+// 把底层缓存的数据读到zbuff里, 返回值同network_rx
+// limit为0时空间不够会自动扩容, 把数据全部读出来; 否则最多读limit字节, 而且只用剩余空间, 不扩容
+// 环形模式的zbuff从不扩容, 写到末尾后绕回开头继续读
+// *rest_len为读取前底层还缓存着的数据量减去本次读出的
+static int l_socket_rx_zbuff(network_ctrl_t *netc, luat_zbuff_t *buff, size_t limit, luat_ip_addr_t *ip_addr, uint16_t *port, uint32_t *rx_len, uint32_t *rest_len)
+{
+	uint32_t total_len = 0;
+	uint32_t once;
+	uint8_t *p;
+	*rx_len = 0;
+	*rest_len = 0;
+	int result = network_rx(netc, NULL, 0, 0, NULL, NULL, &total_len);
+	if (result < 0 || !total_len)
+	{
+		return result;
+	}
+	uint32_t want = total_len;
+	if (!limit && !buff->is_ring && (buff->len - buff->used) < want)
+	{
+		__zbuff_resize(buff, want + buff->used);
+	}
+	if (limit && want > limit)
+	{
+		want = limit;
+	}
+	if (want > buff->len - buff->used)
+	{
+		want = buff->len - buff->used;
+	}
+	while (want)
+	{
+		if (buff->is_ring)
+		{
+			once = luat_zbuff_ring_write_span(buff, &p);
+			if (once > want) once = want;
+		}
+		else
+		{
+			p = buff->addr + buff->used;
+			once = want;
+		}
+		result = network_rx(netc, p, once, 0, ip_addr, port, &once);
+		if (result < 0)
+		{
+			return result;
+		}
+		buff->used += once;
+		*rx_len += once;
+		want -= once;
+		// udp一次只取一个包
+		if (!once || !netc->is_tcp)
+		{
+			break;
+		}
+	}
+	*rest_len = (total_len > *rx_len) ? (total_len - *rx_len) : 0;
+	return result;
+}
 
 #ifdef LUAT_USE_LWIP
 
@@ -453,36 +595,28 @@ static int l_socket_close(lua_State *L)
 发送数据给对端，UDP单次发送不要超过1460字节，否则很容易失败
 @api socket.tx(ctrl, data, ip, port, flag)
 @user_data socket.create得到的ctrl
-@string or user_data zbuff  要发送的数据
+@string or user_data zbuff or table 要发送的数据，table时按顺序发送其中的每一段，元素可以是string，zbuff，或者{string/zbuff, 偏移量, 长度}，最多16段
 @string or int 对端IP，如果是TCP应用则忽略，如果是UDP，如果留空则用connect时候的参数，如果是IPV4，可以是大端格式的int值
 @int 对端端口号，小端格式，如果是TCP应用则忽略，如果是UDP，如果留空则用connect时候的参数
 @int 发送参数，目前预留，不起作用
 @return boolean true没有异常发生，false失败了，如果false则不需要看下一个返回值了，如果false，后续要close
 @return boolean true缓冲区满了，false没有满，如果true，则需要等待一段时间或者等到socket.TX_OK消息后再尝试发送，同时忽略下一个返回值
 @return boolean true已经收到应答，false没有收到应答，之后需要接收socket.TX_OK消息， 也可以忽略继续发送，直到full==true
-@usage local succ, full, result = socket.tx(ctrl, "123456", "xxx.xxx.xxx.xxx", xxxx)
+@usage
+local succ, full, result = socket.tx(ctrl, "123456", "xxx.xxx.xxx.xxx", xxxx)
+-- 协议头, 数据和结尾分开存放, 不需要先拼接成一个字符串
+local succ, full, result = socket.tx(ctrl, {hdr_buff, {payload_buff, 0, 1024}, "\r\n"})
 */
 static int l_socket_tx(lua_State *L)
 {
 	char ip_buf[68] = {0};
 	luat_socket_ctrl_t *l_ctrl = l_get_ctrl(L, 1);
 	luat_ip_addr_t ip_addr = {0};
-	luat_zbuff_t *buff = NULL;
+	luat_network_iovec_t iov[LUAT_SOCKET_TX_IOV_MAX];
 	const char *ip = NULL;
-	const char *data = NULL;
 	size_t ip_len = 0, data_len = 0;
 	ip_addr.type = 0xff;
-	if (lua_isstring(L, 2))
-	{
-		data_len = 0;
-		data = luaL_checklstring(L, 2, &data_len);
-	}
-	else
-	{
-		buff = ((luat_zbuff_t *)luaL_checkudata(L, 2, LUAT_ZBUFF_TYPE));
-		data = (const char*)buff->addr;
-		data_len = buff->used;
-	}
+	uint32_t iov_cnt = l_socket_tx_iov(L, 2, iov, &data_len);
 	if (lua_isinteger(L, 3))
 	{
 		ip_addr.type = 0;
@@ -498,7 +632,7 @@ static int l_socket_tx(lua_State *L)
 
 	}
 	uint32_t tx_len;
-	int result = network_tx(l_ctrl->netc, (const uint8_t *)data, data_len, luaL_optinteger(L, 5, 0), (ip_addr.type != 0xff)?&ip_addr:NULL, luaL_optinteger(L, 4, 0), &tx_len, 0);
+	int result = network_txv(l_ctrl->netc, iov, iov_cnt, luaL_optinteger(L, 5, 0), (ip_addr.type != 0xff)?&ip_addr:NULL, luaL_optinteger(L, 4, 0), &tx_len, 0);
 	lua_pushboolean(L, (result < 0)?0:1);
 	lua_pushboolean(L, tx_len != data_len);
 	lua_pushboolean(L, result == 0);
@@ -507,15 +641,28 @@ static int l_socket_tx(lua_State *L)
 
 /*
 接收对端发出的数据，注意数据已经缓存在底层，使用本函数只是提取出来，UDP模式下一次只会取出一个数据包
-@api socket.rx(ctrl, buff, flag)
+@api socket.rx(ctrl, buff, maxlen)
 @user_data socket.create得到的ctrl
-@user_data zbuff 存放接收的数据，如果缓冲区不够大会自动扩容
-@int 接收参数，目前预留，不起作用
+@user_data zbuff 存放接收的数据，追加在used之后。不填maxlen时，如果缓冲区不够大会自动扩容；环形模式(buff:setRing)的zbuff不会扩容，只用剩余空间
+@int 本次最多读取的字节数，可选，默认0不限制。大于0时最多读取maxlen字节，并且只用zbuff的剩余空间，不扩容，没读完的数据留在底层，下次再读。UDP模式下剩余空间需要能放下一个完整的包
 @return boolean true没有异常发生，false失败了，如果false则不需要看下一个返回值了，如果false，后续要close
 @return int 本次接收到数据长度
 @return string 对端IP，只有UDP模式下才有意义，TCP模式返回nil，注意返回的格式，如果是IPV4，1byte 0x00 + 4byte地址 如果是IPV6，1byte 0x01 + 16byte地址
 @return int 对端port，只有UDP模式下才有意义，TCP模式返回0
-@usage local succ, data_len, ip, port = socket.rx(ctrl, buff)
+@return int 底层还剩多少数据没有读出来，大于0时处理完zbuff里的数据后应该再读一次
+@usage
+local succ, data_len, ip, port = socket.rx(ctrl, buff)
+-- 固定内存的流式接收, 例如下载文件
+local rbuf = zbuff.create(4096)
+rbuf:setRing(true)
+while true do
+    local succ, data_len, ip, port, rest = socket.rx(ctrl, rbuf, 2048)
+    if not succ then break end
+    if rbuf:used() > 0 then
+        io.writeFile("/data.bin", rbuf:read(rbuf:used()), "ab+")
+    end
+    if rest == 0 then break end
+end
 */
 static int l_socket_rx(lua_State *L)
 {
@@ -525,74 +672,42 @@ static int l_socket_rx(lua_State *L)
 	luat_ip_addr_t ip_addr;
 	uint8_t ip[17];
 	uint16_t port;
-	uint8_t new_flag = 0;
-	int rx_len;
-	int total_len;
-	int result = network_rx(l_ctrl->netc, NULL, 0, 0, NULL, NULL, &total_len);
+	uint32_t rx_len;
+	uint32_t rest_len;
+	int result = l_socket_rx_zbuff(l_ctrl->netc, buff, luaL_optinteger(L, 3, 0), &ip_addr, &port, &rx_len, &rest_len);
 	if (result < 0)
 	{
 		lua_pushboolean(L, 0);
 		lua_pushinteger(L, 0);
 		lua_pushnil(L);
 		lua_pushnil(L);
+		return 4;
 	}
-	else if (!total_len)
+	lua_pushboolean(L, 1);
+	lua_pushinteger(L, rx_len);
+	if (!rx_len || l_ctrl->netc->is_tcp)
 	{
-		lua_pushboolean(L, 1);
-		lua_pushinteger(L, 0);
 		lua_pushnil(L);
 		lua_pushnil(L);
 	}
 	else
 	{
-		if ((buff->len - buff->used) < total_len)
+		if (IPADDR_TYPE_V4 == ip_addr.type)
 		{
-			__zbuff_resize(buff, total_len + buff->used);
-		}
-		result = network_rx(l_ctrl->netc, buff->addr + buff->used, total_len, 0, &ip_addr, &port, &rx_len);
-		if (result < 0)
-		{
-			lua_pushboolean(L, 0);
-			lua_pushinteger(L, 0);
-			lua_pushnil(L);
-			lua_pushnil(L);
-		}
-		else if (!rx_len)
-		{
-			lua_pushboolean(L, 1);
-			lua_pushinteger(L, 0);
-			lua_pushnil(L);
-			lua_pushnil(L);
+			ip[0] = 0;
+			memcpy(ip + 1, &ip_addr.u_addr.ip4.addr, 4);
+			lua_pushlstring(L, (const char*)ip, 5);
 		}
 		else
 		{
-			buff->used += rx_len;
-			lua_pushboolean(L, 1);
-			lua_pushinteger(L, rx_len);
-			if (l_ctrl->netc->is_tcp)
-			{
-				lua_pushnil(L);
-				lua_pushnil(L);
-			}
-			else
-			{
-				if (IPADDR_TYPE_V4 == ip_addr.type)
-				{
-					ip[0] = 0;
-					memcpy(ip + 1, &ip_addr.u_addr.ip4.addr, 4);
-					lua_pushlstring(L, (const char*)ip, 5);
-				}
-				else
-				{
-					ip[0] = 1;
-					memcpy(ip + 1, ip_addr.u_addr.ip6.addr, 16);
-					lua_pushlstring(L, (const char*)ip, 17);
-				}
-				lua_pushinteger(L, port);
-			}
+			ip[0] = 1;
+			memcpy(ip + 1, ip_addr.u_addr.ip6.addr, 16);
+			lua_pushlstring(L, (const char*)ip, 17);
 		}
+		lua_pushinteger(L, port);
 	}
-	return 4;
+	lua_pushinteger(L, rest_len);
+	return 5;
 }
 
 /*
@@ -1054,22 +1169,11 @@ static int l_socket_tx(lua_State *L)
 {
 	luat_socket_ctrl_t *l_ctrl = l_get_ctrl(L, 1);
 	luat_ip_addr_t ip_addr = {0};
-	luat_zbuff_t *buff = NULL;
+	luat_network_iovec_t iov[LUAT_SOCKET_TX_IOV_MAX];
 	const char *ip = NULL;
-	const char *data = NULL;
 	size_t ip_len = 0, data_len = 0;
 	ip_addr.is_ipv6 = 0xff;
-	if (lua_isstring(L, 2))
-	{
-		data_len = 0;
-		data = luaL_checklstring(L, 2, &data_len);
-	}
-	else
-	{
-		buff = ((luat_zbuff_t *)luaL_checkudata(L, 2, LUAT_ZBUFF_TYPE));
-		data = (const char *)buff->addr;
-		data_len = buff->used;
-	}
+	uint32_t iov_cnt = l_socket_tx_iov(L, 2, iov, &data_len);
 	if (lua_isinteger(L, 3))
 	{
 		ip_addr.is_ipv6 = 0;
@@ -1095,7 +1199,7 @@ static int l_socket_tx(lua_State *L)
 		}
 	}
 	uint32_t tx_len;
-	int result = network_tx(l_ctrl->netc, (const uint8_t *)data, data_len, luaL_optinteger(L, 5, 0), (ip_addr.is_ipv6 != 0xff)?&ip_addr:NULL, luaL_optinteger(L, 4, 0), &tx_len, 0);
+	int result = network_txv(l_ctrl->netc, iov, iov_cnt, luaL_optinteger(L, 5, 0), (ip_addr.is_ipv6 != 0xff)?&ip_addr:NULL, luaL_optinteger(L, 4, 0), &tx_len, 0);
 	lua_pushboolean(L, (result < 0)?0:1);
 	lua_pushboolean(L, tx_len != data_len);
 	lua_pushboolean(L, result == 0);
@@ -1111,74 +1215,42 @@ static int l_socket_rx(lua_State *L)
 	luat_ip_addr_t ip_addr;
 	uint8_t ip[17];
 	uint16_t port;
-	uint8_t new_flag = 0;
-	int rx_len;
-	int total_len;
-	int result = network_rx(l_ctrl->netc, NULL, 0, 0, NULL, NULL, &total_len);
+	uint32_t rx_len;
+	uint32_t rest_len;
+	int result = l_socket_rx_zbuff(l_ctrl->netc, buff, luaL_optinteger(L, 3, 0), &ip_addr, &port, &rx_len, &rest_len);
 	if (result < 0)
 	{
 		lua_pushboolean(L, 0);
 		lua_pushinteger(L, 0);
 		lua_pushnil(L);
 		lua_pushnil(L);
+		return 4;
 	}
-	else if (!total_len)
+	lua_pushboolean(L, 1);
+	lua_pushinteger(L, rx_len);
+	if (!rx_len || l_ctrl->netc->is_tcp)
 	{
-		lua_pushboolean(L, 1);
-		lua_pushinteger(L, 0);
 		lua_pushnil(L);
 		lua_pushnil(L);
 	}
 	else
 	{
-		if ((buff->len - buff->used) < total_len)
+		if (!ip_addr.is_ipv6)
 		{
-			__zbuff_resize(buff, total_len + buff->used);
-		}
-		result = network_rx(l_ctrl->netc, buff->addr + buff->used, total_len, 0, &ip_addr, &port, &rx_len);
-		if (result < 0)
-		{
-			lua_pushboolean(L, 0);
-			lua_pushinteger(L, 0);
-			lua_pushnil(L);
-			lua_pushnil(L);
-		}
-		else if (!rx_len)
-		{
-			lua_pushboolean(L, 1);
-			lua_pushinteger(L, 0);
-			lua_pushnil(L);
-			lua_pushnil(L);
+			ip[0] = 0;
+			memcpy(ip + 1, &ip_addr.ipv4, 4);
+			lua_pushlstring(L, (const char*)ip, 5);
 		}
 		else
 		{
-			buff->used += rx_len;
-			lua_pushboolean(L, 1);
-			lua_pushinteger(L, rx_len);
-			if (l_ctrl->netc->is_tcp)
-			{
-				lua_pushnil(L);
-				lua_pushnil(L);
-			}
-			else
-			{
-				if (!ip_addr.is_ipv6)
-				{
-					ip[0] = 0;
-					memcpy(ip + 1, &ip_addr.ipv4, 4);
-					lua_pushlstring(L, (const char*)ip, 5);
-				}
-				else
-				{
-					ip[0] = 1;
-					memcpy(ip + 1, &ip_addr.ipv6_u8_addr, 16);
-					lua_pushlstring(L, (const char*)ip, 17);
-				}
-				lua_pushinteger(L, port);
-			}
+			ip[0] = 1;
+			memcpy(ip + 1, &ip_addr.ipv6_u8_addr, 16);
+			lua_pushlstring(L, (const char*)ip, 17);
 		}
+		lua_pushinteger(L, port);
 	}
-	return 4;
+	lua_pushinteger(L, rest_len);
+	return 5;
 }
 
 
@@ -151,8 +151,8 @@ extern void DBG_Printf(const char* format, ...);
 extern void DBG_HexPrintf(void *Data, unsigned int len);
 //#define DBG(x,y...)		DBG_Printf("%s %d:"x"\r\n", __FUNCTION__,__LINE__,##y)
 //#define DBG_ERR(x,y...)		DBG_Printf("%s %d:"x"\r\n", __FUNCTION__,__LINE__,##y)
-static int tls_random( void *p_rng,
-        unsigned char *output, size_t output_len );
+static int tls_random( void *p_rng,
+        unsigned char *output, size_t output_len );
 
 #define __NW_DEBUG_ENABLE__
 #ifdef __NW_DEBUG_ENABLE__
@@ -222,6 +222,40 @@ static int network_base_tx(network_ctrl_t *ctrl, const uint8_t *data, uint32_t l
 	return result;
 }
 
+static int network_base_txv(network_ctrl_t *ctrl, const luat_network_iovec_t *iov, uint32_t iov_cnt, int flags, luat_ip_addr_t *remote_ip, uint16_t remote_port)
+{
+	int result = -1;
+	uint32_t len = 0;
+	for (uint32_t i = 0; i < iov_cnt; i++)
+	{
+		len += iov[i].len;
+	}
+	if (ctrl->is_tcp)
+	{
+		result = network_socket_sendv(ctrl, iov, iov_cnt, flags, NULL, 0);
+	}
+	else
+	{
+		if (remote_ip)
+		{
+			result = network_socket_sendv(ctrl, iov, iov_cnt, flags, remote_ip, remote_port);
+		}
+		else
+		{
+			result = network_socket_sendv(ctrl, iov, iov_cnt, flags, ctrl->online_ip, ctrl->remote_port);
+		}
+	}
+	if (result >= 0)
+	{
+		ctrl->tx_size += len;
+	}
+	else
+	{
+		ctrl->need_close = 1;
+	}
+	return result;
+}
+
 static LUAT_RT_RET_TYPE tls_shorttimeout(LUAT_RT_CB_PARAM)
 {
 	network_ctrl_t *ctrl = (network_ctrl_t *)param;
@@ -1319,6 +1353,59 @@ int network_socket_send(network_ctrl_t *ctrl,const uint8_t *buf, uint32_t len, i
 	network_adapter_t *adapter = &prv_adapter_table[ctrl->adapter_index];
 	return adapter->opt->socket_send(ctrl->socket_id, ctrl->tag, buf, len, flags, remote_ip, remote_port, adapter->user_data);
 }
+//一次发送多段数据，适配器没有socket_sendv时，tcp逐段发送，udp合并成一个包再发送
+//返回值同socket_send，tcp时返回值小于总长度说明缓冲区满了，后面的数据没有发出去
+int network_socket_sendv(network_ctrl_t *ctrl, const luat_network_iovec_t *iov, uint32_t iov_cnt, int flags, luat_ip_addr_t *remote_ip, uint16_t remote_port)
+{
+	network_adapter_t *adapter = &prv_adapter_table[ctrl->adapter_index];
+	if (adapter->opt->socket_sendv)
+	{
+		return adapter->opt->socket_sendv(ctrl->socket_id, ctrl->tag, iov, iov_cnt, flags, remote_ip, remote_port, adapter->user_data);
+	}
+	if (1 == iov_cnt)
+	{
+		return adapter->opt->socket_send(ctrl->socket_id, ctrl->tag, iov[0].data, iov[0].len, flags, remote_ip, remote_port, adapter->user_data);
+	}
+	int result;
+	uint32_t total = 0;
+	if (ctrl->is_tcp)
+	{
+		for (uint32_t i = 0; i < iov_cnt; i++)
+		{
+			if (!iov[i].len) continue;
+			result = adapter->opt->socket_send(ctrl->socket_id, ctrl->tag, iov[i].data, iov[i].len, flags, remote_ip, remote_port, adapter->user_data);
+			if (result < 0)
+			{
+				return result;
+			}
+			total += result;
+			if ((uint32_t)result < iov[i].len)
+			{
+				break;
+			}
+		}
+		return total;
+	}
+	//udp必须是一个完整的包
+	for (uint32_t i = 0; i < iov_cnt; i++)
+	{
+		total += iov[i].len;
+	}
+	uint8_t *buf = malloc(total ? total : 1);
+	if (!buf)
+	{
+		return -1;
+	}
+	total = 0;
+	for (uint32_t i = 0; i < iov_cnt; i++)
+	{
+		memcpy(buf + total, iov[i].data, iov[i].len);
+		total += iov[i].len;
+	}
+	result = adapter->opt->socket_send(ctrl->socket_id, ctrl->tag, buf, total, flags, remote_ip, remote_port, adapter->user_data);
+	free(buf);
+	return result;
+}
 
 int network_getsockopt(network_ctrl_t *ctrl, int level, int optname, void *optval, uint32_t *optlen)
 {
@@ -1952,6 +2039,19 @@ int network_close(network_ctrl_t *ctrl, uint32_t timeout_ms)
  */
 int network_tx(network_ctrl_t *ctrl, const uint8_t *data, uint32_t len, int flags, luat_ip_addr_t *remote_ip, uint16_t remote_port, uint32_t *tx_len, uint32_t timeout_ms)
 {
+	luat_network_iovec_t iov = {.data = data, .len = len};
+	return network_txv(ctrl, &iov, 1, flags, remote_ip, remote_port, tx_len, timeout_ms);
+}
+/*
+ * 多段数据一起发送，tcp下等同于把各段拼接后调用network_tx，但不需要额外拼接
+ */
+int network_txv(network_ctrl_t *ctrl, const luat_network_iovec_t *iov, uint32_t iov_cnt, int flags, luat_ip_addr_t *remote_ip, uint16_t remote_port, uint32_t *tx_len, uint32_t timeout_ms)
+{
+	uint32_t len = 0;
+	for (uint32_t i = 0; i < iov_cnt; i++)
+	{
+		len += iov[i].len;
+	}
 	if ((ctrl->need_close) || (ctrl->socket_id < 0) || (ctrl->state != NW_STATE_ONLINE))
 	{
 		return -1;
@@ -1972,8 +2072,12 @@ int network_tx(network_ctrl_t *ctrl, const uint8_t *data, uint32_t len, int flag
 				ctrl->cache_data = NULL;
 			}
 			ctrl->cache_data = malloc(len);
-			memcpy(ctrl->cache_data, data, len);
-			ctrl->cache_len = len;
+			ctrl->cache_len = 0;
+			for (uint32_t i = 0; i < iov_cnt; i++)
+			{
+				memcpy(ctrl->cache_data + ctrl->cache_len, iov[i].data, iov[i].len);
+				ctrl->cache_len += iov[i].len;
+			}
 	    	mbedtls_ssl_session_reset(ctrl->ssl);
 	    	do
 	    	{
@@ -2000,7 +2104,27 @@ int network_tx(network_ctrl_t *ctrl, const uint8_t *data, uint32_t len, int flag
 			}while(ctrl->ssl->state != MBEDTLS_SSL_HANDSHAKE_OVER);
 			#endif
 		}
+		// 多段数据先拼成一块再加密, 每段单独写会变成多个记录, DTLS下更会拆成多个数据报
+		const uint8_t *data = iov_cnt ? iov[0].data : NULL;
+		uint8_t *gather = NULL;
+		if (iov_cnt > 1)
+		{
+			gather = malloc(len);
+			if (!gather)
+			{
+				NW_UNLOCK;
+				return -1;
+			}
+			len = 0;
+			for (uint32_t i = 0; i < iov_cnt; i++)
+			{
+				memcpy(gather + len, iov[i].data, iov[i].len);
+				len += iov[i].len;
+			}
+			data = gather;
+		}
 		result = mbedtls_ssl_write(ctrl->ssl, data, len);
+		free(gather);
 	    if (result < 0)
 	    {
 	    	DBG("%08x", -result);
@@ -2013,7 +2137,7 @@ int network_tx(network_ctrl_t *ctrl, const uint8_t *data, uint32_t len, int flag
 	else
 #endif
 	{
-		result = network_base_tx(ctrl, data, len, flags, remote_ip, remote_port);
+		result = network_base_txv(ctrl, iov, iov_cnt, flags, remote_ip, remote_port);
 		if (result < 0)
 		{
 			ctrl->need_close = 1;
@@ -2409,6 +2533,40 @@ static int network_base_tx(network_ctrl_t *ctrl, const uint8_t *data, uint32_t l
 	return result;
 }
 
+static int network_base_txv(network_ctrl_t *ctrl, const luat_network_iovec_t *iov, uint32_t iov_cnt, int flags, luat_ip_addr_t *remote_ip, uint16_t remote_port)
+{
+	int result = -1;
+	uint32_t len = 0;
+	for (uint32_t i = 0; i < iov_cnt; i++)
+	{
+		len += iov[i].len;
+	}
+	if (ctrl->is_tcp)
+	{
+		result = network_socket_sendv(ctrl, iov, iov_cnt, flags, NULL, 0);
+	}
+	else
+	{
+		if (remote_ip)
+		{
+			result = network_socket_sendv(ctrl, iov, iov_cnt, flags, remote_ip, remote_port);
+		}
+		else
+		{
+			result = network_socket_sendv(ctrl, iov, iov_cnt, flags, ctrl->online_ip, ctrl->remote_port);
+		}
+	}
+	if (result >= 0)
+	{
+		ctrl->tx_size += len;
+	}
+	else
+	{
+		ctrl->need_close = 1;
+	}
+	return result;
+}
+
 static int32_t tls_shorttimeout(void *data, void *param)
 {
 	network_ctrl_t *ctrl = (network_ctrl_t *)param;
@@ -2645,12 +2803,14 @@ static int network_prepare_connect(network_ctrl_t *ctrl)
 		return -1;
 	}
 
+	//先切到连接中再发起连接, posix等适配器在自己的线程里回调, 可能在返回前就上报了结果
+	ctrl->state = NW_STATE_CONNECTING;
 	if (network_base_connect(ctrl, &ctrl->remote_ip))
 	{
 		network_socket_force_close(ctrl);
+		ctrl->state = NW_STATE_OFF_LINE;
 		return -1;
 	}
-	ctrl->state = NW_STATE_CONNECTING;
 	return 0;
 }
 
@@ -2669,11 +2829,12 @@ static int network_state_link_off(network_ctrl_t *ctrl, OS_EVENT *event, network
 			{
 				if (ctrl->is_server_mode)
 				{
+					ctrl->state = NW_STATE_CONNECTING;
 					if (network_base_connect(ctrl, NULL))
 					{
+						ctrl->state = NW_STATE_OFF_LINE;
 						return -1;
 					}
-					ctrl->state = NW_STATE_CONNECTING;
 				}
 				else
 				{
@@ -3076,6 +3237,21 @@ static void network_default_statemachine(network_ctrl_t *ctrl, OS_EVENT *event,
 	}
 }
 
+#if UINTPTR_MAX > UINT32_MAX
+//64位平台上Param3装不下network_ctrl指针, 用socket id和tag找回
+static network_ctrl_t *network_find_ctrl(network_adapter_t *adapter, int socket_id, uint64_t tag)
+{
+	int i;
+	for (i = 0; i < adapter->opt->max_socket_num; i++)
+	{
+		if (adapter->ctrl_busy[i] && (adapter->ctrl_table[i].socket_id == socket_id) && (adapter->ctrl_table[i].tag == tag))
+		{
+			return &adapter->ctrl_table[i];
+		}
+	}
+	return NULL;
+}
+#endif
 
 static int32_t network_default_socket_callback(void *data, void *param)
 {
@@ -3084,7 +3260,13 @@ static int32_t network_default_socket_callback(void *data, void *param)
 	luat_network_cb_param_t *cb_param = (luat_network_cb_param_t *)param;
 	network_adapter_t *adapter =(network_adapter_t *)(cb_param->param);
 	int i = 0;
-	network_ctrl_t *ctrl = (network_ctrl_t *)event->Param3;
+	network_ctrl_t *ctrl = (network_ctrl_t *)(uintptr_t)event->Param3;
+#if UINTPTR_MAX > UINT32_MAX
+	if ((event->ID > EV_NW_TIMEOUT) && (event->ID != EV_NW_DNS_RESULT))
+	{
+		ctrl = network_find_ctrl(adapter, (int)event->Param1, cb_param->tag);
+	}
+#endif
 	if (event->ID > EV_NW_TIMEOUT)
 	{
 		if (ctrl && ((ctrl->tag == cb_param->tag) || (event->ID == EV_NW_DNS_RESULT)))
@@ -3111,7 +3293,10 @@ static int32_t network_default_socket_callback(void *data, void *param)
 		else
 		{
 			DBG_ERR("cb ctrl invaild %x", ctrl);
-			DBG_HexPrintf(&ctrl->tag, 8);
+			if (ctrl)
+			{
+				DBG_HexPrintf(&ctrl->tag, 8);
+			}
 			DBG_HexPrintf(&cb_param->tag, 8);
 		}
 	}
@@ -3576,6 +3761,59 @@ int network_socket_send(network_ctrl_t *ctrl,const uint8_t *buf, uint32_t len, i
 	network_adapter_t *adapter = &prv_adapter_table[ctrl->adapter_index];
 	return adapter->opt->socket_send(ctrl->socket_id, ctrl->tag, buf, len, flags, remote_ip, remote_port, adapter->user_data);
 }
+//一次发送多段数据，适配器没有socket_sendv时，tcp逐段发送，udp合并成一个包再发送
+//返回值同socket_send，tcp时返回值小于总长度说明缓冲区满了，后面的数据没有发出去
+int network_socket_sendv(network_ctrl_t *ctrl, const luat_network_iovec_t *iov, uint32_t iov_cnt, int flags, luat_ip_addr_t *remote_ip, uint16_t remote_port)
+{
+	network_adapter_t *adapter = &prv_adapter_table[ctrl->adapter_index];
+	if (adapter->opt->socket_sendv)
+	{
+		return adapter->opt->socket_sendv(ctrl->socket_id, ctrl->tag, iov, iov_cnt, flags, remote_ip, remote_port, adapter->user_data);
+	}
+	if (1 == iov_cnt)
+	{
+		return adapter->opt->socket_send(ctrl->socket_id, ctrl->tag, iov[0].data, iov[0].len, flags, remote_ip, remote_port, adapter->user_data);
+	}
+	int result;
+	uint32_t total = 0;
+	if (ctrl->is_tcp)
+	{
+		for (uint32_t i = 0; i < iov_cnt; i++)
+		{
+			if (!iov[i].len) continue;
+			result = adapter->opt->socket_send(ctrl->socket_id, ctrl->tag, iov[i].data, iov[i].len, flags, remote_ip, remote_port, adapter->user_data);
+			if (result < 0)
+			{
+				return result;
+			}
+			total += result;
+			if ((uint32_t)result < iov[i].len)
+			{
+				break;
+			}
+		}
+		return total;
+	}
+	//udp必须是一个完整的包
+	for (uint32_t i = 0; i < iov_cnt; i++)
+	{
+		total += iov[i].len;
+	}
+	uint8_t *buf = malloc(total ? total : 1);
+	if (!buf)
+	{
+		return -1;
+	}
+	total = 0;
+	for (uint32_t i = 0; i < iov_cnt; i++)
+	{
+		memcpy(buf + total, iov[i].data, iov[i].len);
+		total += iov[i].len;
+	}
+	result = adapter->opt->socket_send(ctrl->socket_id, ctrl->tag, buf, total, flags, remote_ip, remote_port, adapter->user_data);
+	free(buf);
+	return result;
+}
 
 int network_getsockopt(network_ctrl_t *ctrl, int level, int optname, void *optval, uint32_t *optlen)
 {
@@ -3638,7 +3876,8 @@ void network_clean_invaild_socket(uint8_t adapter_index)
 	network_adapter_t *adapter = &prv_adapter_table[adapter_index];
 	network_ctrl_t *ctrl = NULL;
 	list = malloc(adapter->opt->max_socket_num * sizeof(int));
-	NW_LOCK;
+	//这里还没有具体的ctrl, 不能用NW_LOCK
+	OS_LOCK;
 	for (i = 0; i < adapter->opt->max_socket_num; i++)
 	{
 		ctrl = &adapter->ctrl_table[i];
@@ -3654,7 +3893,7 @@ void network_clean_invaild_socket(uint8_t adapter_index)
 		DBG("%d,%d", i, list[i]);
 	}
 	adapter->opt->socket_clean(list, adapter->opt->max_socket_num, adapter->user_data);
-	NW_UNLOCK;
+	OS_UNLOCK;
 	free(list);
 }
 
@@ -4010,6 +4249,7 @@ int network_listen(network_ctrl_t *ctrl, uint32_t timeout_ms)
 		ctrl->state = NW_STATE_LINK_OFF;
 		goto NETWORK_LISTEN_WAIT;
 	}
+	ctrl->state = NW_STATE_CONNECTING;
 	if (network_base_connect(ctrl, NULL))
 	{
 		ctrl->state = NW_STATE_OFF_LINE;
@@ -4017,7 +4257,6 @@ int network_listen(network_ctrl_t *ctrl, uint32_t timeout_ms)
 		NW_UNLOCK;
 		return -1;
 	}
-	ctrl->state = NW_STATE_CONNECTING;
 NETWORK_LISTEN_WAIT:
 	NW_UNLOCK;
 	if (!ctrl->task_handle || !timeout_ms)
@@ -4146,6 +4385,19 @@ int network_close(network_ctrl_t *ctrl, uint32_t timeout_ms)
  */
 int network_tx(network_ctrl_t *ctrl, const uint8_t *data, uint32_t len, int flags, luat_ip_addr_t *remote_ip, uint16_t remote_port, uint32_t *tx_len, uint32_t timeout_ms)
 {
+	luat_network_iovec_t iov = {.data = data, .len = len};
+	return network_txv(ctrl, &iov, 1, flags, remote_ip, remote_port, tx_len, timeout_ms);
+}
+/*
+ * 多段数据一起发送，tcp下等同于把各段拼接后调用network_tx，但不需要额外拼接
+ */
+int network_txv(network_ctrl_t *ctrl, const luat_network_iovec_t *iov, uint32_t iov_cnt, int flags, luat_ip_addr_t *remote_ip, uint16_t remote_port, uint32_t *tx_len, uint32_t timeout_ms)
+{
+	uint32_t len = 0;
+	for (uint32_t i = 0; i < iov_cnt; i++)
+	{
+		len += iov[i].len;
+	}
 	if ((ctrl->need_close) || (ctrl->socket_id < 0) || (ctrl->state != NW_STATE_ONLINE))
 	{
 		return -1;
@@ -4166,8 +4418,12 @@ int network_tx(network_ctrl_t *ctrl, const uint8_t *data, uint32_t len, int flag
 				ctrl->cache_data = NULL;
 			}
 			ctrl->cache_data = malloc(len);
-			memcpy(ctrl->cache_data, data, len);
-			ctrl->cache_len = len;
+			ctrl->cache_len = 0;
+			for (uint32_t i = 0; i < iov_cnt; i++)
+			{
+				memcpy(ctrl->cache_data + ctrl->cache_len, iov[i].data, iov[i].len);
+				ctrl->cache_len += iov[i].len;
+			}
 	    	mbedtls_ssl_session_reset(ctrl->ssl);
 	    	do
 	    	{
@@ -4187,7 +4443,27 @@ int network_tx(network_ctrl_t *ctrl, const uint8_t *data, uint32_t len, int flag
 	    		}
 	    	}while(ctrl->ssl->state != MBEDTLS_SSL_HANDSHAKE_OVER);
 		}
+		// 多段数据先拼成一块再加密, 每段单独写会变成多个记录, DTLS下更会拆成多个数据报
+		const uint8_t *data = iov_cnt ? iov[0].data : NULL;
+		uint8_t *gather = NULL;
+		if (iov_cnt > 1)
+		{
+			gather = malloc(len);
+			if (!gather)
+			{
+				NW_UNLOCK;
+				return -1;
+			}
+			len = 0;
+			for (uint32_t i = 0; i < iov_cnt; i++)
+			{
+				memcpy(gather + len, iov[i].data, iov[i].len);
+				len += iov[i].len;
+			}
+			data = gather;
+		}
 		result = mbedtls_ssl_write(ctrl->ssl, data, len);
+		free(gather);
 	    if (result < 0)
 	    {
 	    	DBG("%08x", -result);
@@ -4200,7 +4476,7 @@ int network_tx(network_ctrl_t *ctrl, const uint8_t *data, uint32_t len, int flag
 	else
 #endif
 	{
-		result = network_base_tx(ctrl, data, len, flags, remote_ip, remote_port);
+		result = network_base_txv(ctrl, iov, iov_cnt, flags, remote_ip, remote_port);
 		if (result < 0)
 		{
 			ctrl->need_close = 1;
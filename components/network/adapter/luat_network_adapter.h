@@ -226,6 +226,12 @@ typedef struct
 	uint8_t remote_close;
 }socket_ctrl_t;		//推荐底层协议栈适配用的socket状态结构
 
+typedef struct
+{
+	const uint8_t *data;
+	uint32_t len;
+}luat_network_iovec_t;	//分散发送用的一段数据
+
 /*
  * info内的api必须全部是非阻塞的及任务的，并且对socket_id和tag做合法性检查
  * 目前只支持tcp和udp，不支持raw
@@ -284,6 +290,9 @@ typedef struct
 	//OS_EVENT ID为EV_NW_XXX，param1是socket id param2是各自参数 param3是create_soceket传入的socket_param(就是network_ctrl *)
 	//dns结果是特别的，ID为EV_NW_SOCKET_DNS_RESULT，param1是获取到的IP数据量，0就是失败了，param2是ip组，动态分配的， param3是dns传入的param(就是network_ctrl *)
 	void (*socket_set_callback)(CBFuncEx_t cb_fun, void *param, void *user_data);
+	//可选，一次发送多段数据，返回值同socket_send，udp时多段数据组成一个包
+	//为NULL时由network_socket_sendv逐段调用socket_send
+	int (*socket_sendv)(int socket_id, uint64_t tag, const luat_network_iovec_t *iov, uint32_t iov_cnt, int flags, luat_ip_addr_t *remote_ip, uint16_t remote_port, void *user_data);
 
 	char *name;
 	int max_socket_num;//最大socket数量，也是最大network_ctrl申请数量的基础值
@@ -376,6 +385,8 @@ int network_socket_receive(network_ctrl_t *ctrl,uint8_t *buf, uint32_t len, int
 //tcp时，不需要remote_ip和remote_port
 //成功返回0，失败 < 0
 int network_socket_send(network_ctrl_t *ctrl,const uint8_t *buf, uint32_t len, int flags, luat_ip_addr_t *remote_ip, uint16_t remote_port);
+//多段数据一起发送，返回值同network_socket_send
+int network_socket_sendv(network_ctrl_t *ctrl, const luat_network_iovec_t *iov, uint32_t iov_cnt, int flags, luat_ip_addr_t *remote_ip, uint16_t remote_port);
 
 int network_getsockopt(network_ctrl_t *ctrl, int level, int optname, void *optval, uint32_t *optlen);
 int network_setsockopt(network_ctrl_t *ctrl, int level, int optname, const void *optval, uint32_t optlen);
@@ -465,6 +476,10 @@ int network_close(network_ctrl_t *ctrl, uint32_t timeout_ms);
  * 则塞模式，*tx_len不需要看，非则塞模式需要看*tx_len的实际长度是不是和len一致
  */
 int network_tx(network_ctrl_t *ctrl, const uint8_t *data, uint32_t len, int flags, luat_ip_addr_t *remote_ip, uint16_t remote_port, uint32_t *tx_len, uint32_t timeout_ms);
+/*
+ * 同network_tx，数据由多段组成，不需要先拼接到一起，*tx_len是各段实际发送的总长度
+ */
+int network_txv(network_ctrl_t *ctrl, const luat_network_iovec_t *iov, uint32_t iov_cnt, int flags, luat_ip_addr_t *remote_ip, uint16_t remote_port, uint32_t *tx_len, uint32_t timeout_ms);
 /*
  * 实际读到的数据量在read_len里，如果是UDP模式且为server时，需要看remote_ip和remote_port
  */
@@ -45,15 +45,20 @@ static int32_t l_mqtt_callback(lua_State *L, void* ptr){
 		case MQTT_MSG_PUBLISH : {
 			luat_mqtt_msg_t *mqtt_msg =(luat_mqtt_msg_t *)msg->arg2;
 			if (mqtt_ctrl->mqtt_cb) {
-				luat_mqtt_msg_t *mqtt_msg =(luat_mqtt_msg_t *)msg->arg2;
 				lua_geti(L, LUA_REGISTRYINDEX, mqtt_ctrl->mqtt_cb);
 				if (lua_isfunction(L, -1)) {
 					lua_geti(L, LUA_REGISTRYINDEX, mqtt_ctrl->mqtt_ref);
 					lua_pushstring(L, "recv");
 					lua_pushlstring(L, (const char*)(mqtt_msg->data),mqtt_msg->topic_len);
-					lua_pushlstring(L, (const char*)(mqtt_msg->data+mqtt_msg->topic_len),mqtt_msg->payload_len);
+					// 写入了sink的大消息, payload就是rxsink设置的zbuff或文件路径
+					if (mqtt_msg->sink == MQTT_SINK_ZBUFF)
+						lua_geti(L, LUA_REGISTRYINDEX, mqtt_ctrl->sink_ref);
+					else if (mqtt_msg->sink == MQTT_SINK_FILE)
+						lua_pushstring(L, mqtt_ctrl->sink_path);
+					else
+						lua_pushlstring(L, (const char*)(mqtt_msg->data+mqtt_msg->topic_len),mqtt_msg->payload_len);
 					
-					// 增加一个返回值meta，类型为table，包含qos、retain和dup
+					// 增加一个返回值meta，类型为table，包含qos、retain、dup和len
 					// 	mqttc:on(function(mqtt_client, event, data, payload, meta)
             		// 		if event == "recv" then
             		//     	log.info("mqtt recv", "topic", data)
@@ -61,24 +66,33 @@ static int32_t l_mqtt_callback(lua_State *L, void* ptr){
             		//     	log.info("mqtt recv", 'meta.qos', meta.qos)
             		//     	log.info("mqtt recv", 'meta.retain', meta.retain)
             		//     	log.info("mqtt recv", 'meta.dup', meta.dup)
-					lua_createtable(L, 0, 3);
+            		//     	log.info("mqtt recv", 'meta.len', meta.len)
+					// 这些标志取自消息本身, 此时网络层可能已经在收下一个报文了
+					lua_createtable(L, 0, 4);
 
 					lua_pushliteral(L, "qos"); 
-					lua_pushinteger(L, MQTTParseMessageQos(mqtt_ctrl->mqtt_packet_buffer));
+					lua_pushinteger(L, MQTTParseMessageQos(&mqtt_msg->header));
 					lua_settable(L, -3);
 
 					lua_pushliteral(L, "retain"); 
-					lua_pushinteger(L, MQTTParseMessageRetain(mqtt_ctrl->mqtt_packet_buffer));
+					lua_pushinteger(L, MQTTParseMessageRetain(&mqtt_msg->header));
 					lua_settable(L, -3);
 
 					lua_pushliteral(L, "dup"); 
-					lua_pushinteger(L, MQTTParseMessageDuplicate(mqtt_ctrl->mqtt_packet_buffer));
+					lua_pushinteger(L, MQTTParseMessageDuplicate(&mqtt_msg->header));
+					lua_settable(L, -3);
+
+					lua_pushliteral(L, "len"); 
+					lua_pushinteger(L, mqtt_msg->payload_len);
 					lua_settable(L, -3);
 
 					// lua_call(L, 4, 0);
 					lua_call(L, 5, 0);
 				}
             }
+			// 回调返回后sink可以接收下一条大消息了
+			if (mqtt_msg->sink)
+				mqtt_ctrl->sink_busy = 0;
 			luat_heap_free(mqtt_msg);
             break;
         }
@@ -414,7 +428,7 @@ static int l_mqtt_keepalive(lua_State *L) {
 /*
 注册mqtt回调
 @api mqttc:on(cb)
-@function cb mqtt回调,参数包括mqtt_client, event, data, payload
+@function cb mqtt回调,参数包括mqtt_client, event, data, payload, meta
 @return nil 无返回值
 @usage 
 mqttc:on(function(mqtt_client, event, data, payload)
@@ -538,6 +552,61 @@ static int l_mqtt_publish(lua_State *L) {
 	return 1;
 }
 
+/*
+设置大消息的接收方式, payload直接写入zbuff或文件, 不再整条转成string
+@api mqttc:rxsink(target, min_len)
+@zbuff/string zbuff或文件路径, nil则恢复默认, 全部转成string
+@int payload不小于这个长度才写入target, 默认4096
+@return bool 成功返回true,否则返回false
+@usage
+-- payload是在网络任务里直接写入target的, 设置之后只能在收到消息的回调里读取target,
+-- 回调之外不要读写/resize这个zbuff, 也不要打开/删除这个文件, 直到rxsink()取消
+-- zbuff不会被自动扩容, payload比zbuff长度大的消息仍以string传递, 请按最大消息创建zbuff
+-- 文件方式在网络任务里调用文件系统接口, 需要所用的文件系统(vfs)可以跨任务访问
+-- 大于等于4k的消息写入zbuff, 回调的payload参数就是这个zbuff, 长度看meta.len或buff:used()
+local buff = zbuff.create(64*1024)
+mqttc:rxsink(buff)
+-- 写入文件, 回调的payload参数是文件路径, 每条消息会覆盖上一条
+mqttc:rxsink("/ota.bin", 1024)
+-- 恢复默认
+mqttc:rxsink()
+-- 注意: 回调返回之前收到的大消息仍会存入内存并以string传递, 不会覆盖target
+*/
+static int l_mqtt_rxsink(lua_State *L) {
+	luat_mqtt_ctrl_t * mqtt_ctrl = get_mqtt_ctrl(L);
+	size_t len = 0;
+	if (mqtt_ctrl->sink_busy || mqtt_ctrl->parser.state == MQTT_PARSE_PUB_PAYLOAD) {
+		LLOGW("mqtt msg is writing to sink, try later");
+		lua_pushboolean(L, 0);
+		return 1;
+	}
+	if (mqtt_ctrl->sink_ref) {
+		luaL_unref(L, LUA_REGISTRYINDEX, mqtt_ctrl->sink_ref);
+		mqtt_ctrl->sink_ref = 0;
+	}
+	mqtt_ctrl->sink_type = MQTT_SINK_NONE;
+	mqtt_ctrl->sink_zbuff = NULL;
+	mqtt_ctrl->sink_min = luaL_optinteger(L, 3, MQTT_RECV_BUF_LEN_MAX);
+	if (luaL_testudata(L, 2, LUAT_ZBUFF_TYPE)) {
+		mqtt_ctrl->sink_zbuff = luaL_checkudata(L, 2, LUAT_ZBUFF_TYPE);
+		lua_pushvalue(L, 2);
+		mqtt_ctrl->sink_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+		mqtt_ctrl->sink_type = MQTT_SINK_ZBUFF;
+	}
+	else if (lua_type(L, 2) == LUA_TSTRING) {
+		const char* path = luaL_checklstring(L, 2, &len);
+		if (len >= sizeof(mqtt_ctrl->sink_path)) {
+			LLOGE("path too long %s", path);
+			lua_pushboolean(L, 0);
+			return 1;
+		}
+		memcpy(mqtt_ctrl->sink_path, path, len + 1);
+		mqtt_ctrl->sink_type = MQTT_SINK_FILE;
+	}
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
 /*
 mqtt客户端关闭(关闭后资源释放无法再使用)
 @api mqttc:close()
@@ -552,6 +621,11 @@ static int l_mqtt_close(lua_State *L) {
 		luaL_unref(L, LUA_REGISTRYINDEX, mqtt_ctrl->mqtt_cb);
 		mqtt_ctrl->mqtt_cb = 0;
 	}
+	if (mqtt_ctrl->sink_ref) {
+		luaL_unref(L, LUA_REGISTRYINDEX, mqtt_ctrl->sink_ref);
+		mqtt_ctrl->sink_ref = 0;
+	}
+	mqtt_ctrl->sink_type = MQTT_SINK_NONE;
 	luat_mqtt_release_socket(mqtt_ctrl);
 	return 0;
 }
@@ -618,6 +692,7 @@ static const rotable_Reg_t reg_mqtt[] =
 	{"ready",			ROREG_FUNC(l_mqtt_ready)},
 	{"will",			ROREG_FUNC(l_mqtt_will)},
 	{"debug",			ROREG_FUNC(l_mqtt_set_debug)},
+	{"rxsink",			ROREG_FUNC(l_mqtt_rxsink)},
 
 	{ NULL,             ROREG_INT(0)}
 };
@@ -5,7 +5,21 @@
 #define MQTT_MSG_TIMER_PING 2
 #define MQTT_MSG_RECONNECT  3
 
+#include "luat_mqtt_parser.h"
+
+// 每次从网络读取的长度, 读到的数据直接交给解析器, 不需要凑整包
+#define MQTT_RECV_CHUNK_LEN 1024
+// 小于等于这个长度的报文整包缓存后处理, 更大的PUBLISH流式接收, 其他报文超过则断开
+#ifndef MQTT_RECV_BUF_LEN_MAX
 #define MQTT_RECV_BUF_LEN_MAX 4096
+#endif
+
+// 大消息的接收方式
+enum {
+	MQTT_SINK_NONE = 0,		// 存入内存, 回调时转成string
+	MQTT_SINK_ZBUFF,		// 写入用户指定的zbuff
+	MQTT_SINK_FILE,			// 写入用户指定的文件
+};
 
 
 typedef struct{
@@ -13,8 +27,8 @@ typedef struct{
 	network_ctrl_t *netc;		// mqtt netc
 	luat_ip_addr_t ip_addr;		// mqtt ip
 	char host[192]; 			// mqtt host
-	uint16_t buffer_offset; 	// 用于标识mqtt_packet_buffer当前有多少数据
-	uint8_t mqtt_packet_buffer[MQTT_RECV_BUF_LEN_MAX + 4];
+	luat_mqtt_parser_t parser;	// 接收报文解析器
+	uint8_t rx_buff[MQTT_RECV_CHUNK_LEN];
 	int mqtt_cb;				// mqtt lua回调函数
 	uint16_t remote_port; 		// 远程端口号
 	uint32_t keepalive;   		// 心跳时长 单位s
@@ -25,11 +39,23 @@ typedef struct{
 	void* reconnect_timer;		// mqtt重连定时器
 	void* ping_timer;			// mqtt_ping定时器
 	int mqtt_ref;				// 强制引用自身避免被GC
+	uint8_t sink_type;			// 大消息的接收方式, MQTT_SINK_XXX
+	uint8_t sink_busy;			// 上一条写入sink的消息lua还没处理完, 期间改为存入内存
+	uint32_t sink_min;			// payload不小于这个长度才写入sink
+	void* sink_zbuff;			// MQTT_SINK_ZBUFF时的zbuff
+	int sink_ref;				// 对sink_zbuff的引用, 避免被GC
+	char sink_path[64];			// MQTT_SINK_FILE时的文件路径
+	void* rx_msg;				// 正在接收的PUBLISH消息
+	uint32_t rx_got;			// 已收到的payload长度
+	void* rx_fd;				// MQTT_SINK_FILE时正在写入的文件
+	uint16_t rx_msg_id;
 }luat_mqtt_ctrl_t;
 
 typedef struct{
 	uint16_t topic_len;
-    uint16_t payload_len;
+	uint8_t header;				// 固定头部第一个字节, 包含qos/retain/dup
+	uint8_t sink;				// 不为MQTT_SINK_NONE时data只有topic, payload在sink里
+	uint32_t payload_len;
 	uint8_t data[];
 }luat_mqtt_msg_t;
 
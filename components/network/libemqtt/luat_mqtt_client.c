@@ -6,6 +6,7 @@
 #include "luat_zbuff.h"
 #include "luat_malloc.h"
 #include "luat_mqtt.h"
+#include "luat_fs.h"
 
 #define LUAT_LOG_TAG "mqtt"
 #include "luat_log.h"
@@ -17,7 +18,8 @@
 #define LLOGD(...)
 #endif
 
-static int luat_mqtt_msg_cb(luat_mqtt_ctrl_t *mqtt_ctrl);
+static const luat_mqtt_parser_cb_t mqtt_parser_cb;
+static void mqtt_rx_drop(luat_mqtt_ctrl_t *mqtt_ctrl);
 
 
 LUAT_RT_RET_TYPE luat_mqtt_timer_callback(LUAT_RT_CB_PARAM){
@@ -61,6 +63,7 @@ int luat_mqtt_init(luat_mqtt_ctrl_t *mqtt_ctrl, int adapter_index) {
 	mqtt_ctrl->keepalive = 240;
 	network_set_base_mode(mqtt_ctrl->netc, 1, 10000, 0, 0, 0, 0);
 	network_set_local_port(mqtt_ctrl->netc, 0);
+	luat_mqtt_parser_init(&mqtt_ctrl->parser, &mqtt_parser_cb, mqtt_ctrl, MQTT_RECV_BUF_LEN_MAX);
 	mqtt_ctrl->reconnect_timer = luat_create_rtos_timer(reconnect_timer_cb, mqtt_ctrl, NULL);
 	mqtt_ctrl->ping_timer = luat_create_rtos_timer(luat_mqtt_timer_callback, mqtt_ctrl, NULL);
     return 0;
@@ -95,7 +98,6 @@ int luat_mqtt_set_connopts(luat_mqtt_ctrl_t *mqtt_ctrl, luat_mqtt_connopts_t *op
 
 static void mqtt_reconnect(luat_mqtt_ctrl_t *mqtt_ctrl){
 	LLOGI("reconnect after %dms", mqtt_ctrl->reconnect_time);
-	mqtt_ctrl->buffer_offset = 0;
 	luat_start_rtos_timer(mqtt_ctrl->reconnect_timer, mqtt_ctrl->reconnect_time, 0);
 }
 
@@ -107,6 +109,7 @@ void luat_mqtt_close_socket(luat_mqtt_ctrl_t *mqtt_ctrl){
 	}
 	luat_stop_rtos_timer(mqtt_ctrl->ping_timer);
 	mqtt_ctrl->mqtt_state = 0;
+	mqtt_rx_drop(mqtt_ctrl);
 	if (mqtt_ctrl->reconnect && mqtt_ctrl->reconnect_time > 0){
 		mqtt_reconnect(mqtt_ctrl);
 	}
@@ -131,187 +134,232 @@ void luat_mqtt_release_socket(luat_mqtt_ctrl_t *mqtt_ctrl){
 		network_release_ctrl(mqtt_ctrl->netc);
     	mqtt_ctrl->netc = NULL;
 	}
+	mqtt_rx_drop(mqtt_ctrl);
+	luat_mqtt_parser_deinit(&mqtt_ctrl->parser);
 }
 
-static int mqtt_parse(luat_mqtt_ctrl_t *mqtt_ctrl) {
-	LLOGD("mqtt_parse offset %d", mqtt_ctrl->buffer_offset);
-	if (mqtt_ctrl->buffer_offset < 2) {
-		LLOGD("wait more data");
-		return 0;
+// 丢弃还没收完的消息, 断线或出错时调用
+static void mqtt_rx_drop(luat_mqtt_ctrl_t *mqtt_ctrl) {
+	if (mqtt_ctrl->rx_fd) {
+		luat_fs_fclose(mqtt_ctrl->rx_fd);
+		mqtt_ctrl->rx_fd = NULL;
 	}
-	// 判断数据长度, 前几个字节能判断出够不够读出mqtt的头
-	char* buf = (char*)mqtt_ctrl->mqtt_packet_buffer;
-	int num_bytes = 1;
-	if ((buf[1] & 0x80) == 0x80) {
-		num_bytes++;
-		if (mqtt_ctrl->buffer_offset < 3) {
-			LLOGD("wait more data for mqtt head");
-			return 0;
+	if (mqtt_ctrl->rx_msg) {
+		luat_heap_free(mqtt_ctrl->rx_msg);
+		mqtt_ctrl->rx_msg = NULL;
+	}
+	luat_mqtt_parser_reset(&mqtt_ctrl->parser);
+}
+
+static int mqtt_publish_begin(void* userdata, uint8_t header, const uint8_t* topic, uint16_t topic_len, uint16_t msg_id, uint32_t payload_len) {
+	luat_mqtt_ctrl_t *mqtt_ctrl = (luat_mqtt_ctrl_t *)userdata;
+	uint8_t sink = MQTT_SINK_NONE;
+	if (mqtt_ctrl->sink_type != MQTT_SINK_NONE && !mqtt_ctrl->sink_busy && payload_len >= mqtt_ctrl->sink_min)
+		sink = mqtt_ctrl->sink_type;
+	// 这里跑在网络任务里, 不能改zbuff的大小(lua那边可能正拿着addr), 放不下就退回内存
+	if (sink == MQTT_SINK_ZBUFF && ((luat_zbuff_t *)mqtt_ctrl->sink_zbuff)->len < payload_len) {
+		LLOGW("payload %d > sink zbuff %d, deliver as string", payload_len, ((luat_zbuff_t *)mqtt_ctrl->sink_zbuff)->len);
+		sink = MQTT_SINK_NONE;
+	}
+	luat_mqtt_msg_t *mqtt_msg = luat_heap_malloc(sizeof(luat_mqtt_msg_t) + topic_len + (sink ? 0 : payload_len));
+	if (mqtt_msg == NULL) {
+		// 内存不够, 这条消息丢掉, 连接继续
+		LLOGE("out of memory for mqtt msg, topic %d payload %d", topic_len, payload_len);
+	}
+	else {
+		mqtt_msg->topic_len = topic_len;
+		mqtt_msg->header = header;
+		mqtt_msg->sink = sink;
+		mqtt_msg->payload_len = payload_len;
+		memcpy(mqtt_msg->data, topic, topic_len);
+		if (sink == MQTT_SINK_ZBUFF) {
+			luat_zbuff_t *buff = (luat_zbuff_t *)mqtt_ctrl->sink_zbuff;
+			buff->used = 0;
+			buff->head = 0;
 		}
-		if ((buf[2] & 0x80) == 0x80) {
-			num_bytes ++;
-			if (mqtt_ctrl->buffer_offset < 4) {
-				LLOGD("wait more data for mqtt head");
-				return 0;
-			}
-			if ((buf[3] & 0x80) == 0x80) {
-				num_bytes ++;
+		else if (sink == MQTT_SINK_FILE) {
+			// 文件也是在网络任务里写的, 依赖vfs自身的锁, lua层在回调之外不要打开这个路径
+			mqtt_ctrl->rx_fd = luat_fs_fopen(mqtt_ctrl->sink_path, "wb");
+			if (mqtt_ctrl->rx_fd == NULL) {
+				LLOGE("open %s fail, drop mqtt msg", mqtt_ctrl->sink_path);
+				luat_heap_free(mqtt_msg);
+				mqtt_msg = NULL;
 			}
 		}
 	}
-	// 判断数据总长, 这里rem_len只包含mqtt头部之外的数据
-	uint16_t rem_len = mqtt_parse_rem_len(mqtt_ctrl->mqtt_packet_buffer);
-	if (rem_len > mqtt_ctrl->buffer_offset - num_bytes - 1) {
-		LLOGD("wait more data for mqtt head");
+	mqtt_ctrl->rx_msg = mqtt_msg;
+	mqtt_ctrl->rx_got = 0;
+	mqtt_ctrl->rx_msg_id = msg_id;
+	return 0;
+}
+
+static int mqtt_publish_data(void* userdata, const uint8_t* data, uint32_t len) {
+	luat_mqtt_ctrl_t *mqtt_ctrl = (luat_mqtt_ctrl_t *)userdata;
+	luat_mqtt_msg_t *mqtt_msg = (luat_mqtt_msg_t *)mqtt_ctrl->rx_msg;
+	if (mqtt_msg == NULL)
 		return 0;
+	switch (mqtt_msg->sink) {
+	case MQTT_SINK_ZBUFF: {
+		luat_zbuff_t *buff = (luat_zbuff_t *)mqtt_ctrl->sink_zbuff;
+		memcpy(buff->addr + buff->used, data, len);
+		buff->used += len;
+		break;
 	}
-	// 至此, mqtt包是完整的 解析类型, 处理之
-	int ret = luat_mqtt_msg_cb(mqtt_ctrl);
-	if (ret != 0){
-		LLOGW("bad mqtt packet!! ret %d", ret);
-		return -1;
+	case MQTT_SINK_FILE:
+		if (luat_fs_fwrite(data, 1, len, mqtt_ctrl->rx_fd) != len) {
+			LLOGE("write %s fail, drop mqtt msg", mqtt_ctrl->sink_path);
+			luat_fs_fclose(mqtt_ctrl->rx_fd);
+			mqtt_ctrl->rx_fd = NULL;
+			luat_heap_free(mqtt_msg);
+			mqtt_ctrl->rx_msg = NULL;
+			return 0;
+		}
+		break;
+	default:
+		memcpy(mqtt_msg->data + mqtt_msg->topic_len + mqtt_ctrl->rx_got, data, len);
+		break;
 	}
-	// 处理完成后, 如果还有数据, 移动数据, 继续处理
-	mqtt_ctrl->buffer_offset -= (1 + num_bytes + rem_len);
-	memmove(mqtt_ctrl->mqtt_packet_buffer, mqtt_ctrl->mqtt_packet_buffer+1 + num_bytes + rem_len, mqtt_ctrl->buffer_offset);
-	return 1;
+	mqtt_ctrl->rx_got += len;
+	return 0;
 }
 
-int luat_mqtt_read_packet(luat_mqtt_ctrl_t *mqtt_ctrl){
-	// LLOGD("luat_mqtt_read_packet mqtt_ctrl->buffer_offset:%d",mqtt_ctrl->buffer_offset);
-	int ret = -1;
-	uint8_t *read_buff = NULL;
-	uint32_t total_len = 0;
-	uint32_t rx_len = 0;
-	int result = network_rx(mqtt_ctrl->netc, NULL, 0, 0, NULL, NULL, &total_len);
-	if (total_len > 0xFFF) {
-		LLOGE("too many data wait for recv %d", total_len);
-		luat_mqtt_close_socket(mqtt_ctrl);
-		return -1;
+static int mqtt_publish_end(void* userdata) {
+	luat_mqtt_ctrl_t *mqtt_ctrl = (luat_mqtt_ctrl_t *)userdata;
+	luat_mqtt_msg_t *mqtt_msg = (luat_mqtt_msg_t *)mqtt_ctrl->rx_msg;
+	uint8_t qos = (mqtt_ctrl->parser.header & 0x06) >> 1;
+	mqtt_ctrl->rx_msg = NULL;
+	if (mqtt_ctrl->rx_fd) {
+		luat_fs_fclose(mqtt_ctrl->rx_fd);
+		mqtt_ctrl->rx_fd = NULL;
 	}
-	if (total_len == 0) {
-		LLOGW("rx event but NO data wait for recv");
-		return 0;
+	if (mqtt_msg) {
+		// sink在lua处理完之前不能再写
+		if (mqtt_msg->sink)
+			mqtt_ctrl->sink_busy = 1;
+		l_luat_mqtt_msg_cb(mqtt_ctrl, MQTT_MSG_PUBLISH, (int)mqtt_msg);
 	}
-	if (MQTT_RECV_BUF_LEN_MAX - mqtt_ctrl->buffer_offset <= 0) {
-		LLOGE("buff is FULL, mqtt packet too big");
-		luat_mqtt_close_socket(mqtt_ctrl);
-		return -1;
-	}
-	#define MAX_READ (1024)
-	int recv_want = 0;
-
-	while (MQTT_RECV_BUF_LEN_MAX - mqtt_ctrl->buffer_offset > 0) {
-		if (MAX_READ > (MQTT_RECV_BUF_LEN_MAX - mqtt_ctrl->buffer_offset)) {
-			recv_want = MQTT_RECV_BUF_LEN_MAX - mqtt_ctrl->buffer_offset;
-		}
-		else {
-			recv_want = MAX_READ;
-		}
-		// 从网络接收数据
-		result = network_rx(mqtt_ctrl->netc, mqtt_ctrl->mqtt_packet_buffer + mqtt_ctrl->buffer_offset, recv_want, 0, NULL, NULL, &rx_len);
-		if (rx_len == 0 || result != 0 ) {
-			LLOGD("rx_len %d result %d", rx_len, result);
-			break;
-		}
-		// 收到数据了, 传给处理函数继续处理
-		// 数据的长度变更, 触发传递
-		mqtt_ctrl->buffer_offset += rx_len;
-		LLOGD("data recv %d offset %d", rx_len, mqtt_ctrl->buffer_offset);
-further:
-		result = mqtt_parse(mqtt_ctrl);
-		if (result == 0) {
-			// OK
-		}else if(result == 1){
-			if (mqtt_ctrl->buffer_offset > 0)
-				goto further;
-			else {
-				continue;
-			}
-		}
-		else {
-			LLOGW("mqtt_parse ret %d, closing socket");
-			luat_mqtt_close_socket(mqtt_ctrl);
-			break;
-		}
+	// 还要回复puback
+	if (qos == 1) {
+		mqtt_puback(&(mqtt_ctrl->broker), mqtt_ctrl->rx_msg_id);
 	}
 	return 0;
 }
 
-
-static int luat_mqtt_msg_cb(luat_mqtt_ctrl_t *mqtt_ctrl) {
-	rtos_msg_t msg = {0};
-    // msg.handler = l_mqtt_callback;
-    uint8_t msg_tp = MQTTParseMessageType(mqtt_ctrl->mqtt_packet_buffer);
+static int mqtt_packet_cb(void* userdata, uint8_t header, const uint8_t* body, uint32_t len) {
+	luat_mqtt_ctrl_t *mqtt_ctrl = (luat_mqtt_ctrl_t *)userdata;
+	uint8_t msg_tp = header & 0xF0;
 	uint16_t msg_id = 0;
-	uint8_t qos = 0;
-    switch (msg_tp) {
+	// PUBACK/PUBREC/PUBCOMP的可变头部就是msg id
+	if (len >= 2)
+		msg_id = (body[0] << 8) | body[1];
+	switch (msg_tp) {
 		case MQTT_MSG_CONNACK: {
 			// LLOGD("MQTT_MSG_CONNACK");
-			if(mqtt_ctrl->mqtt_packet_buffer[3] != 0x00){
-				LLOGW("CONACK 0x%02x",mqtt_ctrl->mqtt_packet_buffer[3]);
-                luat_mqtt_close_socket(mqtt_ctrl);
-                return -1;
-            }
+			if(len < 2 || body[1] != 0x00){
+				LLOGW("CONACK 0x%02x", len < 2 ? 0xFF : body[1]);
+				return -1;
+			}
 			mqtt_ctrl->mqtt_state = 1;
-            l_luat_mqtt_msg_cb(mqtt_ctrl, MQTT_MSG_CONNACK, 0);
-            break;
-        }
-        case MQTT_MSG_PUBLISH : {
+			l_luat_mqtt_msg_cb(mqtt_ctrl, MQTT_MSG_CONNACK, 0);
+			break;
+		}
+		case MQTT_MSG_PUBLISH : {
 			// LLOGD("MQTT_MSG_PUBLISH");
-			const uint8_t* ptr;
-			qos = MQTTParseMessageQos(mqtt_ctrl->mqtt_packet_buffer);
-			uint16_t topic_len = mqtt_parse_pub_topic_ptr(mqtt_ctrl->mqtt_packet_buffer, &ptr);
-			uint16_t payload_len = mqtt_parse_pub_msg_ptr(mqtt_ctrl->mqtt_packet_buffer, &ptr);
-			luat_mqtt_msg_t *mqtt_msg = (luat_mqtt_msg_t *)luat_heap_malloc(sizeof(luat_mqtt_msg_t)+topic_len+payload_len);
-			mqtt_msg->topic_len = mqtt_parse_pub_topic(mqtt_ctrl->mqtt_packet_buffer, mqtt_msg->data);
-            mqtt_msg->payload_len = mqtt_parse_publish_msg(mqtt_ctrl->mqtt_packet_buffer, mqtt_msg->data+topic_len);
-			l_luat_mqtt_msg_cb(mqtt_ctrl, MQTT_MSG_PUBLISH, mqtt_msg);
-			// 还要回复puback
-			if (qos == 1) {
-				msg_id = mqtt_parse_msg_id(mqtt_ctrl->mqtt_packet_buffer);
-				mqtt_puback(&(mqtt_ctrl->broker), msg_id);
-			}
-            break;
-        }
-        case MQTT_MSG_PUBACK : {
+			// 小消息整包到达, 也走流式接收的流程, 这样sink的处理只有一份
+			uint8_t qos = (header & 0x06) >> 1;
+			uint32_t var_len = 2 + (qos ? 2 : 0);
+			if (len < var_len)
+				return -1;
+			uint16_t topic_len = (body[0] << 8) | body[1];
+			var_len += topic_len;
+			if (len < var_len)
+				return -1;
+			if (qos)
+				msg_id = (body[2 + topic_len] << 8) | body[3 + topic_len];
+			mqtt_publish_begin(mqtt_ctrl, header, body + 2, topic_len, msg_id, len - var_len);
+			mqtt_publish_data(mqtt_ctrl, body + var_len, len - var_len);
+			mqtt_publish_end(mqtt_ctrl);
+			break;
+		}
+		case MQTT_MSG_PUBACK : {
 			// LLOGD("MQTT_MSG_PUBACK");
-            l_luat_mqtt_msg_cb(mqtt_ctrl, MQTT_MSG_PUBACK, mqtt_parse_msg_id(mqtt_ctrl->mqtt_packet_buffer));
+			l_luat_mqtt_msg_cb(mqtt_ctrl, MQTT_MSG_PUBACK, msg_id);
 			break;
 		}
 		case MQTT_MSG_PUBREC : {
-			msg_id = mqtt_parse_msg_id(&(mqtt_ctrl->broker));
 			mqtt_pubrel(&(mqtt_ctrl->broker), msg_id);
 			// LLOGD("MQTT_MSG_PUBREC");
 			break;
 		}
 		case MQTT_MSG_PUBCOMP : {
 			// LLOGD("MQTT_MSG_PUBCOMP");
-            l_luat_mqtt_msg_cb(mqtt_ctrl, MQTT_MSG_PUBCOMP, mqtt_parse_msg_id(mqtt_ctrl->mqtt_packet_buffer));
+			l_luat_mqtt_msg_cb(mqtt_ctrl, MQTT_MSG_PUBCOMP, msg_id);
 			break;
 		}
-        case MQTT_MSG_SUBACK : {
+		case MQTT_MSG_SUBACK : {
 			LLOGD("MQTT_MSG_SUBACK");
-            break;
-        }
+			break;
+		}
 		case MQTT_MSG_UNSUBACK : {
 			LLOGD("MQTT_MSG_UNSUBACK");
-            break;
-        }
-        case MQTT_MSG_PINGRESP : {
+			break;
+		}
+		case MQTT_MSG_PINGRESP : {
 			LLOGD("MQTT_MSG_PINGRESP");
-            break;
-        }
+			break;
+		}
 		case MQTT_MSG_DISCONNECT : {
 			// LLOGD("MQTT_MSG_DISCONNECT");
-            break;
-        }
-        default : {
+			break;
+		}
+		default : {
 			LLOGD("luat_mqtt_msg_cb error msg_tp:%d",msg_tp);
-            break;
-        }
-    }
-    return 0;
+			break;
+		}
+	}
+	return 0;
+}
+
+static const luat_mqtt_parser_cb_t mqtt_parser_cb = {
+	.on_packet = mqtt_packet_cb,
+	.on_publish_begin = mqtt_publish_begin,
+	.on_publish_data = mqtt_publish_data,
+	.on_publish_end = mqtt_publish_end,
+};
+
+int luat_mqtt_read_packet(luat_mqtt_ctrl_t *mqtt_ctrl){
+	int result = 0;
+	uint32_t rx_len = 0;
+	uint8_t *span = NULL;
+	uint32_t span_len = 0;
+	// 收多少解析多少, 报文长度不受接收缓冲区限制, 也不需要搬移剩余数据
+	while (1) {
+		// 正在拼包的话, 剩下的部分直接收到解析器的缓存里
+		span_len = luat_mqtt_parser_span(&mqtt_ctrl->parser, &span);
+		if (span_len > 0) {
+			result = network_rx(mqtt_ctrl->netc, span, span_len, 0, NULL, NULL, &rx_len);
+			if (rx_len == 0 || result != 0 ) {
+				LLOGD("rx_len %d result %d", rx_len, result);
+				break;
+			}
+			result = luat_mqtt_parser_commit(&mqtt_ctrl->parser, rx_len);
+		}
+		else {
+			result = network_rx(mqtt_ctrl->netc, mqtt_ctrl->rx_buff, MQTT_RECV_CHUNK_LEN, 0, NULL, NULL, &rx_len);
+			if (rx_len == 0 || result != 0 ) {
+				LLOGD("rx_len %d result %d", rx_len, result);
+				break;
+			}
+			LLOGD("data recv %d", rx_len);
+			result = luat_mqtt_parser_feed(&mqtt_ctrl->parser, mqtt_ctrl->rx_buff, rx_len);
+		}
+		if (result) {
+			LLOGW("bad mqtt packet!! ret %d, closing socket", result);
+			luat_mqtt_close_socket(mqtt_ctrl);
+			return -1;
+		}
+	}
+	return 0;
 }
 
 static const char* event2str(uint32_t id) {
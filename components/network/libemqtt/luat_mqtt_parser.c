@@ -0,0 +1,193 @@
+#include "luat_base.h"
+#include "luat_malloc.h"
+#include "luat_mqtt_parser.h"
+
+#define LUAT_LOG_TAG "mqtt"
+#include "luat_log.h"
+
+#define MQTT_TYPE_PUBLISH (3 << 4)
+
+void luat_mqtt_parser_init(luat_mqtt_parser_t* parser, const luat_mqtt_parser_cb_t* cb, void* userdata, uint32_t inline_max) {
+	memset(parser, 0, sizeof(luat_mqtt_parser_t));
+	parser->cb = cb;
+	parser->userdata = userdata;
+	parser->inline_max = inline_max;
+}
+
+void luat_mqtt_parser_reset(luat_mqtt_parser_t* parser) {
+	parser->state = MQTT_PARSE_HEADER;
+	parser->got = 0;
+}
+
+void luat_mqtt_parser_deinit(luat_mqtt_parser_t* parser) {
+	if (parser->buff) {
+		luat_heap_free(parser->buff);
+		parser->buff = NULL;
+	}
+	parser->buff_size = 0;
+	luat_mqtt_parser_reset(parser);
+}
+
+// 缓存只增不减, 一般几次之后就稳定了
+static int parser_reserve(luat_mqtt_parser_t* parser, uint32_t size) {
+	if (size <= parser->buff_size)
+		return 0;
+	uint32_t new_size = parser->buff_size ? parser->buff_size : 256;
+	while (new_size < size)
+		new_size *= 2;
+	uint8_t* buff = luat_heap_realloc(parser->buff, new_size);
+	if (buff == NULL) {
+		LLOGE("out of memory for mqtt packet %d", size);
+		return -1;
+	}
+	parser->buff = buff;
+	parser->buff_size = new_size;
+	return 0;
+}
+
+// 剩余长度已读完, 决定这个报文怎么收
+static int parser_body_begin(luat_mqtt_parser_t* parser) {
+	parser->got = 0;
+	if ((parser->header & 0xF0) == MQTT_TYPE_PUBLISH && parser->rem_len > parser->inline_max
+		&& parser->cb->on_publish_begin) {
+		// topic长度(2) + topic + msg id(qos>0时2字节), 先按最短的收
+		parser->var_len = 2;
+		parser->state = MQTT_PARSE_PUB_VAR;
+		return parser_reserve(parser, 2);
+	}
+	if (parser->rem_len > parser->inline_max) {
+		LLOGE("mqtt packet too big %d type %02X", parser->rem_len, parser->header);
+		return -1;
+	}
+	if (parser->rem_len == 0) {
+		parser->state = MQTT_PARSE_HEADER;
+		return parser->cb->on_packet(parser->userdata, parser->header, NULL, 0);
+	}
+	// 缓存等真的需要拼包时再分配
+	parser->state = MQTT_PARSE_BODY;
+	return 0;
+}
+
+static int parser_pub_end(luat_mqtt_parser_t* parser) {
+	parser->state = MQTT_PARSE_HEADER;
+	return parser->cb->on_publish_end(parser->userdata);
+}
+
+int luat_mqtt_parser_feed(luat_mqtt_parser_t* parser, const uint8_t* data, size_t len) {
+	size_t i = 0;
+	while (i < len) {
+		switch (parser->state) {
+		case MQTT_PARSE_HEADER:
+			parser->header = data[i++];
+			parser->rem_len = 0;
+			parser->len_bytes = 0;
+			parser->state = MQTT_PARSE_LEN;
+			break;
+		case MQTT_PARSE_LEN: {
+			uint8_t digit = data[i++];
+			parser->rem_len |= (uint32_t)(digit & 0x7F) << (7 * parser->len_bytes);
+			parser->len_bytes++;
+			if (digit & 0x80) {
+				if (parser->len_bytes >= 4) {
+					LLOGE("bad mqtt remaining length");
+					return -1;
+				}
+				break;
+			}
+			if (parser_body_begin(parser))
+				return -1;
+			break;
+		}
+		case MQTT_PARSE_BODY: {
+			// 整包都在这次的数据里, 直接交出去, 不用先复制到缓存
+			if (parser->got == 0 && len - i >= parser->rem_len) {
+				parser->state = MQTT_PARSE_HEADER;
+				i += parser->rem_len;
+				if (parser->cb->on_packet(parser->userdata, parser->header, data + i - parser->rem_len, parser->rem_len))
+					return -1;
+				break;
+			}
+			uint32_t n = parser->rem_len - parser->got;
+			if (n > len - i)
+				n = len - i;
+			if (parser->got == 0 && parser_reserve(parser, parser->rem_len))
+				return -1;
+			memcpy(parser->buff + parser->got, data + i, n);
+			parser->got += n;
+			i += n;
+			if (parser->got == parser->rem_len) {
+				parser->state = MQTT_PARSE_HEADER;
+				if (parser->cb->on_packet(parser->userdata, parser->header, parser->buff, parser->rem_len))
+					return -1;
+			}
+			break;
+		}
+		case MQTT_PARSE_PUB_VAR: {
+			uint32_t n = parser->var_len - parser->got;
+			if (n > len - i)
+				n = len - i;
+			memcpy(parser->buff + parser->got, data + i, n);
+			parser->got += n;
+			i += n;
+			if (parser->got < parser->var_len)
+				break;
+			if (parser->var_len == 2) {
+				// 拿到topic长度了, 算出完整的可变头部长度
+				parser->var_len = 2 + ((parser->buff[0] << 8) | parser->buff[1]);
+				if (parser->header & 0x06)
+					parser->var_len += 2;
+				if (parser->var_len > parser->rem_len) {
+					LLOGE("bad mqtt publish, topic len %d", parser->var_len);
+					return -1;
+				}
+				if (parser_reserve(parser, parser->var_len))
+					return -1;
+				if (parser->got < parser->var_len)
+					break;
+			}
+			uint16_t topic_len = parser->var_len - 2 - ((parser->header & 0x06) ? 2 : 0);
+			uint16_t msg_id = 0;
+			if (parser->header & 0x06)
+				msg_id = (parser->buff[2 + topic_len] << 8) | parser->buff[3 + topic_len];
+			uint32_t payload_len = parser->rem_len - parser->var_len;
+			if (parser->cb->on_publish_begin(parser->userdata, parser->header, parser->buff + 2, topic_len, msg_id, payload_len))
+				return -1;
+			parser->state = MQTT_PARSE_PUB_PAYLOAD;
+			if (payload_len == 0 && parser_pub_end(parser))
+				return -1;
+			break;
+		}
+		case MQTT_PARSE_PUB_PAYLOAD: {
+			// 直接把收到的分片交出去, 不复制
+			uint32_t n = parser->rem_len - parser->got;
+			if (n > len - i)
+				n = len - i;
+			if (parser->cb->on_publish_data(parser->userdata, data + i, n))
+				return -1;
+			parser->got += n;
+			i += n;
+			if (parser->got == parser->rem_len && parser_pub_end(parser))
+				return -1;
+			break;
+		}
+		default:
+			return -1;
+		}
+	}
+	return 0;
+}
+
+uint32_t luat_mqtt_parser_span(luat_mqtt_parser_t* parser, uint8_t** p) {
+	if (parser->state != MQTT_PARSE_BODY || parser->got == 0)
+		return 0;
+	*p = parser->buff + parser->got;
+	return parser->rem_len - parser->got;
+}
+
+int luat_mqtt_parser_commit(luat_mqtt_parser_t* parser, uint32_t len) {
+	parser->got += len;
+	if (parser->got < parser->rem_len)
+		return 0;
+	parser->state = MQTT_PARSE_HEADER;
+	return parser->cb->on_packet(parser->userdata, parser->header, parser->buff, parser->rem_len) ? -1 : 0;
+}
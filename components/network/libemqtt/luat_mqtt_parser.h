@@ -0,0 +1,57 @@
+#ifndef LUAT_MQTT_PARSER_H
+#define LUAT_MQTT_PARSER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// mqtt协议允许的最大remaining length, 4字节变长编码, 约268MB
+#define MQTT_REM_LEN_MAX (268435455)
+
+// 逐字节推进的mqtt报文解析器, 不依赖网络层
+// 收到多少数据就喂多少, 不需要凑齐整包, 也不需要搬移剩余数据
+// 小于等于inline_max的报文整包缓存后回调on_packet
+// 更大的PUBLISH只缓存topic等可变头部, payload按收到的分片直接回调, 不占整包内存
+
+enum {
+	MQTT_PARSE_HEADER = 0,
+	MQTT_PARSE_LEN,
+	MQTT_PARSE_BODY,
+	MQTT_PARSE_PUB_VAR,
+	MQTT_PARSE_PUB_PAYLOAD,
+};
+
+typedef struct luat_mqtt_parser_cb {
+	// 完整的报文, body不含固定头部
+	int (*on_packet)(void* userdata, uint8_t header, const uint8_t* body, uint32_t len);
+	// 大报文流式回调, 依次为开始, 若干次数据, 结束
+	int (*on_publish_begin)(void* userdata, uint8_t header, const uint8_t* topic, uint16_t topic_len, uint16_t msg_id, uint32_t payload_len);
+	int (*on_publish_data)(void* userdata, const uint8_t* data, uint32_t len);
+	int (*on_publish_end)(void* userdata);
+}luat_mqtt_parser_cb_t;
+
+typedef struct luat_mqtt_parser {
+	const luat_mqtt_parser_cb_t* cb;
+	void* userdata;
+	uint32_t inline_max;	// 整包缓存的上限
+	uint8_t state;
+	uint8_t header;			// 固定头部第一个字节
+	uint8_t len_bytes;		// remaining length已读的字节数
+	uint32_t rem_len;
+	uint32_t got;			// 当前报文已收到的body字节数
+	uint32_t var_len;		// PUBLISH可变头部长度, 收齐topic长度后才知道
+	uint8_t* buff;			// 整包或可变头部的缓存, 按需扩大
+	uint32_t buff_size;
+}luat_mqtt_parser_t;
+
+void luat_mqtt_parser_init(luat_mqtt_parser_t* parser, const luat_mqtt_parser_cb_t* cb, void* userdata, uint32_t inline_max);
+// 回到等待新报文的状态, 断线重连时调用
+void luat_mqtt_parser_reset(luat_mqtt_parser_t* parser);
+void luat_mqtt_parser_deinit(luat_mqtt_parser_t* parser);
+// 喂入数据, 成功返回0. 报文非法或回调返回非0时返回负数, 此时应断开连接
+int luat_mqtt_parser_feed(luat_mqtt_parser_t* parser, const uint8_t* data, size_t len);
+// 正在拼包时, 返回当前报文还缺的长度及可以直接写入的位置, 不在拼包返回0
+// 接收方把数据直接写进去后调用commit, 省掉一次复制, 用法同zbuff的ring_write_span
+uint32_t luat_mqtt_parser_span(luat_mqtt_parser_t* parser, uint8_t** p);
+int luat_mqtt_parser_commit(luat_mqtt_parser_t* parser, uint32_t len);
+
+#endif
@@ -1690,6 +1690,92 @@ static int net_lwip_socket_send(int socket_id, uint64_t tag, const uint8_t *buf,
 	return result;
 }
 
+//从iov的第*seg段*offset处开始，取len字节放到一个新的数据节点里，多段数据只拷贝一次
+static socket_data_t * net_lwip_create_data_node_v(uint8_t socket_id, const luat_network_iovec_t *iov, uint32_t *seg, uint32_t *offset, uint32_t len, luat_ip_addr_t *remote_ip, uint16_t remote_port)
+{
+	socket_data_t *p = net_lwip_create_data_node(socket_id, NULL, len, remote_ip, remote_port);
+	if (!p || !len) return p;
+	p->data = malloc(len);
+	if (!p->data)
+	{
+		free(p);
+		return NULL;
+	}
+	uint32_t save_len = 0;
+	uint32_t dummy_len;
+	while(save_len < len)
+	{
+		dummy_len = iov[*seg].len - *offset;
+		if (dummy_len > (len - save_len))
+		{
+			dummy_len = len - save_len;
+		}
+		memcpy(p->data + save_len, iov[*seg].data + *offset, dummy_len);
+		save_len += dummy_len;
+		*offset += dummy_len;
+		if (*offset >= iov[*seg].len)
+		{
+			(*seg)++;
+			*offset = 0;
+		}
+	}
+	return p;
+}
+
+static int net_lwip_socket_sendv(int socket_id, uint64_t tag, const luat_network_iovec_t *iov, uint32_t iov_cnt, int flags, luat_ip_addr_t *remote_ip, uint16_t remote_port, void *user_data)
+{
+	int result = net_lwip_check_socket(user_data, socket_id, tag);
+	if (result) return result;
+	uint32_t len = 0;
+	uint32_t seg = 0;
+	uint32_t offset = 0;
+	uint32_t save_len = 0;
+	uint32_t dummy_len = 0;
+	socket_data_t *p;
+	for(uint32_t i = 0; i < iov_cnt; i++)
+	{
+		len += iov[i].len;
+	}
+	while (seg < iov_cnt && !iov[seg].len) seg++;
+	SOCKET_LOCK(socket_id);
+	if (prvlwip.socket[socket_id].is_tcp)
+	{
+		while(save_len < len)
+		{
+			dummy_len = ((len - save_len) > SOCKET_BUF_LEN)?SOCKET_BUF_LEN:(len - save_len);
+			p = net_lwip_create_data_node_v(socket_id, iov, &seg, &offset, dummy_len, remote_ip, remote_port);
+			if (p)
+			{
+				llist_add_tail(&p->node, &prvlwip.socket[socket_id].tx_head);
+			}
+			else
+			{
+				SOCKET_UNLOCK(socket_id);
+				return -1;
+			}
+			save_len += dummy_len;
+		}
+	}
+	else
+	{
+		p = net_lwip_create_data_node_v(socket_id, iov, &seg, &offset, len, remote_ip, remote_port);
+		if (p)
+		{
+			llist_add_tail(&p->node, &prvlwip.socket[socket_id].tx_head);
+		}
+		else
+		{
+			SOCKET_UNLOCK(socket_id);
+			return -1;
+		}
+	}
+
+	SOCKET_UNLOCK(socket_id);
+	platform_send_event(prvlwip.task_handle, EV_LWIP_SOCKET_TX, socket_id, 0, user_data);
+	result = len;
+	return result;
+}
+
 void net_lwip_socket_clean(int *vaild_socket_list, uint32_t num, void *user_data)
 {
 	if ((uint32_t)user_data >= NW_ADAPTER_INDEX_LWIP_NETIF_QTY) return;
@@ -2202,6 +2288,7 @@ static network_adapter_info prv_net_lwip_adapter =
 		.get_local_ip_info = net_lwip_get_local_ip_info,
 		.get_full_ip_info = net_lwip_get_full_ip_info,
 		.socket_set_callback = net_lwip_socket_set_callback,
+		.socket_sendv = net_lwip_socket_sendv,
 		.name = "lwip",
 		.max_socket_num = MAX_SOCK_NUM,
 		.no_accept = 1,
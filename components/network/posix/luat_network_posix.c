@@ -1,3 +1,6 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
 #include "luat_base.h"
 #include "luat_network_adapter.h"
 #include "luat_malloc.h"
@@ -15,12 +18,48 @@
 #define LUAT_LOG_TAG "network"
 #include "luat_log.h"
 
+// 调试开关, 打开后输出适配器各接口的调用和事件, 默认关闭, 否则每次启动都会刷日志
+#ifndef LUAT_POSIX_NETWORK_DEBUG
+#define LUAT_POSIX_NETWORK_DEBUG 0
+#endif
+#if LUAT_POSIX_NETWORK_DEBUG
+#define POSIX_DBG(...) LLOGD(__VA_ARGS__)
+#else
+#define POSIX_DBG(...)
+#endif
+
 #include "luat_network_posix.h"
 
+#ifdef __linux__
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <netinet/in.h>
+#include <sys/uio.h>
+#include <sys/eventfd.h>
+#endif
+
 CBFuncEx_t posix_network_cb;
 void * posix_network_param;
 uint8_t posix_network_ready;
 
+#ifdef __linux__
+static void posix_send_event(posix_socket_t *ps, int id, int p1, int p2) {
+    luat_network_cb_param_t params = {0};
+    params.tag = ps->tag;
+    params.param = posix_network_param;
+    // 64位平台上Param3放不下指针, 适配器会改用socket id和tag查找ctrl
+    OS_EVENT event = {
+        .ID = id,
+        .Param1 = p1,
+        .Param2 = p2,
+        .Param3 = (uint32_t)(uintptr_t)ps->param
+    };
+    // LLOGD("posix event %d %d %d", id, p1, p2);
+    posix_network_cb(&event, &params);
+}
+#else
 static luat_rtos_mutex_t* master_lock;
 
 static void posix_send_event(int id, int p1, int p2, int p3) {
@@ -35,7 +74,7 @@ static void posix_send_event(int id, int p1, int p2, int p3) {
         .Param2 = p2,
         .Param3 = p3
     };
-    LLOGD("posix event %d %d %d %d", id, p1, p2, p3);
+    POSIX_DBG("posix event %d %d %d %d", id, p1, p2, p3);
     posix_network_cb(&event, &params);
 }
 
@@ -54,10 +93,10 @@ void posix_network_client_thread_entry(posix_socket_t *ps) {
     sockaddr.sin_addr.s_addr = ps->remote_ip.ipv4;
     luat_rtos_task_sleep(50);
 
-    LLOGD("ready to connect %d", ps->socket_id);
+    POSIX_DBG("ready to connect %d", ps->socket_id);
     int ret = connect(ps->socket_id, (struct sockaddr*)&sockaddr, sizeof(sockaddr));
 
-    LLOGD("connect ret %d", ret);
+    POSIX_DBG("connect ret %d", ret);
     if (ret) {
         // 失败了
         LLOGD("connect FAIL ret %d", ret);
@@ -67,7 +106,7 @@ void posix_network_client_thread_entry(posix_socket_t *ps) {
     }
     // 发送系统消息, 通知连接成功
     posix_send_event(EV_NW_SOCKET_CONNECT_OK, ps->socket_id, 0, 0);
-    LLOGD("wait data now");
+    POSIX_DBG("wait data now");
 
     fd_set readfds;
     fd_set writefds;
@@ -117,9 +156,10 @@ void posix_network_client_thread_entry(posix_socket_t *ps) {
     luat_heap_free(ps);
     LLOGI("socket thread exit");
 }
+#endif
 
 void posix_network_set_ready(uint8_t ready) {
-    LLOGD("CALL posix_network_set_ready");
+    POSIX_DBG("CALL posix_network_set_ready");
     posix_network_ready = ready;
     luat_network_cb_param_t params = {0};
     params.tag = 0;
@@ -138,23 +178,578 @@ void posix_network_set_ready(uint8_t ready) {
 
 //检查网络是否准备好，返回非0准备好，user_data是注册时的user_data，传入给底层api
 uint8_t (posix_check_ready)(void *user_data) {
-    LLOGD("CALL posix_check_ready %d", posix_network_ready);
+    POSIX_DBG("CALL posix_check_ready %d", posix_network_ready);
     return posix_network_ready;
 };
 
+#ifdef __linux__
+//------------------------------------------------------------------
+// Linux下使用单个epoll线程驱动全部socket, 连接/收发均为非阻塞
+// 事件在释放锁之后再回调给适配器, 避免回调里再次进入本文件时死锁
+// epoll使用水平触发, 上报RX_NEW后暂停关注可读, 等适配器来读取时再恢复, 没读完会再次上报
+
+// fd索引表大小, socket的fd必须小于该值
+#ifndef LUAT_POSIX_FD_MAX
+#define LUAT_POSIX_FD_MAX (4096)
+#endif
+
+#define POSIX_EPOLL_BATCH (64)
+#define POSIX_EV_RX (EPOLLIN | EPOLLRDHUP)
+// 唤醒reactor线程的eventfd的key, 不会和socket的key重复
+#define POSIX_WAKE_KEY (UINT64_MAX)
+
+typedef struct posix_event {
+    posix_socket_t ps;  // 只用到tag/param/socket_id, 拷贝一份以免回调时已被释放
+    int id;
+    int p2;
+}posix_event_t;
+
+// 不是由epoll产生的事件, 例如CLOSE_OK, 先挂在这里再唤醒reactor线程上报
+typedef struct posix_event_node {
+    struct posix_event_node *next;
+    posix_event_t evt;
+}posix_event_node_t;
+
+// 内核发送缓冲区满时暂存的数据, udp时每个节点是一个完整的包
+typedef struct posix_tx_node {
+    struct posix_tx_node *next;
+    uint32_t len;
+    uint32_t offset;
+    uint8_t has_addr;
+    struct sockaddr_in addr;
+    uint8_t data[];
+}posix_tx_node_t;
+
+static pthread_mutex_t posix_lock = PTHREAD_MUTEX_INITIALIZER;
+static posix_socket_t *posix_sockets[LUAT_POSIX_FD_MAX];
+static int posix_epfd = -1;
+static int posix_wakefd = -1;
+static uint64_t posix_tag_counter;
+static posix_event_node_t *posix_event_head;
+static posix_event_node_t *posix_event_tail;
+
+static inline uint64_t posix_epoll_key(posix_socket_t *ps) {
+    return (uint32_t)ps->socket_id | ((uint64_t)(uint32_t)ps->tag << 32);
+}
+
+// 更新epoll中关注的事件, events为0时从epoll中移除
+static int posix_epoll_update(posix_socket_t *ps, uint32_t events) {
+    struct epoll_event ev = {0};
+    int op = ps->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    if (events == ps->events)
+        return 0;
+    ps->events = events;
+    if (events == 0)
+        return epoll_ctl(posix_epfd, EPOLL_CTL_DEL, ps->socket_id, NULL);
+    ev.events = events;
+    ev.data.u64 = posix_epoll_key(ps);
+    return epoll_ctl(posix_epfd, op, ps->socket_id, &ev);
+}
+
+static posix_socket_t* posix_socket_get(int socket_id, uint64_t tag) {
+    if (socket_id < 0 || socket_id >= LUAT_POSIX_FD_MAX)
+        return NULL;
+    posix_socket_t *ps = posix_sockets[socket_id];
+    if (ps == NULL || ps->tag != tag)
+        return NULL;
+    return ps;
+}
+
+static void posix_socket_release(posix_socket_t *ps) {
+    posix_epoll_update(ps, 0);
+    while (ps->tx_head) {
+        posix_tx_node_t *node = ps->tx_head;
+        ps->tx_head = node->next;
+        luat_heap_free(node);
+    }
+    posix_sockets[ps->socket_id] = NULL;
+    close(ps->socket_id);
+    luat_heap_free(ps);
+}
+
+static inline void posix_event_add(posix_event_t *evts, int *cnt, posix_socket_t *ps, int id, int p2) {
+    evts[*cnt].ps = *ps;
+    evts[*cnt].id = id;
+    evts[*cnt].p2 = p2;
+    (*cnt)++;
+}
+
+// 投递一个事件给reactor线程上报, 需持有posix_lock
+static int posix_event_post(posix_socket_t *ps, int id, int p2) {
+    uint64_t one = 1;
+    posix_event_node_t *node = luat_heap_malloc(sizeof(posix_event_node_t));
+    if (node == NULL) {
+        LLOGE("out of memory when post event %d", id);
+        return -1;
+    }
+    node->next = NULL;
+    node->evt.ps = *ps;
+    node->evt.id = id;
+    node->evt.p2 = p2;
+    if (posix_event_tail)
+        posix_event_tail->next = node;
+    else
+        posix_event_head = node;
+    posix_event_tail = node;
+    if (write(posix_wakefd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        LLOGE("wake reactor fail %d", errno);
+    }
+    return 0;
+}
+
+// 把积压的数据继续交给内核, 需持有posix_lock
+// 成功返回0(不一定发完), 出错返回-1
+static int posix_tx_flush(posix_socket_t *ps) {
+    while (ps->tx_head) {
+        posix_tx_node_t *node = ps->tx_head;
+        ssize_t ret = sendto(ps->socket_id, node->data + node->offset, node->len - node->offset, MSG_DONTWAIT | MSG_NOSIGNAL,
+            node->has_addr ? (struct sockaddr*)&node->addr : NULL, node->has_addr ? sizeof(node->addr) : 0);
+        if (ret < 0)
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        ps->tx_pending += ret;
+        node->offset += ret;
+        if (node->offset < node->len)
+            return 0;
+        ps->tx_head = node->next;
+        if (ps->tx_head == NULL)
+            ps->tx_tail = NULL;
+        luat_heap_free(node);
+    }
+    return 0;
+}
+
+// 处理单个socket的epoll事件, 需持有posix_lock
+static void posix_reactor_handle(posix_socket_t *ps, uint32_t events, posix_event_t *evts, int *cnt) {
+    int err = 0;
+    socklen_t errlen = sizeof(err);
+    switch (ps->state) {
+    case POSIX_SOCKET_CONNECTING:
+        if (events & (EPOLLERR | EPOLLHUP)) {
+            getsockopt(ps->socket_id, SOL_SOCKET, SO_ERROR, &err, &errlen);
+            LLOGD("socket %d connect fail %d", ps->socket_id, err);
+            ps->state = POSIX_SOCKET_IDLE;
+            posix_epoll_update(ps, 0);
+            posix_event_add(evts, cnt, ps, EV_NW_SOCKET_ERROR, 0);
+        }
+        else if (events & EPOLLOUT) {
+            ps->state = POSIX_SOCKET_ONLINE;
+            posix_epoll_update(ps, POSIX_EV_RX);
+            posix_event_add(evts, cnt, ps, EV_NW_SOCKET_CONNECT_OK, 0);
+        }
+        break;
+    case POSIX_SOCKET_LISTENING:
+        if (events & EPOLLIN) {
+            // 适配器是no_accept模式, 把新连接替换到监听socket的fd上, socket_id保持不变
+            struct sockaddr_in addr = {0};
+            socklen_t addrlen = sizeof(addr);
+            int fd = accept4(ps->socket_id, (struct sockaddr*)&addr, &addrlen, SOCK_NONBLOCK);
+            if (fd < 0)
+                break;
+            posix_epoll_update(ps, 0);
+            dup2(fd, ps->socket_id);
+            close(fd);
+            ps->remote_ip.ipv4 = addr.sin_addr.s_addr;
+            ps->remote_port = ntohs(addr.sin_port);
+            ps->state = POSIX_SOCKET_ONLINE;
+            posix_epoll_update(ps, POSIX_EV_RX);
+            posix_event_add(evts, cnt, ps, EV_NW_SOCKET_CONNECT_OK, 0);
+        }
+        break;
+    case POSIX_SOCKET_ONLINE:
+        if (events & EPOLLERR) {
+            // 水平触发下不移除会一直报错
+            ps->state = POSIX_SOCKET_IDLE;
+            posix_epoll_update(ps, 0);
+            posix_event_add(evts, cnt, ps, EV_NW_SOCKET_ERROR, 0);
+            break;
+        }
+        if ((events & EPOLLOUT) && (ps->events & EPOLLOUT)) {
+            if (posix_tx_flush(ps)) {
+                ps->state = POSIX_SOCKET_IDLE;
+                posix_epoll_update(ps, 0);
+                posix_event_add(evts, cnt, ps, EV_NW_SOCKET_ERROR, 0);
+                break;
+            }
+            // 积压的数据全部交给内核后才上报发送完成, 并取消写关注
+            if (ps->tx_head == NULL) {
+                if (ps->tx_pending)
+                    posix_event_add(evts, cnt, ps, EV_NW_SOCKET_TX_OK, ps->tx_pending);
+                ps->tx_pending = 0;
+                posix_epoll_update(ps, ps->events & ~EPOLLOUT);
+            }
+        }
+        if (events & EPOLLIN) {
+            posix_epoll_update(ps, ps->events & ~EPOLLIN);
+            posix_event_add(evts, cnt, ps, EV_NW_SOCKET_RX_NEW, 0);
+        }
+        if (events & (EPOLLRDHUP | EPOLLHUP)) {
+            ps->state = POSIX_SOCKET_IDLE;
+            posix_epoll_update(ps, 0);
+            posix_event_add(evts, cnt, ps, EV_NW_SOCKET_REMOTE_CLOSE, 0);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void *posix_reactor_entry(void *args) {
+    struct epoll_event evs[POSIX_EPOLL_BATCH];
+    // 每个socket最多产生3个事件
+    static posix_event_t evts[POSIX_EPOLL_BATCH * 3];
+    posix_event_node_t *posted;
+    uint64_t wake;
+    int cnt;
+    while (1) {
+        int n = epoll_wait(posix_epfd, evs, POSIX_EPOLL_BATCH, -1);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            LLOGE("epoll_wait ret %d errno %d", n, errno);
+            break;
+        }
+        cnt = 0;
+        posted = NULL;
+        pthread_mutex_lock(&posix_lock);
+        for (int i = 0; i < n; i++) {
+            if (evs[i].data.u64 == POSIX_WAKE_KEY) {
+                if (read(posix_wakefd, &wake, sizeof(wake)) < 0 && errno != EAGAIN)
+                    LLOGE("read eventfd fail %d", errno);
+                posted = posix_event_head;
+                posix_event_head = posix_event_tail = NULL;
+                continue;
+            }
+            int fd = (int)(uint32_t)evs[i].data.u64;
+            posix_socket_t *ps = (fd < LUAT_POSIX_FD_MAX) ? posix_sockets[fd] : NULL;
+            // key不一致说明fd已被关闭并复用, 丢弃旧事件
+            if (ps == NULL || posix_epoll_key(ps) != evs[i].data.u64)
+                continue;
+            posix_reactor_handle(ps, evs[i].events, evts, &cnt);
+        }
+        pthread_mutex_unlock(&posix_lock);
+        for (int i = 0; i < cnt; i++) {
+            posix_send_event(&evts[i].ps, evts[i].id, evts[i].ps.socket_id, evts[i].p2);
+        }
+        while (posted) {
+            posix_event_node_t *node = posted;
+            posted = node->next;
+            posix_send_event(&node->evt.ps, node->evt.id, node->evt.ps.socket_id, node->evt.p2);
+            luat_heap_free(node);
+        }
+    }
+    return NULL;
+}
+
+static int posix_reactor_start(void) {
+    pthread_t t;
+    struct epoll_event ev = {0};
+    if (posix_epfd >= 0)
+        return 0;
+    posix_epfd = epoll_create1(EPOLL_CLOEXEC);
+    posix_wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (posix_epfd < 0 || posix_wakefd < 0) {
+        LLOGE("epoll/eventfd create fail %d", errno);
+        goto fail;
+    }
+    ev.events = EPOLLIN;
+    ev.data.u64 = POSIX_WAKE_KEY;
+    if (epoll_ctl(posix_epfd, EPOLL_CTL_ADD, posix_wakefd, &ev)) {
+        LLOGE("epoll add eventfd fail %d", errno);
+        goto fail;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    if (pthread_create(&t, NULL, posix_reactor_entry, NULL)) {
+        LLOGE("reactor thread start fail");
+        goto fail;
+    }
+    pthread_detach(t);
+    return 0;
+fail:
+    if (posix_epfd >= 0)
+        close(posix_epfd);
+    if (posix_wakefd >= 0)
+        close(posix_wakefd);
+    posix_epfd = posix_wakefd = -1;
+    return -1;
+}
+
+//创建一个socket，并设置成非阻塞模式，user_data传入对应适配器, tag作为socket的合法依据，给check_socket_vaild比对用
+//成功返回socketid，失败 < 0
+int (posix_create_socket)(uint8_t is_tcp, uint64_t *tag, void *param, uint8_t is_ipv6, void *user_data) {
+    // TODO 支持IPV6
+    int s = socket(AF_INET, (is_tcp ? SOCK_STREAM : SOCK_DGRAM) | SOCK_NONBLOCK | SOCK_CLOEXEC, is_tcp ? IPPROTO_TCP : IPPROTO_UDP);
+    POSIX_DBG("CALL posix_create_socket %d %d", s, is_tcp);
+    if (s < 0)
+        return -1;
+    if (s >= LUAT_POSIX_FD_MAX) {
+        LLOGE("socket fd %d out of range", s);
+        close(s);
+        return -1;
+    }
+    posix_socket_t *ps = luat_heap_malloc(sizeof(posix_socket_t));
+    if (ps == NULL) {
+        LLOGE("out of memory when malloc posix_socket_t");
+        close(s);
+        return -1;
+    }
+    memset(ps, 0, sizeof(posix_socket_t));
+    ps->socket_id = s;
+    ps->is_tcp = is_tcp;
+    ps->param = param;
+    ps->user_data = user_data;
+    pthread_mutex_lock(&posix_lock);
+    ps->tag = ++posix_tag_counter;
+    posix_sockets[s] = ps;
+    pthread_mutex_unlock(&posix_lock);
+    *tag = ps->tag;
+    return s;
+}
+
+//作为client绑定一个port，并连接remote_ip和remote_port对应的server
+//成功返回0，失败 < 0
+int (posix_socket_connect)(int socket_id, uint64_t tag, uint16_t local_port, luat_ip_addr_t *remote_ip, uint16_t remote_port, void *user_data) {
+    POSIX_DBG("CALL posix_socket_connect %d", socket_id);
+    int ret = -1;
+    pthread_mutex_lock(&posix_lock);
+    posix_socket_t *ps = posix_socket_get(socket_id, tag);
+    if (ps == NULL)
+        goto exit;
+    ps->local_port = local_port;
+    memcpy(&ps->remote_ip, remote_ip, sizeof(luat_ip_addr_t));
+    ps->remote_port = remote_port;
+    if (local_port) {
+        struct sockaddr_in local = {0};
+        local.sin_family = AF_INET;
+        local.sin_port = htons(local_port);
+        bind(socket_id, (struct sockaddr*)&local, sizeof(local));
+    }
+    struct sockaddr_in sockaddr = {0};
+    sockaddr.sin_family = AF_INET;
+    sockaddr.sin_port = htons(remote_port);
+    sockaddr.sin_addr.s_addr = remote_ip->ipv4;
+    if (connect(socket_id, (struct sockaddr*)&sockaddr, sizeof(sockaddr)) && errno != EINPROGRESS) {
+        LLOGD("connect FAIL errno %d", errno);
+        goto exit;
+    }
+    // 无论是否立即连上, 都由reactor线程在可写时上报CONNECT_OK
+    ps->state = POSIX_SOCKET_CONNECTING;
+    ret = posix_epoll_update(ps, EPOLLOUT);
+exit:
+    pthread_mutex_unlock(&posix_lock);
+    return ret;
+}
+//作为server绑定一个port，开始监听
+//成功返回0，失败 < 0
+int (posix_socket_listen)(int socket_id, uint64_t tag, uint16_t local_port, void *user_data) {
+    int ret = -1;
+    int opt = 1;
+    pthread_mutex_lock(&posix_lock);
+    posix_socket_t *ps = posix_socket_get(socket_id, tag);
+    if (ps == NULL || !ps->is_tcp)
+        goto exit;
+    struct sockaddr_in local = {0};
+    local.sin_family = AF_INET;
+    local.sin_port = htons(local_port);
+    setsockopt(socket_id, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (bind(socket_id, (struct sockaddr*)&local, sizeof(local)) || listen(socket_id, 1)) {
+        LLOGD("listen FAIL errno %d", errno);
+        goto exit;
+    }
+    ps->local_port = local_port;
+    ps->state = POSIX_SOCKET_LISTENING;
+    ret = posix_epoll_update(ps, EPOLLIN);
+exit:
+    pthread_mutex_unlock(&posix_lock);
+    return ret;
+}
+//作为server接受一个client
+//成功返回0，失败 < 0
+int (posix_socket_accept)(int socket_id, uint64_t tag, luat_ip_addr_t *remote_ip, uint16_t *remote_port, void *user_data) {
+    // no_accept模式, 新连接在reactor线程中直接替换监听socket
+    return -1;
+}
+
+static int posix_socket_close_inner(int socket_id, uint64_t tag, uint8_t check_tag) {
+    int ret = -1;
+    pthread_mutex_lock(&posix_lock);
+    posix_socket_t *ps = (socket_id >= 0 && socket_id < LUAT_POSIX_FD_MAX) ? posix_sockets[socket_id] : NULL;
+    if (ps && (!check_tag || ps->tag == tag)) {
+        posix_socket_release(ps);
+        ret = 0;
+    }
+    pthread_mutex_unlock(&posix_lock);
+    return ret;
+}
+
+//主动断开一个tcp连接，需要走完整个tcp流程，用户需要接收到close ok回调才能确认彻底断开
+//成功返回0，失败 < 0
+int (posix_socket_disconnect)(int socket_id, uint64_t tag, void *user_data) {
+    int ret = -1;
+    pthread_mutex_lock(&posix_lock);
+    posix_socket_t *ps = posix_socket_get(socket_id, tag);
+    if (ps) {
+        // 挥手由内核在close之后完成, 积压的数据尽量先交给内核
+        posix_tx_flush(ps);
+        posix_event_post(ps, EV_NW_SOCKET_CLOSE_OK, 0);
+        posix_socket_release(ps);
+        ret = 0;
+    }
+    pthread_mutex_unlock(&posix_lock);
+    return ret;
+}
+
+//释放掉socket的控制权，除了tag异常外，必须立刻生效
+//成功返回0，失败 < 0
+int (posix_socket_close)(int socket_id, uint64_t tag, void *user_data) {
+    return posix_socket_close_inner(socket_id, tag, 1);
+}
+
+//强行释放掉socket的控制权，必须立刻生效
+//成功返回0，失败 < 0
+int (posix_socket_force_close)(int socket_id, void *user_data) {
+    return posix_socket_close_inner(socket_id, 0, 0);
+}
+
+//tcp时，不需要remote_ip和remote_port，如果buf为NULL，则返回当前缓存区的数据量，当返回值小于len时说明已经读完了
+//udp时，只返回1个block数据，需要多次读直到没有数据为止
+//成功返回实际读取的值，失败 < 0
+int (posix_socket_receive)(int socket_id, uint64_t tag, uint8_t *buf, uint32_t len, int flags, luat_ip_addr_t *remote_ip, uint16_t *remote_port, void *user_data) {
+    int ret = -1;
+    pthread_mutex_lock(&posix_lock);
+    posix_socket_t *ps = posix_socket_get(socket_id, tag);
+    if (ps == NULL)
+        goto exit;
+    if (buf == NULL) {
+        int avail = 0;
+        ret = ioctl(socket_id, FIONREAD, &avail) ? -1 : avail;
+        goto exit;
+    }
+    struct sockaddr_in addr = {0};
+    socklen_t addrlen = sizeof(addr);
+    ret = recvfrom(socket_id, buf, len, flags | MSG_DONTWAIT, (struct sockaddr*)&addr, &addrlen);
+    if (ret < 0) {
+        ret = (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+    }
+    else if (!ps->is_tcp) {
+        if (remote_ip)
+            remote_ip->ipv4 = addr.sin_addr.s_addr;
+        if (remote_port)
+            *remote_port = ntohs(addr.sin_port);
+    }
+    // 适配器来读了, 恢复可读关注, 还有剩余数据时会再次上报RX_NEW
+    if (ps->state == POSIX_SOCKET_ONLINE)
+        posix_epoll_update(ps, ps->events | EPOLLIN);
+exit:
+    pthread_mutex_unlock(&posix_lock);
+    return ret;
+}
+
+// 发送iov中的数据, 内核缓冲区放不下的部分加入积压队列, 需持有posix_lock
+// 成功返回len, 失败 < 0
+static int posix_socket_tx(posix_socket_t *ps, struct msghdr *msg, uint32_t len, int flags) {
+    ssize_t ret = 0;
+    // 已经有积压时直接排队, 保证顺序
+    if (ps->tx_head == NULL) {
+        ret = sendmsg(ps->socket_id, msg, flags | MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (ret < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                return -1;
+            ret = 0;
+        }
+        ps->tx_pending += ret;
+    }
+    if (ret < len) {
+        posix_tx_node_t *node = luat_heap_malloc(sizeof(posix_tx_node_t) + len - ret);
+        if (node == NULL) {
+            LLOGE("out of memory when queue %d bytes", len - ret);
+            return -1;
+        }
+        node->next = NULL;
+        node->len = 0;
+        node->offset = 0;
+        node->has_addr = msg->msg_name != NULL;
+        if (node->has_addr)
+            memcpy(&node->addr, msg->msg_name, sizeof(node->addr));
+        // 跳过内核已经接收的ret字节
+        for (size_t i = 0; i < msg->msg_iovlen; i++) {
+            size_t seg = msg->msg_iov[i].iov_len;
+            if ((size_t)ret >= seg) {
+                ret -= seg;
+                continue;
+            }
+            memcpy(node->data + node->len, (uint8_t*)msg->msg_iov[i].iov_base + ret, seg - ret);
+            node->len += seg - ret;
+            ret = 0;
+        }
+        if (ps->tx_tail)
+            ps->tx_tail->next = node;
+        else
+            ps->tx_head = node;
+        ps->tx_tail = node;
+    }
+    // 关注可写事件, 由reactor线程继续发送积压数据并上报TX_OK
+    if (ps->state == POSIX_SOCKET_ONLINE)
+        posix_epoll_update(ps, ps->events | EPOLLOUT);
+    return len;
+}
+
+// 多段数据直接交给sendmsg, 内核里完成拼接, udp时多段组成一个包
+int (posix_socket_sendv)(int socket_id, uint64_t tag, const luat_network_iovec_t *iov, uint32_t iov_cnt, int flags, luat_ip_addr_t *remote_ip, uint16_t remote_port, void *user_data) {
+    int ret = -1;
+    uint32_t len = 0;
+    struct iovec vec[16];
+    struct msghdr msg = {0};
+    struct sockaddr_in addr = {0};
+    if (iov_cnt > sizeof(vec) / sizeof(vec[0])) {
+        LLOGE("too many iov %d", iov_cnt);
+        return -1;
+    }
+    for (size_t i = 0; i < iov_cnt; i++) {
+        vec[i].iov_base = (void*)iov[i].data;
+        vec[i].iov_len = iov[i].len;
+        len += iov[i].len;
+    }
+    msg.msg_iov = vec;
+    msg.msg_iovlen = iov_cnt;
+    pthread_mutex_lock(&posix_lock);
+    posix_socket_t *ps = posix_socket_get(socket_id, tag);
+    if (ps == NULL)
+        goto exit;
+    if (!ps->is_tcp && remote_ip && remote_port) {
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(remote_port);
+        addr.sin_addr.s_addr = remote_ip->ipv4;
+        msg.msg_name = &addr;
+        msg.msg_namelen = sizeof(addr);
+    }
+    ret = posix_socket_tx(ps, &msg, len, flags);
+exit:
+    pthread_mutex_unlock(&posix_lock);
+    return ret;
+}
+
+//tcp时，不需要remote_ip和remote_port
+//成功返回>0的len，缓冲区满了=0，失败 < 0，如果发送了len=0的空包，也是返回0，注意判断
+int (posix_socket_send)(int socket_id, uint64_t tag, const uint8_t *buf, uint32_t len, int flags, luat_ip_addr_t *remote_ip, uint16_t remote_port, void *user_data) {
+    luat_network_iovec_t iov = {.data = buf, .len = len};
+    return posix_socket_sendv(socket_id, tag, &iov, 1, flags, remote_ip, remote_port, user_data);
+}
+
+#else
+
 //创建一个socket，并设置成非阻塞模式，user_data传入对应适配器, tag作为socket的合法依据，给check_socket_vaild比对用
 //成功返回socketid，失败 < 0
 int (posix_create_socket)(uint8_t is_tcp, uint64_t *tag, void *param, uint8_t is_ipv6, void *user_data) {
     // TODO 支持IPV6
     int s = socket(AF_INET, is_tcp ? SOCK_STREAM : SOCK_DGRAM, is_tcp ? IPPROTO_TCP : IPPROTO_UDP);
-    LLOGD("CALL posix_create_socket %d %d", s, is_tcp);
+    POSIX_DBG("CALL posix_create_socket %d %d", s, is_tcp);
     return s;
 }
 
 //作为client绑定一个port，并连接remote_ip和remote_port对应的server
 //成功返回0，失败 < 0
 int (posix_socket_connect)(int socket_id, uint64_t tag, uint16_t local_port, luat_ip_addr_t *remote_ip, uint16_t remote_port, void *user_data) {
-    LLOGD("CALL posix_socket_connect %d", socket_id);
+    POSIX_DBG("CALL posix_socket_connect %d", socket_id);
     posix_socket_t *ps = luat_heap_malloc(sizeof(posix_socket_t));
     if (ps == NULL) {
         LLOGE("out of memory when malloc posix_socket_t");
@@ -168,7 +763,7 @@ int (posix_socket_connect)(int socket_id, uint64_t tag, uint16_t local_port, lua
     ps->user_data = user_data;
 
     int ret = network_posix_client_thread_start(ps);
-    LLOGD("socket thread start %d", ret);
+    POSIX_DBG("socket thread start %d", ret);
 
     if (ret) {
         luat_heap_free(ps);
@@ -242,13 +837,23 @@ int (posix_socket_send)(int socket_id, uint64_t tag, const uint8_t *buf, uint32_
         luat_rtos_mutex_unlock(master_lock);
     return ret;
 }
+#endif
 
 //检查socket合法性，成功返回0，失败 < 0
+#ifdef __linux__
+int (posix_socket_check)(int socket_id, uint64_t tag, void *user_data) {
+    pthread_mutex_lock(&posix_lock);
+    int ret = posix_socket_get(socket_id, tag) ? 0 : -1;
+    pthread_mutex_unlock(&posix_lock);
+    return ret;
+}
+#else
 int (posix_socket_check)(int socket_id, uint64_t tag, void *user_data) {
     // TODO 通过select errorfds?
-    LLOGD("CALL posix_socket_check %d %lld", socket_id, tag);
+    POSIX_DBG("CALL posix_socket_check %d %lld", socket_id, tag);
     return 0;
 }
+#endif
 
 //保留有效的socket，将无效的socket关闭
 void (posix_socket_clean)(int *vaild_socket_list, uint32_t num, void *user_data) {
@@ -270,7 +875,7 @@ int (posix_user_cmd)(int socket_id, uint64_t tag, uint32_t cmd, uint32_t value,
 
 
 int (posix_dns)(const char *domain_name, uint32_t len, void *param,  void *user_data) {
-    LLOGD("CALL posix_dns %.*s", len, domain_name);
+    POSIX_DBG("CALL posix_dns %.*s", len, domain_name);
     return -1; // 暂不支持DNS
 }
 
@@ -294,9 +899,13 @@ int (posix_get_local_ip_info)(luat_ip_addr_t *ip, luat_ip_addr_t *submask, luat_
 //OS_EVENT ID为EV_NW_XXX，param1是socket id param2是各自参数 param3是create_soceket传入的socket_param(就是network_ctrl *)
 //dns结果是特别的，ID为EV_NW_SOCKET_DNS_RESULT，param1是获取到的IP数据量，0就是失败了，param2是ip组，动态分配的， param3是dns传入的param(就是network_ctrl *)
 void (posix_socket_set_callback)(CBFuncEx_t cb_fun, void *param, void *user_data) {
-    LLOGD("call posix_socket_set_callback %p %p", cb_fun, param);
+    POSIX_DBG("call posix_socket_set_callback %p %p", cb_fun, param);
+#ifdef __linux__
+    posix_reactor_start();
+#else
     if (master_lock == NULL)
         luat_rtos_mutex_create(master_lock);
+#endif
     posix_network_cb = cb_fun;
     posix_network_param = param;
 }
@@ -306,10 +915,12 @@ network_adapter_info network_posix = {
     .check_ready = posix_check_ready,
     .create_soceket = posix_create_socket,
     .socket_connect  = posix_socket_connect,
+    .socket_listen = posix_socket_listen,
     .socket_accept = posix_socket_accept,
     .socket_disconnect  = posix_socket_disconnect,
     .socket_close = posix_socket_close,
     .socket_force_close = posix_socket_force_close,
+    .socket_check = posix_socket_check,
     .socket_receive = posix_socket_receive,
     .socket_send = posix_socket_send,
     .socket_clean = posix_socket_clean,
@@ -320,8 +931,11 @@ network_adapter_info network_posix = {
     .set_dns_server = posix_set_dns_server,
     .get_local_ip_info = posix_get_local_ip_info,
     .socket_set_callback = posix_socket_set_callback,
+#ifdef __linux__
+    .socket_sendv = posix_socket_sendv,
+#endif
     .name = "posix",
-    .max_socket_num = 4,
+    .max_socket_num = LUAT_POSIX_MAX_SOCKET,
     .no_accept = 1, // 暂时不支持接收
     .is_posix = 1,
 };
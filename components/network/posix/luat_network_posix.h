@@ -4,6 +4,22 @@
 #include "luat_base.h"
 #include "luat_network_adapter.h"
 
+// 适配器可同时打开的最大socket数量
+#ifndef LUAT_POSIX_MAX_SOCKET
+#ifdef __linux__
+#define LUAT_POSIX_MAX_SOCKET (1024)
+#else
+#define LUAT_POSIX_MAX_SOCKET (4)
+#endif
+#endif
+
+enum {
+    POSIX_SOCKET_IDLE = 0,
+    POSIX_SOCKET_CONNECTING,
+    POSIX_SOCKET_LISTENING,
+    POSIX_SOCKET_ONLINE,
+};
+
 typedef struct posix_socket
 {
     int socket_id;
@@ -12,9 +28,18 @@ typedef struct posix_socket
     luat_ip_addr_t remote_ip;
     uint16_t remote_port;
     void *user_data;
+    void *param;            // create_soceket传入的socket_param, 回调时作为Param3
+    uint32_t tx_pending;    // 已交给内核但尚未上报TX_OK的字节数
+    struct posix_tx_node *tx_head;  // 内核缓冲区满时积压的数据, 可写时继续发送
+    struct posix_tx_node *tx_tail;
+    uint32_t events;        // 当前在epoll中关注的事件, 0代表未注册
+    uint8_t is_tcp;
+    uint8_t state;
 }posix_socket_t;
 
+#ifndef __linux__
 int network_posix_client_thread_start(posix_socket_t* ps);
 void posix_network_client_thread_entry(posix_socket_t* args);
+#endif
 
 #endif
@@ -21,7 +21,7 @@ extern const sdf_opts_t sfd_onchip_opts;
 @api    sfd.init(type, spi_id, spi_cs)
 @string 类型, 可以是"spi", 也可以是"zbuff", 或者"onchip"
 @int  SPI总线的id, 或者 zbuff实例
-@int  SPI FLASH的片选脚对应的GPIO, 当类型是spi时才需要传
+@int  SPI FLASH的片选脚对应的GPIO, 当类型是spi时才需要传. 类型是zbuff时可传入table开启时序模拟, 见usage
 @return userdata 成功返回一个数据结构,否则返回nil
 @usage
 local drv = sfd.init("spi", 0, 17)
@@ -35,6 +35,9 @@ local data = sfd.read(onchip, 0x100, 256)
 sfd.erase(onchip, 0x100)
 sfd.write(onchip, 0x100, data or "Hi")
 
+-- zbuff类型可以按W25Q的典型时序模拟耗时, 用于在PC上评估上层的吞吐量, 耗时通过sfd.sim_stat获取
+-- hz是SPI时钟, legacy=true时模拟旧版驱动(0x03读, 只擦除4K, 写入不按页拆分)
+local sim = sfd.init("zbuff", zbuff.create(1024*1024, 0xFF), {hz=40000000})
 */
 static int l_sfd_init(lua_State *L) {
 
@@ -58,12 +61,27 @@ static int l_sfd_init(lua_State *L) {
         return 0;
     }
     if (!strcmp("zbuff", type)) {
-        sfd_drv_t *drv = (sfd_drv_t *)lua_newuserdata(L, sizeof(sfd_drv_t));
+        int sim = lua_istable(L, 3);
+        sfd_drv_t *drv = (sfd_drv_t *)lua_newuserdata(L, sizeof(sfd_drv_t) + (sim ? sizeof(sfd_mem_sim_t) : 0));
         memset(drv, 0, sizeof(sfd_drv_t));
         drv->type = 1;
         drv->cfg.zbuff = luaL_checkudata(L, 2, "ZBUFF*");
+        if (sim) {
+            drv->sim = (sfd_mem_sim_t*)(drv + 1);
+            memset(drv->sim, 0, sizeof(sfd_mem_sim_t));
+            lua_getfield(L, 3, "hz");
+            drv->sim->spi_hz = luaL_optinteger(L, -1, 40000000);
+            lua_getfield(L, 3, "legacy");
+            drv->sim->legacy = lua_toboolean(L, -1);
+            lua_pop(L, 2);
+            if (drv->sim->spi_hz == 0)
+                drv->sim->spi_hz = 40000000;
+        }
         drv->opts = &sfd_mem_opts;
         drv->sector_count = drv->cfg.zbuff->len / 256;
+        // drv只保存了指针, 把zbuff挂在uservalue上, 避免被GC回收
+        lua_pushvalue(L, 2);
+        lua_setuservalue(L, -2);
 
         int re = drv->opts->initialize(drv);
         if (re == 0) {
@@ -107,7 +125,7 @@ static int l_sfd_status(lua_State *L) {
 @api    sfd.read(drv, offset, len)
 @userdata  sfd.init返回的数据结构
 @int    起始偏移量
-@int    读取长度,当前限制在256以内
+@int    读取长度
 @return string 数据
 @usage
 local drv = sfd.init("spi", 0, 17)
@@ -121,8 +139,9 @@ static int l_sfd_read(lua_State *L) {
     size_t len = luaL_checkinteger(L, 3);
     luaL_Buffer buff;
     luaL_buffinitsize(L, &buff, len);
-    drv->opts->read(drv, buff.b, offset, len);
-    luaL_pushresult(&buff);
+    int re = drv->opts->read(drv, buff.b, offset, len);
+    // 各类型都返回实际读取的长度, 越界部分不会返回
+    luaL_pushresultsize(&buff, re > 0 ? (size_t)re : 0);
     return 1;
 }
 
@@ -131,7 +150,7 @@ static int l_sfd_read(lua_State *L) {
 @api    sfd.write(drv, offset, data)
 @userdata  sfd.init返回的数据结构
 @int    起始偏移量
-@string    需要写入的数据,当前支持256字节及以下
+@string    需要写入的数据, 驱动会按256字节的页自动拆分
 @return boolean 成功返回true,失败返回false
 @usage
 local drv = sfd.init("spi", 0, 17)
@@ -145,7 +164,7 @@ static int l_sfd_write(lua_State *L) {
     size_t len = 0;
     const char* buff = luaL_checklstring(L, 3, &len);
     int re = drv->opts->write(drv, buff, offset, len);
-    lua_pushboolean(L, re == 0 ? 1 : 0);
+    lua_pushboolean(L, re >= 0 ? 1 : 0);
     return 1;
 }
 
@@ -153,12 +172,15 @@ static int l_sfd_write(lua_State *L) {
 擦除数据
 @api    sfd.erase(drv, offset)
 @userdata  sfd.init返回的数据结构
-@int    起始偏移量
+@int    起始偏移量, 从其所在的4K扇区开始擦除
+@int    擦除长度, 默认4096. 对齐时自动使用32K/64K块擦除
 @return boolean 成功返回true,失败返回false
 @usage
 local drv = sfd.init("spi", 0, 17)
 if drv then
     log.info("sfd", "write", sfd.erase(drv, 0x100))
+    -- 擦除前1M, 使用64K块擦除, 比逐个扇区快很多
+    sfd.erase(drv, 0, 1024*1024)
 end
 */
 static int l_sfd_erase(lua_State *L) {
@@ -191,6 +213,36 @@ static int l_sfd_id(lua_State *L) {
     return 1;
 }
 
+/*
+获取时序模拟的统计数据, 仅对开启了模拟的zbuff类型有效
+@api    sfd.sim_stat(drv, reset)
+@userdata  sfd.init返回的数据结构
+@bool   是否在读取后清零, 默认false
+@return int 累计耗时, 单位us
+@return int 读取次数
+@return int 页编程次数
+@return int 擦除次数
+@usage
+local us, reads, progs, erases = sfd.sim_stat(sim, true)
+*/
+static int l_sfd_sim_stat(lua_State *L) {
+    sfd_drv_t *drv = (sfd_drv_t *) lua_touserdata(L, 1);
+    if (drv == NULL || drv->sim == NULL) {
+        return 0;
+    }
+    lua_pushinteger(L, drv->sim->busy_us);
+    lua_pushinteger(L, drv->sim->read_count);
+    lua_pushinteger(L, drv->sim->prog_count);
+    lua_pushinteger(L, drv->sim->erase_count);
+    if (lua_toboolean(L, 2)) {
+        drv->sim->busy_us = 0;
+        drv->sim->read_count = 0;
+        drv->sim->prog_count = 0;
+        drv->sim->erase_count = 0;
+    }
+    return 4;
+}
+
 #include "rotable2.h"
 static const rotable_Reg_t reg_sfd[] =
 {
@@ -201,6 +253,7 @@ static const rotable_Reg_t reg_sfd[] =
     { "erase",             ROREG_FUNC(l_sfd_erase)},
     { "ioctl",             ROREG_FUNC(l_sfd_ioctl)},
     { "id",                ROREG_FUNC(l_sfd_id)},
+    { "sim_stat",          ROREG_FUNC(l_sfd_sim_stat)},
     { NULL,                ROREG_INT(0)}
 };
 
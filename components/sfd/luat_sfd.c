@@ -22,12 +22,15 @@ int luat_sfd_read (sfd_drv_t* drv, char* buff, size_t offset, size_t len) {
 int luat_sfd_write (sfd_drv_t* drv, const char* buff, size_t offset, size_t len) {
     if (drv == NULL)
         return -1;
+    drv->prog_count++;
+    drv->prog_bytes += len;
     return drv->opts->write(drv->userdata, buff, offset, len);
 }
 
 int luat_sfd_erase (sfd_drv_t* drv, size_t offset, size_t len) {
     if (drv == NULL)
         return -1;
+    drv->erase_count++;
     return drv->opts->erase(drv->userdata, offset, len);
 }
 
@@ -28,6 +28,85 @@ const sdf_opts_t sfd_mem_opts = {
     .ioctl = sfd_mem_ioctl,
 };
 
+//--------------------------------------------------------------------
+// 时序模拟, 数值取W25Q128JV数据手册的典型值
+#define SIM_T_PAGE_PROG_US      (400)
+#define SIM_T_SECTOR_ERASE_US   (45000)
+#define SIM_T_BLOCK32_ERASE_US  (120000)
+#define SIM_T_BLOCK64_ERASE_US  (150000)
+#define SIM_READ_MAX_HZ         (50000000)  // 0x03普通读的最高时钟
+#define SIM_FAST_READ_MAX_HZ    (133000000) // 0x0B快速读的最高时钟
+
+static void sim_bus(sfd_mem_sim_t* sim, size_t bytes, uint32_t max_hz) {
+    uint32_t hz = sim->spi_hz < max_hz ? sim->spi_hz : max_hz;
+    sim->busy_us += (uint64_t)bytes * 8 * 1000000 / hz;
+}
+
+// NOR flash只能把1写成0, 旧驱动不按页拆分时, 超出页尾的数据会绕回页首
+static void sim_prog(uint8_t* addr, const char* buff, size_t offset, size_t len, int wrap) {
+    for (size_t i = 0; i < len; i++) {
+        size_t pos = offset + i;
+        if (wrap)
+            pos = offset - (offset % SFD_W25Q_PAGE_SIZE) + ((offset + i) % SFD_W25Q_PAGE_SIZE);
+        addr[pos] &= (uint8_t)buff[i];
+    }
+}
+
+static void sim_write(sfd_drv_t *drv, const char* buff, size_t offset, size_t len) {
+    sfd_mem_sim_t* sim = drv->sim;
+    uint8_t* addr = drv->cfg.zbuff->addr;
+    if (sim->legacy) {
+        // 一条页编程命令写完全部数据
+        sim_bus(sim, 4 + len, SIM_FAST_READ_MAX_HZ);
+        sim->busy_us += SIM_T_PAGE_PROG_US;
+        sim->prog_count++;
+        sim_prog(addr, buff, offset, len, 1);
+        return;
+    }
+    while (len > 0) {
+        size_t n = SFD_W25Q_PAGE_SIZE - (offset % SFD_W25Q_PAGE_SIZE);
+        if (n > len)
+            n = len;
+        // 写使能 + 命令地址 + 数据, 然后查询状态直到编程完成
+        sim_bus(sim, 1 + 4 + n + 2, SIM_FAST_READ_MAX_HZ);
+        sim->busy_us += SIM_T_PAGE_PROG_US;
+        sim->prog_count++;
+        sim_prog(addr, buff, offset, n, 0);
+        buff += n;
+        offset += n;
+        len -= n;
+    }
+}
+
+static void sim_erase(sfd_drv_t *drv, size_t offset, size_t len) {
+    sfd_mem_sim_t* sim = drv->sim;
+    size_t end = offset + (len ? len : 1);
+    offset -= offset % SFD_W25Q_SECTOR_SIZE;
+    if (sim->legacy) {
+        // 旧驱动不管len多大, 只擦除offset所在的扇区
+        end = offset + SFD_W25Q_SECTOR_SIZE;
+    }
+    if (end > drv->cfg.zbuff->len)
+        end = drv->cfg.zbuff->len;
+    // 与真实芯片一样整个扇区/块都会被擦除, 只在zbuff末尾截断
+    while (offset < end) {
+        size_t unit = sim->legacy ? SFD_W25Q_SECTOR_SIZE : sfd_w25q_erase_unit(offset, end - offset);
+        if (unit == SFD_W25Q_BLOCK64_SIZE)
+            sim->busy_us += SIM_T_BLOCK64_ERASE_US;
+        else if (unit == SFD_W25Q_BLOCK32_SIZE)
+            sim->busy_us += SIM_T_BLOCK32_ERASE_US;
+        else
+            sim->busy_us += SIM_T_SECTOR_ERASE_US;
+        sim_bus(sim, 1 + 4 + 2, SIM_FAST_READ_MAX_HZ);
+        sim->erase_count++;
+        size_t n = unit;
+        if (offset + n > drv->cfg.zbuff->len)
+            n = drv->cfg.zbuff->len - offset;
+        memset(drv->cfg.zbuff->addr + offset, 0xFF, n);
+        offset += unit;
+    }
+}
+
 static int sfd_mem_init (void* userdata) {
     if (userdata == NULL) {
         LLOGE("userdata for sfd_mem must NOT NULL");
@@ -64,6 +143,13 @@ static int sfd_mem_read (void* userdata, char* buff, size_t offset, size_t len)
     }
     if (len > 0) {
         memcpy(buff, zbuff->addr + offset, len);
+        if (drv->sim) {
+            drv->sim->read_count++;
+            if (drv->sim->legacy)
+                sim_bus(drv->sim, 4 + len, SIM_READ_MAX_HZ);
+            else
+                sim_bus(drv->sim, 5 + len, SIM_FAST_READ_MAX_HZ);
+        }
     }
     return len;
 }
@@ -82,7 +168,10 @@ static int sfd_mem_write (void* userdata, const char* buff, size_t offset, size_
         len = zbuff->len  - offset;
     }
     if (len > 0) {
-        memcpy(zbuff->addr + offset, buff, len);
+        if (drv->sim)
+            sim_write(drv, buff, offset, len);
+        else
+            memcpy(zbuff->addr + offset, buff, len);
     }
     return len;
 }
@@ -100,7 +189,10 @@ static int sfd_mem_erase (void* userdata, size_t offset, size_t len) {
     if (offset+len > zbuff->len) {
         len = zbuff->len  - offset;
     }
-    if (len > 0) {
+    if (drv->sim) {
+        sim_erase(drv, offset, len);
+    }
+    else if (len > 0) {
         memset(zbuff->addr + offset, 0, len);
     }
     return 0;
@@ -1,7 +1,8 @@
-
 #include "luat_base.h"
 #include "luat_spi.h"
 #include "luat_gpio.h"
+#include "luat_mcu.h"
+#include "luat_timer.h"
 
 #include "luat_sfd.h"
 
@@ -11,6 +12,35 @@
 #define CS_H(pin) luat_gpio_set(pin, 1)
 #define CS_L(pin) luat_gpio_set(pin, 0)
 
+#define W25Q_CMD_WRITE_ENABLE   (0x06)
+#define W25Q_CMD_READ_STATUS1   (0x05)
+#define W25Q_CMD_READ           (0x03)
+#define W25Q_CMD_FAST_READ      (0x0B)
+#define W25Q_CMD_PAGE_PROGRAM   (0x02)
+#define W25Q_CMD_SECTOR_ERASE   (0x20)
+#define W25Q_CMD_BLOCK32_ERASE  (0x52)
+#define W25Q_CMD_BLOCK64_ERASE  (0xD8)
+#define W25Q_CMD_JEDEC_ID       (0x9F)
+#define W25Q_CMD_UNIQUE_ID      (0x4B)
+#define W25Q_CMD_ENTER_4B_ADDR  (0xB7)
+
+#define W25Q_STATUS_BUSY        (0x01)
+
+// 超时取数据手册里最大值的数倍, 正常不会触发
+#define W25Q_TIMEOUT_PROG_MS    (10)
+#define W25Q_TIMEOUT_SECTOR_MS  (1000)
+#define W25Q_TIMEOUT_BLOCK_MS   (4000)
+
+// 容量大于16M字节时需要4字节地址
+#define W25Q_ADDR4(drv)         ((drv)->sector_count * SFD_W25Q_PAGE_SIZE > 0x1000000)
+
+// JEDEC容量码0x20开始的型号, 单位M字节
+static const uint16_t w25q_big_capacity[] = {
+    64,     // 0x20 W25Q512, EF4020
+    128,    // 0x21 W25Q01
+    256,    // 0x22 W25Q02
+};
+
 // 针对drv的实现
 static int sfd_w25q_init (void* userdata);
 static int sfd_w25q_status (void* userdata);
@@ -28,58 +58,100 @@ const sdf_opts_t sfd_w25q_opts = {
     .ioctl = sfd_w25q_ioctl,
 };
 
+size_t sfd_w25q_erase_unit(size_t offset, size_t len) {
+    if (offset % SFD_W25Q_BLOCK64_SIZE == 0 && len >= SFD_W25Q_BLOCK64_SIZE)
+        return SFD_W25Q_BLOCK64_SIZE;
+    if (offset % SFD_W25Q_BLOCK32_SIZE == 0 && len >= SFD_W25Q_BLOCK32_SIZE)
+        return SFD_W25Q_BLOCK32_SIZE;
+    return SFD_W25Q_SECTOR_SIZE;
+}
+
+static void sfd_w25q_cmd(sfd_drv_t *drv, uint8_t cmd) {
+    CS_L(drv->cfg.spi.cs);
+    luat_spi_send(drv->cfg.spi.id, (const char*)&cmd, 1);
+    CS_H(drv->cfg.spi.cs);
+}
+
+// 命令加地址, 返回实际长度
+static size_t sfd_w25q_cmd_addr(sfd_drv_t *drv, char cmd[5], uint8_t op, size_t offset) {
+    size_t i = 0;
+    cmd[i++] = op;
+    if (W25Q_ADDR4(drv))
+        cmd[i++] = (offset >> 24) & 0xFF;
+    cmd[i++] = (offset >> 16) & 0xFF;
+    cmd[i++] = (offset >> 8) & 0xFF;
+    cmd[i++] = offset & 0xFF;
+    return i;
+}
+
+static uint8_t sfd_w25q_read_status(sfd_drv_t *drv) {
+    uint8_t cmd = W25Q_CMD_READ_STATUS1;
+    uint8_t status = 0;
+    CS_L(drv->cfg.spi.cs);
+    luat_spi_send(drv->cfg.spi.id, (const char*)&cmd, 1);
+    luat_spi_recv(drv->cfg.spi.id, (char*)&status, 1);
+    CS_H(drv->cfg.spi.cs);
+    return status;
+}
+
+// 等待编程/擦除完成. 编程只要几百us, 一直查询; 擦除要几十ms以上, 每次查询之间让出1ms
+static int sfd_w25q_wait_busy(sfd_drv_t *drv, uint32_t timeout_ms, int sleep) {
+    uint64_t end = luat_mcu_tick64_ms() + timeout_ms;
+    while (sfd_w25q_read_status(drv) & W25Q_STATUS_BUSY) {
+        if (luat_mcu_tick64_ms() > end) {
+            LLOGE("spi flash busy timeout %dms", timeout_ms);
+            return -1;
+        }
+        if (sleep)
+            luat_timer_mdelay(1);
+    }
+    return 0;
+}
+
 static int sfd_w25q_init (void* userdata) {
     sfd_drv_t *drv = (sfd_drv_t *)userdata;
-    uint8_t cmd = 0x9F;
+    uint8_t cmd = W25Q_CMD_JEDEC_ID;
     // 发送CMD 9F, 读取容量信息
     luat_gpio_set(drv->cfg.spi.cs, 0);
     luat_spi_send(drv->cfg.spi.id, (const char*)&cmd, 1);
     char buff[3] = {0};
     luat_spi_recv(drv->cfg.spi.id, buff, 3);
     luat_gpio_set(drv->cfg.spi.cs, 1);
-    if (buff[0] != 0xEF) {
+    if ((uint8_t)buff[0] != 0xEF) {
         LLOGW("can't read spi flash: cmd 9F");
         return -1;
     }
     LLOGD("spi flash %02X %02X %02X", buff[0], buff[1], buff[2]);
-    if (buff[1] == 0x40) {
-        switch(buff[2]) {
-            case 0x13:
-                drv->sector_count = 8*256;// drv80, 8M
-                break;
-            case 0x14:
-                drv->sector_count = 16*256;// drv16, 16M
-                break;
-            case 0x15:
-                drv->sector_count = 32*256;// drv32, 32M
-                break;
-            case 0x16:
-                drv->sector_count = 64*256;// drv64, 64M
-                break;
-            case 0x17:
-                drv->sector_count = 128*256;// drv128, 128M
-                break;
-            case 0x18:
-                drv->sector_count = 256*256;// drv256, 256M
-                break;
-            case 0x19:
-                drv->sector_count = 512*256;// drv512, 512M
-                break;
-            default :
-                drv->sector_count = 16*256;// 默认当16M吧
-                break;
-        }
+    // 第3个字节0x10~0x19是容量的2的幂, 例如W25Q128是0x18, 即16M字节
+    // 更大的型号不再按2的幂编码, 见w25q_big_capacity
+    uint8_t capacity = (uint8_t)buff[2];
+    size_t size = 0;
+    if (buff[1] == 0x40 || buff[1] == 0x70) {
+        if (capacity >= 0x10 && capacity <= 0x19)
+            size = (size_t)1 << capacity;
+        else if (capacity >= 0x20 && capacity < 0x20 + sizeof(w25q_big_capacity) / sizeof(w25q_big_capacity[0]))
+            size = (size_t)w25q_big_capacity[capacity - 0x20] * 1024 * 1024;
+    }
+    if (size) {
+        drv->sector_count = size / SFD_W25Q_PAGE_SIZE;
     }
     else {
         drv->sector_count = 16*256;// 默认当16M吧
     }
+    drv->sector_size = SFD_W25Q_PAGE_SIZE;
+    drv->erase_size = SFD_W25Q_SECTOR_SIZE;
     //drv->flash_id[0] = buff[1];
     //drv->flash_id[1] = buff[2];
 
-    // 读设备唯一id
+    // W25Q256及以上, 切换到4字节地址模式
+    if (W25Q_ADDR4(drv)) {
+        sfd_w25q_cmd(drv, W25Q_CMD_ENTER_4B_ADDR);
+    }
+
+    // 读设备唯一id, 命令后面是dummy字节, 4字节地址模式下要多1个
     luat_gpio_set(drv->cfg.spi.cs, 0);
-    char chip_id_cmd[] = {0x4B, 0x00, 0x00, 0x00, 0x00};
-    luat_spi_send(drv->cfg.spi.id, chip_id_cmd, sizeof(chip_id_cmd));
+    char chip_id_cmd[] = {W25Q_CMD_UNIQUE_ID, 0x00, 0x00, 0x00, 0x00, 0x00};
+    luat_spi_send(drv->cfg.spi.id, chip_id_cmd, W25Q_ADDR4(drv) ? 6 : 5);
     luat_spi_recv(drv->cfg.spi.id, drv->chip_id, 8);
     luat_gpio_set(drv->cfg.spi.cs, 1);
 
@@ -88,44 +160,75 @@ static int sfd_w25q_init (void* userdata) {
 
 static int sfd_w25q_status (void* userdata) {
     sfd_drv_t *drv = (sfd_drv_t *)userdata;
-    return drv->sector_count == 0 ? 0 : 1; // TODO 根据BUSY 状态返回
+    if (drv->sector_count == 0)
+        return 0;
+    return (sfd_w25q_read_status(drv) & W25Q_STATUS_BUSY) ? 2 : 1;
 }
 
 static int sfd_w25q_read (void* userdata, char* buff, size_t offset, size_t len) {
     sfd_drv_t *drv = (sfd_drv_t *)userdata;
-    char cmd[4] = {0x03, offset >> 16, (offset >> 8) & 0xFF, offset & 0xFF};
+    // 0x0B快速读, 比0x03多一个dummy字节, 但SPI时钟可以更高
+    char cmd[6];
+    size_t cmd_len = sfd_w25q_cmd_addr(drv, cmd, W25Q_CMD_FAST_READ, offset);
+    cmd[cmd_len++] = 0xFF;
     luat_gpio_set(drv->cfg.spi.cs, 0);
-    luat_spi_send(drv->cfg.spi.id, (const char*)&cmd, sizeof(cmd));
+    luat_spi_send(drv->cfg.spi.id, (const char*)&cmd, cmd_len);
     luat_spi_recv(drv->cfg.spi.id, buff, len);
     luat_gpio_set(drv->cfg.spi.cs, 1);
-    return 0;
+    return len;
 }
 
 void sfd_w25q_write_enable(sfd_drv_t *drv) {
-    luat_gpio_set(drv->cfg.spi.cs, 0);
-    uint8_t cmd = 0x06;
-    luat_spi_send(drv->cfg.spi.id, (const char*)&cmd, sizeof(cmd));
-    luat_gpio_set(drv->cfg.spi.cs, 1);
+    sfd_w25q_cmd(drv, W25Q_CMD_WRITE_ENABLE);
 }
 
 static int sfd_w25q_write (void* userdata, const char* buff, size_t offset, size_t len) {
     sfd_drv_t *drv = (sfd_drv_t *)userdata;
-    sfd_w25q_write_enable(drv);
-    char cmd[4] = {0x02, offset >> 16, (offset >> 8) & 0xFF, offset & 0xFF};
-    luat_gpio_set(drv->cfg.spi.cs, 0);
-    luat_spi_send(drv->cfg.spi.id, (const char*)&cmd, sizeof(cmd));
-    luat_spi_send(drv->cfg.spi.id, buff, len);
-    luat_gpio_set(drv->cfg.spi.cs, 1);
+    char cmd[5];
+    // 页编程不能跨页, 超出的部分会绕回页首, 所以按页拆分
+    while (len > 0) {
+        size_t n = SFD_W25Q_PAGE_SIZE - (offset % SFD_W25Q_PAGE_SIZE);
+        if (n > len)
+            n = len;
+        sfd_w25q_write_enable(drv);
+        size_t cmd_len = sfd_w25q_cmd_addr(drv, cmd, W25Q_CMD_PAGE_PROGRAM, offset);
+        luat_gpio_set(drv->cfg.spi.cs, 0);
+        luat_spi_send(drv->cfg.spi.id, (const char*)&cmd, cmd_len);
+        luat_spi_send(drv->cfg.spi.id, buff, n);
+        luat_gpio_set(drv->cfg.spi.cs, 1);
+        if (sfd_w25q_wait_busy(drv, W25Q_TIMEOUT_PROG_MS, 0))
+            return -1;
+        buff += n;
+        offset += n;
+        len -= n;
+    }
     return 0;
 }
 
 static int sfd_w25q_erase (void* userdata, size_t offset, size_t len) {
     sfd_drv_t *drv = (sfd_drv_t *)userdata;
-    sfd_w25q_write_enable(drv);
-    char cmd[4] = {0x20, offset >> 16, (offset >> 8) & 0xFF, offset & 0xFF};
-    luat_gpio_set(drv->cfg.spi.cs, 0);
-    luat_spi_send(drv->cfg.spi.id, (const char*)&cmd, sizeof(cmd));
-    luat_gpio_set(drv->cfg.spi.cs, 1);
+    char cmd[5];
+    // 按扇区对齐, 能用32K/64K块擦除的就用块擦除, 比逐个扇区擦除快很多
+    // 与旧版一致, offset所在的扇区起算, 默认的4096就是擦除一个扇区
+    // 结束位置按原始offset计算, 否则跨扇区的区间会少擦尾部
+    size_t end = offset + (len ? len : 1);
+    offset -= offset % SFD_W25Q_SECTOR_SIZE;
+    while (offset < end) {
+        size_t unit = sfd_w25q_erase_unit(offset, end - offset);
+        uint8_t op = W25Q_CMD_SECTOR_ERASE;
+        if (unit == SFD_W25Q_BLOCK64_SIZE)
+            op = W25Q_CMD_BLOCK64_ERASE;
+        else if (unit == SFD_W25Q_BLOCK32_SIZE)
+            op = W25Q_CMD_BLOCK32_ERASE;
+        sfd_w25q_write_enable(drv);
+        size_t cmd_len = sfd_w25q_cmd_addr(drv, cmd, op, offset);
+        luat_gpio_set(drv->cfg.spi.cs, 0);
+        luat_spi_send(drv->cfg.spi.id, (const char*)&cmd, cmd_len);
+        luat_gpio_set(drv->cfg.spi.cs, 1);
+        if (sfd_w25q_wait_busy(drv, unit == SFD_W25Q_SECTOR_SIZE ? W25Q_TIMEOUT_SECTOR_MS : W25Q_TIMEOUT_BLOCK_MS, 1))
+            return -1;
+        offset += unit;
+    }
     return 0;
 }
 
@@ -0,0 +1,59 @@
+-- LuaTools需要PROJECT和VERSION这两个信息
+PROJECT = "crc_bench"
+VERSION = "1.0.0"
+
+--[[
+CRC校验的吞吐量测试, 以及分段计算的用法
+
+crypto.crc32/crc16_modbus 支持传入上一段的结果继续计算, 数据也可以直接是zbuff,
+适合边接收边校验固件, 或者拼接多段modbus报文.
+]]
+
+_G.sys = require("sys")
+
+local BLOCK = 4096
+local TOTAL = 1024 * 1024
+
+local function bench(name, fn, data)
+    local rounds = TOTAL // BLOCK
+    local start = os.clock()
+    local crc
+    for i = 1, rounds do
+        crc = fn(data)
+    end
+    local cost = os.clock() - start
+    log.info("crc", string.format("%-12s %8.2f MB/s  0x%X", name, TOTAL / 1024 / 1024 / (cost > 0 and cost or 1e-6), crc))
+end
+
+sys.taskInit(function()
+    -- 标准测试向量
+    log.info("crc", "crc32", string.format("0x%08X", crypto.crc32("123456789")), "expect 0xCBF43926")
+    log.info("crc", "modbus", string.format("0x%04X", crypto.crc16_modbus("123456789")), "expect 0x4B37")
+    log.info("crc", "xmodem", string.format("0x%04X", crypto.crc16("XMODEM", "123456789")), "expect 0x31C3")
+    log.info("crc", "crc8", string.format("0x%02X", crypto.crc8("123456789")), "expect 0xF4")
+
+    -- 分段计算与一次计算结果相同
+    local part = crypto.crc32("12345")
+    log.info("crc", "crc32 分段", crypto.crc32("6789", part) == crypto.crc32("123456789"))
+    part = crypto.crc16_modbus("1234")
+    log.info("crc", "modbus 分段", crypto.crc16_modbus("56789", part) == crypto.crc16_modbus("123456789"))
+
+    local data = string.rep("LuatOS-CRC-", BLOCK // 11 + 1):sub(1, BLOCK)
+    local buff = zbuff.create(BLOCK)
+    buff:write(data)
+    log.info("crc", "zbuff", crypto.crc32(buff) == crypto.crc32(data))
+
+    bench("crc32", crypto.crc32, data)
+    bench("crc32 zbuff", crypto.crc32, buff)
+    bench("modbus", crypto.crc16_modbus, data)
+    bench("ccitt-false", function(d) return crypto.crc16("CCITT-FALSE", d) end, data)
+    bench("dnp", function(d) return crypto.crc16("DNP", d) end, data)
+    bench("crc8", crypto.crc8, data)
+    bench("crc8 0x31", function(d) return crypto.crc8(d, 0x31, 0, true) end, data)
+    os.exit(0)
+end)
+
+-- 用户代码已结束---------------------------------------------
+-- 结尾总是这一句
+sys.run()
+-- sys.run()之后后面不要加任何语句!!!!!
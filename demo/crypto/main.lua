@@ -95,6 +95,19 @@ sys.taskInit(function()
         log.info("checksum", "OK", string.char(crypto.checksum("OK")):toHex())
     end
 
+    -- 分段计算, 数据可以来自zbuff, 适合边接收边校验
+    if crypto.hash then
+        local buff = zbuff.create(1024)
+        buff:write("1234567890")
+        local h = crypto.hash("SHA256")
+        h:update(buff)
+        h:update("abcdef", 0, 3)
+        log.info("hash", "sha256", h:finish(), crypto.sha256("1234567890abc"))
+        local c = crypto.hash("CRC32")
+        c:update(buff, 0, 5):update(buff, 5)
+        log.info("hash", "crc32", c:finish(), crypto.crc32("1234567890"))
+    end
+
     log.info("crypto", "ALL Done")
     sys.wait(100000)
 end)
@@ -54,6 +54,14 @@ sys.taskInit(function()
     local t = fskv.get("my_bool")
     log.info("fskv", "my_bool",      type(t),    t)
 
+    -- 批量写入, 多个值一起保存, 要么全部生效, 要么全部不生效
+    fskv.batch(function(tx)
+        tx:set("wifi_ssid", "luatos")
+        tx:set("wifi_passwd", "12345678")
+        tx:del("my_str_int")
+    end)
+    log.info("fskv", "wifi_ssid", fskv.get("wifi_ssid"), "my_str_int", fskv.get("my_str_int"))
+
     -- 查询kv数据库状态
     -- local used, total,kv_count = fskv.stat()
     -- log.info("fdb", "kv", used,total,kv_count)
@@ -0,0 +1,85 @@
+
+-- LuaTools需要PROJECT和VERSION这两个信息
+PROJECT = "fskvbench"
+VERSION = "1.0.0"
+
+-- sys库是标配
+_G.sys = require("sys")
+
+-- 测量fskv读写速度, 以及每次更新实际写入flash的字节数/擦除次数
+-- 同一份脚本可分别在 LUAT_USE_FSKV_LOG 开启/关闭的固件上运行, 对比两种存储方式
+
+local COUNT = 2000
+
+local function flash_delta(s0, s1)
+    return s1[1] - s0[1], s1[2] - s0[2], s1[3] - s0[3]
+end
+
+local function bench(name, count, func)
+    local s0 = {fskv.flash_stat()}
+    local t = os.clock()
+    for i = 1, count do
+        func(i)
+        if i % 200 == 0 then
+            sys.wait(1) -- 让出时间片, 后台整理也在这里执行
+        end
+    end
+    t = os.clock() - t
+    local progs, bytes, erases = flash_delta(s0, {fskv.flash_stat()})
+    log.info("bench", name, string.format("%d ops/s", math.floor(count / (t > 0 and t or 0.000001))),
+        "prog/op", string.format("%.2f", progs / count),
+        "bytes/op", string.format("%.1f", bytes / count),
+        "erase", erases)
+end
+
+sys.taskInit(function()
+    sys.wait(1000)
+    if not fskv or not fskv.flash_stat then
+        while true do
+            log.info("fskv", "this demo need fskv with flash_stat")
+            sys.wait(1000)
+        end
+    end
+    fskv.init()
+    fskv.clear()
+
+    -- 典型用法: 频繁更新一个计数器
+    bench("counter", COUNT, function(i) fskv.set("counter", i) end)
+    -- 轮流更新16个配置项
+    bench("16 keys", COUNT, function(i) fskv.set("cfg" .. (i % 16), "value" .. i) end)
+    -- 稍大一点的值
+    local blob = string.rep("A", 200)
+    bench("200B value", COUNT // 4, function(i) fskv.set("blob" .. (i % 4), blob .. i) end)
+    -- 读
+    bench("get", COUNT, function(i) fskv.get("cfg" .. (i % 16)) end)
+
+    -- 保存一份20个字段的配置, 逐个set与一次batch对比
+    local function config(i)
+        local cfg = {}
+        for k = 1, 20 do
+            cfg["field" .. k] = "v" .. k .. "_" .. i
+        end
+        return cfg
+    end
+    bench("20 x set", COUNT // 20, function(i)
+        for k, v in pairs(config(i)) do
+            fskv.set(k, v)
+        end
+    end)
+    bench("batch(20)", COUNT // 20, function(i)
+        local cfg = config(i)
+        fskv.batch(function(tx)
+            for k, v in pairs(cfg) do
+                tx:set(k, v)
+            end
+        end)
+    end)
+
+    log.info("fskv", "stat", fskv.stat())
+    log.info("fskv", "bench done")
+end)
+
+-- 用户代码已结束---------------------------------------------
+-- 结尾总是这一句
+sys.run()
+-- sys.run()之后后面不要加任何语句!!!!!
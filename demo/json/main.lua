@@ -42,6 +42,16 @@ sys.taskInit(function()
         -- 限制小数点到1位
         log.info("json", json.encode({abc=1234.300}, "1f"))
 
+        -- 直接编码到zbuff, 追加在已有数据之后, 不生成中间字符串, 适合频繁上报的大报文
+        local buff = zbuff.create(256)
+        local len = json.encode({temp=25.5, hum=60}, buff)
+        log.info("json", "zbuff", len, buff:toStr(0, buff:used()))
+        -- 也可以直接从zbuff解码, 可以指定起始位置和长度
+        local t = json.decode(buff)
+        if t then
+            log.info("json", "decode zbuff", t.temp, t.hum)
+        end
+
     end
 end)
 
@@ -0,0 +1,64 @@
+-- LuaTools需要PROJECT和VERSION这两个信息
+PROJECT = "json_number"
+VERSION = "1.0.0"
+
+--[[
+数值数组的json编码吞吐量测试
+
+json.encode默认模式下, 整数与浮点数都与tostring共用同一套转换(luat_dtoa),
+浮点数输出能精确还原原值的最短形式, 例如 25.3 得到 "25.3" 而不是 "25.299999"
+传入 "7g"/"2f" 之类的格式时仍走printf, 可与默认模式对比
+]]
+
+log.info("main", PROJECT, VERSION)
+
+_G.sys = require("sys")
+
+local COUNT = 500
+local ROUNDS = 20
+
+local function bench(name, arr, fmt)
+    local total = 0
+    local start = os.clock()
+    for i = 1, ROUNDS do
+        total = total + #json.encode(arr, fmt)
+    end
+    local cost = os.clock() - start
+    if cost <= 0 then cost = 1e-6 end
+    log.info("json_number", string.format("%-10s %8.1f KB/s %10d num/s", name, total / 1024 / cost, COUNT * ROUNDS // cost))
+end
+
+sys.taskInit(function()
+    sys.wait(100)
+    local ints, floats, sensors = {}, {}, {}
+    for i = 1, COUNT do
+        ints[i] = math.random(-100000, 100000)
+        floats[i] = (math.random() - 0.5) * 10 ^ math.random(-8, 8)
+        sensors[i] = math.random(-400, 1250) / 10 -- 温度之类的一位小数
+    end
+    -- 默认模式可以原样还原
+    local back = json.decode(json.encode(floats))
+    local same = true
+    for i = 1, COUNT do
+        if back[i] ~= floats[i] then same = false end
+    end
+    log.info("json_number", "roundtrip", same, json.encode({sensors[1], sensors[COUNT], 0.1, 1 / 3}))
+
+    bench("int", ints)
+    bench("float", floats)
+    bench("sensor", sensors)
+    bench("float 7g", floats, "7g")
+    bench("sensor 1f", sensors, "1f")
+
+    -- tostring 与 string.format 的 %d/%s 同样受益
+    local start = os.clock()
+    for i = 1, COUNT * ROUNDS do
+        local _ = tostring(floats[i % COUNT + 1])
+    end
+    log.info("json_number", "tostring", string.format("%.3fs", os.clock() - start))
+end)
+
+-- 用户代码已结束---------------------------------------------
+-- 结尾总是这一句
+sys.run()
+-- sys.run()之后后面不要加任何语句!!!!!
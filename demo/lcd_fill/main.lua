@@ -0,0 +1,72 @@
+-- LuaTools需要PROJECT和VERSION这两个信息
+PROJECT = "lcd_fill"
+VERSION = "1.0.0"
+
+--[[
+LCD基础绘图吞吐量测试, 输出 clear/fill/drawLine 的 Mpixel/s
+
+USE_BUFF = true  : 绘制到显存, 关闭自动刷新, 测的是绘图本身的速度
+USE_BUFF = false : 直接刷屏, 测的是SPI的实际传输速度
+]]
+
+log.info("main", PROJECT, VERSION)
+
+_G.sys = require("sys")
+
+local USE_BUFF = true
+local W, H = 320, 480
+
+local rtos_bsp = rtos.bsp()
+
+-- spi_id,pin_reset,pin_dc,pin_cs,bl
+local function lcd_pin()
+    if rtos_bsp == "AIR101" or rtos_bsp == "AIR103" then
+        return 0,pin.PB03,pin.PB01,pin.PB04,pin.PB00
+    elseif rtos_bsp == "AIR105" then
+        return 5,pin.PC12,pin.PE08,pin.PC14,pin.PE09
+    elseif rtos_bsp == "ESP32C3" then
+        return 2,10,6,7,11
+    elseif rtos_bsp == "EC618" then
+        return 0,1,10,8,18
+    end
+end
+
+local spi_id,pin_reset,pin_dc,pin_cs,bl = lcd_pin()
+if spi_id then
+    local spi_lcd = spi.deviceSetup(spi_id,pin_cs,0,0,8,40*1000*1000,spi.MSB,1,0)
+    lcd.init("st7796",{port = "device",pin_dc = pin_dc, pin_pwr = bl, pin_rst = pin_reset,direction = 0,w = W,h = H,xoffset = 0,yoffset = 0},spi_lcd)
+else
+    -- 模拟器
+    lcd.init("st7796",{port = 0,pin_dc = 0,pin_rst = 0,direction = 0,w = W,h = H,xoffset = 0,yoffset = 0})
+end
+
+if USE_BUFF then
+    lcd.setupBuff(nil, true)
+    lcd.autoFlush(false)
+end
+
+local function bench(name, rounds, pixels, fn)
+    local start = os.clock()
+    for i = 1, rounds do
+        fn(i)
+    end
+    local cost = os.clock() - start
+    log.info("lcd_fill", string.format("%-6s %8.2f Mpixel/s", name, pixels * rounds / 1000000 / (cost > 0 and cost or 1e-6)))
+end
+
+sys.taskInit(function()
+    sys.wait(100)
+    bench("clear", 50, W * H, function(i) lcd.clear(i) end)
+    bench("fill", 500, 100 * 60, function(i) lcd.fill(i % 200, i % 400, i % 200 + 99, i % 400 + 59, i) end)
+    bench("hline", 2000, W, function(i) lcd.drawLine(0, i % H, W - 1, i % H, i) end)
+    bench("vline", 2000, H, function(i) lcd.drawLine(i % W, 0, i % W, H - 1, i) end)
+    bench("point", 20000, 1, function(i) lcd.drawPoint(i % W, i % H, i) end)
+    if USE_BUFF then
+        lcd.flush()
+    end
+end)
+
+-- 用户代码已结束---------------------------------------------
+-- 结尾总是这一句
+sys.run()
+-- sys.run()之后后面不要加任何语句!!!!!
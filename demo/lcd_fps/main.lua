@@ -0,0 +1,91 @@
+-- LuaTools需要PROJECT和VERSION这两个信息
+PROJECT = "lcd_fps"
+VERSION = "1.0.0"
+
+--[[
+LCD刷新帧率测试, 对比单缓冲同步刷新与双缓冲异步刷新
+
+单缓冲: lcd.flush() 阻塞到SPI发送完成才返回
+双缓冲: lcd.flush() 把脏区域复制到发送缓冲区后立即返回, 发送期间继续绘制下一帧,
+        发送完成后发布 LCD_FLUSH_DONE
+
+setupBuff只能调用一次, 修改 DOUBLE_BUFF 后重新运行以对比两种模式.
+PC模拟器(SDL2)上lcd.init任意型号都会打开一个窗口, 无需接线.
+]]
+
+log.info("main", PROJECT, VERSION)
+
+_G.sys = require("sys")
+
+local DOUBLE_BUFF = true
+local FRAMES = 300
+local W, H = 320, 480
+local BOX = 48
+
+local rtos_bsp = rtos.bsp()
+
+-- spi_id,pin_reset,pin_dc,pin_cs,bl
+local function lcd_pin()
+    if rtos_bsp == "AIR101" or rtos_bsp == "AIR103" then
+        return 0,pin.PB03,pin.PB01,pin.PB04,pin.PB00
+    elseif rtos_bsp == "AIR105" then
+        return 5,pin.PC12,pin.PE08,pin.PC14,pin.PE09
+    elseif rtos_bsp == "ESP32C3" then
+        return 2,10,6,7,11
+    elseif rtos_bsp == "EC618" then
+        return 0,1,10,8,18
+    end
+end
+
+local spi_id,pin_reset,pin_dc,pin_cs,bl = lcd_pin()
+if spi_id then
+    local spi_lcd = spi.deviceSetup(spi_id,pin_cs,0,0,8,40*1000*1000,spi.MSB,1,0)
+    lcd.init("st7796",{port = "device",pin_dc = pin_dc, pin_pwr = bl, pin_rst = pin_reset,direction = 0,w = W,h = H,xoffset = 0,yoffset = 0},spi_lcd)
+else
+    -- 模拟器
+    lcd.init("st7796",{port = 0,pin_dc = 0,pin_rst = 0,direction = 0,w = W,h = H,xoffset = 0,yoffset = 0})
+end
+
+lcd.setupBuff(nil, true, DOUBLE_BUFF)
+lcd.autoFlush(false)
+
+-- 一帧: 擦除上一帧的方块, 画新位置的方块和一条进度条, 只有这些区域会被发送
+local function draw(i)
+    local x = (i * 5) % (W - BOX)
+    local y = (i * 3) % (H - BOX)
+    local px = ((i - 1) * 5) % (W - BOX)
+    local py = ((i - 1) * 3) % (H - BOX)
+    lcd.fill(px, py, px + BOX, py + BOX, 0xFFFF)
+    lcd.fill(x, y, x + BOX, y + BOX, (i * 0x0841) & 0xFFFF)
+    lcd.fill(0, H - 8, (i % W) + 1, H, 0x001F)
+end
+
+sys.taskInit(function()
+    lcd.clear()
+    if lcd.flush() and DOUBLE_BUFF then
+        sys.waitUntil("LCD_FLUSH_DONE", 1000)
+    end
+    lcd.flushStat(true)
+    local hz = mcu.hz()
+    local start = mcu.ticks()
+    for i = 1, FRAMES do
+        draw(i)
+        if DOUBLE_BUFF and i > 1 then
+            -- 等待上一帧发送完成, 期间本帧已经画好了
+            sys.waitUntil("LCD_FLUSH_DONE", 1000)
+        end
+        lcd.flush()
+    end
+    if DOUBLE_BUFF then
+        sys.waitUntil("LCD_FLUSH_DONE", 1000)
+    end
+    local cost = (mcu.ticks() - start) / hz
+    local flushes, bytes, last, windows = lcd.flushStat()
+    log.info("lcd_fps", DOUBLE_BUFF and "double" or "single", string.format("%.1f fps", FRAMES / (cost > 0 and cost or 1e-6)))
+    log.info("lcd_fps", "avg bytes/frame", bytes // (flushes > 0 and flushes or 1), "windows", windows, "full frame", W * H * 2)
+end)
+
+-- 用户代码已结束---------------------------------------------
+-- 结尾总是这一句
+sys.run()
+-- sys.run()之后后面不要加任何语句!!!!!
@@ -0,0 +1,137 @@
+
+-- LuaTools需要PROJECT和VERSION这两个信息
+PROJECT = "lfs2bench"
+VERSION = "1.0.0"
+
+-- sys库是标配
+_G.sys = require("sys")
+
+-- 在16M的模拟W25Q上测试lfs2, 对比默认参数与调大缓存/块之后的读写速度和挂载耗时
+-- 耗时取自sfd的时序模拟(sfd.sim_stat), 即flash和SPI总线的耗时, 不含CPU时间
+
+local SIZE = 16 * 1024 * 1024
+local FILE_SIZE = 256 * 1024
+local FILL = 0.9 -- 写到90%左右, 模拟快满的文件系统
+local PATH = "/bench"
+
+local configs = {
+    -- 与之前版本相同的参数, 不使用共享读缓存
+    {name = "nolru", opts = {lru = 0}},
+    {name = "default", opts = nil},
+    -- 小粒度读取+大缓存, 读多写少时用
+    {name = "tuned", opts = {read = 64, cache = 1024, lookahead = 64, lru = 16}},
+    -- 64K块可以用上块擦除, 适合大文件顺序写入, 但小文件改写会变慢
+    {name = "bigfile", opts = {block = 65536, cache = 1024, lookahead = 64, lru = 8}},
+}
+
+-- 固定种子的伪随机数, 保证每组参数访问的位置完全一样
+local seed = 1
+local function rand(low, up)
+    seed = (seed * 1103515245 + 12345) % 2147483648
+    return low + (seed >> 8) % (up - low + 1)
+end
+
+local function mbps(bytes, us)
+    if us == 0 then return "-" end
+    return string.format("%.2f MB/s", bytes / 1024 / 1024 * 1000000 / us)
+end
+
+local function run(cfg)
+    local drv = sfd.init("zbuff", zbuff.create(SIZE, 0xFF), {hz = 80000000})
+    sfd.erase(drv, 0, SIZE)
+    if not lfs2.mount(PATH, drv, true, cfg.opts) then
+        log.info(cfg.name, "mount failed")
+        return
+    end
+    local chunk = string.rep("\xA5", 4096)
+
+    -- 顺序写
+    sfd.sim_stat(drv, true)
+    local count = math.floor(SIZE * FILL / FILE_SIZE)
+    local written = 0
+    for i = 1, count do
+        local f = io.open(PATH .. "/d" .. i .. ".bin", "wb")
+        if not f then break end
+        for _ = 1, FILE_SIZE // #chunk do
+            f:write(chunk)
+        end
+        f:close()
+        written = written + FILE_SIZE
+    end
+    local us = sfd.sim_stat(drv, true)
+    log.info(cfg.name, "seq write", mbps(written, us), string.format("%.1fMB in %d files", written / 1024 / 1024, count))
+
+    -- 顺序读
+    local read = 0
+    for i = 1, count do
+        local f = io.open(PATH .. "/d" .. i .. ".bin", "rb")
+        if f then
+            while true do
+                local data = f:read(#chunk)
+                if not data or #data == 0 then break end
+                read = read + #data
+            end
+            f:close()
+        end
+    end
+    us = sfd.sim_stat(drv, true)
+    log.info(cfg.name, "seq read", mbps(read, us))
+
+    -- 随机读, 每次在随机文件的随机位置读256字节
+    seed = 1
+    local files = {}
+    for i = 1, 8 do
+        files[i] = io.open(PATH .. "/d" .. rand(1, count) .. ".bin", "rb")
+    end
+    read = 0
+    local hit0, miss0 = lfs2.cache_stat(PATH)
+    for _ = 1, 2000 do
+        local f = files[rand(1, #files)]
+        f:seek("set", rand(0, FILE_SIZE // 256 - 1) * 256)
+        read = read + #(f:read(256) or "")
+    end
+    for _, f in ipairs(files) do f:close() end
+    us = sfd.sim_stat(drv, true)
+    local hit, miss = lfs2.cache_stat(PATH)
+    log.info(cfg.name, "rand read", mbps(read, us), "lru hit/miss", hit - hit0, miss - miss0)
+
+    -- 反复改写小文件
+    written = 0
+    for i = 1, 200 do
+        local f = io.open(PATH .. "/s" .. (i % 16) .. ".bin", "wb")
+        if f then
+            f:write(chunk:sub(1, 256))
+            f:close()
+            written = written + 256
+        end
+    end
+    us = sfd.sim_stat(drv, true)
+    log.info(cfg.name, "small rewrite", mbps(written, us))
+
+    -- 重新挂载, 并创建一个文件, 触发一次空闲块扫描
+    lfs2.unmount(PATH)
+    sfd.sim_stat(drv, true)
+    local t = os.clock()
+    lfs2.mount(PATH, drv, false, cfg.opts)
+    local f = io.open(PATH .. "/new.txt", "wb")
+    if f then
+        f:write("hi")
+        f:close()
+    end
+    us = sfd.sim_stat(drv, true)
+    log.info(cfg.name, "mount", string.format("%dms flash, %dms cpu", us // 1000, math.floor((os.clock() - t) * 1000)))
+    lfs2.unmount(PATH)
+end
+
+sys.taskInit(function()
+    sys.wait(100)
+    for _, cfg in ipairs(configs) do
+        run(cfg)
+        collectgarbage("collect")
+    end
+end)
+
+-- 用户代码已结束---------------------------------------------
+-- 结尾总是这一句
+sys.run()
+-- sys.run()之后后面不要加任何语句!!!!!
@@ -0,0 +1,113 @@
+#!/usr/bin/python
+# -*- coding: UTF-8 -*-
+
+# mqtt_bench的服务器端, 只实现测试用到的mqtt 3.1.1报文, 不是完整的broker
+# 设备向bench/req发布"大小,条数", 这里就向bench/data连续下发对应的PUBLISH, 最后发一条bench/done
+# 用法: python broker.py [端口, 默认1883]
+
+import socket
+import struct
+import sys
+import threading
+
+
+def encode_len(n):
+    out = bytearray()
+    while True:
+        d = n & 0x7F
+        n >>= 7
+        if n:
+            d |= 0x80
+        out.append(d)
+        if not n:
+            return bytes(out)
+
+
+def publish(topic, payload):
+    t = topic.encode()
+    body = struct.pack(">H", len(t)) + t + payload
+    return b"\x30" + encode_len(len(body)) + body
+
+
+def recv_exact(conn, n):
+    data = b""
+    while len(data) < n:
+        chunk = conn.recv(n - len(data))
+        if not chunk:
+            raise ConnectionError("closed")
+        data += chunk
+    return data
+
+
+def read_packet(conn):
+    header = recv_exact(conn, 1)[0]
+    rem_len, shift = 0, 0
+    while True:
+        d = recv_exact(conn, 1)[0]
+        rem_len |= (d & 0x7F) << shift
+        shift += 7
+        if not d & 0x80:
+            break
+    return header, recv_exact(conn, rem_len)
+
+
+def burst(conn, size, count):
+    payload = bytes(i & 0xFF for i in range(size))
+    pkt = publish("bench/data", payload)
+    for _ in range(count):
+        conn.sendall(pkt)
+    conn.sendall(publish("bench/done", b""))
+    print("sent %d x %d" % (size, count))
+
+
+def client(conn, addr):
+    print("client", addr)
+    try:
+        while True:
+            header, body = read_packet(conn)
+            tp = header & 0xF0
+            if tp == 0x10:      # CONNECT
+                conn.sendall(b"\x20\x02\x00\x00")
+            elif tp == 0x80:    # SUBSCRIBE, 每个topic都给qos0
+                msg_id = body[:2]
+                n = 0
+                i = 2
+                while i < len(body):
+                    tl = struct.unpack(">H", body[i:i + 2])[0]
+                    i += 2 + tl + 1
+                    n += 1
+                conn.sendall(b"\x90" + encode_len(2 + n) + msg_id + b"\x00" * n)
+            elif tp == 0x30:    # PUBLISH
+                tl = struct.unpack(">H", body[:2])[0]
+                topic = body[2:2 + tl].decode()
+                off = 2 + tl
+                if header & 0x06:
+                    conn.sendall(b"\x40\x02" + body[off:off + 2])
+                    off += 2
+                if topic == "bench/req":
+                    size, count = [int(x) for x in body[off:].decode().split(",")]
+                    burst(conn, size, count)
+            elif tp == 0xC0:    # PINGREQ
+                conn.sendall(b"\xD0\x00")
+            elif tp == 0xE0:    # DISCONNECT
+                break
+    except ConnectionError:
+        pass
+    conn.close()
+    print("bye", addr)
+
+
+def main():
+    port = int(sys.argv[1]) if len(sys.argv) > 1 else 1883
+    srv = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    srv.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    srv.bind(("0.0.0.0", port))
+    srv.listen(4)
+    print("listen on", port)
+    while True:
+        conn, addr = srv.accept()
+        threading.Thread(target=client, args=(conn, addr), daemon=True).start()
+
+
+if __name__ == "__main__":
+    main()
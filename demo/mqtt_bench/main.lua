@@ -0,0 +1,99 @@
+
+-- LuaTools需要PROJECT和VERSION这两个信息
+PROJECT = "mqttbench"
+VERSION = "1.0.0"
+
+-- sys库是标配
+_G.sys = require("sys")
+--[[特别注意, 使用mqtt库需要下列语句]]
+_G.sysplus = require("sysplus")
+
+--[[
+mqtt下行吞吐量测试
+电脑上运行同目录下的broker.py充当服务器, 它收到bench/req后按要求的大小和条数连续下发PUBLISH
+分别测试payload转成string, 写入zbuff, 写入文件三种接收方式
+旧版本的接收缓冲区固定4K, 超过4K的消息会直接断开连接
+]]
+
+-- 改成运行broker.py的电脑的ip
+local mqtt_host = "192.168.1.100"
+local mqtt_port = 1883
+
+-- {payload大小, 条数}
+local cases = {
+    {256, 400},
+    {2048, 200},
+    {16 * 1024, 40},
+    {128 * 1024, 8},
+}
+
+local mqttc = nil
+local got_bytes = 0
+local got_count = 0
+
+local function wait_net()
+    if rtos.bsp():startsWith("ESP32") then
+        wlan.init()
+        wlan.setMode(wlan.STATION)
+        wlan.connect("uiot", "12345678", 1)
+    end
+    sys.waitUntil("IP_READY", 30000)
+end
+
+local function run(mode, size, count)
+    if mode == "zbuff" then
+        mqttc:rxsink(zbuff.create(size), 0)
+    elseif mode == "file" then
+        mqttc:rxsink("/mqtt_bench.bin", 0)
+    else
+        mqttc:rxsink()
+    end
+    got_bytes, got_count = 0, 0
+    local t = mcu.ticks()
+    mqttc:publish("bench/req", string.format("%d,%d", size, count), 1)
+    local ok = sys.waitUntil("bench_done", 60000)
+    local ms = (mcu.ticks() - t) * 1000 // mcu.hz()
+    if not ok or got_count ~= count then
+        log.warn(mode, size, "incomplete", got_count, count)
+        return
+    end
+    if ms == 0 then ms = 1 end
+    log.info(mode, string.format("payload %6d x %3d  %5dms  %d KB/s", size, count, ms, got_bytes * 1000 // ms // 1024))
+end
+
+sys.taskInit(function()
+    wait_net()
+    mqttc = mqtt.create(nil, mqtt_host, mqtt_port)
+    mqttc:auth("bench")
+    mqttc:on(function(mqtt_client, event, topic, payload, meta)
+        if event == "conack" then
+            mqtt_client:subscribe("bench/data")
+            mqtt_client:subscribe("bench/done")
+            sys.publish("mqtt_conack")
+        elseif event == "recv" then
+            if topic == "bench/done" then
+                sys.publish("bench_done")
+            else
+                -- payload可能是string, zbuff, 或者文件路径, 长度统一看meta.len
+                got_bytes = got_bytes + meta.len
+                got_count = got_count + 1
+            end
+        end
+    end)
+    mqttc:connect()
+    sys.waitUntil("mqtt_conack", 30000)
+    sys.wait(500)
+    for _, mode in ipairs({"string", "zbuff", "file"}) do
+        for _, c in ipairs(cases) do
+            run(mode, c[1], c[2])
+            collectgarbage("collect")
+        end
+    end
+    log.info("mem", rtos.meminfo("sys"))
+    mqttc:close()
+end)
+
+-- 用户代码已结束---------------------------------------------
+-- 结尾总是这一句
+sys.run()
+-- sys.run()之后后面不要加任何语句!!!!!
@@ -0,0 +1,60 @@
+-- LuaTools需要PROJECT和VERSION这两个信息
+PROJECT = "pack_bench"
+VERSION = "1.0.0"
+
+--[[
+pack.pack/pack.unpack 以及 zbuff:pack/unpack 每次调用的耗时对比
+
+格式串每次调用都要重新解析, pack.compile 把格式编译成对象后可以反复使用,
+适合modbus这类高频收发, 格式又固定的协议
+]]
+
+log.info("main", PROJECT, VERSION)
+
+_G.sys = require("sys")
+
+local ROUNDS = 20000
+
+local function bench(name, fn)
+    local start = os.clock()
+    for i = 1, ROUNDS do
+        fn(i)
+    end
+    local cost = os.clock() - start
+    log.info("pack", string.format("%-16s %6.2f us/call", name, cost * 1000000 / ROUNDS))
+end
+
+sys.taskInit(function()
+    sys.wait(100)
+    local FMT = ">bbHHHHHH"
+    local plan = pack.compile(FMT)
+    log.info("pack", "compiled", plan)
+
+    local frame = pack.pack(FMT, 1, 3, 100, 200, 300, 400, 500, 600)
+    -- 两种写法结果一致
+    log.info("pack", "same", frame == pack.pack(plan, 1, 3, 100, 200, 300, 400, 500, 600))
+
+    bench("pack string", function(i) pack.pack(FMT, 1, 3, i, 200, 300, 400, 500, 600) end)
+    bench("pack compiled", function(i) pack.pack(plan, 1, 3, i, 200, 300, 400, 500, 600) end)
+    bench("unpack string", function() pack.unpack(frame, FMT) end)
+    bench("unpack compiled", function() pack.unpack(frame, plan) end)
+
+    local buff = zbuff.create(64)
+    bench("zbuff string", function(i)
+        buff:seek(0)
+        buff:pack(FMT, 1, 3, i, 200, 300, 400, 500, 600)
+        buff:seek(0)
+        buff:unpack(FMT)
+    end)
+    bench("zbuff compiled", function(i)
+        buff:seek(0)
+        buff:pack(plan, 1, 3, i, 200, 300, 400, 500, 600)
+        buff:seek(0)
+        buff:unpack(plan)
+    end)
+end)
+
+-- 用户代码已结束---------------------------------------------
+-- 结尾总是这一句
+sys.run()
+-- sys.run()之后后面不要加任何语句!!!!!
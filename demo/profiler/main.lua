@@ -4,23 +4,51 @@ PROJECT = "memtest"
 VERSION = "1.0.0"
 
 --[[
-lua内存分析库, 未完成
+lua内存分析, 需要固件启用 LUAT_USE_PROFILER
+
+按字节采样, 找出是哪些lua代码(源文件:行号, 以及当时调用的C函数)占用了虚拟机内存
 ]]
 
 -- sys库是标配
 _G.sys = require("sys")
 
+local cache = {}
+
+-- 模拟一个会不断积累数据的模块
+local function leaky()
+    cache[#cache + 1] = string.rep("x", 200) .. #cache
+end
+
+-- 模拟一个只产生临时对象的模块
+local function churn()
+    local t = {}
+    for i = 1, 50 do
+        t[i] = tostring(i) .. "abc"
+    end
+    return #t
+end
+
 sys.taskInit(function()
-    sys.wait(1000)
+    sys.wait(100)
     collectgarbage()
     collectgarbage()
-    sys.wait(1000)
     profiler.start()
-    while 1 do
-        log.info("sys", rtos.meminfo("sys"))
+    for i = 1, 5 do
+        for j = 1, 50 do
+            leaky()
+            churn()
+        end
+        sys.wait(100)
+        collectgarbage()
         log.info("lua", rtos.meminfo("lua"))
-        sys.wait(3000)
     end
+    profiler.stop()
+    -- 打印占用最多的前10个位置
+    profiler.print(10)
+    -- 导出二进制数据, 可以保存或上传后离线分析
+    local data = profiler.dump()
+    log.info("profiler", "dump", #data, data:sub(1, 4))
+    if os.exit then os.exit(0) end
 end)
 
 -- 用户代码已结束---------------------------------------------
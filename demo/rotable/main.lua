@@ -0,0 +1,54 @@
+-- LuaTools需要PROJECT和VERSION这两个信息
+PROJECT = "rotable_bench"
+VERSION = "1.0.0"
+
+--[[
+库函数/对象方法查找性能测试
+rotable库(如rtos, zbuff)以及zbuff对象的方法, 每次调用都需要按名字查找一次
+]]
+
+_G.sys = require("sys")
+
+local COUNT = 200000
+
+local function bench(name, func)
+    local start = os.clock()
+    func()
+    local used = os.clock() - start
+    log.info("bench", name, string.format("%.3f us/call", used * 1000000 / COUNT))
+end
+
+sys.taskInit(function()
+    sys.wait(100)
+    local buff = zbuff.create(64)
+    -- 靠前的方法
+    bench("zbuff:seek", function()
+        for i = 1, COUNT do
+            buff:seek(0)
+        end
+    end)
+    -- 靠后的方法, 线性查找时最慢
+    bench("zbuff:used", function()
+        for i = 1, COUNT do
+            buff:used()
+        end
+    end)
+    -- 库函数查找
+    bench("zbuff.SEEK_END", function()
+        local v
+        for i = 1, COUNT do
+            v = zbuff.SEEK_END
+        end
+    end)
+    bench("rtos.bsp", function()
+        for i = 1, COUNT do
+            local f = rtos.bsp
+        end
+    end)
+    os.exit(0)
+end)
+
+-- 用户代码已结束---------------------------------------------
+-- 结尾总是这一句
+sys.run()
+-- sys.run()之后后面不要加任何语句!!!!!
@@ -0,0 +1,89 @@
+
+-- LuaTools需要PROJECT和VERSION这两个信息
+PROJECT = "sfdbench"
+VERSION = "1.0.0"
+
+-- sys库是标配
+_G.sys = require("sys")
+
+-- 用zbuff模拟一片W25Q, 按数据手册的典型时序累计耗时, 对比新旧驱动的吞吐量
+-- legacy=true 模拟旧驱动: 0x03普通读, 擦除只擦4K扇区, 写入不按256字节页拆分
+
+local SIZE = 1024 * 1024
+local HZ = 80000000
+
+local function kbps(bytes, us)
+    if us == 0 then return "-" end
+    return string.format("%d KB/s", math.floor(bytes / 1024 * 1000000 / us))
+end
+
+local function bench(name, legacy)
+    local buff = zbuff.create(SIZE, 0xFF)
+    local drv = sfd.init("zbuff", buff, {hz=HZ, legacy=legacy})
+    local chunk = string.rep("\x5A", 4096)
+
+    -- 擦除64K, 旧驱动需要逐个扇区调用
+    if legacy then
+        for off = 0, 0xFFFF, 4096 do
+            sfd.erase(drv, off, 4096)
+        end
+    else
+        sfd.erase(drv, 0, 0x10000)
+    end
+    local us, _, _, erases = sfd.sim_stat(drv, true)
+    log.info(name, "erase 64K", string.format("%dms", us // 1000), "erase cmds", erases)
+
+    for off = 0, 0xFFFF, 4096 do
+        sfd.write(drv, off, chunk)
+    end
+    -- 旧驱动一条命令写4K, 看上去更快, 但超出页尾的数据绕回了页首, 后面的校验会失败
+    local us, _, progs = sfd.sim_stat(drv, true)
+    log.info(name, "write 64K", kbps(0x10000, us), "page programs", progs)
+
+    local ok = true
+    for off = 0, 0xFFFF, 4096 do
+        if sfd.read(drv, off, 4096) ~= chunk then
+            ok = false
+        end
+    end
+    local us = sfd.sim_stat(drv, true)
+    log.info(name, "read 64K", kbps(0x10000, us), "data ok", ok)
+
+    -- 从页中间开始跨页写入, 旧驱动的数据会绕回页首
+    sfd.erase(drv, 0x20000, 4096)
+    local data = string.rep("0123456789ABCDEF", 16)
+    sfd.write(drv, 0x20000 + 0x80, data)
+    log.info(name, "cross page write", sfd.read(drv, 0x20000 + 0x80, #data) == data)
+
+    -- 在模拟flash上挂载lfs2, 写入若干文件
+    -- lfs2按4K块擦除, 256字节编程, 所以这一项新旧驱动差别不大, 耗时主要在扇区擦除
+    sfd.erase(drv, 0, SIZE)
+    sfd.sim_stat(drv, true)
+    local path = legacy and "/sim_old" or "/sim_new"
+    if lfs2.mount(path, drv, true) then
+        local total = 0
+        for i = 1, 8 do
+            local f = io.open(path .. "/f" .. i .. ".bin", "wb")
+            if f then
+                f:write(string.rep(string.char(i), 8192))
+                f:close()
+                total = total + 8192
+            end
+        end
+        local us = sfd.sim_stat(drv, true)
+        log.info(name, "lfs2 write 64K", kbps(total, us))
+    else
+        log.info(name, "lfs2 mount failed")
+    end
+end
+
+sys.taskInit(function()
+    sys.wait(100)
+    bench("legacy", true)
+    bench("w25q", false)
+end)
+
+-- 用户代码已结束---------------------------------------------
+-- 结尾总是这一句
+sys.run()
+-- sys.run()之后后面不要加任何语句!!!!!
@@ -0,0 +1,62 @@
+-- LuaTools需要PROJECT和VERSION这两个信息
+PROJECT = "slab_bench"
+VERSION = "1.0.0"
+
+--[[
+虚拟机小对象分级分配器(LUAT_USE_MEMORY_SLAB)的负载及统计演示
+
+大量短生命周期的字符串/表/闭包与少量长期驻留的对象交替分配, 是最容易产生碎片的场景.
+在bsp/linux下可以录制内存操作, 再用 alloc_replay 对比有无slab时的碎片率:
+    LUATOS_ALLOC_TRACE=alloc.trace ./luatos ../../demo/slab/main.lua
+    ./alloc_replay alloc.trace heap
+    ./alloc_replay alloc.trace slab
+]]
+
+_G.sys = require("sys")
+
+local ROUNDS = 200
+
+local function churn(keep)
+    local tmp = {}
+    for i = 1, 200 do
+        local s = "key_" .. i .. "_" .. math.random(1, 100000)
+        tmp[s] = {i, s, function() return i end}
+        if i % 20 == 0 then
+            -- 少量对象长期驻留, 夹在短生命周期对象之间
+            keep[#keep + 1] = s
+        end
+    end
+    return tmp
+end
+
+sys.taskInit(function()
+    local keep = {}
+    local start = os.clock()
+    for round = 1, ROUNDS do
+        churn(keep)
+        if #keep > 1000 then
+            -- 定期淘汰一批驻留对象
+            for i = 1, 500 do
+                table.remove(keep, 1)
+            end
+        end
+        if round % 20 == 0 then
+            sys.wait(1)
+        end
+    end
+    log.info("slab", "churn done", string.format("%.1fms", (os.clock() - start) * 1000))
+    log.info("mem.lua", rtos.meminfo())
+    local total, used, max_used, classes = rtos.meminfo("slab")
+    if classes then
+        log.info("mem.slab", total, used, max_used, string.format("page free %.1f%%", total > 0 and (total - used) * 100 / total or 0))
+        for _, c in ipairs(classes) do
+            log.info("mem.slab", c.size, "pages", c.pages, "objs", c.objs, "hit", c.hit, "miss", c.miss, "waste", c.waste)
+        end
+    end
+    os.exit(0)
+end)
+
+-- 用户代码已结束---------------------------------------------
+-- 结尾总是这一句
+sys.run()
+-- sys.run()之后后面不要加任何语句!!!!!
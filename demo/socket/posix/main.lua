@@ -0,0 +1,71 @@
+-- LuaTools需要PROJECT和VERSION这两个信息
+PROJECT = "posix_socket_bench"
+VERSION = "1.0.0"
+
+--[[
+posix网络适配器压力测试, 用于Linux等posix环境
+1. 先在本机起一个tcp服务器, 例如 nc -lk 127.0.0.1 9000 或任意echo服务器
+2. 同时建立 SOCKET_COUNT 个连接, 统计建连速率
+3. 全部在线后保持空闲 IDLE_TIME 毫秒, 统计这段时间消耗的cpu时间
+bsp/linux默认带socket库(posix适配器), 编译后执行 ./luatos main.lua 即可
+]]
+
+_G.sys = require("sys")
+_G.sysplus = require("sysplus")
+
+local SERVER_IP = "127.0.0.1"
+local SERVER_PORT = 9000
+local SOCKET_COUNT = 1000
+local IDLE_TIME = 10000
+
+local online = 0
+local failed = 0
+
+local function netCB(netc, event, param)
+    if param ~= 0 then
+        failed = failed + 1
+        return
+    end
+    if event == socket.ON_LINE then
+        online = online + 1
+        if online + failed == SOCKET_COUNT then
+            sys.publish("BENCH_ALL_ONLINE")
+        end
+    end
+end
+
+sys.taskInit(function()
+    sys.wait(1000)
+    local ctrls = {}
+    local start = mcu.ticks()
+    for i = 1, SOCKET_COUNT do
+        local netc = socket.create(nil, netCB)
+        if not netc then
+            log.info("bench", "socket.create fail at", i)
+            break
+        end
+        socket.connect(netc, SERVER_IP, SERVER_PORT)
+        ctrls[#ctrls + 1] = netc
+    end
+    sys.waitUntil("BENCH_ALL_ONLINE", 30000)
+    local used = mcu.ticks() - start
+    log.info("bench", "online", online, "failed", failed, "ms", used)
+    if used > 0 then
+        log.info("bench", "connect/s", online * 1000 // used)
+    end
+
+    -- 空闲阶段, 理想情况下cpu时间接近0
+    local cpu = os.clock()
+    sys.wait(IDLE_TIME)
+    log.info("bench", "idle cpu ms", (os.clock() - cpu) * 1000, "in", IDLE_TIME)
+
+    for _, netc in ipairs(ctrls) do
+        socket.close(netc)
+        socket.release(netc)
+    end
+end)
+
+-- 用户代码已结束---------------------------------------------
+-- 结尾总是这一句
+sys.run()
+-- sys.run()之后后面不要加任何语句!!!!!
@@ -46,6 +46,30 @@ sys.taskInit(function()
     local i8data = buff:readI8()
     local u32data = buff:readU32()
 
+    -- 批量读写一组数据, 以及不离开C的数值运算, 适合ADC/音频采样
+    local pcm = zbuff.create(256 * 2)
+    local samples = {}
+    for i = 1, 256 do
+        samples[i] = math.floor(math.sin(i / 8) * 20000)
+    end
+    pcm:writeArray("i16", samples)
+    local sum, min, max = pcm:stats("i16")
+    log.info("zbuff", "pcm avg", sum / 256, "min", min, "max", max)
+    pcm:scale("i16", 0.5) -- 音量减半
+    local fbuf = zbuff.create(256 * 4)
+    pcm:convert("i16", fbuf, "f32", 1 / 32768) -- 转成-1.0~1.0的浮点
+    fbuf:seek(0)
+    local floats = fbuf:readArray("f32", 4)
+    log.info("zbuff", "f32", floats[1], floats[2], floats[3], floats[4])
+
+    -- 环形缓冲区模式, 内存固定, 取走数据不需要移动剩余的数据, 配合socket.rx(ctrl, rbuf, maxlen)做流式接收
+    local rbuf = zbuff.create(16)
+    rbuf:setRing(true)
+    rbuf:write("hello,")
+    log.info("zbuff", "ring", rbuf:read(3), rbuf:used())
+    rbuf:write("world,luatos") -- 写到末尾后绕回开头
+    log.info("zbuff", "ring", rbuf:toStr(), rbuf:used())
+
     -- 取出指定区间的数据
     local fz = buff:toStr(0,5)
 
@@ -0,0 +1,49 @@
+-- LuaTools需要PROJECT和VERSION这两个信息
+PROJECT = "zbuff_raster"
+VERSION = "1.0.0"
+
+--[[
+zbuff framebuffer 绘图吞吐量测试, 输出各色深下的 Mpixel/s
+
+fill     : drawRect填充整屏
+rect     : drawRect填充 100x60 的小矩形
+blit     : 从另一个framebuffer复制 64x64 的区域
+colorkey : 带透明色的blit, 约一半像素透明
+]]
+
+_G.sys = require("sys")
+
+local W, H = 320, 240
+local ROUNDS = 200
+
+local function bench(name, bit, pixels, fn)
+    local start = os.clock()
+    for i = 1, ROUNDS do
+        fn(i)
+    end
+    local cost = os.clock() - start
+    log.info("raster", string.format("%2dbit %-9s %8.2f Mpixel/s", bit, name, pixels * ROUNDS / 1000000 / (cost > 0 and cost or 1e-6)))
+end
+
+sys.taskInit(function()
+    for _, bit in ipairs({1, 4, 8, 16, 24, 32}) do
+        local fb = zbuff.create({W, H, bit}, 0)
+        local icon = zbuff.create({64, 64, bit}, 1)
+        -- 图标左半边为透明色0
+        icon:drawRect(0, 0, 31, 63, 0, true)
+        bench("fill", bit, W * H, function(i) fb:drawRect(0, 0, W - 1, H - 1, i, true) end)
+        bench("rect", bit, 100 * 60, function(i) fb:drawRect(i, i, i + 99, i + 59, i, true) end)
+        bench("blit", bit, 64 * 64, function(i) fb:blit(icon, 0, 0, 64, 64, i * 3, i) end)
+        bench("colorkey", bit, 64 * 64, function(i) fb:blit(icon, 0, 0, 64, 64, i * 3, i, 0) end)
+        fb = nil
+        icon = nil
+        collectgarbage()
+        sys.wait(1)
+    end
+    os.exit(0)
+end)
+
+-- 用户代码已结束---------------------------------------------
+-- 结尾总是这一句
+sys.run()
+-- sys.run()之后后面不要加任何语句!!!!!
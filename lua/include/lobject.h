@@ -431,11 +431,16 @@ typedef struct LocVar {
 /*
 ** Function Prototypes
 */
+/* bits of 'Proto.rom': array lives in a read-only mapping, never freed */
+#define PROTO_ROM_CODE      1
+#define PROTO_ROM_LINEINFO  2
+
 typedef struct Proto {
   CommonHeader;
   lu_byte numparams;  /* number of fixed parameters */
   lu_byte is_vararg;
   lu_byte maxstacksize;  /* number of registers needed by this function */
+  lu_byte rom;  /* LuatOS: PROTO_ROM_* bits, arrays referenced in place */
 #ifdef __LUATOS_SMALL_RAM__
   uint16_t sizeupvalues;  /* size of 'upvalues' */
   uint16_t sizek;  /* size of 'k' */
@@ -282,6 +282,9 @@ LUA_API int   (lua_pcallk) (lua_State *L, int nargs, int nresults, int errfunc,
 LUA_API int   (lua_load) (lua_State *L, lua_Reader reader, void *dt,
                           const char *chunkname, const char *mode);
 
+LUA_API int   (lua_loadrom) (lua_State *L, const char *buff, size_t size,
+                            const char *chunkname, const char *mode);
+
 LUA_API int (lua_dump) (lua_State *L, lua_Writer writer, void *data, int strip);
 
 
@@ -434,8 +434,16 @@
 
 #define l_floor(x)		(l_mathop(floor)(x))
 
+/* LuatOS: float/double走luat_dtoa, 输出最短可往返表示, 不经过printf */
+#include "luat_dtoa.h"
+#if LUA_FLOAT_TYPE == LUA_FLOAT_FLOAT
+#define lua_number2str(s,sz,n)  ((void)(sz), luat_ftoa((float)(n), (s)))
+#elif LUA_FLOAT_TYPE == LUA_FLOAT_DOUBLE
+#define lua_number2str(s,sz,n)  ((void)(sz), luat_dtoa((double)(n), (s)))
+#else
 #define lua_number2str(s,sz,n)  \
 	l_sprintf((s), sz, LUA_NUMBER_FMT, (LUAI_UACNUMBER)(n))
+#endif
 
 /*
 @@ lua_numbertointeger converts a float number to an integer, or
@@ -528,8 +536,7 @@
 
 #define LUAI_UACINT		LUA_INTEGER
 
-#define lua_integer2str(s,sz,n)  \
-	l_sprintf((s), sz, LUA_INTEGER_FMT, (LUAI_UACINT)(n))
+#define lua_integer2str(s,sz,n)  ((void)(sz), luat_i64toa((int64_t)(n), (s)))
 
 /*
 ** use LUAI_UACINT here to avoid problems with promotions (which
@@ -0,0 +1,25 @@
+#ifndef LUAT_DTOA_H
+#define LUAT_DTOA_H
+
+#include <stdint.h>
+
+/**
+ * 数值转字符串, 供tostring/string.format/json共用, 不经过printf.
+ *
+ * 整数: 每次处理两位十进制数, 32位范围内不做64位除法.
+ * 浮点: Grisu2算法, 输出能精确还原原值的最短(或极接近最短)数字串,
+ *       格式与%g一致, 即指数在[-4, 精度)之内用小数形式, 否则用 1.5e+20 形式.
+ *       精度对double是17, 对float是9.
+ * 所有函数都会在末尾补'\0', 返回值不含'\0'.
+ */
+
+// 能容纳任意结果的缓冲区大小
+#define LUAT_DTOA_BUFSIZE 32
+
+int luat_u32toa(uint32_t v, char* buf);
+int luat_i64toa(int64_t v, char* buf);
+int luat_dtoa(double v, char* buf);
+// float按float的精度取最短, 例如0.1f输出"0.1"而不是"0.10000000149011612"
+int luat_ftoa(float v, char* buf);
+
+#endif
@@ -58,6 +58,7 @@ struct Zio {
   lua_Reader reader;		/* reader function */
   void *data;			/* additional data */
   lua_State *L;			/* Lua state (for reader) */
+  lu_byte rom;			/* LuatOS: buffer is a read-only mapping that outlives the chunk */
 };
 
 
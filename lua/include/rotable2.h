@@ -42,5 +42,12 @@ ROTABLE_EXPORT void rotable2_newlib( lua_State* L, void const* reg );
  * `rotable_Reg` array. */
 ROTABLE_EXPORT void rotable2_newidx( lua_State* L, void const* reg );
 
+/* pushes the (cached) lookup index of a `rotable_Reg` array, to be used
+ * as an upvalue of a custom `__index` function together with
+ * `rotable2_index()`, which pushes the value for the key at `kidx` and
+ * returns 1, or returns 0 if the key does not exist. */
+ROTABLE_EXPORT void rotable2_pushindex( lua_State* L, void const* reg );
+ROTABLE_EXPORT int rotable2_index( lua_State* L, int iidx, int kidx );
+
 #endif /* ROTABLE_H_ */
 
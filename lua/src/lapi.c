@@ -989,13 +989,14 @@ LUA_API int lua_pcallk (lua_State *L, int nargs, int nresults, int errfunc,
 }
 
 
-LUA_API int lua_load (lua_State *L, lua_Reader reader, void *data,
-                      const char *chunkname, const char *mode) {
+static int load_aux (lua_State *L, lua_Reader reader, void *data,
+                     const char *chunkname, const char *mode, int rom) {
   ZIO z;
   int status;
   lua_lock(L);
   if (!chunkname) chunkname = "?";
   luaZ_init(L, &z, reader, data);
+  z.rom = cast_byte(rom);
   status = luaD_protectedparser(L, &z, chunkname, mode);
   if (status == LUA_OK) {  /* no errors? */
     LClosure *f = clLvalue(L->top - 1);  /* get newly created function */
@@ -1013,6 +1014,43 @@ LUA_API int lua_load (lua_State *L, lua_Reader reader, void *data,
 }
 
 
+LUA_API int lua_load (lua_State *L, lua_Reader reader, void *data,
+                      const char *chunkname, const char *mode) {
+  return load_aux(L, reader, data, chunkname, mode, 0);
+}
+
+
+typedef struct LoadR {
+  const char *s;
+  size_t size;
+} LoadR;
+
+
+static const char *getR (lua_State *L, void *ud, size_t *size) {
+  LoadR *lr = (LoadR *)ud;
+  (void)L;  /* not used */
+  if (lr->size == 0) return NULL;
+  *size = lr->size;
+  lr->size = 0;
+  return lr->s;
+}
+
+
+/*
+** LuatOS: load a chunk from a read-only mapping (luadb, XIP flash...)
+** that stays valid as long as the state. The whole region is handed
+** to the parser in one block, and the undumper references code and
+** line info in place instead of copying them to the heap.
+*/
+LUA_API int lua_loadrom (lua_State *L, const char *buff, size_t size,
+                         const char *chunkname, const char *mode) {
+  LoadR lr;
+  lr.s = buff;
+  lr.size = size;
+  return load_aux(L, getR, &lr, chunkname, mode, 1);
+}
+
+
 LUA_API int lua_dump (lua_State *L, lua_Writer writer, void *data, int strip) {
   int status;
   TValue *o;
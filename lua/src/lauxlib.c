@@ -718,6 +718,29 @@ static int skipcomment (LoadF *lf, int *cp) {
 }
 
 
+#ifdef LUAT_USE_FS_VFS
+/*
+** LuatOS: file lives in a read-only mapping (luadb etc), parse it in
+** place without going through fread. Skips BOM and the '#' first line
+** like 'skipcomment', keeping the newline so line numbers stay right.
+*/
+static int loadmapped (lua_State *L, const char *p, size_t size,
+                       const char *chunkname, const char *mode) {
+  if (size >= 3 && memcmp(p, "\xEF\xBB\xBF", 3) == 0) {
+    p += 3;
+    size -= 3;
+  }
+  if (size > 0 && *p == '#') {
+    while (size > 0 && *p != '\n') {
+      p++;
+      size--;
+    }
+  }
+  return lua_loadrom(L, p, size, chunkname, mode);
+}
+#endif
+
+
 LUALIB_API int luaL_loadfilex (lua_State *L, const char *filename,
                                              const char *mode) {
   LoadF lf;
@@ -733,6 +756,16 @@ LUALIB_API int luaL_loadfilex (lua_State *L, const char *filename,
     lua_pushfstring(L, "@%s", filename);
     lf.f = fopen(filename, "r");
     if (lf.f == NULL) return errfile(L, "open", fnameindex);
+#ifdef LUAT_USE_FS_VFS
+    const char *mapped = (const char *)luat_fs_mmap_ro(lf.f);
+    if (mapped != NULL) {
+      fclose(lf.f);
+      status = loadmapped(L, mapped, luat_fs_fsize(filename),
+                          lua_tostring(L, -1), mode);
+      lua_remove(L, fnameindex);
+      return status;
+    }
+#endif
   }
   if (skipcomment(&lf, &c))  /* read initial portion */
     lf.buff[lf.n++] = '\n';  /* add line to correct line numbers */
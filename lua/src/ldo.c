@@ -645,8 +645,16 @@ static void resume (lua_State *L, void *ud) {
 }
 
 
+#ifdef LUAT_USE_PROFILER
+/* LuatOS: coroutine being resumed, NULL for the main thread */
+lua_State *luat_running_thread;
+#endif
+
 LUA_API int lua_resume (lua_State *L, lua_State *from, int nargs) {
   int status;
+#ifdef LUAT_USE_PROFILER
+  lua_State *prev_running;
+#endif
   unsigned short oldnny = L->nny;  /* save "number of non-yieldable" calls */
   lua_lock(L);
   if (L->status == LUA_OK) {  /* may be starting a coroutine */
@@ -661,6 +669,10 @@ LUA_API int lua_resume (lua_State *L, lua_State *from, int nargs) {
   luai_userstateresume(L, nargs);
   L->nny = 0;  /* allow yields */
   api_checknelems(L, (L->status == LUA_OK) ? nargs + 1 : nargs);
+#ifdef LUAT_USE_PROFILER
+  prev_running = luat_running_thread;
+  luat_running_thread = L;
+#endif
   status = luaD_rawrunprotected(L, resume, &nargs);
   if (status == -1)  /* error calling 'lua_resume'? */
     status = LUA_ERRRUN;
@@ -677,6 +689,9 @@ LUA_API int lua_resume (lua_State *L, lua_State *from, int nargs) {
     else lua_assert(status == L->status);  /* normal end or yield */
   }
   L->nny = oldnny;  /* restore 'nny' */
+#ifdef LUAT_USE_PROFILER
+  luat_running_thread = prev_running;
+#endif
   L->nCcalls--;
   lua_assert(L->nCcalls == ((from) ? from->nCcalls : 0));
   lua_unlock(L);
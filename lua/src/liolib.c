@@ -210,6 +210,14 @@ typedef luaL_Stream LStream;
 #define fwrite  luat_fs_fwrite
 #define ftell   luat_fs_ftell
 
+/* POSIX/Windows下l_fseek会直接用fseeko/_fseeki64, 同样要走vfs */
+#undef l_fseek
+#undef l_ftell
+#undef l_seeknum
+#define l_fseek(f,o,w)		luat_fs_fseek(f,o,w)
+#define l_ftell(f)		luat_fs_ftell(f)
+#define l_seeknum		long
+
 
 static int io_type (lua_State *L) {
   LStream *p;
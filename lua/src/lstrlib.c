@@ -1041,6 +1041,10 @@ static int str_format (lua_State *L) {
         case 'd': case 'i':
         case 'o': case 'u': case 'x': case 'X': {
           lua_Integer n = luaL_checkinteger(L, arg);
+          if (form[1] == 'd' && form[2] == '\0') {  /* plain '%d'? */
+            nb = lua_integer2str(buff, MAX_ITEM, n);
+            break;
+          }
           addlenmod(form, LUA_INTEGER_FRMLEN);
           nb = l_sprintf(buff, MAX_ITEM, form, (LUAI_UACINT)n);
           break;
@@ -0,0 +1,373 @@
+/*
+ * 数值转字符串
+ *
+ * 整数按两位一组查表转换.
+ * 浮点数使用 Florian Loitsch 的 Grisu2 算法 (Printing Floating-Point Numbers Quickly
+ * and Accurately with Integers, PLDI 2010), 实现参考了 Milo Yip 的 dtoa-benchmark.
+ * 只需要一张87项的10的幂表, 全程64位整数运算, 输出一定能还原原值,
+ * 绝大多数情况下就是最短表示. 相比Ryu, 不需要约10KB的查表, 更适合MCU.
+ */
+#include <string.h>
+#include "luat_dtoa.h"
+
+typedef struct diy_fp {
+    uint64_t f;
+    int e;
+} diy_fp_t;
+
+static const char digits_lut[201] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static const uint32_t pow10_32[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+static const uint64_t pow10_64[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+    100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+    10000000000000ULL, 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+    100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+};
+
+// 10^-348 ~ 10^340, 步长8, 规格化到最高位为1的64位尾数及其二进制指数
+static const uint64_t cached_f[87] = {
+    0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+    0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+    0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+    0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+    0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+    0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+    0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+    0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+    0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+    0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+    0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+    0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+    0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+    0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+    0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+    0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+    0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+    0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+    0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+    0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+    0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+    0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+    0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+    0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+    0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+    0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+    0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+    0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+    0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL,
+};
+
+static const int16_t cached_e[87] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+    -901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+    -582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+    -263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+    56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+    694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+    1013, 1039, 1066,
+};
+
+//-----------------------------------------------------------
+// 整数
+
+int luat_u32toa(uint32_t v, char* buf) {
+    char tmp[10];
+    char* p = tmp + sizeof(tmp);
+    uint32_t i;
+    while (v >= 100) {
+        i = (v % 100) << 1;
+        v /= 100;
+        *--p = digits_lut[i + 1];
+        *--p = digits_lut[i];
+    }
+    if (v >= 10) {
+        i = v << 1;
+        *--p = digits_lut[i + 1];
+        *--p = digits_lut[i];
+    }
+    else {
+        *--p = (char)('0' + v);
+    }
+    int len = (int)(tmp + sizeof(tmp) - p);
+    memcpy(buf, p, len);
+    buf[len] = 0;
+    return len;
+}
+
+static int u64toa(uint64_t v, char* buf) {
+    if ((v >> 32) == 0)
+        return luat_u32toa((uint32_t)v, buf);
+    // 每次64位除法取出低8位, 剩下的高位落入32位范围后交给u32toa
+    char tmp[20];
+    char* p = tmp + sizeof(tmp);
+    uint32_t lo, i;
+    while (v >> 32) {
+        lo = (uint32_t)(v % 100000000);
+        v /= 100000000;
+        for (int k = 0; k < 4; k++) {
+            i = (lo % 100) << 1;
+            lo /= 100;
+            *--p = digits_lut[i + 1];
+            *--p = digits_lut[i];
+        }
+    }
+    int len = luat_u32toa((uint32_t)v, buf);
+    int tail = (int)(tmp + sizeof(tmp) - p);
+    memcpy(buf + len, p, tail);
+    len += tail;
+    buf[len] = 0;
+    return len;
+}
+
+int luat_i64toa(int64_t v, char* buf) {
+    if (v < 0) {
+        *buf = '-';
+        return 1 + u64toa(0 - (uint64_t)v, buf + 1);
+    }
+    return u64toa((uint64_t)v, buf);
+}
+
+//-----------------------------------------------------------
+// Grisu2
+
+static diy_fp_t diy_normalize(diy_fp_t x) {
+#if defined(__GNUC__)
+    int s = __builtin_clzll(x.f);
+    x.f <<= s;
+    x.e -= s;
+#else
+    while ((x.f & 0xFFFFFFFF00000000ULL) == 0) {
+        x.f <<= 32;
+        x.e -= 32;
+    }
+    while ((x.f & 0x8000000000000000ULL) == 0) {
+        x.f <<= 1;
+        x.e--;
+    }
+#endif
+    return x;
+}
+
+static diy_fp_t diy_mul(diy_fp_t x, diy_fp_t y) {
+    const uint64_t M32 = 0xFFFFFFFFULL;
+    uint64_t a = x.f >> 32, b = x.f & M32;
+    uint64_t c = y.f >> 32, d = y.f & M32;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t tmp = (bd >> 32) + (ad & M32) + (bc & M32);
+    tmp += 1U << 31; // 四舍五入
+    diy_fp_t r;
+    r.f = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32);
+    r.e = x.e + y.e + 64;
+    return r;
+}
+
+// 选一个10^-K, 使得 e + 其二进制指数 落在[-60, -32]之间
+static diy_fp_t cached_power(int e, int* K) {
+    double dk = (-61 - e) * 0.30102999566398114 + 347;
+    int k = (int)dk;
+    if (dk - k > 0.0)
+        k++;
+    unsigned index = (unsigned)((k >> 3) + 1);
+    *K = -(-348 + (int)(index << 3));
+    diy_fp_t r;
+    r.f = cached_f[index];
+    r.e = cached_e[index];
+    return r;
+}
+
+static void grisu_round(char* buf, int len, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w) {
+    while (rest < wp_w && delta - rest >= ten_kappa &&
+           (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+        buf[len - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+static int digit_gen(diy_fp_t W, diy_fp_t Mp, uint64_t delta, char* buf, int* K) {
+    const int shift = -Mp.e;
+    const uint64_t one = 1ULL << shift;
+    const uint64_t wp_w = Mp.f - W.f;
+    uint32_t p1 = (uint32_t)(Mp.f >> shift);
+    uint64_t p2 = Mp.f & (one - 1);
+    int kappa = 1;
+    int len = 0;
+    uint32_t d;
+    while (kappa < 10 && p1 >= pow10_32[kappa])
+        kappa++;
+    // 整数部分
+    while (kappa > 0) {
+        d = p1 / pow10_32[kappa - 1];
+        p1 %= pow10_32[kappa - 1];
+        if (d || len)
+            buf[len++] = (char)('0' + d);
+        kappa--;
+        uint64_t rest = ((uint64_t)p1 << shift) + p2;
+        if (rest <= delta) {
+            *K += kappa;
+            grisu_round(buf, len, delta, rest, (uint64_t)pow10_32[kappa] << shift, wp_w);
+            return len;
+        }
+    }
+    // 小数部分
+    for (;;) {
+        p2 *= 10;
+        delta *= 10;
+        d = (uint32_t)(p2 >> shift);
+        if (d || len)
+            buf[len++] = (char)('0' + d);
+        p2 &= one - 1;
+        kappa--;
+        if (p2 < delta) {
+            *K += kappa;
+            grisu_round(buf, len, delta, p2, one, -kappa < 20 ? wp_w * pow10_64[-kappa] : 0);
+            return len;
+        }
+    }
+}
+
+// 值为 f * 2^e, f不为0. lower_closer表示f是2的整数次幂, 下边界离得更近
+static int grisu2(uint64_t f, int e, int lower_closer, char* buf, int* K) {
+    diy_fp_t v, mp, mm;
+    mp.f = (f << 1) + 1;
+    mp.e = e - 1;
+    mp = diy_normalize(mp);
+    if (lower_closer) {
+        mm.f = (f << 2) - 1;
+        mm.e = e - 2;
+    }
+    else {
+        mm.f = (f << 1) - 1;
+        mm.e = e - 1;
+    }
+    mm.f <<= mm.e - mp.e;
+    mm.e = mp.e;
+    v.f = f;
+    v.e = e;
+    v = diy_normalize(v);
+
+    diy_fp_t c = cached_power(mp.e, K);
+    diy_fp_t W = diy_mul(v, c);
+    diy_fp_t Wp = diy_mul(mp, c);
+    diy_fp_t Wm = diy_mul(mm, c);
+    Wm.f++;
+    Wp.f--;
+    return digit_gen(W, Wp, Wp.f - Wm.f, buf, K);
+}
+
+// 按%g的规则排版, 值为 digits * 10^K
+static int format_g(char* out, const char* digits, int len, int K, int prec) {
+    int x = len + K - 1; // 首位数字的十进制指数
+    char* p = out;
+    if (x >= -4 && x < prec) {
+        if (x >= len - 1) {
+            memcpy(p, digits, len);
+            p += len;
+            for (int i = len; i <= x; i++)
+                *p++ = '0';
+        }
+        else if (x >= 0) {
+            memcpy(p, digits, x + 1);
+            p += x + 1;
+            *p++ = '.';
+            memcpy(p, digits + x + 1, len - x - 1);
+            p += len - x - 1;
+        }
+        else {
+            *p++ = '0';
+            *p++ = '.';
+            for (int i = -1; i > x; i--)
+                *p++ = '0';
+            memcpy(p, digits, len);
+            p += len;
+        }
+    }
+    else {
+        *p++ = digits[0];
+        if (len > 1) {
+            *p++ = '.';
+            memcpy(p, digits + 1, len - 1);
+            p += len - 1;
+        }
+        *p++ = 'e';
+        if (x < 0) {
+            *p++ = '-';
+            x = -x;
+        }
+        else {
+            *p++ = '+';
+        }
+        if (x >= 100) {
+            *p++ = (char)('0' + x / 100);
+            x %= 100;
+        }
+        *p++ = digits_lut[x * 2];
+        *p++ = digits_lut[x * 2 + 1];
+    }
+    *p = 0;
+    return (int)(p - out);
+}
+
+// f * 2^e 的通用入口, bits是尾数位数(含隐藏位)
+static int fp_to_str(char* buf, int neg, int special, uint64_t f, int e, int lower_closer, int bits, int prec) {
+    char* p = buf;
+    if (special) {
+        // 与printf一致, nan不带符号
+        if (f) {
+            memcpy(buf, "nan", 4);
+            return 3;
+        }
+        if (neg)
+            *p++ = '-';
+        memcpy(p, "inf", 4);
+        return (int)(p - buf) + 3;
+    }
+    if (neg)
+        *p++ = '-';
+    if (f == 0) {
+        *p++ = '0';
+        *p = 0;
+        return (int)(p - buf);
+    }
+    // 本身就是整数的情况直接按整数输出, 最常见也最快
+    if (e <= 0 && e > -bits && (f & ((1ULL << -e) - 1)) == 0) {
+        return (int)(p - buf) + u64toa(f >> -e, p);
+    }
+    char digits[20];
+    int K = 0;
+    int len = grisu2(f, e, lower_closer, digits, &K);
+    return (int)(p - buf) + format_g(p, digits, len, K, prec);
+}
+
+int luat_dtoa(double v, char* buf) {
+    uint64_t u;
+    memcpy(&u, &v, sizeof(u));
+    int be = (int)((u >> 52) & 0x7FF);
+    uint64_t frac = u & 0x000FFFFFFFFFFFFFULL;
+    if (be == 0x7FF)
+        return fp_to_str(buf, (int)(u >> 63), 1, frac, 0, 0, 53, 17);
+    if (be)
+        return fp_to_str(buf, (int)(u >> 63), 0, frac | 0x0010000000000000ULL, be - 1075, frac == 0 && be > 1, 53, 17);
+    return fp_to_str(buf, (int)(u >> 63), 0, frac, 1 - 1075, 0, 53, 17);
+}
+
+int luat_ftoa(float v, char* buf) {
+    uint32_t u;
+    memcpy(&u, &v, sizeof(u));
+    int be = (int)((u >> 23) & 0xFF);
+    uint32_t frac = u & 0x007FFFFF;
+    if (be == 0xFF)
+        return fp_to_str(buf, (int)(u >> 31), 1, frac, 0, 0, 24, 9);
+    if (be)
+        return fp_to_str(buf, (int)(u >> 31), 0, frac | 0x00800000, be - 150, frac == 0 && be > 1, 24, 9);
+    return fp_to_str(buf, (int)(u >> 31), 0, frac, 1 - 150, 0, 24, 9);
+}
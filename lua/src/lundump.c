@@ -83,6 +83,28 @@ static void LoadBlock (LoadState *S, void *b, size_t size) {
 #define LoadVar(S,x)		LoadVector(S,&x,1)
 
 
+// 支持非对齐访问的平台(x86, Cortex-M3/M4等)可在luat_conf_bsp.h中定义LUAT_UNDUMP_ROM_UNALIGNED,
+// 字节码中的数组大多不是4字节对齐的, 开启后原地引用的命中率高很多
+#ifdef LUAT_UNDUMP_ROM_UNALIGNED
+#define ROM_ALIGN(t) 1
+#else
+#define ROM_ALIGN(t) sizeof(t)
+#endif
+
+// 块来自只读映射(lua_loadrom)且对齐满足要求时, 直接返回映射区内的地址, 不做拷贝
+static const void *LoadInPlace (LoadState *S, size_t size, size_t align) {
+  ZIO *z = S->Z;
+  const void *p;
+  if (!z->rom || z->n < size || ((size_t)z->p & (align - 1)) != 0)
+    return NULL;
+  p = z->p;
+  z->p += size;
+  z->n -= size;
+  ptr_offset += size;
+  return p;
+}
+
+
 static lu_byte LoadByte (LoadState *S) {
   lu_byte x;
   LoadVar(S, x);
@@ -171,7 +193,8 @@ static TString *LoadString (LoadState *S, Proto *p) {
   if (size == 0xFF)
     LoadVar(S, size);
 #if defined(__LUATOS_SMALL_RAM__) && defined(__LUATOS_SCRIPT_BASE__)
-  char* ptr = (char*)luat_vfs_mmap(((LoadF*)S->Z->data)->f);
+  // lua_loadrom加载时Z->data不是LoadF, 映射基址由当前读取位置反推
+  char* ptr = S->Z->rom ? (char*)S->Z->p - ptr_offset : (char*)luat_vfs_mmap(((LoadF*)S->Z->data)->f);
   uint32_t offset;
   if (ptr && size) {
 	  offset = (uint32_t)ptr + ptr_offset - __LUATOS_SCRIPT_BASE__;
@@ -211,8 +234,12 @@ static TString *LoadString (LoadState *S, Proto *p) {
     return NULL;
   else if (--size <= LUAI_MAXSHORTLEN) {  /* short string? */
     char buff[LUAI_MAXSHORTLEN];
-    LoadVector(S, buff, size);
-    ts = luaS_newlstr(S->L, buff, size);
+    const char *str = (const char *)LoadInPlace(S, size, 1);
+    if (str == NULL) {
+      LoadVector(S, buff, size);
+      str = buff;
+    }
+    ts = luaS_newlstr(S->L, str, size);
   }
   else {  /* long string */
     ts = luaS_createlngstrobj(S->L, size);
@@ -236,14 +263,20 @@ static void LoadCode (LoadState *S, Proto *f) {
 #ifdef LUAT_UNDUMP_DEBUG
   code_max += n * sizeof(Instruction);
 #endif
+  f->code = (Instruction *)LoadInPlace(S, n * sizeof(Instruction), ROM_ALIGN(Instruction));
+  if (f->code) {
+    f->rom |= PROTO_ROM_CODE;
+    return;
+  }
 #ifdef LUAT_USE_MEMORY_OPTIMIZATION_CODE_MMAP
   #if LUAT_UNDUMP_DEBUG
 //  LLOGD("try mmap %p %p %p", S, S->Z, S->Z->data);
   #endif
-  char* ptr = (char*)luat_fs_mmap(((LoadF*)S->Z->data)->f);
+  char* ptr = S->Z->rom ? NULL : (char*)luat_fs_mmap(((LoadF*)S->Z->data)->f);
   Instruction inst[1];
   if (ptr) {
     f->code = ptr + ptr_offset;
+    f->rom |= PROTO_ROM_CODE;
     for (size_t i = 0; i < n; i++)
     {
       LoadVector(S, &inst, 1);
@@ -342,12 +375,18 @@ static void LoadDebug (LoadState *S, Proto *f) {
   n = LoadInt(S);
   f->sizelineinfo = n;
   f->lineinfo = NULL;
-#ifdef LUAT_USE_MEMORY_OPTIMIZATION_CODE_MMAP
   if (n > 0) {
+    f->lineinfo = (int *)LoadInPlace(S, n * sizeof(int), ROM_ALIGN(int));
+    if (f->lineinfo)
+      f->rom |= PROTO_ROM_LINEINFO;
+  }
+#ifdef LUAT_USE_MEMORY_OPTIMIZATION_CODE_MMAP
+  if (n > 0 && f->lineinfo == NULL && !S->Z->rom) {
     uint8_t* ptr = (uint8_t*)luat_fs_mmap(((LoadF*)S->Z->data)->f);
     int inst[1];
     if (ptr) {
 	    f->lineinfo = (int*)(ptr + ptr_offset);
+	    f->rom |= PROTO_ROM_LINEINFO;
       for (size_t i = 0; i < n; i++)
       {
         LoadVector(S, &inst, 1);
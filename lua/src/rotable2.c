@@ -11,12 +11,16 @@
 #include "lua.h"
 #include "rotable2.h"
 
+#include "lobject.h"
+#include "lstate.h"
+#include "lstring.h"
 
-/* The lookup code uses binary search on sorted `rotable_Reg` arrays
- * to find functions/methods. For a small number of elements a linear
- * search might be faster. */
-#ifndef ROTABLE_BINSEARCH_MIN
-#  define ROTABLE_BINSEARCH_MIN  5
+
+/* 元素数量达到该值的rotable_Reg数组, 注册时会生成一个哈希索引,
+ * 查找时直接使用lua字符串自带的hash, 只需比较一次字符串.
+ * 元素较少时线性查找更省内存. */
+#ifndef ROTABLE_HASH_MIN
+#  define ROTABLE_HASH_MIN  8
 #endif
 
 
@@ -24,8 +28,21 @@ typedef struct {
   int n;
 } rotable;
 
+/* 哈希索引, 保存在lua堆的userdata中, 同一个rotable_Reg数组只生成一份.
+ * 结构体后面紧跟 unsigned int hashes[n] 和 unsigned short slots[mask+1],
+ * slots中存放元素下标+1, 0代表空槽. */
+typedef struct {
+  const rotable_Reg_t* reg;
+  unsigned int n;
+  unsigned int mask;
+} rotable_index;
+
+#define ROTABLE_INDEX_HASHES(idx) ((unsigned int*)((idx) + 1))
+#define ROTABLE_INDEX_SLOTS(idx)  ((unsigned short*)(ROTABLE_INDEX_HASHES(idx) + (idx)->n))
+
 
 static char const unique_address[ 1 ] = { 0 };
+static char const index_cache_address[ 1 ] = { 0 };
 
 
 static int reg_compare(void const* a, void const* b) {
@@ -98,12 +115,85 @@ static const rotable_Reg_t* find_key( const rotable_Reg_t* p, int n,
 }
 
 
+/* 压入reg对应的索引对象: 元素较多时为rotable_index userdata, 否则为reg本身的lightuserdata */
+static void rotable_push_index( lua_State* L, const rotable_Reg_t* reg ) {
+  unsigned int n = 0, size = 4, i, j;
+  const rotable_Reg_t* q;
+  lua_rawgetp( L, LUA_REGISTRYINDEX, (void*)index_cache_address );
+  if( !lua_istable( L, -1 ) ) {
+    lua_pop( L, 1 );
+    lua_newtable( L );
+    lua_pushvalue( L, -1 );
+    lua_rawsetp( L, LUA_REGISTRYINDEX, (void*)index_cache_address );
+  }
+  if( lua_rawgetp( L, -1, (void*)reg ) != LUA_TNIL ) {
+    lua_remove( L, -2 );
+    return;
+  }
+  lua_pop( L, 1 );
+  for( q = reg; q->name != NULL; ++q )
+    n++;
+  if( n < ROTABLE_HASH_MIN || n >= 0xFFFF ) {
+    lua_pop( L, 1 );
+    lua_pushlightuserdata( L, (void*)reg );
+    return;
+  }
+  while( size < n * 2 )
+    size <<= 1;
+  rotable_index* idx = (rotable_index*)lua_newuserdata( L, sizeof( rotable_index )
+                          + n * sizeof( unsigned int ) + size * sizeof( unsigned short ) );
+  idx->reg = reg;
+  idx->n = n;
+  idx->mask = size - 1;
+  unsigned int* hashes = ROTABLE_INDEX_HASHES( idx );
+  unsigned short* slots = ROTABLE_INDEX_SLOTS( idx );
+  memset( slots, 0, size * sizeof( unsigned short ) );
+  for( i = 0; i < n; i++ ) {
+    /* 与lua字符串的hash算法及种子一致, 长字符串的hash也是同样的值 */
+    hashes[ i ] = luaS_hash( reg[ i ].name, strlen( reg[ i ].name ), G( L )->seed );
+    j = hashes[ i ] & idx->mask;
+    while( slots[ j ] )
+      j = ( j + 1 ) & idx->mask;
+    slots[ j ] = (unsigned short)( i + 1 );
+  }
+  lua_pushvalue( L, -1 );
+  lua_rawsetp( L, -3, (void*)reg );
+  lua_remove( L, -2 );
+}
+
+
+/* 在iidx处的索引对象中查找kidx处的key, 同时通过base返回reg数组首地址 */
+static const rotable_Reg_t* rotable_find( lua_State* L, int iidx, int kidx,
+                                          const rotable_Reg_t** base ) {
+  if( lua_type( L, iidx ) == LUA_TLIGHTUSERDATA ) {
+    *base = (const rotable_Reg_t*)lua_touserdata( L, iidx );
+    return find_key( *base, 0, lua_tostring( L, kidx ) );
+  }
+  rotable_index* idx = (rotable_index*)lua_touserdata( L, iidx );
+  *base = idx->reg;
+  if( kidx <= 0 || lua_type( L, kidx ) != LUA_TSTRING ) {
+    /* 非字符串key走原来的路径 */
+    return find_key( idx->reg, 0, lua_tostring( L, kidx ) );
+  }
+  TString* ts = tsvalue( L->ci->func + kidx );
+  unsigned int h = ts->tt == LUA_TSHRSTR ? ts->hash : luaS_hashlongstr( ts );
+  const char* s = getstr( ts );
+  unsigned int* hashes = ROTABLE_INDEX_HASHES( idx );
+  unsigned short* slots = ROTABLE_INDEX_SLOTS( idx );
+  unsigned int j = h & idx->mask;
+  while( slots[ j ] ) {
+    unsigned int i = slots[ j ] - 1;
+    if( hashes[ i ] == h && 0 == strcmp( s, idx->reg[ i ].name ) )
+      return &idx->reg[ i ];
+    j = ( j + 1 ) & idx->mask;
+  }
+  return 0;
+}
+
+
 static int rotable_func_index( lua_State* L ) {
-  char const* s = lua_tostring( L, 2 );
-  const rotable_Reg_t* p = (const rotable_Reg_t*)lua_touserdata( L, lua_upvalueindex( 1 ) );
-  const rotable_Reg_t* p2 = p;
-  int n = lua_tointeger( L, lua_upvalueindex( 2 ) );
-  p = find_key( p, n, s );
+  const rotable_Reg_t* p2 = 0;
+  const rotable_Reg_t* p = rotable_find( L, lua_upvalueindex( 1 ), 2, &p2 );
   if( p ) {
     rotable_push_rovalue(L, p);
   }
@@ -122,13 +212,10 @@ static int rotable_func_index( lua_State* L ) {
 
 
 static int rotable_udata_index( lua_State* L ) {
-  rotable* t = (rotable*)lua_touserdata( L, 1 );
-  char const* s = lua_tostring( L, 2 );
+  const rotable_Reg_t* p2 = 0;
   const rotable_Reg_t* p = 0;
   lua_getuservalue( L, 1 );
-  p = (const rotable_Reg_t*)lua_touserdata( L, -1 );
-  const rotable_Reg_t* p2 = p;
-  p = find_key( p, t->n, s );
+  p = rotable_find( L, lua_gettop( L ), 2, &p2 );
   if( p ) {
     if (rotable_push_rovalue(L, p)) {
       return 1;
@@ -163,7 +250,10 @@ static int rotable_iter( lua_State* L ) {
 
   int isnil = lua_isnil(L, 2);
   lua_getuservalue( L, 1 );
-  p = (const rotable_Reg_t*)lua_touserdata( L, -1 );
+  if( lua_type( L, -1 ) == LUA_TLIGHTUSERDATA )
+    p = (const rotable_Reg_t*)lua_touserdata( L, -1 );
+  else
+    p = ((rotable_index*)lua_touserdata( L, -1 ))->reg;
 
   if (isnil) {
     lua_pushstring(L, p->name);
@@ -224,7 +314,7 @@ ROTABLE_EXPORT void rotable2_newlib( lua_State* L, void const* v ) {
 #if LUA_VERSION_NUM < 503
   t->p = reg;
 #else
-  lua_pushlightuserdata( L, (void*)reg );
+  rotable_push_index( L, reg );
   lua_setuservalue( L, -2 );
 #endif
 }
@@ -233,7 +323,25 @@ ROTABLE_EXPORT void rotable2_newlib( lua_State* L, void const* v ) {
  * 为自定义对象也生成rotable形式的元表, 这个形式比rotable_newlib需要更多内存,但起码是一个解决办法.
  */
 ROTABLE_EXPORT void rotable2_newidx( lua_State* L, void const* v ) {
-  lua_pushlightuserdata( L, (void*)v);
+  rotable_push_index( L, (const rotable_Reg_t*)v );
   lua_pushcclosure( L, rotable_func_index, 1 );
 }
 
+/**
+ * 压入reg的查找索引, 通常作为自定义__index函数的upvalue, 配合rotable2_index使用.
+ */
+ROTABLE_EXPORT void rotable2_pushindex( lua_State* L, void const* reg ) {
+  rotable_push_index( L, (const rotable_Reg_t*)reg );
+}
+
+/**
+ * 在iidx处的索引(由rotable2_pushindex生成)中查找kidx处的key, 找到则压入对应的值并返回1, 否则返回0.
+ */
+ROTABLE_EXPORT int rotable2_index( lua_State* L, int iidx, int kidx ) {
+  const rotable_Reg_t* base = 0;
+  const rotable_Reg_t* p = rotable_find( L, iidx, kidx, &base );
+  if( p )
+    return rotable_push_rovalue( L, p );
+  return 0;
+}
+
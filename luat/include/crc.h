@@ -2,18 +2,55 @@
 #ifndef __CRC_H__
 #define __CRC_H__
 
-#ifndef uint8_t
-#define uint8_t unsigned char
-#define uint16_t unsigned short
-#define uint32_t unsigned int
+#include "stdint.h"
+#include "stddef.h"
+#include "string.h"
+
+#ifndef BOOL
 #define BOOL unsigned char
+#endif
+#ifndef TRUE
 #define TRUE 1
 #define FALSE 0
 #endif
 
-#include "string.h"
+// slice-by-8 的CRC32需要额外7KB的常量表, 空间紧张的平台可以在luat_conf_bsp.h中定义为0
+#ifndef LUAT_CRC32_SLICE8
+#define LUAT_CRC32_SLICE8 1
+#endif
+
+/**
+ * 通用CRC引擎, 参数模型与常见的CRC目录一致(width/poly/init/refin/refout/xorout),
+ * init和poly均按不反射的写法给出.
+ * 常用多项式使用预先计算好的查表, 其余多项式在init时生成16项的半字节表, 不申请内存.
+ * 支持分段计算: init一次, 多次update, 最后final.
+ */
+typedef struct luat_crc_ctx
+{
+    uint32_t crc;        // 当前寄存器值, refin时为反射后的值
+    uint32_t xorout;
+    uint8_t width;       // 8/16/32
+    uint8_t refin;
+    uint8_t refout;
+    uint8_t mode;        // 计算方式, 内部使用
+    const void* table;   // 预置表
+    const void* table2;
+    uint32_t nibble[16]; // 没有预置表时使用的半字节表
+}luat_crc_ctx_t;
+
+// 成功返回0, width不是8/16/32时返回-1
+int luat_crc_init(luat_crc_ctx_t* ctx, uint8_t width, uint32_t poly, uint32_t init, uint32_t xorout, uint8_t refin, uint8_t refout);
+// 按名字初始化, 如"CRC32", "MODBUS", "XMODEM", 找不到返回-1
+int luat_crc_init_name(luat_crc_ctx_t* ctx, const char* name);
+void luat_crc_update(luat_crc_ctx_t* ctx, const void* data, size_t len);
+// 返回当前结果, 不改变ctx, 可以继续update
+uint32_t luat_crc_final(luat_crc_ctx_t* ctx);
+// 以之前final得到的结果作为起点继续计算, ctx需已经init
+void luat_crc_resume(luat_crc_ctx_t* ctx, uint32_t last);
+
+// CRC32(0x04C11DB7反射)的原始寄存器计算, 不做首尾取反, 与zlib的crc32关系为 crc32(c) = ~luat_crc32_update(~c)
+uint32_t luat_crc32_update(uint32_t crc, const void* data, size_t len);
 
-//uint16_t calcCRC16(const uint8_t *data, uint32_t length);
 uint32_t calcCRC32(const uint8_t* buf, uint32_t len);
 uint8_t calcCRC8(const uint8_t *buf, uint32_t len);
 uint16_t calcCRC16(const uint8_t *data, const char *cmd, int length, uint16_t poly, uint16_t initial, uint16_t finally, BOOL bInReverse, BOOL bOutReverse);
@@ -31,4 +31,20 @@ int luat_crypto_cipher_suites(const char** list, size_t* len);
 
 int luat_crypto_md(const char* md, const char* str, size_t str_size, void* out_ptr, const char* key, size_t key_len);
 int luat_crypto_md_file(const char* md, void* out_ptr, const char* key, size_t key_len, const char* path);
+
+// 分段计算hash/hmac, 数据不必一次性放在内存里
+typedef struct luat_crypto_md_ctx
+{
+    void* ctx;     // 平台相关的上下文, 由init申请, finish或free释放
+    uint8_t hmac;
+    uint8_t size;  // 摘要长度
+}luat_crypto_md_ctx_t;
+
+// key_len大于0时为hmac. 成功返回摘要长度, 不支持的算法返回-1
+int luat_crypto_md_init(luat_crypto_md_ctx_t* md, const char* name, const char* key, size_t key_len);
+int luat_crypto_md_update(luat_crypto_md_ctx_t* md, const void* data, size_t len);
+// 输出摘要并释放上下文, 成功返回摘要长度
+int luat_crypto_md_finish(luat_crypto_md_ctx_t* md, void* out_ptr);
+// 未finish时放弃计算
+void luat_crypto_md_free(luat_crypto_md_ctx_t* md);
 #endif
@@ -51,6 +51,8 @@ size_t luat_fs_fsize(const char *filename);
 int luat_fs_fexist(const char *filename);
 int luat_fs_readline(char * buf, int bufsize, FILE * stream);
 void* luat_fs_mmap(FILE * stream);
+// 只读文件系统(如luadb)的映射, 卸载前一直有效, 可被长期引用; 其他情况返回NULL
+void* luat_fs_mmap_ro(FILE * stream);
 
 // TODO 文件夹相关的API
 //int luat_fs_diropen(char const* _FileName);
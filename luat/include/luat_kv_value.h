@@ -0,0 +1,14 @@
+#ifndef LUAT_KV_VALUE_H
+#define LUAT_KV_VALUE_H
+
+#include "luat_base.h"
+
+// fdb和fskv共用的值存储格式: 第一个字节是类型, 后面是数据
+// LUA_TBOOLEAN 1字节bool, LUA_TINTEGER lua_Integer原始字节, LUA_TNUMBER pack.pack(">f"),
+// LUA_TSTRING 原始字符串, LUA_TTABLE json.encode的结果
+
+// 把idx处的值编码成存储的格式, max_len不为0时限制编码后的总长度
+// 成功时结果以string压栈并返回1, 失败时栈不变并返回0
+int luat_kv_pack_value(lua_State *L, int idx, size_t max_len);
+
+#endif
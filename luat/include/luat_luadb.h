@@ -33,6 +33,9 @@ typedef struct luadb_fs
     uint16_t filecount; // 文件总数,实际少于100
     luadb_fd_t fds[LUAT_LUADB_MAX_OPENFILE]; // 句柄数组
     // luadb_file_t *inlines;
+    uint32_t *hashes;     // 文件名的hash, 与files一一对应
+    uint16_t *hash_slots; // 开放寻址哈希表, 存放文件下标+1, 0为空槽
+    uint16_t hash_mask;   // 哈希表大小-1
     luadb_file_t files[1]; // 文件数组
 } luadb_fs_t;
 
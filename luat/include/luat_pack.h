@@ -1,10 +1,40 @@
-
 #ifndef LUAT_PACK_H
 #define LUAT_PACK_H
 
 #include "lua.h"
+#include <stdint.h>
+
+#define LUAT_PACK_PLAN_TYPE "PACKPLAN*"
+
+// 一个格式项, 字节序已经折算进swap, 重复次数已经解析好
+typedef struct luat_pack_op {
+    uint8_t code;   // 格式字符, 如'H'
+    uint8_t swap;   // 1 需要交换字节序
+    uint32_t count; // 重复次数, 'A'时为字节数(unpack)或字符串个数(pack)
+} luat_pack_op_t;
+
+// pack.compile得到的格式对象, ops紧跟在结构体后面
+typedef struct luat_pack_plan {
+    uint32_t op_count;
+    uint32_t values;     // unpack时产生的值个数
+    luat_pack_op_t* ops;
+} luat_pack_plan_t;
+
+// 依次取出格式项, 格式可以是字符串, 也可以是pack.compile的结果
+typedef struct luat_pack_iter {
+    const luat_pack_plan_t* plan;
+    const unsigned char* f;
+    uint32_t index;
+    int swap;
+    int arg;
+} luat_pack_iter_t;
 
 int luat_pack(lua_State *L);
-int luat_unpack(lua_State *L); 
+int luat_unpack(lua_State *L);
+
+// 从栈上arg处取格式, 字符串或格式对象
+void luat_pack_iter_init(lua_State *L, int arg, luat_pack_iter_t* it);
+// 取下一项, 已经结束返回0. 字符串格式不做检查, 未知字符由调用者报错
+int luat_pack_next(luat_pack_iter_t* it, luat_pack_op_t* op);
 
 #endif
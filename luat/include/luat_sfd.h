@@ -10,12 +10,28 @@
 typedef struct sdf_opts {
     int (*initialize) (void* userdata);
 	int (*status) (void* userdata);
-	int (*read) (void* userdata, char* buff, size_t offset, size_t len);
+	int (*read) (void* userdata, char* buff, size_t offset, size_t len); // 返回实际读取的字节数, 失败 < 0
 	int (*write) (void* userdata, const char* buff, size_t offset, size_t len);
 	int (*erase) (void* userdata, size_t offset, size_t len);
 	int (*ioctl) (void* userdata, size_t cmd, void* buff);
 }sdf_opts_t;
 
+// W25Q系列SPI FLASH的几何参数, 驱动与内存模拟共用
+#define SFD_W25Q_PAGE_SIZE      (256)
+#define SFD_W25Q_SECTOR_SIZE    (4096)
+#define SFD_W25Q_BLOCK32_SIZE   (32 * 1024)
+#define SFD_W25Q_BLOCK64_SIZE   (64 * 1024)
+
+// 内存模拟flash时的时序模型, 按W25Q的典型值累计耗时, 用于在PC上评估吞吐量
+typedef struct sfd_mem_sim {
+    uint32_t spi_hz;        // SPI时钟
+    uint8_t legacy;         // 模拟旧驱动: 0x03读, 只擦除4K, 写入不按页拆分
+    uint64_t busy_us;       // 累计耗时, 单位us
+    uint32_t read_count;
+    uint32_t prog_count;    // 页编程次数
+    uint32_t erase_count;
+} sfd_mem_sim_t;
+
 typedef struct sfd_drv {
     const sdf_opts_t* opts;
     uint8_t type;
@@ -32,6 +48,11 @@ typedef struct sfd_drv {
     size_t erase_size;
     char chip_id[8];
     void* userdata;
+    // 写入/擦除次数统计, 用来评估上层的写放大和flash寿命
+    uint32_t prog_count;
+    uint32_t prog_bytes;
+    uint32_t erase_count;
+    sfd_mem_sim_t* sim;     // 仅zbuff类型使用, NULL为不模拟时序
 } sfd_drv_t;
 
 typedef struct sfd_onchip {
@@ -59,6 +80,9 @@ int sfd_onchip_ioctl (void* userdata, size_t cmd, void* buff);
 
 int luat_sfd_onchip_init(void);
 
+// 从offset开始擦除len字节时, 第一次能用的最大擦除块
+size_t sfd_w25q_erase_unit(size_t offset, size_t len);
+
 // 临时声明
 #include "lfs.h"
 
@@ -25,9 +25,32 @@ typedef struct luat_zbuff {
     uint32_t width; //宽度
     uint32_t height;//高度
     uint8_t bit;    //色深度
+    uint8_t is_ring;//环形缓冲区模式, 此时used为数据量, 数据从head开始, 可以绕回开头
+    size_t head;    //环形模式下数据的起始位置
 } luat_zbuff_t;
 
 
 int __zbuff_resize(luat_zbuff_t *buff, uint32_t new_size);
 
+// 按addr[0, used)线性访问数据的接口, 遇到环形模式的zbuff直接报参数错误
+#define luat_zbuff_check_linear(L, buff, arg) luaL_argcheck(L, !(buff)->is_ring, arg, "ring zbuff not supported, call setRing(false) first")
+
+// 环形模式, 写入位置为(head + used) % len, 适合socket接收这类边收边处理的场景, 不需要移动数据
+// 从写入位置开始的连续空闲空间, 返回长度, 写完后用commit确认
+size_t luat_zbuff_ring_write_span(luat_zbuff_t *buff, uint8_t **p);
+void luat_zbuff_ring_commit(luat_zbuff_t *buff, size_t len);
+// 写入数据, 空间不足时只写入一部分, 返回写入的长度
+size_t luat_zbuff_ring_write(luat_zbuff_t *buff, const uint8_t *data, size_t len);
+// 从offset处复制数据但不取出, 返回复制的长度
+size_t luat_zbuff_ring_peek(const luat_zbuff_t *buff, size_t offset, uint8_t *data, size_t len);
+// 取出数据, data为NULL时直接丢弃, 返回取出的长度
+size_t luat_zbuff_ring_read(luat_zbuff_t *buff, uint8_t *data, size_t len);
+// 把数据整理到从0开始的连续空间, 然后head=0
+void luat_zbuff_ring_linearize(luat_zbuff_t *buff);
+
+// framebuffer的矩形填充, 坐标需已在范围内
+void luat_zbuff_fill_rect(luat_zbuff_t *buff, uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t color);
+// 区域复制, 自动裁剪, 成功返回复制的像素数, 色深不同返回-1
+int luat_zbuff_blit(luat_zbuff_t *dst, const luat_zbuff_t *src, int32_t sx, int32_t sy, int32_t w, int32_t h, int32_t dx, int32_t dy, int use_key, uint32_t key);
+
 #endif
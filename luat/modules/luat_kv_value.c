@@ -0,0 +1,102 @@
+#include "luat_base.h"
+#include "luat_kv_value.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#define LUAT_LOG_TAG "kv"
+#include "luat_log.h"
+
+int luat_kv_pack_value(lua_State *L, int idx, size_t max_len) {
+    int top = lua_gettop(L);
+    char prefix = 0;
+    size_t len = 0;
+    const char* data = NULL;
+    char tmp[sizeof(lua_Integer)];
+    idx = lua_absindex(L, idx);
+    switch (lua_type(L, idx))
+    {
+    case LUA_TBOOLEAN:
+    {
+        prefix = LUA_TBOOLEAN;
+        bool val = lua_toboolean(L, idx);
+        memcpy(tmp, &val, sizeof(val));
+        data = tmp;
+        len = sizeof(val);
+        break;
+    }
+    case LUA_TNUMBER:
+        if (lua_isinteger(L, idx)) {
+            prefix = LUA_TINTEGER; // 自定义类型
+            lua_Integer val = lua_tointeger(L, idx);
+            memcpy(tmp, &val, sizeof(val));
+            data = tmp;
+            len = sizeof(val);
+        }
+        else {
+            prefix = LUA_TNUMBER;
+            lua_getglobal(L, "pack");
+            if (lua_isnil(L, -1)) {
+                LLOGW("float number need pack lib");
+                lua_settop(L, top);
+                return 0;
+            }
+            lua_getfield(L, -1, "pack");
+            lua_pushstring(L, ">f");
+            lua_pushvalue(L, idx);
+            lua_call(L, 2, 1);
+            if (!lua_isstring(L, -1)) {
+                LLOGW("kdb store number fail!!");
+                lua_settop(L, top);
+                return 0;
+            }
+            data = lua_tolstring(L, -1, &len);
+        }
+        break;
+    case LUA_TSTRING:
+        prefix = LUA_TSTRING;
+        data = lua_tolstring(L, idx, &len);
+        break;
+    case LUA_TTABLE:
+        lua_getglobal(L, "json");
+        if (lua_isnil(L, -1)) {
+            LLOGW("miss json lib, not support table value");
+            lua_settop(L, top);
+            return 0;
+        }
+        lua_getfield(L, -1, "encode");
+        if (!lua_isfunction(L, -1)) {
+            LLOGW("miss json.encode, not support table value");
+            lua_settop(L, top);
+            return 0;
+        }
+        lua_pushvalue(L, idx);
+        lua_call(L, 1, 1);
+        if (!lua_isstring(L, -1)) {
+            LLOGW("json.encode(val) report error");
+            lua_settop(L, top);
+            return 0;
+        }
+        prefix = LUA_TTABLE;
+        data = lua_tolstring(L, -1, &len);
+        break;
+    default:
+        LLOGW("function/userdata/nil/thread isn't allow");
+        lua_settop(L, top);
+        return 0;
+    }
+    if (max_len && len + 1 > max_len) {
+        LLOGE("value too big %d max %d", len + 1, max_len);
+        lua_settop(L, top);
+        return 0;
+    }
+    luaL_Buffer buff;
+    luaL_buffinit(L, &buff);
+    luaL_addchar(&buff, prefix);
+    luaL_addlstring(&buff, data, len);
+    luaL_pushresult(&buff);
+    if (lua_gettop(L) > top + 1)
+        lua_replace(L, top + 1);
+    lua_settop(L, top + 1);
+    return 1;
+}
@@ -296,6 +296,7 @@ static int l_crypto_crc16(lua_State *L)
     if(lua_isuserdata(L, 2))
     {
         luat_zbuff_t *buff = ((luat_zbuff_t *)luaL_checkudata(L, 2, LUAT_ZBUFF_TYPE));
+        luat_zbuff_check_linear(L, buff, 2);
         inputlen = buff->len - buff->cursor;
         inputData = (const unsigned char *)(buff->addr + buff->cursor);
     }else{
@@ -310,46 +311,69 @@ static int l_crypto_crc16(lua_State *L)
     return 1;
 }
 
+// 数据可以是字符串, 也可以是zbuff, zbuff时取已写入的部分
+static const uint8_t* crc_input(lua_State *L, int idx, size_t *len)
+{
+    if (lua_isuserdata(L, idx))
+    {
+        luat_zbuff_t *buff = ((luat_zbuff_t *)luaL_checkudata(L, idx, LUAT_ZBUFF_TYPE));
+        luat_zbuff_check_linear(L, buff, idx);
+        *len = buff->used;
+        return buff->addr;
+    }
+    return (const uint8_t*)luaL_checklstring(L, idx, len);
+}
+
 /**
 直接计算modbus的crc16值
-@api crypto.crc16_modbus(data)
-@string 数据
+@api crypto.crc16_modbus(data, last)
+@string 数据, 也可以是zbuff, 取已写入的部分
+@int 上一段数据的结果, 可选, 用于分段计算
 @return int 对应的CRC16值
 @usage
 -- 计算CRC16 modbus
 local crc = crypto.crc16_modbus(data)
+-- 分段计算, 结果与 crypto.crc16_modbus(data1 .. data2) 相同
+local crc = crypto.crc16_modbus(data2, crypto.crc16_modbus(data1))
  */
 static int l_crypto_crc16_modbus(lua_State *L)
 {
     size_t len = 0;
-    const unsigned char *inputData = (const unsigned char*)luaL_checklstring(L, 1, &len);
-
-    lua_pushinteger(L, calcCRC16_modbus(inputData, len));
+    const uint8_t *inputData = crc_input(L, 1, &len);
+    luat_crc_ctx_t ctx;
+    luat_crc_init_name(&ctx, "MODBUS");
+    if (lua_isinteger(L, 2))
+        luat_crc_resume(&ctx, lua_tointeger(L, 2));
+    luat_crc_update(&ctx, inputData, len);
+    lua_pushinteger(L, luat_crc_final(&ctx));
     return 1;
 }
 
 /**
 计算crc32值
-@api crypto.crc32(data)
-@string 数据
+@api crypto.crc32(data, last)
+@string 数据, 也可以是zbuff, 取已写入的部分
+@int 上一段数据的结果, 可选, 用于分段计算, 例如逐块校验固件
 @return int 对应的CRC32值
 @usage
 -- 计算CRC32
 local crc = crypto.crc32(data)
+-- 分段计算, 结果与 crypto.crc32(data1 .. data2) 相同
+local crc = crypto.crc32(data2, crypto.crc32(data1))
  */
 static int l_crypto_crc32(lua_State *L)
 {
     size_t len = 0;
-    const unsigned char *inputData = (const unsigned char*)luaL_checklstring(L, 1, &len);
-
-    lua_pushinteger(L, calcCRC32(inputData, len));
+    const uint8_t *inputData = crc_input(L, 1, &len);
+    uint32_t last = (uint32_t)luaL_optinteger(L, 2, 0);
+    lua_pushinteger(L, ~luat_crc32_update(~last, inputData, len));
     return 1;
 }
 
 /**
 计算crc8值
 @api crypto.crc8(data)
-@string 数据
+@string 数据, 也可以是zbuff, 取已写入的部分
 @int crc多项式，可选，如果不写，将忽略除了数据外所有参数
 @int crc初始值，可选，默认0
 @boolean 是否需要逆序处理，默认否
@@ -362,68 +386,21 @@ local crc = crypto.crc8(data, 0x31, 0xff, false)
 static int l_crypto_crc8(lua_State *L)
 {
     size_t len = 0;
-    const unsigned char *inputData = (const unsigned char*)luaL_checklstring(L, 1, &len);
+    const uint8_t *inputData = crc_input(L, 1, &len);
     if (!lua_isinteger(L, 2)) {
         lua_pushinteger(L, calcCRC8(inputData, len));
     } else {
-    	uint8_t poly = lua_tointeger(L, 2);
-    	uint8_t start = luaL_optinteger(L, 3, 0);
-    	uint8_t is_rev = 0;
-    	if (lua_isboolean(L, 4)) {
-    		is_rev = lua_toboolean(L, 4);
-    	}
-    	uint8_t i;
-    	uint8_t CRC8 = start;
-		uint8_t *Src = (uint8_t *)inputData;
-		if (is_rev)
-		{
-			poly = 0;
-			for (i = 0; i < 8; i++)
-			{
-				if (start & (1 << (7 - i)))
-				{
-					poly |= 1 << i;
-				}
-			}
-			while (len--)
-			{
-
-				CRC8 ^= *Src++;
-				for (i = 0; i < 8; i++)
-				{
-					if ((CRC8 & 0x01))
-					{
-						CRC8 >>= 1;
-						CRC8 ^= poly;
-					}
-					else
-					{
-						CRC8 >>= 1;
-					}
-				}
-			}
-		}
-		else
-		{
-			while (len--)
-			{
-
-				CRC8 ^= *Src++;
-				for (i = 8; i > 0; --i)
-				{
-					if ((CRC8 & 0x80))
-					{
-						CRC8 <<= 1;
-						CRC8 ^= poly;
-					}
-					else
-					{
-						CRC8 <<= 1;
-					}
-				}
-			}
-		}
-		lua_pushinteger(L, CRC8);
+        luat_crc_ctx_t ctx;
+        uint8_t poly = lua_tointeger(L, 2);
+        uint8_t start = luaL_optinteger(L, 3, 0);
+        uint8_t is_rev = 0;
+        if (lua_isboolean(L, 4)) {
+            is_rev = lua_toboolean(L, 4);
+        }
+        luat_crc_init(&ctx, 8, poly, 0, 0, is_rev, is_rev);
+        ctx.crc = start; // 初始值直接作为寄存器的值, 与之前的实现一致
+        luat_crc_update(&ctx, inputData, len);
+        lua_pushinteger(L, ctx.crc);
     }
     return 1;
 }
@@ -702,6 +679,133 @@ static int l_crypt_checksum(lua_State *L) {
     return 1;
 }
 
+#define LUAT_CRYPTO_HASH_TYPE "CRYPTO_HASH*"
+
+typedef struct crypto_hash
+{
+    uint8_t is_crc;
+    uint8_t done;
+    luat_crypto_md_ctx_t md;
+    luat_crc_ctx_t crc;
+}crypto_hash_t;
+
+/*
+创建分段计算的hash/crc对象, 数据可以分多次传入, 不需要拼接成一个大字符串
+@api crypto.hash(tp, hmac)
+@string 类型, hash为 "MD5" "SHA1" "SHA256" "SHA512" 等, crc为 "CRC32" "MODBUS" "XMODEM" "CCITT-FALSE" "CRC8" 等
+@string hmac的密钥, 可选, 仅hash类型有效
+@return userdata 成功返回对象, 失败返回nil
+@usage
+-- 边下载边计算固件的sha256
+local h = crypto.hash("SHA256")
+h:update(buff)          -- zbuff, 默认取已写入的部分
+h:update(buff, 0, 512)  -- zbuff的指定区间
+h:update("tail")        -- 字符串
+log.info("sha256", h:finish())
+
+-- crc对象, finish返回整数
+local c = crypto.hash("CRC32")
+c:update("1234")
+c:update("56789")
+log.info("crc32", string.format("%08X", c:finish()))
+*/
+static int l_crypto_hash(lua_State *L) {
+    const char* tp = luaL_checkstring(L, 1);
+    size_t key_len = 0;
+    const char* key = NULL;
+    if (lua_type(L, 2) == LUA_TSTRING) {
+        key = luaL_checklstring(L, 2, &key_len);
+    }
+    crypto_hash_t* h = (crypto_hash_t*)lua_newuserdata(L, sizeof(crypto_hash_t));
+    memset(h, 0, sizeof(crypto_hash_t));
+    if (luat_crypto_md_init(&h->md, tp, key, key_len) < 0) {
+        if (key_len || luat_crc_init_name(&h->crc, tp)) {
+            LLOGW("not support %s", tp);
+            return 0;
+        }
+        h->is_crc = 1;
+    }
+    luaL_setmetatable(L, LUAT_CRYPTO_HASH_TYPE);
+    return 1;
+}
+
+/*
+向hash/crc对象追加数据
+@api hash:update(data, offset, len)
+@string 数据, 也可以是zbuff
+@int 起始偏移量, 默认0
+@int 长度, 默认为字符串长度或zbuff已写入的长度减去偏移量
+@return userdata 对象本身, 可以连续调用
+*/
+static int l_crypto_hash_update(lua_State *L) {
+    crypto_hash_t* h = (crypto_hash_t*)luaL_checkudata(L, 1, LUAT_CRYPTO_HASH_TYPE);
+    const uint8_t* data;
+    size_t len = 0;
+    if (lua_isuserdata(L, 2)) {
+        luat_zbuff_t *buff = ((luat_zbuff_t *)luaL_checkudata(L, 2, LUAT_ZBUFF_TYPE));
+        luat_zbuff_check_linear(L, buff, 2);
+        data = buff->addr;
+        len = buff->used;
+    }
+    else {
+        data = (const uint8_t*)luaL_checklstring(L, 2, &len);
+    }
+    size_t offset = luaL_optinteger(L, 3, 0);
+    if (offset > len)
+        offset = len;
+    size_t dlen = luaL_optinteger(L, 4, len - offset);
+    if (dlen > len - offset)
+        dlen = len - offset;
+    if (h->done) {
+        return luaL_error(L, "hash already finished");
+    }
+    if (h->is_crc)
+        luat_crc_update(&h->crc, data + offset, dlen);
+    else
+        luat_crypto_md_update(&h->md, data + offset, dlen);
+    lua_settop(L, 1);
+    return 1;
+}
+
+/*
+结束计算, 取得结果, 之后不能再update
+@api hash:finish(raw)
+@boolean 是否返回原始二进制数据, 默认false返回HEX字符串, 仅hash类型有效
+@return any hash类型返回字符串, crc类型返回整数, 失败返回nil
+*/
+static int l_crypto_hash_finish(lua_State *L) {
+    crypto_hash_t* h = (crypto_hash_t*)luaL_checkudata(L, 1, LUAT_CRYPTO_HASH_TYPE);
+    if (h->done) {
+        return 0;
+    }
+    h->done = 1;
+    if (h->is_crc) {
+        lua_pushinteger(L, luat_crc_final(&h->crc));
+        return 1;
+    }
+    char output[64];
+    char buff[128];
+    int ret = luat_crypto_md_finish(&h->md, output);
+    if (ret < 1) {
+        return 0;
+    }
+    if (lua_toboolean(L, 2)) {
+        lua_pushlstring(L, output, ret);
+    }
+    else {
+        fixhex(output, buff, ret);
+        lua_pushlstring(L, buff, ret * 2);
+    }
+    return 1;
+}
+
+static int l_crypto_hash_gc(lua_State *L) {
+    crypto_hash_t* h = (crypto_hash_t*)luaL_checkudata(L, 1, LUAT_CRYPTO_HASH_TYPE);
+    if (!h->is_crc)
+        luat_crypto_md_free(&h->md);
+    return 0;
+}
+
 #include "rotable2.h"
 static const rotable_Reg_t reg_crypto[] =
 {
@@ -729,11 +833,25 @@ static const rotable_Reg_t reg_crypto[] =
     { "md_file",        ROREG_FUNC(l_crypto_md_file)},
     { "md",             ROREG_FUNC(l_crypto_md)},
     { "checksum",       ROREG_FUNC(l_crypt_checksum)},
+    { "hash",           ROREG_FUNC(l_crypto_hash)},
 
 	{ NULL,             ROREG_INT(0) }
 };
 
+static const rotable_Reg_t reg_crypto_hash[] =
+{
+    { "update",         ROREG_FUNC(l_crypto_hash_update)},
+    { "finish",         ROREG_FUNC(l_crypto_hash_finish)},
+	{ NULL,             ROREG_INT(0) }
+};
+
 LUAMOD_API int luaopen_crypto( lua_State *L ) {
+    luaL_newmetatable(L, LUAT_CRYPTO_HASH_TYPE);
+    rotable2_newidx(L, reg_crypto_hash);
+    lua_setfield(L, -2, "__index");
+    lua_pushcfunction(L, l_crypto_hash_gc);
+    lua_setfield(L, -2, "__gc");
+    lua_pop(L, 1);
     luat_newlib2(L, reg_crypto);
     return 1;
 }
@@ -752,6 +870,10 @@ LUAT_WEAK int luat_crypto_hmac_sha256_simple(const char* str, size_t str_size, c
 LUAT_WEAK int luat_crypto_sha512_simple(const char* str, size_t str_size, void* out_ptr) {return -1;}
 LUAT_WEAK int luat_crypto_hmac_sha512_simple(const char* str, size_t str_size, const char* mac, size_t mac_size, void* out_ptr) {return -1;}
 LUAT_WEAK int l_crypto_cipher_xxx(lua_State *L, uint8_t flags) {return 0;}
+LUAT_WEAK int luat_crypto_md_init(luat_crypto_md_ctx_t* md, const char* name, const char* key, size_t key_len) {md->ctx = NULL; return -1;}
+LUAT_WEAK int luat_crypto_md_update(luat_crypto_md_ctx_t* md, const void* data, size_t len) {return -1;}
+LUAT_WEAK int luat_crypto_md_finish(luat_crypto_md_ctx_t* md, void* out_ptr) {return -1;}
+LUAT_WEAK void luat_crypto_md_free(luat_crypto_md_ctx_t* md) {}
 LUAT_WEAK int luat_crypto_trng(char* buff, size_t len) {
     memset(buff, 0, len);
     return 0;
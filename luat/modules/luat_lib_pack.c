@@ -33,15 +33,16 @@
 #include "lua.h"
 #include "lualib.h"
 #include "lauxlib.h"
+#include "luat_pack.h"
 
 #define LUAT_LOG_TAG "pack"
 #include "luat_log.h"
 
-static void badcode(lua_State *L, int c)
+static void badcode(lua_State *L, int arg, int c)
 {
  char s[]="bad code `?'";
  s[sizeof(s)-3]=c;
- luaL_argerror(L,1,s);
+ luaL_argerror(L,arg,s);
 }
 
 static int doendian(int c)
@@ -67,6 +68,46 @@ static void doswap(int swap, void *p, size_t n)
  }
 }
 
+void luat_pack_iter_init(lua_State *L, int arg, luat_pack_iter_t* it)
+{
+ memset(it,0,sizeof(luat_pack_iter_t));
+ it->arg=arg;
+ it->plan=(const luat_pack_plan_t*)luaL_testudata(L,arg,LUAT_PACK_PLAN_TYPE);
+ if (it->plan==NULL) it->f=(const unsigned char*)luaL_checkstring(L,arg);
+}
+
+int luat_pack_next(luat_pack_iter_t* it, luat_pack_op_t* op)
+{
+ if (it->plan)
+ {
+  if (it->index>=it->plan->op_count) return 0;
+  *op=it->plan->ops[it->index++];
+  return 1;
+ }
+ while (*it->f)
+ {
+  int c=*it->f++;
+  uint32_t N=1;
+  if (isdigit(*it->f))
+  {
+   N=0;
+   while (isdigit(*it->f)) N=10*N+(*it->f++)-'0';
+  }
+  if (c==OP_LITTLEENDIAN || c==OP_BIGENDIAN || c==OP_NATIVE)
+  {
+   it->swap=doendian(c);
+   continue;
+  }
+  // 'A0'在unpack时要返回空字符串, 其余重复0次的项直接忽略
+  if (c==' ' || c==',' || (N==0 && c!=OP_STRING)) continue;
+  op->code=c;
+  op->swap=it->swap;
+  op->count=N;
+  return 1;
+ }
+ return 0;
+}
+
 #define UNPACKNUMBER(OP,T)		\
    case OP:				\
    {					\
@@ -130,7 +171,7 @@ static void doswap(int swap, void *p, size_t n)
 解包字符串
 @api pack.unpack( string, format, init)
 @string 需解包的字符串
-@string 格式化符号 '<':设为小端编码 '>':设为大端编码 '=':大小端遵循本地设置 'z':空字符串 'p':byte字符串 'P':word字符串 'a':size_t字符串 'A':指定长度字符串 'f':float 'd':double 'n':Lua number 'c':char 'b':byte = unsigned char 'h':short 'H':unsigned short 'i':int 'I':unsigned int 'l':long 'L':unsigned long
+@string 格式化符号, 也可以传入pack.compile编译好的格式对象. '<':设为小端编码 '>':设为大端编码 '=':大小端遵循本地设置 'z':空字符串 'p':byte字符串 'P':word字符串 'a':size_t字符串 'A':指定长度字符串 'f':float 'd':double 'n':Lua number 'c':char 'b':byte = unsigned char 'h':short 'H':unsigned short 'i':int 'I':unsigned int 'l':long 'L':unsigned long
 @int 默认值为1，标记解包开始的位置
 @return int 字符串标记的位置
 @return any 第一个解包的值, 根据format值,可能有N个返回值
@@ -141,31 +182,22 @@ static int l_unpack(lua_State *L)
 {
  size_t len;
  const char *s=luaL_checklstring(L,1,&len);
- const unsigned char *f= (const unsigned char*)luaL_checkstring(L,2);
+ luat_pack_iter_t it;
+ luat_pack_op_t op;
+ luat_pack_iter_init(L,2,&it);
  int i=luaL_optnumber(L,3,1)-1;
  int n=0;
  int swap=0;
  lua_pushnil(L);
- while (*f)
+ while (luat_pack_next(&it,&op))
  {
-  int c=*f++;
-  int N=1;
-  if (isdigit(*f)) 
-  {
-   N=0;
-   while (isdigit(*f)) N=10*N+(*f++)-'0';
-   if (N==0 && c==OP_STRING) { lua_pushliteral(L,""); ++n; }
-  }
+  int c=op.code;
+  uint32_t N=op.count;
+  swap=op.swap;
+  luaL_checkstack(L,c==OP_STRING ? 1 : (int)N,"too many results");
+  if (N==0) { lua_pushliteral(L,""); ++n; continue; }
   while (N--) switch (c)
   {
-   case OP_LITTLEENDIAN:
-   case OP_BIGENDIAN:
-   case OP_NATIVE:
-   {
-    swap=doendian(c);
-    N=0;
-    break;
-   }
    case OP_STRING:
    {
     ++N;
@@ -202,10 +234,8 @@ static int l_unpack(lua_State *L)
    UNPACKINT(OP_UINT, unsigned int)
    UNPACKINT(OP_LONG, long)
    UNPACKINT(OP_ULONG, unsigned long)
-   case ' ': case ',':
-    break;
    default:
-    badcode(L,c);
+    badcode(L,it.arg,c);
     break;
   }
  }
@@ -248,7 +278,7 @@ done:
 /*
 打包字符串的值
 @api pack.pack( format, val1, val2, val3, valn )
-@string format 格式化符号 '<':设为小端编码 '>':设为大端编码 '=':大小端遵循本地设置 'z':空字符串 'p':byte字符串 'P':word字符串 'a':size_t字符串 'A':指定长度字符串 'f':float 'd':double 'n':Lua number 'c':char 'b':byte = unsigned char 'h':short 'H':unsigned short 'i':int 'I':unsigned int 'l':long 'L':unsigned long
+@string format 格式化符号, 也可以传入pack.compile编译好的格式对象. '<':设为小端编码 '>':设为大端编码 '=':大小端遵循本地设置 'z':空字符串 'p':byte字符串 'P':word字符串 'a':size_t字符串 'A':指定长度字符串 'f':float 'd':double 'n':Lua number 'c':char 'b':byte = unsigned char 'h':short 'H':unsigned short 'i':int 'I':unsigned int 'l':long 'L':unsigned long
 @any 第一个需打包的值
 @any 第二个需打包的值
 @any 第二个需打包的值
@@ -261,29 +291,19 @@ log.info("data", data, data:toHex())
 static int l_pack(lua_State *L)
 {
  int i=2;
- const unsigned char *f=(const unsigned char*)luaL_checkstring(L,1);
+ luat_pack_iter_t it;
+ luat_pack_op_t op;
+ luat_pack_iter_init(L,1,&it);
  int swap=0;
  luaL_Buffer b;
  luaL_buffinit(L,&b);
- while (*f)
+ while (luat_pack_next(&it,&op))
  {
-  int c=*f++;
-  int N=1;
-  if (isdigit(*f)) 
-  {
-   N=0;
-   while (isdigit(*f)) N=10*N+(*f++)-'0';
-  }
+  int c=op.code;
+  uint32_t N=op.count;
+  swap=op.swap;
   while (N--) switch (c)
   {
-   case OP_LITTLEENDIAN:
-   case OP_BIGENDIAN:
-   case OP_NATIVE:
-   {
-    swap=doendian(c);
-    N=0;
-    break;
-   }
    case OP_STRING:
    case OP_ZSTRING:
    {
@@ -308,10 +328,8 @@ static int l_pack(lua_State *L)
    PACKINT(OP_UINT, unsigned int)
    PACKINT(OP_LONG, long)
    PACKINT(OP_ULONG, unsigned long)
-   case ' ': case ',':
-    break;
    default:
-    badcode(L,c);
+    badcode(L,it.arg,c);
     break;
   }
  }
@@ -327,15 +345,78 @@ int luat_unpack(lua_State *L) {
    return l_unpack(L);
 }
 
+#define PACK_CODES "zpPaAnfdcbhHiIlL"
+
+static int pack_can_merge(const luat_pack_op_t* last, const luat_pack_op_t* op)
+{
+ // 'A'重复多次与一次取多个字节含义不同, 不能合并
+ return last->code==op->code && last->swap==op->swap && op->code!=OP_STRING;
+}
+
+/*
+编译格式串, 得到的格式对象可以代替格式串传给pack.pack/pack.unpack/zbuff的pack/unpack,
+重复使用同一个格式时省去每次解析字符串, 同时提前检查格式是否合法
+@api pack.compile(format)
+@string 格式化符号, 与pack.pack相同
+@return userdata 格式对象
+@usage
+local MODBUS_REG = pack.compile(">HHIf")
+local _, addr, cnt, val, f = pack.unpack(data, MODBUS_REG)
+local data = pack.pack(MODBUS_REG, 1, 2, 3, 1.5)
+*/
+static int l_pack_compile(lua_State *L)
+{
+ luat_pack_iter_t it;
+ luat_pack_op_t op;
+ luat_pack_op_t last={0};
+ uint32_t count=0;
+ luaL_checkstring(L,1);
+ // 第一遍检查格式并统计合并后的项数
+ luat_pack_iter_init(L,1,&it);
+ while (luat_pack_next(&it,&op))
+ {
+  if (strchr(PACK_CODES,op.code)==NULL) badcode(L,1,op.code);
+  if (count==0 || !pack_can_merge(&last,&op)) count++;
+  last=op;
+ }
+ luat_pack_plan_t* plan=(luat_pack_plan_t*)lua_newuserdata(L,sizeof(luat_pack_plan_t)+count*sizeof(luat_pack_op_t));
+ plan->op_count=0;
+ plan->values=0;
+ plan->ops=(luat_pack_op_t*)(plan+1);
+ luat_pack_iter_init(L,1,&it);
+ while (luat_pack_next(&it,&op))
+ {
+  if (plan->op_count && pack_can_merge(&plan->ops[plan->op_count-1],&op))
+   plan->ops[plan->op_count-1].count+=op.count;
+  else
+   plan->ops[plan->op_count++]=op;
+  plan->values+=(op.code==OP_STRING) ? 1 : op.count;
+ }
+ luaL_setmetatable(L,LUAT_PACK_PLAN_TYPE);
+ return 1;
+}
+
+static int l_pack_plan_tostring(lua_State *L)
+{
+ luat_pack_plan_t* plan=(luat_pack_plan_t*)luaL_checkudata(L,1,LUAT_PACK_PLAN_TYPE);
+ lua_pushfstring(L,"pack.plan(%d ops, %d values)",(int)plan->op_count,(int)plan->values);
+ return 1;
+}
+
 #include "rotable2.h"
 static const rotable_Reg_t reg_pack[] =
 {
 	{"pack",	   ROREG_FUNC(l_pack)},
 	{"unpack",	ROREG_FUNC(l_unpack)},
+	{"compile",	ROREG_FUNC(l_pack_compile)},
 	{NULL,	   ROREG_INT(0) }
 };
 
 LUAMOD_API int luaopen_pack( lua_State *L ) {
+    luaL_newmetatable(L, LUAT_PACK_PLAN_TYPE);
+    lua_pushcfunction(L, l_pack_plan_tostring);
+    lua_setfield(L, -2, "__tostring");
+    lua_pop(L, 1);
     luat_newlib2(L, reg_pack);
     return 1;
 }
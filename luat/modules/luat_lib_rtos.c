@@ -11,6 +11,10 @@
 #include "luat_timer.h"
 #include "luat_malloc.h"
 
+#ifdef LUAT_USE_MEMORY_SLAB
+#include "luat_slab.h"
+#endif
+
 #define LUAT_LOG_TAG "rtos"
 #include "luat_log.h"
 
@@ -237,14 +241,18 @@ static int l_rtos_standy(lua_State *L) {
 /*
 获取内存信息
 @api    rtos.meminfo(type)
-@type   "sys"系统内存, "lua"虚拟机内存, 默认为lua虚拟机内存
-@return int 总内存大小,单位字节
-@return int 当前已使用的内存大小,单位字节
-@return int 历史最高已使用的内存大小,单位字节
+@type   "sys"系统内存, "lua"虚拟机内存, "slab"虚拟机小对象分级分配器, 默认为lua虚拟机内存
+@return int 总内存大小,单位字节, slab时为页的总大小
+@return int 当前已使用的内存大小,单位字节, slab时为使用中槽位的总大小
+@return int 历史最高已使用的内存大小,单位字节, slab时为页的历史最大值
+@return table 仅slab时返回, 每个分级的统计 {size=槽位大小, pages=页数, objs=对象数, hit=命中次数, miss=回落到堆的次数, waste=内部碎片字节数}
 @usage
 -- 打印内存占用
 log.info("mem.lua", rtos.meminfo())
 log.info("mem.sys", rtos.meminfo("sys"))
+-- 需要固件启用 LUAT_USE_MEMORY_SLAB, 页内空闲比例即外部碎片
+local total, used, _, classes = rtos.meminfo("slab")
+log.info("mem.slab", total, used, classes[1].hit)
 */
 static int l_rtos_meminfo(lua_State *L) {
     size_t len = 0;
@@ -252,6 +260,35 @@ static int l_rtos_meminfo(lua_State *L) {
     size_t used = 0;
     size_t max_used = 0;
     const char * str = luaL_optlstring(L, 1, "lua", &len);
+#ifdef LUAT_USE_MEMORY_SLAB
+    if (strcmp("slab", str) == 0) {
+        luat_slab_stat_t st;
+        luat_slab_stat(&st);
+        lua_pushinteger(L, st.page_bytes);
+        lua_pushinteger(L, st.used_bytes);
+        lua_pushinteger(L, st.max_page_bytes);
+        lua_createtable(L, LUAT_SLAB_CLASS_COUNT, 0);
+        for (size_t i = 0; i < LUAT_SLAB_CLASS_COUNT; i++)
+        {
+            luat_slab_class_stat_t* c = &st.classes[i];
+            lua_createtable(L, 0, 6);
+            lua_pushinteger(L, c->size);
+            lua_setfield(L, -2, "size");
+            lua_pushinteger(L, c->pages);
+            lua_setfield(L, -2, "pages");
+            lua_pushinteger(L, c->objs);
+            lua_setfield(L, -2, "objs");
+            lua_pushinteger(L, c->hit);
+            lua_setfield(L, -2, "hit");
+            lua_pushinteger(L, c->miss);
+            lua_setfield(L, -2, "miss");
+            lua_pushinteger(L, (size_t)c->objs * c->size - c->requested);
+            lua_setfield(L, -2, "waste");
+            lua_rawseti(L, -2, i + 1);
+        }
+        return 4;
+    }
+#endif
     if (strcmp("sys", str) == 0) {
         //lua_gc(L, LUA_GCCOLLECT, 0);
         //lua_gc(L, LUA_GCCOLLECT, 0);
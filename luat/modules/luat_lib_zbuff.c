@@ -10,6 +10,7 @@
 #include "luat_base.h"
 #include "luat_zbuff.h"
 #include "luat_malloc.h"
+#include "luat_pack.h"
 
 #define LUAT_LOG_TAG "zbuff"
 #include "luat_log.h"
@@ -40,11 +41,11 @@ int add_bytes(luat_zbuff_t *buff, const char *source, size_t len)
     buff->addr[point * 3] = color / 0x10000;                          \
     buff->addr[point * 3 + 1] = color % 0x10000 / 0x100; \
     buff->addr[point * 3 + 2] = color % 0x100
-#define SET_POINT_32(buff, point, color)                 \
-    buff->addr[point] = color / 0x1000000;               \
-    buff->addr[point + 1] = color % 0x1000000 / 0x10000; \
-    buff->addr[point + 2] = color % 0x10000 / 0x100;     \
-    buff->addr[point + 3] = color % 0x100
+#define SET_POINT_32(buff, point, color)                     \
+    buff->addr[point * 4] = color / 0x1000000;               \
+    buff->addr[point * 4 + 1] = color % 0x1000000 / 0x10000; \
+    buff->addr[point * 4 + 2] = color % 0x10000 / 0x100;     \
+    buff->addr[point * 4 + 3] = color % 0x100
 
 #define SET_POINT_CASE(n, point, color)    \
     case n:                                \
@@ -71,7 +72,7 @@ int add_bytes(luat_zbuff_t *buff, const char *source, size_t len)
 #define GET_POINT_24(buff, point) \
     buff->addr[point * 3] * 0x10000 + buff->addr[point * 3 + 1] * 0x100 + buff->addr[point * 3 + 2]
 #define GET_POINT_32(buff, point) \
-    buff->addr[point] * 0x1000000 + buff->addr[point + 1] * 0x10000 + buff->addr[point + 2] * 0x100 + buff->addr[point + 3]
+    (uint32_t)buff->addr[point * 4] * 0x1000000 + buff->addr[point * 4 + 1] * 0x10000 + buff->addr[point * 4 + 2] * 0x100 + buff->addr[point * 4 + 3]
 #define GET_POINT_CASE(n, point)           \
     case n:                                \
         return GET_POINT_##n(buff, point); \
@@ -93,6 +94,370 @@ uint32_t get_framebuffer_point(luat_zbuff_t *buff,uint32_t point)
     return 0;
 }
 
+/*
+按行(span)处理的framebuffer操作. 像素在内存中按行连续排列, 多字节颜色为大端,
+1/4位色深时高位在前. 每种色深单独处理, 不再逐像素判断色深.
+*/
+
+// 把颜色展开成24字节的重复图案, 24是2/3/4字节像素与8字节写入的公倍数
+static void fb_pattern(uint8_t bit, uint32_t color, uint8_t *pat)
+{
+    size_t bpp = bit / 8;
+    for (size_t i = 0; i < 24; i++)
+        pat[i] = color >> (8 * (bpp - 1 - i % bpp));
+}
+
+// 用图案填充len字节, period为8或24, 每次写入8字节
+static void fb_fill_bytes(uint8_t *dst, size_t len, const uint8_t *pat, size_t period)
+{
+    uint64_t w[3];
+    memcpy(w, pat, sizeof(w));
+    if (period == 8)
+    {
+        for (; len >= 32; len -= 32, dst += 32)
+        {
+            memcpy(dst, &w[0], 8);
+            memcpy(dst + 8, &w[0], 8);
+            memcpy(dst + 16, &w[0], 8);
+            memcpy(dst + 24, &w[0], 8);
+        }
+    }
+    for (; len >= period; len -= period, dst += period)
+    {
+        memcpy(dst, &w[0], 8);
+        if (period == 24)
+        {
+            memcpy(dst + 8, &w[1], 8);
+            memcpy(dst + 16, &w[2], 8);
+        }
+    }
+    memcpy(dst, pat, len);
+}
+
+// 从第point个像素开始, 连续n个像素填充为color
+static void fb_fill_span(luat_zbuff_t *buff, size_t point, size_t n, uint32_t color)
+{
+    uint8_t *a = buff->addr;
+    if (n == 0)
+        return;
+    switch (buff->bit)
+    {
+    case 1:
+    {
+        uint8_t v = (color & 1) ? 0xFF : 0;
+        size_t first = point >> 3, last = (point + n - 1) >> 3;
+        uint8_t hm = 0xFF >> (point & 7);
+        uint8_t tm = 0xFF << (7 - ((point + n - 1) & 7));
+        if (first == last)
+        {
+            hm &= tm;
+            a[first] = (a[first] & ~hm) | (v & hm);
+            break;
+        }
+        a[first] = (a[first] & ~hm) | (v & hm);
+        memset(a + first + 1, v, last - first - 1);
+        a[last] = (a[last] & ~tm) | (v & tm);
+        break;
+    }
+    case 4:
+    {
+        uint8_t c = color & 0x0F;
+        if (point & 1)
+        {
+            a[point / 2] = (a[point / 2] & 0xF0) | c;
+            point++;
+            n--;
+        }
+        memset(a + point / 2, c * 0x11, n / 2);
+        if (n & 1)
+        {
+            size_t i = (point + n - 1) / 2;
+            a[i] = (a[i] & 0x0F) | (c << 4);
+        }
+        break;
+    }
+    case 8:
+        memset(a + point, color, n);
+        break;
+    case 16:
+    case 24:
+    case 32:
+    {
+        uint8_t pat[24];
+        size_t bpp = buff->bit / 8;
+        fb_pattern(buff->bit, color, pat);
+        fb_fill_bytes(a + point * bpp, n * bpp, pat, bpp == 3 ? 24 : 8);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+// 画一条水平线, 超出范围的部分会被裁剪
+static void fb_hline(luat_zbuff_t *buff, int32_t x1, int32_t x2, int32_t y, uint32_t color)
+{
+    if (y < 0 || y >= (int32_t)buff->height)
+        return;
+    if (x1 < 0)
+        x1 = 0;
+    if (x2 >= (int32_t)buff->width)
+        x2 = buff->width - 1;
+    if (x1 > x2)
+        return;
+    fb_fill_span(buff, x1 + (size_t)y * buff->width, x2 - x1 + 1, color);
+}
+
+// 填充矩形, 坐标需已裁剪到framebuffer内
+void luat_zbuff_fill_rect(luat_zbuff_t *buff, uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t color)
+{
+    if (w == 0 || h == 0)
+        return;
+    if (w == buff->width)
+    {
+        // 整行宽度, 相当于一段连续内存
+        fb_fill_span(buff, (size_t)y * buff->width, (size_t)w * h, color);
+        return;
+    }
+    fb_fill_span(buff, x + (size_t)y * buff->width, w, color);
+    if (buff->bit >= 8)
+    {
+        // 后续各行直接复制第一行
+        size_t bpp = buff->bit / 8;
+        uint8_t *first = buff->addr + (x + (size_t)y * buff->width) * bpp;
+        for (uint32_t i = 1; i < h; i++)
+            memcpy(first + (size_t)i * buff->width * bpp, first, (size_t)w * bpp);
+    }
+    else
+    {
+        for (uint32_t i = 1; i < h; i++)
+            fb_fill_span(buff, x + (size_t)(y + i) * buff->width, w, color);
+    }
+}
+
+// 1/4位色深的逐像素读写, 仅blit在子字节不对齐时使用
+static inline uint32_t fb_get_small(const uint8_t *a, uint8_t bit, size_t point)
+{
+    if (bit == 1)
+        return (a[point / 8] >> (7 - point % 8)) & 1;
+    return (a[point / 2] >> ((point % 2) ? 0 : 4)) & 0x0F;
+}
+
+static inline void fb_set_small(uint8_t *a, uint8_t bit, size_t point, uint32_t c)
+{
+    if (bit == 1)
+    {
+        if (c)
+            a[point / 8] |= 1 << (7 - point % 8);
+        else
+            a[point / 8] &= ~(1 << (7 - point % 8));
+    }
+    else if (point % 2)
+        a[point / 2] = (a[point / 2] & 0xF0) | c;
+    else
+        a[point / 2] = (a[point / 2] & 0x0F) | (c << 4);
+}
+
+// 复制单个像素, 与透明色key相同的像素跳过
+static inline void fb_copy_keyed(uint8_t *d, const uint8_t *s, size_t bpp, uint32_t key)
+{
+    uint8_t k[4] = {key >> 24, key >> 16, key >> 8, key};
+    if (memcmp(s, k + 4 - bpp, bpp))
+        memcpy(d, s, bpp);
+}
+
+// 复制一行像素, use_key时跳过颜色等于key的像素
+static void fb_copy_span(luat_zbuff_t *dst, size_t dp, const luat_zbuff_t *src, size_t sp, size_t n, int use_key, uint32_t key)
+{
+    uint8_t bit = dst->bit;
+    if (bit >= 8)
+    {
+        size_t bpp = bit / 8;
+        uint8_t *d = dst->addr + dp * bpp;
+        const uint8_t *s = src->addr + sp * bpp;
+        if (!use_key)
+        {
+            memmove(d, s, n * bpp);
+            return;
+        }
+        // 同一个buff内向后复制时从尾部开始, 以免源像素先被覆盖
+        if (dst->addr == src->addr && dp > sp)
+        {
+            for (size_t i = n; i > 0; i--)
+                fb_copy_keyed(d + (i - 1) * bpp, s + (i - 1) * bpp, bpp, key);
+            return;
+        }
+        switch (bpp)
+        {
+        case 1:
+            // 写成选择而不是分支, 便于编译器向量化
+            for (size_t i = 0; i < n; i++)
+                d[i] = s[i] == (uint8_t)key ? d[i] : s[i];
+            break;
+        case 2:
+        {
+            uint8_t kb[2] = {key >> 8, key};
+            uint16_t k; // 与内存中的字节顺序一致, 直接比较
+            memcpy(&k, kb, 2);
+            for (size_t i = 0; i < n; i++, d += 2, s += 2)
+            {
+                uint16_t sv, dv;
+                memcpy(&sv, s, 2);
+                memcpy(&dv, d, 2);
+                dv = sv == k ? dv : sv;
+                memcpy(d, &dv, 2);
+            }
+            break;
+        }
+        default:
+            for (size_t i = 0; i < n; i++, d += bpp, s += bpp)
+                fb_copy_keyed(d, s, bpp, key);
+            break;
+        }
+        return;
+    }
+    size_t ppb = 8 / bit; // 每字节的像素数
+    if (!use_key && dp % ppb == sp % ppb && (dst->addr != src->addr || dp <= sp))
+    {
+        // 字节内相位相同, 首尾零散像素单独处理, 中间整字节复制
+        while (n && dp % ppb)
+        {
+            fb_set_small(dst->addr, bit, dp++, fb_get_small(src->addr, bit, sp++));
+            n--;
+        }
+        memmove(dst->addr + dp / ppb, src->addr + sp / ppb, n / ppb);
+        dp += n - n % ppb;
+        sp += n - n % ppb;
+        n %= ppb;
+    }
+    if (dst->addr == src->addr && dp > sp)
+    {
+        // 同一个buff内向后复制, 从尾部开始以免覆盖
+        for (size_t i = n; i > 0; i--)
+        {
+            uint32_t c = fb_get_small(src->addr, bit, sp + i - 1);
+            if (!use_key || c != key)
+                fb_set_small(dst->addr, bit, dp + i - 1, c);
+        }
+        return;
+    }
+    for (size_t i = 0; i < n; i++)
+    {
+        uint32_t c = fb_get_small(src->addr, bit, sp + i);
+        if (!use_key || c != key)
+            fb_set_small(dst->addr, bit, dp + i, c);
+    }
+}
+
+// 把src中(sx,sy)起w*h的区域复制到dst的(dx,dy), 超出两边范围的部分会被裁剪, 色深不同时返回-1
+int luat_zbuff_blit(luat_zbuff_t *dst, const luat_zbuff_t *src, int32_t sx, int32_t sy, int32_t w, int32_t h, int32_t dx, int32_t dy, int use_key, uint32_t key)
+{
+    if (dst->bit != src->bit || dst->width == 0 || src->width == 0)
+        return -1;
+    // 裁剪到源和目标范围内
+    if (sx < 0) { w += sx; dx -= sx; sx = 0; }
+    if (sy < 0) { h += sy; dy -= sy; sy = 0; }
+    if (dx < 0) { w += dx; sx -= dx; dx = 0; }
+    if (dy < 0) { h += dy; sy -= dy; dy = 0; }
+    if (sx + w > (int32_t)src->width) w = src->width - sx;
+    if (sy + h > (int32_t)src->height) h = src->height - sy;
+    if (dx + w > (int32_t)dst->width) w = dst->width - dx;
+    if (dy + h > (int32_t)dst->height) h = dst->height - dy;
+    if (w <= 0 || h <= 0)
+        return 0;
+    // 同一个buff内向下复制时从最后一行开始
+    int reverse = dst->addr == src->addr && dy > sy;
+    for (int32_t i = 0; i < h; i++)
+    {
+        int32_t row = reverse ? h - 1 - i : i;
+        fb_copy_span(dst, dx + (size_t)(dy + row) * dst->width, src, sx + (size_t)(sy + row) * src->width, w, use_key, key);
+    }
+    return w * h;
+}
+
+size_t luat_zbuff_ring_write_span(luat_zbuff_t *buff, uint8_t **p)
+{
+    size_t tail = (buff->head + buff->used) % buff->len;
+    *p = buff->addr + tail;
+    if (buff->used == buff->len)
+        return 0;
+    // 数据绕回了开头, 空闲空间在中间; 否则空闲空间到末尾为止
+    return (tail < buff->head) ? buff->head - tail : buff->len - tail;
+}
+
+void luat_zbuff_ring_commit(luat_zbuff_t *buff, size_t len)
+{
+    if (len > buff->len - buff->used)
+        len = buff->len - buff->used;
+    buff->used += len;
+}
+
+size_t luat_zbuff_ring_write(luat_zbuff_t *buff, const uint8_t *data, size_t len)
+{
+    size_t done = 0;
+    uint8_t *p;
+    while (done < len)
+    {
+        size_t span = luat_zbuff_ring_write_span(buff, &p);
+        if (!span)
+            break;
+        if (span > len - done)
+            span = len - done;
+        memcpy(p, data + done, span);
+        buff->used += span;
+        done += span;
+    }
+    return done;
+}
+
+size_t luat_zbuff_ring_peek(const luat_zbuff_t *buff, size_t offset, uint8_t *data, size_t len)
+{
+    if (offset >= buff->used)
+        return 0;
+    if (len > buff->used - offset)
+        len = buff->used - offset;
+    size_t start = (buff->head + offset) % buff->len;
+    size_t first = buff->len - start;
+    if (first > len)
+        first = len;
+    memcpy(data, buff->addr + start, first);
+    memcpy(data + first, buff->addr, len - first);
+    return len;
+}
+
+size_t luat_zbuff_ring_read(luat_zbuff_t *buff, uint8_t *data, size_t len)
+{
+    if (len > buff->used)
+        len = buff->used;
+    if (data)
+        luat_zbuff_ring_peek(buff, 0, data, len);
+    buff->used -= len;
+    // 读空以后回到开头, 后续写入尽量连续
+    buff->head = buff->used ? (buff->head + len) % buff->len : 0;
+    return len;
+}
+
+static void zbuff_reverse(uint8_t *p, size_t len)
+{
+    for (size_t i = 0, j = len - 1; i < len / 2; i++, j--)
+    {
+        uint8_t t = p[i];
+        p[i] = p[j];
+        p[j] = t;
+    }
+}
+
+void luat_zbuff_ring_linearize(luat_zbuff_t *buff)
+{
+    if (!buff->head)
+        return;
+    // 三次翻转完成原地循环左移, 不需要额外的内存
+    zbuff_reverse(buff->addr, buff->head);
+    zbuff_reverse(buff->addr + buff->head, buff->len - buff->head);
+    zbuff_reverse(buff->addr, buff->len);
+    buff->head = 0;
+}
+
 /**
 创建zbuff
 @api zbuff.create(length,data)
@@ -152,6 +517,8 @@ static int l_zbuff_create(lua_State *L)
 
     buff->len = len;
     buff->cursor = 0;
+    buff->is_ring = 0;
+    buff->head = 0;
 
     if (lua_istable(L, 1))
     {
@@ -160,12 +527,7 @@ static int l_zbuff_create(lua_State *L)
         buff->bit = luaL_checkinteger(L, -4);
         if (lua_isinteger(L, 2))
         {
-            LUA_INTEGER initial = luaL_checkinteger(L, 2);
-            uint32_t i;
-            for (i = 0; i < buff->width * buff->height; i++)
-            {
-                set_framebuffer_point(buff, i, initial);
-            }
+            luat_zbuff_fill_rect(buff, 0, 0, buff->width, buff->height, luaL_checkinteger(L, 2));
         }
     }
     else
@@ -207,6 +569,28 @@ local len = buff:write(0x1a,0x30,0x31,0x32,0x00,0x01)  -- 按数值写入多个
  */
 static int l_zbuff_write(lua_State *L)
 {
+    luat_zbuff_t *ring = tozbuff(L);
+    if (ring->is_ring)
+    {
+        size_t len = 0;
+        if (lua_isinteger(L, 2))
+        {
+            uint8_t data;
+            while (lua_isinteger(L, 2 + len) && ring->used < ring->len)
+            {
+                data = luaL_checkinteger(L, 2 + len) % 0x100;
+                luat_zbuff_ring_write(ring, &data, 1);
+                len++;
+            }
+        }
+        else
+        {
+            const char *data = luaL_checklstring(L, 2, &len);
+            len = luat_zbuff_ring_write(ring, (const uint8_t *)data, len);
+        }
+        lua_pushinteger(L, len);
+        return 1;
+    }
     if (lua_isinteger(L, 2))
     {
         int len = 0;
@@ -251,6 +635,18 @@ static int l_zbuff_read(lua_State *L)
 {
     luat_zbuff_t *buff = tozbuff(L);
     int read_num = luaL_optinteger(L, 2, 1);
+    if (buff->is_ring)
+    {
+        luaL_Buffer b;
+        if (read_num < 0)
+            read_num = 0;
+        if (read_num > buff->used)
+            read_num = buff->used;
+        uint8_t *p = (uint8_t *)luaL_buffinitsize(L, &b, read_num);
+        luat_zbuff_ring_read(buff, p, read_num);
+        luaL_pushresultsize(&b, read_num);
+        return 1;
+    }
     if (read_num > buff->len - buff->cursor) //防止越界
     {
         read_num = buff->len - buff->cursor;
@@ -302,6 +698,7 @@ buff:seek(-3,zbuff.SEEK_END)
 static int l_zbuff_seek(lua_State *L)
 {
     luat_zbuff_t *buff = tozbuff(L);
+    luat_zbuff_check_linear(L, buff, 1);
 
     int offset = luaL_checkinteger(L, 2);
     int whence = luaL_optinteger(L, 3, ZBUFF_SEEK_SET);
@@ -340,26 +737,13 @@ static int l_zbuff_seek(lua_State *L)
 #define	OP_UINT		'I'
 #define	OP_LONG		'l'
 #define	OP_ULONG	'L'
-#define	OP_LITTLEENDIAN	'<'
-#define	OP_BIGENDIAN	'>'
-#define	OP_NATIVE	'='
 
-#define isdigit(c) ((c) >= '0' && (c) <= '9')
 static void badcode(lua_State *L, int c)
 {
     char s[]="bad code `?'";
     s[sizeof(s)-3]=c;
     luaL_argerror(L,1,s);
 }
-static int doendian(int c)
-{
-    int x=1;
-    int e=*(char*)&x;
-    if (c==OP_LITTLEENDIAN) return !e;
-    if (c==OP_BIGENDIAN) return e;
-    if (c==OP_NATIVE) return 0;
-    return 0;
-}
 static void doswap(int swap, void *p, size_t n)
 {
     if (swap)
@@ -378,7 +762,7 @@ static void doswap(int swap, void *p, size_t n)
 /**
 将一系列数据按照格式字符转化，并写入（从当前指针位置开始；执行后指针会向后移动）
 @api buff:pack(format,val1, val2,...)
-@string 后面数据的格式（符号含义见下面的例子）
+@string 后面数据的格式（符号含义见下面的例子）, 也可以是pack.compile编译好的格式对象
 @val  传入的数据，可以为多个数据
 @return int 成功写入的数据长度
 @usage
@@ -420,36 +804,26 @@ buff:pack(">IIHA", 0x1234, 0x4567, 0x12,"abcdefg") -- 按格式写入几个数
 static int l_zbuff_pack(lua_State *L)
 {
     luat_zbuff_t *buff = tozbuff(L);
+    luat_zbuff_check_linear(L, buff, 1);
     int i = 3;
-    char *f = (char *)luaL_checkstring(L, 2);
+    luat_pack_iter_t it;
+    luat_pack_op_t op;
     int swap = 0;
     int write_len = 0; //已写入长度
-    while (*f)
+    luat_pack_iter_init(L, 2, &it);
+    while (luat_pack_next(&it, &op))
     {
         if (buff->cursor == buff->len) //到头了
             break;
-        int c = *f++;
-        int N = 1;
-        if (isdigit(*f))
-        {
-            N = 0;
-            while (isdigit(*f))
-                N = 10 * N + (*f++) - '0';
-        }
+        int c = op.code;
+        uint32_t N = op.count;
+        swap = op.swap;
         while (N--)
         {
             if (buff->cursor == buff->len) //到头了
                 break;
             switch (c)
             {
-            case OP_LITTLEENDIAN:
-            case OP_BIGENDIAN:
-            case OP_NATIVE:
-            {
-                swap = doendian(c);
-                N = 0;
-                break;
-            }
             case OP_STRING:
             {
                 size_t l;
@@ -468,9 +842,6 @@ static int l_zbuff_pack(lua_State *L)
             PACKINT(OP_UINT, unsigned int)
             PACKINT(OP_LONG, long)
             PACKINT(OP_ULONG, unsigned long)
-            case ' ':
-            case ',':
-                break;
             default:
                 badcode(L, c);
                 break;
@@ -528,7 +899,7 @@ static int l_zbuff_pack(lua_State *L)
 /**
 将一系列数据按照格式字符读取出来（从当前指针位置开始；执行后指针会向后移动）
 @api buff:unpack(format)
-@string 数据的格式（符号含义见上面pack接口的例子）
+@string 数据的格式（符号含义见上面pack接口的例子）, 也可以是pack.compile编译好的格式对象
 @return int 成功读取的数据字节长度
 @return any 按格式读出来的数据
 @usage
@@ -538,39 +909,31 @@ local cnt,a,b,c,s = buff:unpack(">IIHA10") -- 按格式读取几个数据
 static int l_zbuff_unpack(lua_State *L)
 {
     luat_zbuff_t *buff = tozbuff(L);
-    char *f = (char *)luaL_checkstring(L, 2);
+    luat_zbuff_check_linear(L, buff, 1);
+    luat_pack_iter_t it;
+    luat_pack_op_t op;
+    luat_pack_iter_init(L, 2, &it);
     size_t len = buff->len - buff->cursor;
     const char *s = (const char*)(buff->addr + buff->cursor);
     int i = 0;
     int n = 0;
     int swap = 0;
     lua_pushnil(L); //给个数占位用的
-    while (*f)
+    while (luat_pack_next(&it, &op))
     {
-        int c = *f++;
-        int N = 1;
-        if (isdigit(*f))
+        int c = op.code;
+        uint32_t N = op.count;
+        swap = op.swap;
+        luaL_checkstack(L, c == OP_STRING ? 1 : (int)N, "too many results");
+        if (N == 0) // 只有'A0'
         {
-            N = 0;
-            while (isdigit(*f))
-                N = 10 * N + (*f++) - '0';
-            if (N == 0 && c == OP_STRING)
-            {
-                lua_pushliteral(L, "");
-                ++n;
-            }
+            lua_pushliteral(L, "");
+            ++n;
+            continue;
         }
         while (N--)
             switch (c)
             {
-            case OP_LITTLEENDIAN:
-            case OP_BIGENDIAN:
-            case OP_NATIVE:
-            {
-                swap = doendian(c);
-                N = 0;
-                break;
-            }
             case OP_STRING:
             {
                 ++N;
@@ -593,9 +956,6 @@ static int l_zbuff_unpack(lua_State *L)
             UNPACKINT(OP_UINT, unsigned int)
             UNPACKINT(OP_LONG, long)
             UNPACKINT(OP_ULONG, unsigned long)
-            case ' ':
-            case ',':
-                break;
             default:
                 badcode(L, c);
                 break;
@@ -621,6 +981,7 @@ local data = buff:readU32()
     static int l_zbuff_read_##n(lua_State *L)                \
     {                                                        \
         luat_zbuff_t *buff = tozbuff(L);                       \
+        luat_zbuff_check_linear(L, buff, 1);                 \
         if (buff->len - buff->cursor < sizeof(t))            \
             return 0;                                        \
         lua_push##f(L, *((t *)(buff->addr + buff->cursor))); \
@@ -652,6 +1013,7 @@ local len = buff:writeU32(1024)
     static int l_zbuff_write_##n(lua_State *L)                        \
     {                                                                 \
         luat_zbuff_t *buff = tozbuff(L);                                \
+        luat_zbuff_check_linear(L, buff, 1);                          \
         if (buff->len - buff->cursor < sizeof(t))                     \
         {                                                             \
             lua_pushinteger(L, 0);                                    \
@@ -673,6 +1035,391 @@ zwrite(u64, uint64_t, integer);
 zwrite(f32, float, number);
 zwrite(f64, double, number);
 
+// 批量读写和数值运算用到的元素类型, 如 "i16", "u8", "f32be", 默认小端
+typedef struct zbuff_elem {
+    uint8_t size;      // 1/2/4/8
+    uint8_t is_float;
+    uint8_t is_signed;
+    uint8_t big;       // 大端
+} zbuff_elem_t;
+
+static void zbuff_check_elem(lua_State *L, int arg, zbuff_elem_t *e)
+{
+    const char *s = luaL_checkstring(L, arg);
+    int bits = 0;
+    memset(e, 0, sizeof(zbuff_elem_t));
+    switch (*s++)
+    {
+    case 'i': case 'I': e->is_signed = 1; break;
+    case 'u': case 'U': break;
+    case 'f': case 'F': e->is_float = 1; e->is_signed = 1; break;
+    default: goto error;
+    }
+    while (*s >= '0' && *s <= '9')
+        bits = bits * 10 + (*s++ - '0');
+    if (strcmp(s, "be") == 0 || strcmp(s, "BE") == 0)
+        e->big = 1;
+    else if (*s && strcmp(s, "le") && strcmp(s, "LE"))
+        goto error;
+    if (e->is_float ? (bits != 32 && bits != 64) : (bits != 8 && bits != 16 && bits != 32 && bits != 64))
+        goto error;
+    e->size = bits / 8;
+    return;
+error:
+    luaL_argerror(L, arg, "bad element type, e.g. i16, u8, f32, i32be");
+}
+
+static uint64_t zbuff_elem_raw(const uint8_t *p, const zbuff_elem_t *e)
+{
+    uint64_t v = 0;
+    if (e->big)
+        for (int i = 0; i < e->size; i++)
+            v = (v << 8) | p[i];
+    else
+        for (int i = e->size - 1; i >= 0; i--)
+            v = (v << 8) | p[i];
+    return v;
+}
+
+static void zbuff_elem_store_raw(uint8_t *p, const zbuff_elem_t *e, uint64_t v)
+{
+    if (e->big)
+        for (int i = e->size - 1; i >= 0; i--, v >>= 8)
+            p[i] = (uint8_t)v;
+    else
+        for (int i = 0; i < e->size; i++, v >>= 8)
+            p[i] = (uint8_t)v;
+}
+
+// 整数类型取值, 按符号扩展
+static int64_t zbuff_elem_get_int(const uint8_t *p, const zbuff_elem_t *e)
+{
+    uint64_t v = zbuff_elem_raw(p, e);
+    if (e->is_signed && e->size < 8)
+    {
+        uint64_t sign = 1ULL << (e->size * 8 - 1);
+        v = (v ^ sign) - sign;
+    }
+    return (int64_t)v;
+}
+
+static double zbuff_elem_get_number(const uint8_t *p, const zbuff_elem_t *e)
+{
+    if (!e->is_float)
+        return e->is_signed ? (double)zbuff_elem_get_int(p, e) : (double)zbuff_elem_raw(p, e);
+    uint64_t v = zbuff_elem_raw(p, e);
+    if (e->size == 4)
+    {
+        uint32_t u = (uint32_t)v;
+        float f;
+        memcpy(&f, &u, 4);
+        return f;
+    }
+    double d;
+    memcpy(&d, &v, 8);
+    return d;
+}
+
+// 与writeI16等一致, 整数超出范围时截断
+static void zbuff_elem_put_int(uint8_t *p, const zbuff_elem_t *e, int64_t v)
+{
+    zbuff_elem_store_raw(p, e, (uint64_t)v);
+}
+
+// 浮点直接写入, 整数类型四舍五入并限幅, 用于数值运算的结果
+static void zbuff_elem_put_number(uint8_t *p, const zbuff_elem_t *e, double v)
+{
+    if (e->is_float)
+    {
+        if (e->size == 4)
+        {
+            float f = (float)v;
+            uint32_t u;
+            memcpy(&u, &f, 4);
+            zbuff_elem_store_raw(p, e, u);
+        }
+        else
+        {
+            uint64_t u;
+            memcpy(&u, &v, 8);
+            zbuff_elem_store_raw(p, e, u);
+        }
+        return;
+    }
+    int bits = e->size * 8;
+    uint64_t ihi = e->is_signed ? (UINT64_MAX >> (65 - bits)) : (UINT64_MAX >> (64 - bits));
+    uint64_t ilo = e->is_signed ? ~ihi : 0;
+    v = v < 0 ? v - 0.5 : v + 0.5;
+    if (v != v)
+        v = 0;
+    if (v <= (e->is_signed ? (double)(int64_t)ilo : 0.0))
+        zbuff_elem_store_raw(p, e, ilo);
+    else if (v >= (double)ihi)
+        zbuff_elem_store_raw(p, e, ihi);
+    else
+        zbuff_elem_store_raw(p, e, e->is_signed ? (uint64_t)(int64_t)v : (uint64_t)v);
+}
+
+// 取 offset/count 表示的区域, count为负数或者超出时截到末尾, 返回元素个数
+static size_t zbuff_elem_region(lua_State *L, luat_zbuff_t *buff, const zbuff_elem_t *e, int offset_arg, int count_arg, size_t *offset)
+{
+    lua_Integer off = luaL_optinteger(L, offset_arg, 0);
+    if (off < 0 || (size_t)off > buff->len)
+        off = buff->len;
+    size_t avail = (buff->len - off) / e->size;
+    lua_Integer count = luaL_optinteger(L, count_arg, avail);
+    if (count < 0 || (size_t)count > avail)
+        count = avail;
+    *offset = off;
+    return count;
+}
+
+/**
+从当前指针位置批量读取一组数据到table中（执行后指针会向后移动）, 适合ADC/音频采样数据
+@api buff:readArray(type, count, tbl)
+@string 元素类型, i8/u8/i16/u16/i32/u32/i64/u64/f32/f64, 可以加le/be后缀指定字节序, 默认小端, 例如"i16be"
+@int 读取的个数, 默认读到末尾, 超出时只读剩余的部分
+@table 可选, 结果写入这个table而不是新建, 用于反复读取时减少内存分配, 超出读取个数的旧元素保持不变
+@return table 读出来的数据
+@return int 实际读取的个数
+@usage
+-- 4096个16位小端采样
+local samples, n = buff:readArray("i16", 4096)
+-- 复用同一个table
+buff:seek(0)
+buff:readArray("i16", 4096, samples)
+*/
+static int l_zbuff_read_array(lua_State *L)
+{
+    luat_zbuff_t *buff = tozbuff(L);
+    luat_zbuff_check_linear(L, buff, 1);
+    zbuff_elem_t e;
+    zbuff_check_elem(L, 2, &e);
+    size_t avail = (buff->len - buff->cursor) / e.size;
+    lua_Integer count = luaL_optinteger(L, 3, avail);
+    if (count < 0 || (size_t)count > avail)
+        count = avail;
+    if (lua_istable(L, 4))
+        lua_settop(L, 4);
+    else
+        lua_createtable(L, count, 0);
+    const uint8_t *p = buff->addr + buff->cursor;
+    for (lua_Integer i = 1; i <= count; i++, p += e.size)
+    {
+        if (e.is_float)
+            lua_pushnumber(L, (lua_Number)zbuff_elem_get_number(p, &e));
+        else
+            lua_pushinteger(L, (lua_Integer)zbuff_elem_get_int(p, &e));
+        lua_rawseti(L, -2, i);
+    }
+    buff->cursor += count * e.size;
+    lua_pushinteger(L, count);
+    return 2;
+}
+
+/**
+把table中的一组数据批量写入当前指针位置（执行后指针会向后移动）
+@api buff:writeArray(type, tbl, start, count)
+@string 元素类型, 与readArray相同
+@table 待写入的数据, 整数类型时元素必须是整数, 超出范围时与writeI16等一样截断
+@int 从table的第几个元素开始, 默认1
+@int 写入的个数, 默认到table末尾, 空间不足时只写能放下的部分
+@return int 实际写入的个数
+@usage
+buff:writeArray("f32", {1.5, 2.5, 3.5})
+buff:writeArray("i16be", samples, 1, 100)
+*/
+static int l_zbuff_write_array(lua_State *L)
+{
+    luat_zbuff_t *buff = tozbuff(L);
+    luat_zbuff_check_linear(L, buff, 1);
+    zbuff_elem_t e;
+    zbuff_check_elem(L, 2, &e);
+    luaL_checktype(L, 3, LUA_TTABLE);
+    lua_Integer start = luaL_optinteger(L, 4, 1);
+    lua_Integer total = (lua_Integer)lua_rawlen(L, 3);
+    lua_Integer count = luaL_optinteger(L, 5, total - start + 1);
+    if (start < 1)
+        start = 1;
+    if (count > total - start + 1)
+        count = total - start + 1;
+    if (count < 0)
+        count = 0;
+    size_t avail = (buff->len - buff->cursor) / e.size;
+    if ((size_t)count > avail)
+        count = avail;
+    uint8_t *p = buff->addr + buff->cursor;
+    for (lua_Integer i = 0; i < count; i++, p += e.size)
+    {
+        lua_rawgeti(L, 3, start + i);
+        if (e.is_float)
+        {
+            int isnum;
+            lua_Number v = lua_tonumberx(L, -1, &isnum);
+            if (!isnum)
+                return luaL_error(L, "element %d is not a number", (int)(start + i));
+            zbuff_elem_put_number(p, &e, v);
+        }
+        else
+        {
+            int isnum;
+            lua_Integer v = lua_tointegerx(L, -1, &isnum);
+            if (!isnum)
+                return luaL_error(L, "element %d is not an integer", (int)(start + i));
+            zbuff_elem_put_int(p, &e, v);
+        }
+        lua_pop(L, 1);
+    }
+    buff->cursor += count * e.size;
+    lua_pushinteger(L, count);
+    return 1;
+}
+
+/**
+统计一段数据的和, 最小值, 最大值（与当前指针位置无关；执行后指针位置不变）
+@api buff:stats(type, offset, count)
+@string 元素类型, 与readArray相同
+@int 起始位置, 单位字节, 默认0
+@int 元素个数, 默认到末尾
+@return number 和, 整数类型时为整数
+@return number 最小值, 没有数据时为nil
+@return number 最大值
+@usage
+local sum, min, max = buff:stats("i16", 0, 4096)
+local avg = sum / 4096
+*/
+static int l_zbuff_stats(lua_State *L)
+{
+    luat_zbuff_t *buff = tozbuff(L);
+    zbuff_elem_t e;
+    size_t offset;
+    luat_zbuff_check_linear(L, buff, 1);
+    zbuff_check_elem(L, 2, &e);
+    size_t count = zbuff_elem_region(L, buff, &e, 3, 4, &offset);
+    const uint8_t *p = buff->addr + offset;
+    if (count == 0)
+    {
+        lua_pushinteger(L, 0);
+        return 1;
+    }
+    if (e.is_float || (!e.is_signed && e.size == 8))
+    {
+        double sum = 0, v;
+        double mn = zbuff_elem_get_number(p, &e), mx = mn;
+        for (size_t i = 0; i < count; i++, p += e.size)
+        {
+            v = zbuff_elem_get_number(p, &e);
+            sum += v;
+            if (v < mn) mn = v;
+            if (v > mx) mx = v;
+        }
+        lua_pushnumber(L, sum);
+        lua_pushnumber(L, mn);
+        lua_pushnumber(L, mx);
+    }
+    else
+    {
+        int64_t sum = 0, v;
+        int64_t mn = zbuff_elem_get_int(p, &e), mx = mn;
+        for (size_t i = 0; i < count; i++, p += e.size)
+        {
+            v = zbuff_elem_get_int(p, &e);
+            sum += v;
+            if (v < mn) mn = v;
+            if (v > mx) mx = v;
+        }
+        lua_pushinteger(L, (lua_Integer)sum);
+        lua_pushinteger(L, (lua_Integer)mn);
+        lua_pushinteger(L, (lua_Integer)mx);
+    }
+    return 3;
+}
+
+/**
+原地线性变换一段数据, v = v * k + b, 整数类型四舍五入并限幅到类型范围（与当前指针位置无关；执行后指针位置不变）
+@api buff:scale(type, k, b, offset, count)
+@string 元素类型, 与readArray相同
+@number 乘数
+@number 偏移, 默认0
+@int 起始位置, 单位字节, 默认0
+@int 元素个数, 默认到末尾
+@return int 处理的元素个数
+@usage
+-- 音量减半
+buff:scale("i16", 0.5)
+*/
+static int l_zbuff_scale(lua_State *L)
+{
+    luat_zbuff_t *buff = tozbuff(L);
+    zbuff_elem_t e;
+    size_t offset;
+    luat_zbuff_check_linear(L, buff, 1);
+    zbuff_check_elem(L, 2, &e);
+    double k = luaL_checknumber(L, 3);
+    double b = luaL_optnumber(L, 4, 0);
+    size_t count = zbuff_elem_region(L, buff, &e, 5, 6, &offset);
+    uint8_t *p = buff->addr + offset;
+    for (size_t i = 0; i < count; i++, p += e.size)
+        zbuff_elem_put_number(p, &e, zbuff_elem_get_number(p, &e) * k + b);
+    lua_pushinteger(L, count);
+    return 1;
+}
+
+/**
+类型转换, 把一段数据按 v * scale 转换成另一种类型写入目标zbuff, 目标为整数类型时四舍五入并限幅（与当前指针位置无关；执行后指针位置不变）
+@api buff:convert(type, dst, dst_type, scale, offset, dst_offset, count)
+@string 源元素类型, 与readArray相同
+@userdata 目标zbuff, 可以是自身, 此时区域重叠的话需要目标起始位置不大于源且元素不大于源, 或者目标起始位置不小于源且元素不小于源
+@string 目标元素类型
+@number 缩放系数, 默认1
+@int 源起始位置, 单位字节, 默认0
+@int 目标起始位置, 单位字节, 默认0
+@int 元素个数, 默认取源和目标都能容纳的最大值
+@return int 转换的元素个数
+@usage
+-- i16 PCM 转成 -1.0~1.0 的 f32
+local fbuf = zbuff.create(4096 * 4)
+pcm:convert("i16", fbuf, "f32", 1 / 32768)
+-- 处理完再转回 i16
+fbuf:convert("f32", pcm, "i16", 32767)
+*/
+static int l_zbuff_convert(lua_State *L)
+{
+    luat_zbuff_t *buff = tozbuff(L);
+    luat_zbuff_t *dst = (luat_zbuff_t *)luaL_checkudata(L, 3, LUAT_ZBUFF_TYPE);
+    zbuff_elem_t se, de;
+    size_t soff, doff;
+    luat_zbuff_check_linear(L, buff, 1);
+    luat_zbuff_check_linear(L, dst, 3);
+    zbuff_check_elem(L, 2, &se);
+    zbuff_check_elem(L, 4, &de);
+    double k = luaL_optnumber(L, 5, 1);
+    size_t count = zbuff_elem_region(L, buff, &se, 6, 8, &soff);
+    size_t dcount = zbuff_elem_region(L, dst, &de, 7, 8, &doff);
+    if (dcount < count)
+        count = dcount;
+    const uint8_t *sp = buff->addr + soff;
+    uint8_t *dp = dst->addr + doff;
+    // 同一块内存时, 按不会覆盖未读数据的方向处理
+    int backward = 0;
+    if (dst == buff && count > 0 && dp < sp + count * se.size && sp < dp + count * de.size)
+    {
+        if (dp <= sp && de.size <= se.size)
+            backward = 0;
+        else if (dp >= sp && de.size >= se.size)
+            backward = 1;
+        else
+            return luaL_error(L, "overlapping convert not supported");
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t j = backward ? count - 1 - i : i;
+        zbuff_elem_put_number(dp + j * de.size, &de, zbuff_elem_get_number(sp + j * se.size, &se) * k);
+    }
+    lua_pushinteger(L, count);
+    return 1;
+}
+
 /**
 按起始位置和长度取出数据（与当前指针位置无关；执行后指针位置不变）
 @api buff:toStr(offset,length)
@@ -688,6 +1435,20 @@ static int l_zbuff_toStr(lua_State *L)
 {
     luat_zbuff_t *buff = tozbuff(L);
     int start = luaL_optinteger(L, 2, 0);
+    if (buff->is_ring)
+    {
+        // 环形模式下相对于数据起始位置, 默认取出全部数据, 数据不会被取出
+        luaL_Buffer b;
+        if (start < 0 || start > buff->used)
+            start = buff->used;
+        int len = luaL_optinteger(L, 3, buff->used);
+        if (len < 0 || start + len > buff->used)
+            len = buff->used - start;
+        uint8_t *p = (uint8_t *)luaL_buffinitsize(L, &b, len);
+        luat_zbuff_ring_peek(buff, start, p, len);
+        luaL_pushresultsize(&b, len);
+        return 1;
+    }
     if (start > buff->len)
         start = buff->len;
     int len = luaL_optinteger(L, 3, buff->len);
@@ -726,6 +1487,7 @@ result = buff:setFrameBuffer(320,240,16,0xffff)
 static int l_zbuff_set_frame_buffer(lua_State *L)
 {
     luat_zbuff_t *buff = tozbuff(L);
+    luat_zbuff_check_linear(L, buff, 1);
     //检查空间够不够
     if((luaL_checkinteger(L, 2) * luaL_checkinteger(L, 3) * luaL_checkinteger(L, 4) - 1) / 8 + 1 > buff->len)
         return 0;
@@ -734,10 +1496,7 @@ static int l_zbuff_set_frame_buffer(lua_State *L)
     buff->bit = luaL_checkinteger(L,4);
     if (lua_isinteger(L, 5))
     {
-        LUA_INTEGER color = luaL_checkinteger(L, 5);
-        uint32_t i;
-        for (i = 0; i < buff->width * buff->height; i++)
-            set_framebuffer_point(buff, i, color);
+        luat_zbuff_fill_rect(buff, 0, 0, buff->width, buff->height, luaL_checkinteger(L, 5));
     }
     lua_pushboolean(L,1);
     return 1;
@@ -757,6 +1516,7 @@ color = buff:pixel(0,3)
 static int l_zbuff_pixel(lua_State *L)
 {
     luat_zbuff_t *buff = tozbuff(L);
+    luat_zbuff_check_linear(L, buff, 1);
     uint32_t x = luaL_checkinteger(L,2);
     uint32_t y = luaL_checkinteger(L,3);
     if(x>=buff->width||y>=buff->height)
@@ -791,6 +1551,7 @@ rerult = buff:drawLine(0,0,2,3,0xffff)
 static int l_zbuff_draw_line(lua_State *L)
 {
     luat_zbuff_t *buff = tozbuff(L);
+    luat_zbuff_check_linear(L, buff, 1);
     if(buff->width<=0) return 0;//不是framebuffer数据
     uint32_t x0 = luaL_checkinteger(L,2);
     uint32_t y0 = luaL_checkinteger(L,3);
@@ -837,6 +1598,7 @@ rerult = buff:drawRect(0,0,2,3,0xffff)
 static int l_zbuff_draw_rectangle(lua_State *L)
 {
     luat_zbuff_t *buff = tozbuff(L);
+    luat_zbuff_check_linear(L, buff, 1);
     if(buff->width<=0) return 0;//不是framebuffer数据
     int32_t x1 = (int32_t)luaL_checkinteger(L,2);  CHECK0(x1,buff->width);
     int32_t y1 = (int32_t)luaL_checkinteger(L,3);  CHECK0(y1,buff->height);
@@ -844,17 +1606,13 @@ static int l_zbuff_draw_rectangle(lua_State *L)
     int32_t y2 = (int32_t)luaL_checkinteger(L,5);  CHECK0(y2,buff->height);
     int32_t color = (int32_t)luaL_optinteger(L,6,0);
     uint8_t fill = lua_toboolean(L,7);
-    int x,y;
+    int y;
     int32_t xmax=x1>x2?x1:x2,xmin=x1>x2?x2:x1,ymax=y1>y2?y1:y2,ymin=y1>y2?y2:y1;
     if(fill){
-        for(x=xmin;x<=xmax;x++)
-            for(y=ymin;y<=ymax;y++)
-                set_framebuffer_point(buff,x+y*buff->width,color);
+        luat_zbuff_fill_rect(buff,xmin,ymin,xmax-xmin+1,ymax-ymin+1,color);
     }else{
-        for(x=xmin;x<=xmax;x++){
-            set_framebuffer_point(buff,x+ymin*buff->width,color);
-            set_framebuffer_point(buff,x+ymax*buff->width,color);
-        }
+        fb_fill_span(buff,xmin+ymin*buff->width,xmax-xmin+1,color);
+        fb_fill_span(buff,xmin+ymax*buff->width,xmax-xmin+1,color);
         for(y=ymin;y<=ymax;y++){
             set_framebuffer_point(buff,xmin+y*buff->width,color);
             set_framebuffer_point(buff,xmax+y*buff->width,color);
@@ -899,6 +1657,7 @@ rerult = buff:drawCircle(15,5,3,0xC,true)
 static int l_zbuff_draw_circle(lua_State *L)
 {
     luat_zbuff_t *buff = tozbuff(L);
+    luat_zbuff_check_linear(L, buff, 1);
     if(buff->width<=0) return 0;//不是framebuffer数据
     int32_t xc = luaL_checkinteger(L,2);
     int32_t yc = luaL_checkinteger(L,3);
@@ -911,15 +1670,18 @@ static int l_zbuff_draw_circle(lua_State *L)
     if (xc + r < 0 || xc - r >= buff->width || yc + r < 0 || yc - r >= buff->height)
         return 0;
 
-    int x = 0, y = r, yi, d;
+    int x = 0, y = r, d;
     d = 3 - 2 * r;
 
     while (x <= y)
     {
         if (fill)
         {
-            for (yi = x; yi <= y; yi++)
-                DRAW_CIRCLE_ALL(buff, xc, yc, x, yi, color);
+            // 按行填充, 上下对称的四条水平线
+            fb_hline(buff, xc - y, xc + y, yc + x, color);
+            fb_hline(buff, xc - y, xc + y, yc - x, color);
+            fb_hline(buff, xc - x, xc + x, yc + y, color);
+            fb_hline(buff, xc - x, xc + x, yc - y, color);
         }
         else
         {
@@ -940,6 +1702,42 @@ static int l_zbuff_draw_circle(lua_State *L)
     return 1;
 }
 
+/**
+把另一个framebuffer的一块区域复制过来（与当前指针位置无关；执行后指针位置不变）
+@api buff:blit(src,sx,sy,w,h,dx,dy,colorkey)
+@userdata 源zbuff, 色深必须相同, 也可以是自身
+@int 源区域左上角x
+@int 源区域左上角y
+@int 区域宽度
+@int 区域高度
+@int 目标位置左上角x
+@int 目标位置左上角y
+@int 可选，透明色，源中等于该颜色的像素不复制
+@return bool 成功返回true, 色深不同或不是framebuffer返回false
+@usage
+-- 把图标合成到画面上, 0x0000视为透明
+fb:blit(icon, 0, 0, 32, 32, 100, 40, 0x0000)
+-- 画面整体上移10行
+fb:blit(fb, 0, 10, 320, 230, 0, 0)
+ */
+static int l_zbuff_blit(lua_State *L)
+{
+    luat_zbuff_t *buff = tozbuff(L);
+    luat_zbuff_t *src = (luat_zbuff_t *)luaL_checkudata(L, 2, LUAT_ZBUFF_TYPE);
+    luat_zbuff_check_linear(L, buff, 1);
+    luat_zbuff_check_linear(L, src, 2);
+    int32_t sx = luaL_checkinteger(L, 3);
+    int32_t sy = luaL_checkinteger(L, 4);
+    int32_t w = luaL_checkinteger(L, 5);
+    int32_t h = luaL_checkinteger(L, 6);
+    int32_t dx = luaL_checkinteger(L, 7);
+    int32_t dy = luaL_checkinteger(L, 8);
+    int use_key = lua_isinteger(L, 9);
+    uint32_t key = use_key ? lua_tointeger(L, 9) : 0;
+    lua_pushboolean(L, luat_zbuff_blit(buff, src, sx, sy, w, h, dx, dy, use_key, key) >= 0);
+    return 1;
+}
+
 /**
 以下标形式进行数据读写（与当前指针位置无关；执行后指针位置不变）
 @api buff[n]
@@ -963,7 +1761,14 @@ static int l_zbuff_index(lua_State *L)
         /* found no method, so get value from userdata. */
         luat_zbuff_t *buff = tozbuff(L);
         int o = luaL_checkinteger(L, 2);
-        if (o >= buff->len)
+        if (buff->is_ring)
+        {
+            // 环形模式下下标相对于数据起始位置, 只能访问0~used
+            if (o < 0 || o >= buff->used)
+                return 0;
+            o = (buff->head + o) % buff->len;
+        }
+        else if (o >= buff->len)
             return 0;
         lua_pushinteger(L, buff->addr[o]);
         return 1;
@@ -980,7 +1785,13 @@ static int l_zbuff_newindex(lua_State *L)
         {
             int o = luaL_checkinteger(L, 2);
             int n = luaL_checkinteger(L, 3) % 256;
-            if (o > buff->len)
+            if (buff->is_ring)
+            {
+                if (o < 0 || o >= buff->used)
+                    return 0;
+                o = (buff->head + o) % buff->len;
+            }
+            else if (o > buff->len)
                 return 0;
             buff->addr[o] = n;
         }
@@ -998,9 +1809,18 @@ static int l_zbuff_gc(lua_State *L)
 
 int __zbuff_resize(luat_zbuff_t *buff, uint32_t new_size)
 {
+	// 环形模式下len不能为0, 否则计算位置时会除0
+	if (buff->is_ring && new_size == 0)
+	{
+		return -1;
+	}
 	void *p = luat_heap_malloc(new_size);
 	if (p)
 	{
+		if (buff->is_ring)
+		{
+			luat_zbuff_ring_linearize(buff);
+		}
 		memcpy(p, buff->addr, (new_size > buff->used)?buff->used:new_size);
 		luat_heap_free(buff->addr);
 		buff->addr = p;
@@ -1048,6 +1868,7 @@ local len = buff:copy(5, buff2, 10, 1024)  -- 类似于memcpy(&buff[5], &buff2[1
 static int l_zbuff_copy(lua_State *L)
 {
 	luat_zbuff_t *buff = tozbuff(L);
+	luat_zbuff_check_linear(L, buff, 1);
 	int temp_cursor = luaL_optinteger(L, 2, buff->used);
 	if (temp_cursor < 0)
 	{
@@ -1102,6 +1923,7 @@ static int l_zbuff_copy(lua_State *L)
     else if (lua_isuserdata(L, 3))
     {
         luat_zbuff_t *copy_buff = ((luat_zbuff_t *)luaL_checkudata(L, 3, LUAT_ZBUFF_TYPE));
+        luat_zbuff_check_linear(L, copy_buff, 3);
         uint32_t start =  luaL_optinteger(L, 4, 0);
         uint32_t len =  luaL_optinteger(L, 5, copy_buff->used);
         if (len + temp_cursor > buff->len) //防止越界
@@ -1172,6 +1994,15 @@ static int l_zbuff_del(lua_State *L)
     {
     	buff->used = start;
     }
+    else if (buff->is_ring)
+    {
+    	// 环形模式只支持删除头部或者尾部的数据, 删除头部不需要移动数据
+    	if (start)
+    	{
+    		return luaL_error(L, "ring zbuff can only delete from head or tail");
+    	}
+    	luat_zbuff_ring_read(buff, NULL, len);
+    }
     else
     {
 		uint32_t rest = buff->used - len;
@@ -1182,6 +2013,44 @@ static int l_zbuff_del(lua_State *L)
     return 0;
 }
 
+/**
+设置为环形缓冲区模式，或者恢复普通模式
+@api buff:setRing(enable)
+@boolean true开启，false关闭，默认true
+@return nil 无返回值
+@usage
+-- 环形模式下数据写到末尾后会绕回开头，取走数据只需要移动起始位置，不需要memmove，也不会自动扩容
+-- 适合socket.rx这种边收边处理的场景，内存占用固定
+-- 按环形处理的API: write/read/toStr/query/get/buff[n]/del/used/len/resize/clear 以及socket.rx，used为当前数据量
+-- write在末尾追加，read从头部取出，toStr/query/get/buff[n]的下标相对于数据起始位置，del只能删除头部或尾部
+-- resize不能缩到0，clear填充整个空间，不改变数据量，长度为0的zbuff不能开启环形模式
+-- 以下按线性内存访问的API遇到环形模式会报错: seek/copy/set/isEqual/pack/unpack/readXXX/writeXXX/readArray/writeArray
+-- stats/scale/convert/blit/setFrameBuffer/pixel/drawLine/drawRect/drawCircle，以及json.encode/json.decode, socket.tx, crypto
+-- 其他库直接使用zbuff内存的接口不识别环形模式，需要时先关闭环形模式，关闭时数据会被整理到从0开始的连续空间
+local rbuf = zbuff.create(4096)
+rbuf:setRing(true)
+socket.rx(ctrl, rbuf)
+local line = rbuf:read(rbuf:used())
+*/
+static int l_zbuff_set_ring(lua_State *L)
+{
+    luat_zbuff_t *buff = tozbuff(L);
+    int enable = lua_isnoneornil(L, 2) ? 1 : lua_toboolean(L, 2);
+    if (enable && !buff->is_ring)
+    {
+        luaL_argcheck(L, buff->len > 0, 1, "zbuff len is 0, resize it first");
+        // 已有的数据在0~used, 正好作为环形缓冲区的内容
+        buff->head = 0;
+        buff->is_ring = 1;
+    }
+    else if (!enable && buff->is_ring)
+    {
+        luat_zbuff_ring_linearize(buff);
+        buff->is_ring = 0;
+    }
+    return 0;
+}
+
 static uint32_t BytesGetBe32(const void *ptr)
 {
     const uint8_t *p = (const uint8_t *)ptr;
@@ -1243,6 +2112,13 @@ static int l_zbuff_query(lua_State *L)
     		is_float = lua_toboolean(L, 6);
     	}
     	uint8_t *p = buff->addr + start;
+    	uint8_t ring_tmp[8];
+    	if (buff->is_ring)
+    	{
+    		// 环形模式下start相对于数据起始位置, 数据可能绕回开头
+    		luat_zbuff_ring_peek(buff, start, ring_tmp, len);
+    		p = ring_tmp;
+    	}
     	uint8_t uc;
     	int16_t s;
     	uint16_t us;
@@ -1328,6 +2204,14 @@ static int l_zbuff_query(lua_State *L)
     	}
     	return 1;
     }
+    if (buff->is_ring)
+    {
+    	luaL_Buffer b;
+    	uint8_t *p = (uint8_t *)luaL_buffinitsize(L, &b, len);
+    	luat_zbuff_ring_peek(buff, start, p, len);
+    	luaL_pushresultsize(&b, len);
+    	return 1;
+    }
     lua_pushlstring(L, (const char*)(buff->addr + start), len);
     return 1;
 }
@@ -1351,6 +2235,7 @@ static int l_zbuff_set(lua_State *L)
     int num = luaL_optinteger(L, 3, 0);
     uint32_t start = luaL_optinteger(L, 2, 0);
     uint32_t len = luaL_optinteger(L, 4, buff->len);
+    luat_zbuff_check_linear(L, buff, 1);
     memset(buff->addr + start, num & 0x00ff, ((len + start) > buff->len)?(buff->len - start):len);
     return 0;
 }
@@ -1375,6 +2260,8 @@ static int l_zbuff_equal(lua_State *L)
     uint32_t offset2 = luaL_optinteger(L, 4, 0);
     uint32_t len = luaL_optinteger(L, 5, 1);
     uint32_t i;
+    luat_zbuff_check_linear(L, buff, 1);
+    luat_zbuff_check_linear(L, buff2, 3);
     uint8_t *b1 = buff->addr + offset1;
     uint8_t *b2 = buff2->addr + offset2;
     for(i = 0; i < len; i++) {
@@ -1389,72 +2276,71 @@ static int l_zbuff_equal(lua_State *L)
 	return 2;
 }
 
-static const luaL_Reg lib_zbuff[] = {
-    {"write", l_zbuff_write},
-    {"read", l_zbuff_read},
-    {"clear", l_zbuff_clear},
-    {"seek", l_zbuff_seek},
-    {"pack", l_zbuff_pack},
-    {"unpack", l_zbuff_unpack},
-    {"get", l_zbuff_index},
-    {"readI8", l_zbuff_read_i8},
-    {"readI16", l_zbuff_read_i16},
-    {"readI32", l_zbuff_read_i32},
-    {"readI64", l_zbuff_read_i64},
-    {"readU8", l_zbuff_read_u8},
-    {"readU16", l_zbuff_read_u16},
-    {"readU32", l_zbuff_read_u32},
-    {"readU64", l_zbuff_read_u64},
-    {"readF32", l_zbuff_read_f32},
-    {"readF64", l_zbuff_read_f64},
-    {"writeI8", l_zbuff_write_i8},
-    {"writeI16", l_zbuff_write_i16},
-    {"writeI32", l_zbuff_write_i32},
-    {"writeI64", l_zbuff_write_i64},
-    {"writeU8", l_zbuff_write_u8},
-    {"writeU16", l_zbuff_write_u16},
-    {"writeU32", l_zbuff_write_u32},
-    {"writeU64", l_zbuff_write_u64},
-    {"writeF32", l_zbuff_write_f32},
-    {"writeF64", l_zbuff_write_f64},
-    {"toStr", l_zbuff_toStr},
-    {"len", l_zbuff_len},
-    {"setFrameBuffer", l_zbuff_set_frame_buffer},
-    {"pixel", l_zbuff_pixel},
-    {"drawLine", l_zbuff_draw_line},
-    {"drawRect", l_zbuff_draw_rectangle},
-    {"drawCircle", l_zbuff_draw_circle},
-    //{"__index", l_zbuff_index},
-    //{"__len", l_zbuff_len},
-    //{"__newindex", l_zbuff_newindex},
-    //{"__gc", l_zbuff_gc},
+#include "rotable2.h"
+static const rotable_Reg_t lib_zbuff[] = {
+    {"write", ROREG_FUNC(l_zbuff_write)},
+    {"read", ROREG_FUNC(l_zbuff_read)},
+    {"clear", ROREG_FUNC(l_zbuff_clear)},
+    {"seek", ROREG_FUNC(l_zbuff_seek)},
+    {"pack", ROREG_FUNC(l_zbuff_pack)},
+    {"unpack", ROREG_FUNC(l_zbuff_unpack)},
+    {"get", ROREG_FUNC(l_zbuff_index)},
+    {"readI8", ROREG_FUNC(l_zbuff_read_i8)},
+    {"readI16", ROREG_FUNC(l_zbuff_read_i16)},
+    {"readI32", ROREG_FUNC(l_zbuff_read_i32)},
+    {"readI64", ROREG_FUNC(l_zbuff_read_i64)},
+    {"readU8", ROREG_FUNC(l_zbuff_read_u8)},
+    {"readU16", ROREG_FUNC(l_zbuff_read_u16)},
+    {"readU32", ROREG_FUNC(l_zbuff_read_u32)},
+    {"readU64", ROREG_FUNC(l_zbuff_read_u64)},
+    {"readF32", ROREG_FUNC(l_zbuff_read_f32)},
+    {"readF64", ROREG_FUNC(l_zbuff_read_f64)},
+    {"writeI8", ROREG_FUNC(l_zbuff_write_i8)},
+    {"writeI16", ROREG_FUNC(l_zbuff_write_i16)},
+    {"writeI32", ROREG_FUNC(l_zbuff_write_i32)},
+    {"writeI64", ROREG_FUNC(l_zbuff_write_i64)},
+    {"writeU8", ROREG_FUNC(l_zbuff_write_u8)},
+    {"writeU16", ROREG_FUNC(l_zbuff_write_u16)},
+    {"writeU32", ROREG_FUNC(l_zbuff_write_u32)},
+    {"writeU64", ROREG_FUNC(l_zbuff_write_u64)},
+    {"writeF32", ROREG_FUNC(l_zbuff_write_f32)},
+    {"writeF64", ROREG_FUNC(l_zbuff_write_f64)},
+    {"readArray", ROREG_FUNC(l_zbuff_read_array)},
+    {"writeArray", ROREG_FUNC(l_zbuff_write_array)},
+    {"stats", ROREG_FUNC(l_zbuff_stats)},
+    {"scale", ROREG_FUNC(l_zbuff_scale)},
+    {"convert", ROREG_FUNC(l_zbuff_convert)},
+    {"toStr", ROREG_FUNC(l_zbuff_toStr)},
+    {"len", ROREG_FUNC(l_zbuff_len)},
+    {"setFrameBuffer", ROREG_FUNC(l_zbuff_set_frame_buffer)},
+    {"pixel", ROREG_FUNC(l_zbuff_pixel)},
+    {"drawLine", ROREG_FUNC(l_zbuff_draw_line)},
+    {"drawRect", ROREG_FUNC(l_zbuff_draw_rectangle)},
+    {"drawCircle", ROREG_FUNC(l_zbuff_draw_circle)},
+    {"blit", ROREG_FUNC(l_zbuff_blit)},
+    //{"__index", ROREG_FUNC(l_zbuff_index)},
+    //{"__len", ROREG_FUNC(l_zbuff_len)},
+    //{"__newindex", ROREG_FUNC(l_zbuff_newindex)},
+    //{"__gc", ROREG_FUNC(l_zbuff_gc)},
 	//以下为扩展用法，数据的增减操作尽量不要和上面的read,write一起使用，对数值指针的用法不一致
-	{"copy", l_zbuff_copy},
-	{"set", l_zbuff_set},
-	{"query",l_zbuff_query},
-	{"del", l_zbuff_del},
-	{"resize", l_zbuff_resize},
-	{"reSize", l_zbuff_resize},
-	{"used", l_zbuff_used},
-	{"isEqual", l_zbuff_equal},
-    {NULL, NULL}};
+	{"copy", ROREG_FUNC(l_zbuff_copy)},
+	{"set", ROREG_FUNC(l_zbuff_set)},
+	{"query", ROREG_FUNC(l_zbuff_query)},
+	{"del", ROREG_FUNC(l_zbuff_del)},
+	{"resize", ROREG_FUNC(l_zbuff_resize)},
+	{"reSize", ROREG_FUNC(l_zbuff_resize)},
+	{"used", ROREG_FUNC(l_zbuff_used)},
+	{"setRing", ROREG_FUNC(l_zbuff_set_ring)},
+	{"isEqual", ROREG_FUNC(l_zbuff_equal)},
+    {NULL, ROREG_INT(0)}};
 
 static int luat_zbuff_meta_index(lua_State *L) {
     if (lua_isinteger(L, 2)) {
         return l_zbuff_index(L);
     }
     if (lua_isstring(L, 2)) {
-        const char* keyname = luaL_checkstring(L, 2);
-        //printf("zbuff keyname = %s\n", keyname);
-        int i = 0;
-        while (1) {
-            if (lib_zbuff[i].name == NULL) break;
-            if (!strcmp(keyname, lib_zbuff[i].name)) {
-                lua_pushcfunction(L, lib_zbuff[i].func);
-                return 1;
-            }
-            i++;
-        }
+        // upvalue 1 是 lib_zbuff 的哈希索引
+        return rotable2_index(L, lua_upvalueindex(1), 2);
     }
     return 0;
 }
@@ -1472,7 +2358,8 @@ static void createmeta(lua_State *L)
     lua_setfield(L, -2, "__len");
     lua_pushcfunction(L, l_zbuff_gc);
     lua_setfield(L, -2, "__gc");
-    lua_pushcfunction(L, luat_zbuff_meta_index);
+    rotable2_pushindex(L, lib_zbuff);
+    lua_pushcclosure(L, luat_zbuff_meta_index, 1);
     lua_setfield(L, -2, "__index");
     lua_pushcfunction(L, l_zbuff_newindex);
     lua_setfield(L, -2, "__newindex");
@@ -1481,7 +2368,6 @@ static void createmeta(lua_State *L)
     //luaL_newlib(L, lib_zbuff);
 }
 
-#include "rotable2.h"
 static const rotable_Reg_t reg_zbuff[] =
     {
         {"create",  ROREG_FUNC(l_zbuff_create)},
@@ -21,6 +21,10 @@
 #include "luat_profiler.h"
 #endif
 
+#ifdef LUAT_USE_MEMORY_SLAB
+#include "luat_slab.h"
+#endif
+
 #ifdef LUAT_USE_WDT
 #include "luat_wdt.h"
 #endif
@@ -156,6 +160,8 @@ int luat_main_call(void) {
   int result = 0;
 #ifdef LUAT_USE_PROFILER
   L = lua_newstate(luat_profiler_alloc, NULL);
+#elif defined(LUAT_USE_MEMORY_SLAB)
+  L = lua_newstate(luat_slab_alloc, NULL);
 #else
   L = lua_newstate(luat_heap_alloc, NULL);
 #endif
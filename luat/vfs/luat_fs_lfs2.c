@@ -171,7 +171,7 @@ int luat_vfs_lfs2_mount(void** userdata, luat_fs_conf_t *conf) {
 }
 
 int luat_vfs_lfs2_umount(void* userdata, luat_fs_conf_t *conf) {
-    LLOGE("not support yet : umount");
+    // lfs_unmount及内存释放由挂载方(lfs2.unmount)负责, 这里只解除vfs的挂载点
     return 0;
 }
 
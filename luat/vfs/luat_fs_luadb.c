@@ -46,12 +46,34 @@ int luat_luadb_remount(luadb_fs_t *fs, unsigned flags) {
     return 0;
 }
 
+// FNV-1a, 文件名很短, 足够用了
+static uint32_t luadb_name_hash(const char* name) {
+    uint32_t h = 2166136261u;
+    while (*name) {
+        h ^= (uint8_t)(*name++);
+        h *= 16777619u;
+    }
+    return h;
+}
+
 static luadb_file_t* find_by_name(luadb_fs_t *fs, const char *path) {
-    for (size_t i = 0; i < fs->filecount; i++)
-    {
-        if (!strcmp(path, fs->files[i].name)) {
+    if (fs->hash_slots == NULL) {
+        for (size_t i = 0; i < fs->filecount; i++)
+        {
+            if (!strcmp(path, fs->files[i].name)) {
+                return &(fs->files[i]);
+            }
+        }
+        return NULL;
+    }
+    uint32_t h = luadb_name_hash(path);
+    uint16_t j = h & fs->hash_mask;
+    while (fs->hash_slots[j]) {
+        uint16_t i = fs->hash_slots[j] - 1;
+        if (fs->hashes[i] == h && !strcmp(path, fs->files[i].name)) {
             return &(fs->files[i]);
         }
+        j = (j + 1) & fs->hash_mask;
     }
     // luadb_file_t *ext = fs->inlines;
     // while (ext->ptr != NULL)
@@ -237,8 +259,16 @@ _after_head:
 
     LLOGD("LuaDB head seem ok");
 
+    // 文件名哈希表, 大小为文件数的2倍以上, 保证查找时探测次数很少
+    size_t slots = 4;
+    while (slots < filecount * 2)
+        slots <<= 1;
+
     // 由于luadb_fs_t带了一个luadb_file_t元素的
-    size_t msize = sizeof(luadb_fs_t) + (filecount - 1)*sizeof(luadb_file_t);
+    // 文件数组后面紧跟着hash数组和哈希表, 一次分配
+    size_t fsize = sizeof(luadb_fs_t) + (filecount - 1)*sizeof(luadb_file_t);
+    fsize = (fsize + 3) & ~((size_t)3);
+    size_t msize = fsize + filecount * sizeof(uint32_t) + slots * sizeof(uint16_t);
     LLOGD("malloc fo luadb fs size=%d", msize);
     luadb_fs_t *fs = (luadb_fs_t*)luat_heap_malloc(msize);
     if (fs == NULL) {
@@ -320,6 +350,19 @@ _after_head:
 
     if (fail == 0) {
         LLOGD("LuaDB check files .... ok");
+        // 构建文件名索引, 同名文件以靠前的为准, 与线性查找一致
+        fs->hashes = (uint32_t*)((char*)fs + fsize);
+        fs->hash_slots = (uint16_t*)(fs->hashes + filecount);
+        fs->hash_mask = slots - 1;
+        for (size_t i = 0; i < filecount; i++)
+        {
+            uint32_t h = luadb_name_hash(fs->files[i].name);
+            uint16_t j = h & fs->hash_mask;
+            while (fs->hash_slots[j])
+                j = (j + 1) & fs->hash_mask;
+            fs->hashes[i] = h;
+            fs->hash_slots[j] = i + 1;
+        }
         // #ifdef LUAT_CONF_VM_64bit
         // //#if (sizeof(size_t) == 8)
         // //fs->inlines = (luadb_file_t *)luat_inline2_libs_64bit_size64;
@@ -410,24 +453,13 @@ int luat_vfs_luadb_rename(void* userdata, const char *old_filename, const char *
     return -1;
 }
 int luat_vfs_luadb_fexist(void* userdata, const char *filename) {
-    FILE* fd = luat_vfs_luadb_fopen(userdata, filename, "rb");
-    if (fd) {
-        luat_vfs_luadb_fclose(userdata, fd);
-        return 1;
-    }
-    return 0;
+    // 直接查索引, 不占用文件句柄
+    return find_by_name((luadb_fs_t*)userdata, filename) ? 1 : 0;
 }
 
 size_t luat_vfs_luadb_fsize(void* userdata, const char *filename) {
-    FILE *fd;
-    size_t size = 0;
-    fd = luat_vfs_luadb_fopen(userdata, filename, "rb");
-    if (fd) {
-        luat_vfs_luadb_fseek(userdata, fd, 0, SEEK_END);
-        size = luat_vfs_luadb_ftell(userdata, fd); 
-        luat_vfs_luadb_fclose(userdata, fd);
-    }
-    return size;
+    luadb_file_t* f = find_by_name((luadb_fs_t*)userdata, filename);
+    return f ? f->size : 0;
 }
 
 int luat_vfs_luadb_mkfs(void* userdata, luat_fs_conf_t *conf) {
@@ -129,8 +129,25 @@ int luat_fs_umount(luat_fs_conf_t *conf) {
         if (vfs.mounted[j].ok == 0 || vfs.mounted[j].fs->opts.umount == NULL)
             continue;
         if (strcmp(vfs.mounted[j].prefix, conf->mount_point) == 0) {
-            // TODO 关闭对应的FD
-            return vfs.mounted[j].fs->opts.umount(vfs.mounted[j].userdata, conf);
+            // 还有打开的文件就不能卸载, 否则这些文件句柄会指向已释放的文件系统
+            // 也不能替用户关闭, Lua层的文件对象还持有fd下标, 之后可能与新打开的文件混淆
+            size_t opened = 0;
+            for (size_t i = 1; i <= LUAT_VFS_FILESYSTEM_FD_MAX; i++) {
+                if (vfs.fds[i].fsMount == &vfs.mounted[j])
+                    opened ++;
+            }
+            if (opened) {
+                LLOGW("%s still has %d opened files, close them first", conf->mount_point, (int)opened);
+                return -3;
+            }
+            int ret = vfs.mounted[j].fs->opts.umount(vfs.mounted[j].userdata, conf);
+            if (ret == 0) {
+                // 释放挂载点, 之后可以重新挂载
+                vfs.mounted[j].ok = 0;
+                vfs.mounted[j].fs = NULL;
+                vfs.mounted[j].userdata = NULL;
+            }
+            return ret;
         }
     }
     LLOGE("no such mount point %s", conf->mount_point);
@@ -341,6 +358,16 @@ void* luat_fs_mmap(FILE* stream) {
     return NULL;
 }
 
+void* luat_fs_mmap_ro(FILE* stream) {
+    luat_vfs_fd_t* fd = getfd(stream);
+    if (fd == NULL)
+        return NULL;
+    // 可写的文件系统, 文件内容随时可能变化, 不能长期引用
+    if (fd->fsMount->fs->fopts.fwrite != NULL)
+        return NULL;
+    return luat_fs_mmap(stream);
+}
+
 luat_vfs_t* luat_vfs_self(void) {
     return &vfs;
 }
@@ -0,0 +1,73 @@
+--[[
+luadb 挂载及require性能测试, 在bsp/linux编译出的luatos中运行
+
+-- 使用说明
+1. ./luatos luadb_bench.lua             生成含 FILE_COUNT 个模块的 bench.bin
+2. LUATOS_LUADB=bench.bin ./luatos luadb_bench.lua
+   启动日志会打印挂载耗时, 脚本再逐个require全部模块并统计耗时及lua堆占用
+]]
+
+local FILE_COUNT = 100
+local IMAGE = "bench.bin"
+
+-- 每个模块带一段有一定体量的函数, 以字节码形式存放
+local function module_code(i)
+    local src = "local M = {}\nfunction M.calc(a, b)\n"
+    for j = 1, 20 do
+        src = src .. "  a = a * " .. j .. " + b - " .. (i + j) .. "\n"
+    end
+    src = src .. "  return a\nend\nM.id = " .. i .. "\nreturn M\n"
+    return string.dump(load(src, "bench_mod_" .. i))
+end
+
+-- TLD格式打包, Tag - Len - data
+local function TLD(f, T, D)
+    f:write(string.char(T, D:len()), D)
+end
+
+local function make_image()
+    local f = io.open(IMAGE, "wb")
+    local magic = string.char(0x5A, 0xA5, 0X5A, 0xA5)
+    TLD(f, 0x01, magic)
+    TLD(f, 0x02, pack.pack("<H", 2))
+    TLD(f, 0x03, pack.pack("<I", 0x18))
+    TLD(f, 0x04, pack.pack("<H", FILE_COUNT))
+    TLD(f, 0xFE, pack.pack(">H", 0))
+    for i = 1, FILE_COUNT do
+        local data = module_code(i)
+        TLD(f, 0x01, magic)
+        TLD(f, 0x02, "bench_mod_" .. i .. ".luac")
+        TLD(f, 0x03, pack.pack("<I", data:len()))
+        TLD(f, 0xFE, pack.pack(">H", 0))
+        f:write(data)
+        collectgarbage("step")
+    end
+    f:close()
+    log.info("luadb", "image created", IMAGE, FILE_COUNT, "files")
+end
+
+if not io.exists("/luadb/bench_mod_1.luac") then
+    make_image()
+    log.info("luadb", "now run: LUATOS_LUADB=" .. IMAGE .. " ./luatos luadb_bench.lua")
+    return
+end
+
+collectgarbage("collect")
+local mem = collectgarbage("count")
+local start = os.clock()
+for i = 1, FILE_COUNT do
+    assert(require("bench_mod_" .. i).id == i)
+end
+local used = os.clock() - start
+collectgarbage("collect")
+log.info("luadb", "require", FILE_COUNT, "modules", string.format("%.3fms, %.2fus/module", used * 1000, used * 1000000 / FILE_COUNT))
+log.info("luadb", "lua heap used by modules", string.format("%.1fKB", collectgarbage("count") - mem))
+
+-- 原地引用的字节码能正常执行, 丢弃后也能正常回收
+mem = collectgarbage("count")
+local calc
+for i = 1, FILE_COUNT do
+    calc = loadfile("/luadb/bench_mod_" .. i .. ".luac")().calc(1, 2)
+end
+collectgarbage("collect")
+log.info("luadb", "calc", calc, "heap after reload", string.format("%.1fKB", collectgarbage("count") - mem))